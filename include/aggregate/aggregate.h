@@ -0,0 +1,58 @@
+/**
+ * Header-file: aggregate.h
+ **/
+
+#ifndef __aggregate_h__
+#define __aggregate_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+    AGGREGATE_INT16  = 0,
+    AGGREGATE_UINT16 = 1,
+    AGGREGATE_UINT8  = 2
+} aggregate_type_t;
+
+typedef enum
+{
+    AGGREGATE_BACKEND_SCALAR = 0,
+    AGGREGATE_BACKEND_AVX2   = 1
+} aggregate_backend_t;
+
+#define AGGREGATE_MAX_SEGMENTS 2
+
+/**
+ * A column of fixed-width values read in place: a forecast row is one
+ * segment, a wrapped history ring two
+ **/
+typedef struct aggregate_column
+{
+    aggregate_type_t type;
+    uint8_t segment_count;
+    const void *segment[AGGREGATE_MAX_SEGMENTS];
+    size_t length[AGGREGATE_MAX_SEGMENTS];
+} aggregate_column_t;
+
+typedef struct aggregate_summary
+{
+    uint64_t count;
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+    uint64_t above;        /* values greater than the threshold */
+} aggregate_summary_t;
+
+int8_t aggregate_set_backend(aggregate_backend_t backend);
+aggregate_backend_t aggregate_get_backend(void);
+const char *aggregate_backend_name(aggregate_backend_t backend);
+
+void aggregate_column_add(aggregate_column_t *column, const void *values, size_t length);
+void aggregate_column_summary(const aggregate_column_t *column, int32_t threshold,
+                              aggregate_summary_t *summary);
+uint64_t aggregate_column_count_above(const aggregate_column_t *column, int32_t threshold);
+int32_t aggregate_column_percentile(const aggregate_column_t *column, const aggregate_summary_t *summary,
+                                    double percent);
+
+#endif /* __aggregate_h__ */
@@ -0,0 +1,44 @@
+/**
+ * Header-file: city_catalog.h
+ **/
+
+#ifndef __city_catalog_h__
+#define __city_catalog_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../include/catalog/city_catalog_format.h"
+#include "../../include/config/config.h"
+
+/**
+ * Read-only view of a memory-mapped catalog file, nothing is parsed
+ * or copied at load time
+ **/
+typedef struct city_catalog
+{
+    uint8_t loaded;
+    const uint8_t *base;
+    size_t size;
+
+    const city_catalog_header_t *header;
+    const city_record_t *records;
+    const uint32_t *by_id;
+    const uint32_t *buckets;
+    const uint8_t *names;
+    const char *display;
+    const city_kd_node_t *kd;
+} city_catalog_t;
+
+int8_t city_catalog_open(city_catalog_t *self, const char *path);
+void city_catalog_close(city_catalog_t *self);
+size_t city_catalog_normalize(const char *name, char *out, size_t size);
+const city_record_t *city_catalog_find(const city_catalog_t *self, const char *name);
+const city_record_t *city_catalog_by_id(const city_catalog_t *self, uint32_t id);
+uint32_t city_catalog_prefix(const city_catalog_t *self, const char *prefix,
+                             const city_record_t **out, uint32_t max);
+const city_record_t *city_catalog_nearest(const city_catalog_t *self, float lat, float lon,
+                                          float *distance_km);
+void city_catalog_to_xyz(float lat, float lon, float xyz[3]);
+const char *city_catalog_name(const city_catalog_t *self, const city_record_t *record);
+
+#endif /* __city_catalog_h__ */
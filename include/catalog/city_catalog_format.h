@@ -0,0 +1,69 @@
+/**
+ * Header-file: city_catalog_format.h
+ *
+ * On-disk layout of the city catalog, shared by the server and
+ * tools/city_catalog_build. Everything is host-endian and 4-byte
+ * aligned so the file is used straight from the mapping.
+ **/
+
+#ifndef __city_catalog_format_h__
+#define __city_catalog_format_h__
+
+#include <stdint.h>
+
+#define CITY_CATALOG_MAGIC "WACITIES"
+#define CITY_CATALOG_VERSION 2
+#define CITY_CATALOG_BUCKET_SIZE 16
+#define CITY_CATALOG_NAME_MAX 64
+
+/**
+ * Sections, in file order:
+ *   records  city_record_t[count], sorted by normalized name
+ *   by_id    uint32_t[count], record indexes sorted by id
+ *   buckets  uint32_t[bucket_count], offset of each bucket in names
+ *   names    front-coded normalized names, CITY_CATALOG_BUCKET_SIZE per bucket:
+ *            first name  [len u8][bytes]
+ *            the others  [shared prefix u8][suffix len u8][suffix bytes]
+ *   display  nul-terminated display names
+ *   kd       city_kd_node_t[count], implicit k-d tree over unit vectors:
+ *            the node of range [lo, hi) sits at lo + (hi - lo) / 2 and
+ *            splits on axis depth % 3
+ **/
+typedef struct city_catalog_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t bucket_size;
+    uint32_t bucket_count;
+
+    uint32_t records_offset;
+    uint32_t by_id_offset;
+    uint32_t buckets_offset;
+    uint32_t names_offset;
+    uint32_t names_size;
+    uint32_t display_offset;
+    uint32_t display_size;
+    uint32_t kd_offset;
+    uint32_t file_size;
+} city_catalog_header_t;
+
+typedef struct city_record
+{
+    uint32_t id;
+    uint32_t display;
+    float lat;
+    float lon;
+} city_record_t;
+
+/**
+ * Position on the unit sphere, straight-line distance between two of
+ * them orders the same way as great-circle distance
+ **/
+typedef struct city_kd_node
+{
+    float xyz[3];
+    uint32_t record;
+} city_kd_node_t;
+
+#endif /* __city_catalog_format_h__ */
@@ -0,0 +1,49 @@
+/**
+ * Header-file: cbor_writer.h
+ **/
+
+#ifndef __cbor_writer_h__
+#define __cbor_writer_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Encodes CBOR (RFC 8949) straight into a caller's buffer, nothing is
+ * allocated. Maps and arrays take their element count up front; a list
+ * whose length is not known yet is opened indefinite and closed with
+ * cbor_break(). A write that does not fit sets overflow and every later
+ * write is dropped; copy the struct before an element and assign it back
+ * to take the element out again.
+ **/
+typedef struct cbor_writer
+{
+    uint8_t *out;
+    size_t size;
+    size_t len;
+    uint8_t overflow;
+} cbor_writer_t;
+
+void cbor_writer_init(cbor_writer_t *self, void *out, size_t size);
+void cbor_writer_rebuffer(cbor_writer_t *self, void *out, size_t size);
+size_t cbor_writer_finish(const cbor_writer_t *self);
+
+void cbor_uint(cbor_writer_t *self, uint64_t value);
+void cbor_int(cbor_writer_t *self, int64_t value);
+void cbor_text(cbor_writer_t *self, const char *value);
+void cbor_text_n(cbor_writer_t *self, const char *value, size_t len);
+void cbor_bool(cbor_writer_t *self, int value);
+void cbor_null(cbor_writer_t *self);
+
+void cbor_map(cbor_writer_t *self, uint64_t pairs);
+void cbor_array(cbor_writer_t *self, uint64_t items);
+void cbor_array_begin(cbor_writer_t *self);
+void cbor_break(cbor_writer_t *self);
+
+/* An integer key and its value in one call */
+void cbor_key_uint(cbor_writer_t *self, uint64_t key, uint64_t value);
+void cbor_key_int(cbor_writer_t *self, uint64_t key, int64_t value);
+void cbor_key_text(cbor_writer_t *self, uint64_t key, const char *value);
+void cbor_key_bool(cbor_writer_t *self, uint64_t key, int value);
+
+#endif /* __cbor_writer_h__ */
@@ -12,29 +12,225 @@
 /* File descriptor limits */
 #define MAX_FD 64
 
-/* Buffer sizes */
-#define HTTP_RAW_BUFFER_SIZE 2048
-#define HTTP_RESPONSE_BUFFER_SIZE 4096
+/**
+ * Buffer sizes. A query has room for a /weather/batch list of
+ * WEATHER_BATCH_MAX_CITIES names averaging HTTP_QUERY_BYTES_PER_CITY
+ * bytes, separator and escapes included; the raw buffer holds such a
+ * request line and 2 KB of headers. A longer target gets 414.
+ **/
+#define HTTP_QUERY_BYTES_PER_CITY 16
 #define HTTP_METHOD_SIZE 16
 #define HTTP_PATH_SIZE 256
-#define HTTP_QUERY_SIZE 256
-#define HTTP_BODY_SIZE 512
+#define HTTP_QUERY_SIZE (WEATHER_BATCH_MAX_CITIES * HTTP_QUERY_BYTES_PER_CITY)
+#define HTTP_RAW_BUFFER_SIZE (HTTP_PATH_SIZE + HTTP_QUERY_SIZE + 2048)
+#define HTTP_RESPONSE_BUFFER_SIZE 4096
+#define HTTP_BODY_SIZE 16384
+#define HTTP_ACCEPT_SIZE 128
+#define HTTP_IF_NONE_MATCH_SIZE 128
+#define HTTP_WEBSOCKET_KEY_SIZE 32
+
+/**
+ * WebSocket connections on /weather/ws: pinged after HTTP_WEBSOCKET_PING_S
+ * without a frame from the client, closed after HTTP_WEBSOCKET_TIMEOUT_S
+ **/
+#define HTTP_WEBSOCKET_PING_S 20
+#define HTTP_WEBSOCKET_TIMEOUT_S 60
+
+/**
+ * HTTP/2 over cleartext, by prior knowledge or Upgrade: h2c. Streams of
+ * all HTTP/2 connections come from one pool; each builds its answer, the
+ * HEADERS block and body, in its own HTTP2_STREAM_BUFFER_SIZE bytes.
+ **/
+#define HTTP2_MAX_CONNECTIONS 8
+#define HTTP2_MAX_STREAMS 256
+#define HTTP2_MAX_CONCURRENT_STREAMS 128
+#define HTTP2_STREAM_BUFFER_SIZE (WEATHER_RESPONSE_SIZE + 512)
+#define HTTP2_MAX_FRAME_SIZE 16384
+#define HTTP2_HEADER_TABLE_SIZE 4096
+#define HTTP2_HEADER_BLOCK_SIZE (HTTP_QUERY_SIZE + 4096)
+#define HTTP2_SETTINGS_HEADER_SIZE 64
+#define HTTP2_IDLE_TIMEOUT_S 60
+
+/* Response compression, bodies shorter than HTTP_COMPRESS_MIN_SIZE go out as they are */
+#define HTTP_COMPRESS_MIN_SIZE 256
+#define HTTP_COMPRESS_LEVEL 6
+#define HTTP_COMPRESS_WINDOW_BITS 11
+#define HTTP_COMPRESS_MEM_LEVEL 5
+#define HTTP_COMPRESS_ARENA_SIZE (96 * 1024)
 
 /* Weather buffer sizes */
 #define WEATHER_REQUEST_TYPE_SIZE 32
 #define WEATHER_CITY_SIZE 64
-#define WEATHER_RESPONSE_SIZE 1024
+#define WEATHER_COORDINATE_SIZE 24
+#define WEATHER_RESPONSE_SIZE 2048
+
+/* Coalesced requests per in-flight weather request */
+#define WEATHER_MAX_WAITERS CONNECTION_POOL_SIZE
+
+/**
+ * Requests that find every weather slot busy wait in a FIFO for at most
+ * WEATHER_ADMISSION_DEADLINE_MS. Once the wait stays above
+ * WEATHER_ADMISSION_TARGET_MS for WEATHER_ADMISSION_INTERVAL_MS the
+ * queue is standing, not absorbing a burst, and CoDel starts shedding.
+ **/
+#define WEATHER_ADMISSION_QUEUE_SIZE 64
+#define WEATHER_ADMISSION_DEADLINE_MS 1000
+#define WEATHER_ADMISSION_TARGET_MS 10
+#define WEATHER_ADMISSION_INTERVAL_MS 100
+
+/* Weather response cache */
+#define WEATHER_CACHE_SIZE 128
+#define WEATHER_CACHE_TTL_MS 60000
+#define WEATHER_CACHE_STALE_MS 300000
+#define WEATHER_CACHE_REFRESH_INTERVAL_MS 1000
+#define WEATHER_CACHE_REFRESH_AHEAD_MS 10000
+#define WEATHER_CACHE_REFRESH_TOP_N 8
+
+/* Request frequency sketch (count-min, halved every sample) */
+#define WEATHER_SKETCH_WIDTH 2048
+#define WEATHER_SKETCH_DEPTH 4
+#define WEATHER_SKETCH_SAMPLE_SIZE (16 * WEATHER_CACHE_SIZE)
+#define WEATHER_SKETCH_TOP_K 10
+
+/* Negative cache for cities the data source does not know */
+#define WEATHER_NEGATIVE_BLOOM_BITS 8192
+#define WEATHER_NEGATIVE_BLOOM_HASHES 3
+#define WEATHER_NEGATIVE_SIZE 256
+#define WEATHER_NEGATIVE_PROBE 8
+#define WEATHER_NEGATIVE_TTL_MS 30000
 
 /* TCP settings */
 #define LISTEN_BACKLOG 32
 #define DEFAULT_PORT "8080"
-#define ACCEPTS_PER_ITERATION 8
 #define TCP_TIMEOUT_S 5
 
+/**
+ * Deadlines per connection state, on top of TCP_TIMEOUT_S of silence in
+ * any state: the request head within HTTP_HEADER_TIMEOUT_MS of accept,
+ * the body within HTTP_BODY_TIMEOUT_MS, the answer, admission queue and
+ * upstream fetch included, within HTTP_PROCESSING_TIMEOUT_MS of the
+ * request being complete, and each response, or streamed piece, written
+ * within HTTP_SEND_TIMEOUT_MS. A body or response still
+ * under way after HTTP_MIN_RATE_GRACE_MS must have moved at least
+ * HTTP_MIN_RATE_BYTES_PER_S on average. Between requests HTTP/2 and
+ * WebSocket connections idle for HTTP2_IDLE_TIMEOUT_S and
+ * HTTP_WEBSOCKET_TIMEOUT_S.
+ **/
+#define HTTP_HEADER_TIMEOUT_MS 3000
+#define HTTP_BODY_TIMEOUT_MS 30000
+#define HTTP_PROCESSING_TIMEOUT_MS 4000
+#define HTTP_SEND_TIMEOUT_MS 10000
+#define HTTP_MIN_RATE_GRACE_MS 2000
+#define HTTP_MIN_RATE_BYTES_PER_S 1024
+
+/**
+ * Accepts per pass start at TCP_ACCEPT_BUDGET_INITIAL, grow by one after
+ * a pass that used them all and halve when a pass of the loop took
+ * longer than TCP_ACCEPT_LAG_MS. With the pool full the listen socket is
+ * left alone for TCP_ACCEPT_PAUSE_MS, the kernel backlog holding the
+ * burst, and whoever is still queued after that is sent a 503 with
+ * Retry-After: HTTP_BUSY_RETRY_AFTER_S. A pause of 0 rejects at once.
+ **/
+#define TCP_ACCEPT_BUDGET_INITIAL 8
+#define TCP_ACCEPT_BUDGET_MIN 1
+#define TCP_ACCEPT_BUDGET_MAX 32
+#define TCP_ACCEPT_LAG_MS 20
+#define TCP_ACCEPT_PAUSE_MS 50
+#define HTTP_BUSY_RETRY_AFTER_S 1
+
+/**
+ * Token bucket per client address, IPv6 by its /64: every connection
+ * takes a token, and so does every HTTP/2 stream after the first.
+ * Buckets hold TCP_RATELIMIT_BURST tokens and refill at
+ * TCP_RATELIMIT_RATE a second; an empty one gets a 429. The table looks
+ * a key up within TCP_RATELIMIT_PROBE slots of its home and drops
+ * buckets that have refilled completely every
+ * TCP_RATELIMIT_EVICT_INTERVAL_MS.
+ **/
+#define TCP_RATELIMIT_ENABLED 1
+#define TCP_RATELIMIT_SIZE 1024
+#define TCP_RATELIMIT_PROBE 8
+#define TCP_RATELIMIT_RATE 10
+#define TCP_RATELIMIT_BURST 20
+#define TCP_RATELIMIT_EVICT_INTERVAL_MS 1000
+#define HTTP_THROTTLED_RETRY_AFTER_S 1
+
+/* Data files, reloaded when they change in WEATHER_DATA_DIR or on SIGHUP */
+#define WEATHER_DATA_DIR "data"
+#define WEATHER_SNAPSHOT_SLOTS 4
+#define WEATHER_SNAPSHOT_WARM_PAGES 16
+
+/* City catalog, built by tools/city_catalog_build */
+#define CITY_CATALOG_PATH WEATHER_DATA_DIR "/cities.bin"
+#define CITY_PREFIX_MAX_RESULTS 10
+
+/* Forecast store, generated by tools/forecast_generate */
+#define FORECAST_STORE_PATH WEATHER_DATA_DIR "/forecast.bin"
+#define FORECAST_DAYS 5
+
+/* Gridded run for lat/lon forecasts, generated by tools/forecast_grid_generate */
+#define FORECAST_GRID_PATH WEATHER_DATA_DIR "/grid.bin"
+#define FORECAST_GRID_MAX_HOURS (24 * 16)
+
+/* Observation history, preallocated: roughly 55 KB per series, a day of minute samples raw */
+#define TIMESERIES_SERIES 128
+#define TIMESERIES_RAW_CAPACITY 1440
+#define TIMESERIES_MINUTE_CAPACITY 360
+#define TIMESERIES_HOUR_CAPACITY (24 * 14)
+#define TIMESERIES_DAY_CAPACITY 366
+
+/**
+ * Recording the current forecast hour as history for cities without
+ * stations, every TIMESERIES_SAMPLE_INTERVAL_MS. Off at 0: samples walk
+ * every forecast row inside the event loop and fill series that posted
+ * observations then have to take back.
+ **/
+#define TIMESERIES_SAMPLE_INTERVAL_MS 0
+
+/* Posted observations, parsed per chunk and appended in batches */
+#define TIMESERIES_INGEST_LINE_MAX 128
+#define TIMESERIES_INGEST_BATCH 256
+
+/* /aggregate: default forecast window and percentiles per request */
+#define WEATHER_AGGREGATE_HOURS (24 * 7)
+#define WEATHER_AGGREGATE_PERCENTILES 4
+
+/* /weather/batch: cities per request, room for echoing unknown names */
+#define WEATHER_BATCH_MAX_CITIES 512
+#define WEATHER_BATCH_UNKNOWN_SIZE 512
+
+/**
+ * /weather/stream: server-sent events. A subscriber is a 16-byte record
+ * and its socket, capped below FD_SETSIZE since the sockets select()
+ * watches must still get descriptors under it. Events are rendered once
+ * per city into WEATHER_STREAM_EVENT_SIZE bytes.
+ **/
+#define WEATHER_STREAM_MAX_SUBSCRIBERS 768
+#define WEATHER_STREAM_MAX_CITIES 64
+#define WEATHER_STREAM_EVENT_SIZE 512
+#define WEATHER_STREAM_PING_MS 15000
+
+/* City subscriptions held by all WebSocket connections together */
+#define WEATHER_STREAM_MAX_WATCHES 1024
+
+/* Upstream weather API (0 = serve built-in sample data) */
+#define UPSTREAM_ENABLED 0
+#define UPSTREAM_HOST "127.0.0.1"
+#define UPSTREAM_PORT "9090"
+#define UPSTREAM_POOL_SIZE 8
+#define UPSTREAM_TIMEOUT_MS 2000
+#define UPSTREAM_IDLE_TIMEOUT_MS 30000
+#define UPSTREAM_REQUEST_BUFFER_SIZE 512
+#define UPSTREAM_RESPONSE_BUFFER_SIZE 2048
+
 /* Event watcher settings */
 #define EVENT_WATCHER_TIMEOUT_MS 10000
 
 /* HTTP validation */
 #define HTTP_MAX_HEADER_SIZE (HTTP_RAW_BUFFER_SIZE - 1)
 
+/* Request bodies are streamed to the weather layer in HTTP_BODY_SIZE chunks */
+#define HTTP_MAX_BODY_LENGTH (64 * 1024 * 1024)
+#define HTTP_BODY_READS_PER_WORK 8
+
 #endif /* __config_h__ */
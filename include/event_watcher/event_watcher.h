@@ -6,18 +6,30 @@
 #define __event_watcher_h__
 
 #include <stdint.h>
+#include <sys/select.h>
 #include "../../include/config/config.h"
 
+/**
+ * Registered fds are watched for reading, those with want_write set for
+ * writing too. What the last select() reported is kept for fds that only
+ * need handling once ready.
+ **/
 typedef struct event_watcher
 {
 	int fds[MAX_FD];
+	uint8_t want_write[MAX_FD];
 	uint8_t fd_count;
 	int timeout_ms;
+	fd_set ready_read;
+	fd_set ready_write;
 } event_watcher_t;
 
 int8_t event_watcher_init(void);
 int8_t event_watcher_reg_fd(int fd);
 int8_t event_watcher_dereg_fd(int fd);
+int8_t event_watcher_want_write(int fd, uint8_t want);
 int event_watcher_ready(void); 
+int event_watcher_readable(int fd);
+int event_watcher_writable(int fd);
 
 #endif /* __event_watcher_h__  */
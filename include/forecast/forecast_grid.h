@@ -0,0 +1,53 @@
+/**
+ * Header-file: forecast_grid.h
+ **/
+
+#ifndef __forecast_grid_h__
+#define __forecast_grid_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "../../include/forecast/forecast_grid_format.h"
+#include "../../include/config/config.h"
+
+/**
+ * Read-only view of a memory-mapped gridded run
+ **/
+typedef struct forecast_grid
+{
+    uint8_t loaded;
+    const uint8_t *base;
+    size_t size;
+
+    const forecast_grid_header_t *header;
+    const int16_t *temperature;
+    const uint16_t *wind;
+    const uint8_t *humidity;
+    const uint8_t *condition;
+} forecast_grid_t;
+
+/**
+ * Hourly values at one point, interpolated from the four grid points
+ * around it. Conditions are categories and come from the nearest one.
+ **/
+typedef struct forecast_grid_point
+{
+    uint32_t hours;
+    int64_t start;
+    float nearest_lat;
+    float nearest_lon;
+
+    int16_t temperature[FORECAST_GRID_MAX_HOURS];
+    uint16_t wind[FORECAST_GRID_MAX_HOURS];
+    uint8_t humidity[FORECAST_GRID_MAX_HOURS];
+    uint8_t condition[FORECAST_GRID_MAX_HOURS];
+} forecast_grid_point_t;
+
+int8_t forecast_grid_open(forecast_grid_t *self, const char *path);
+void forecast_grid_close(forecast_grid_t *self);
+uint32_t forecast_grid_hour(const forecast_grid_t *self, time_t now);
+int8_t forecast_grid_interpolate(const forecast_grid_t *self, float lat, float lon, uint32_t first_hour,
+                                 uint32_t hours, forecast_grid_point_t *out);
+
+#endif /* __forecast_grid_h__ */
@@ -0,0 +1,61 @@
+/**
+ * Header-file: forecast_grid_format.h
+ *
+ * On-disk layout of a gridded model run, shared by the server and
+ * tools/forecast_grid_generate. The grid is a regular lat/lon lattice
+ * from lat0/lon0 in resolution-degree steps, longitudes wrap around.
+ *
+ * Grid points are grouped into tile x tile squares. Tiles are stored
+ * row-major, points row-major inside a tile, and every point keeps its
+ * hours contiguous. The four points around a query are then almost
+ * always in one tile, a few KB apart, and each is read as one
+ * sequential run over the hours.
+ **/
+
+#ifndef __forecast_grid_format_h__
+#define __forecast_grid_format_h__
+
+#include <stdint.h>
+
+#define FORECAST_GRID_MAGIC "WAGRID01"
+#define FORECAST_GRID_VERSION 1
+
+/**
+ * Sections, in file order, each 64-byte aligned, values per point and
+ * hour as in forecast_store_format.h:
+ *   temperature  int16_t, tenths of a degree C
+ *   wind         uint16_t, tenths of km/h
+ *   humidity     uint8_t, percent
+ *   condition    uint8_t, forecast_condition_t
+ * Each holds tiles_y * tiles_x * tile * tile * hours values, points
+ * past the edge of the grid pad the last row and column of tiles.
+ **/
+typedef struct forecast_grid_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t hours;
+
+    /* Unix time of hour 0 and of the model run */
+    int64_t base_time;
+    int64_t run_time;
+
+    /* South-west grid point and spacing, in degrees */
+    float lat0;
+    float lon0;
+    float resolution;
+    uint32_t rows;
+    uint32_t cols;
+
+    uint32_t tile;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+
+    uint64_t temperature_offset;
+    uint64_t wind_offset;
+    uint64_t humidity_offset;
+    uint64_t condition_offset;
+    uint64_t file_size;
+} forecast_grid_header_t;
+
+#endif /* __forecast_grid_format_h__ */
@@ -0,0 +1,39 @@
+/**
+ * Header-file: forecast_store.h
+ **/
+
+#ifndef __forecast_store_h__
+#define __forecast_store_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "../../include/forecast/forecast_store_format.h"
+#include "../../include/config/config.h"
+
+/**
+ * Read-only view of a memory-mapped model run. Handlers index the
+ * columns directly, values are never parsed or copied out.
+ **/
+typedef struct forecast_store
+{
+    uint8_t loaded;
+    const uint8_t *base;
+    size_t size;
+
+    const forecast_store_header_t *header;
+    const uint32_t *city_ids;
+    const int16_t *temperature;
+    const uint16_t *wind;
+    const uint8_t *humidity;
+    const uint8_t *condition;
+} forecast_store_t;
+
+int8_t forecast_store_open(forecast_store_t *self, const char *path);
+void forecast_store_close(forecast_store_t *self);
+int32_t forecast_store_row(const forecast_store_t *self, uint32_t city_id);
+uint32_t forecast_store_hour(const forecast_store_t *self, time_t now);
+size_t forecast_store_index(const forecast_store_t *self, uint32_t row, uint32_t hour);
+const char *forecast_condition_name(uint8_t condition);
+
+#endif /* __forecast_store_h__ */
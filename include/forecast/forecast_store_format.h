@@ -0,0 +1,58 @@
+/**
+ * Header-file: forecast_store_format.h
+ *
+ * On-disk layout of one forecast model run, shared by the server and
+ * tools/forecast_generate. Columns are fixed-width arrays of
+ * city_count * hours values, row-major by city, so one city's hours
+ * are contiguous in every column.
+ **/
+
+#ifndef __forecast_store_format_h__
+#define __forecast_store_format_h__
+
+#include <stdint.h>
+
+#define FORECAST_STORE_MAGIC "WAFCAST1"
+#define FORECAST_STORE_VERSION 1
+
+typedef enum
+{
+    FORECAST_CONDITION_SUNNY         = 0,
+    FORECAST_CONDITION_PARTLY_CLOUDY = 1,
+    FORECAST_CONDITION_CLOUDY        = 2,
+    FORECAST_CONDITION_RAINY         = 3,
+    FORECAST_CONDITION_SNOW          = 4,
+    FORECAST_CONDITION_FOG           = 5,
+    FORECAST_CONDITION_THUNDER       = 6,
+    FORECAST_CONDITION_COUNT         = 7
+} forecast_condition_t;
+
+/**
+ * Sections, in file order, each 8-byte aligned:
+ *   city_ids     uint32_t[city_count], ascending, row i belongs to city_ids[i]
+ *   temperature  int16_t[city_count * hours], tenths of a degree C
+ *   wind         uint16_t[city_count * hours], tenths of km/h
+ *   humidity     uint8_t[city_count * hours], percent
+ *   condition    uint8_t[city_count * hours], forecast_condition_t
+ **/
+typedef struct forecast_store_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t city_count;
+    uint32_t hours;
+    uint32_t reserved;
+
+    /* Unix time of hour 0 and of the model run */
+    int64_t base_time;
+    int64_t run_time;
+
+    uint32_t city_ids_offset;
+    uint32_t temperature_offset;
+    uint32_t wind_offset;
+    uint32_t humidity_offset;
+    uint32_t condition_offset;
+    uint32_t file_size;
+} forecast_store_header_t;
+
+#endif /* __forecast_store_format_h__ */
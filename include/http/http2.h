@@ -0,0 +1,116 @@
+/**
+ * Header-file: http2.h
+ **/
+
+#ifndef __http2_h__
+#define __http2_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../include/http/http_connection.h"
+#include "../../include/http/http_hpack.h"
+#include "../../include/config/config.h"
+
+#define HTTP2_FRAME_HEADER_SIZE 9
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP2_PREFACE_SIZE (sizeof(HTTP2_PREFACE) - 1)
+#define HTTP2_DEFAULT_WINDOW 65535
+
+typedef enum
+{
+    HTTP2_DATA          = 0x0,
+    HTTP2_HEADERS       = 0x1,
+    HTTP2_PRIORITY      = 0x2,
+    HTTP2_RST_STREAM    = 0x3,
+    HTTP2_SETTINGS      = 0x4,
+    HTTP2_PUSH_PROMISE  = 0x5,
+    HTTP2_PING          = 0x6,
+    HTTP2_GOAWAY        = 0x7,
+    HTTP2_WINDOW_UPDATE = 0x8,
+    HTTP2_CONTINUATION  = 0x9
+} http2_frame_type_t;
+
+typedef enum
+{
+    HTTP2_NO_ERROR           = 0x0,
+    HTTP2_PROTOCOL_ERROR     = 0x1,
+    HTTP2_INTERNAL_ERROR     = 0x2,
+    HTTP2_FLOW_CONTROL_ERROR = 0x3,
+    HTTP2_STREAM_CLOSED      = 0x5,
+    HTTP2_FRAME_SIZE_ERROR   = 0x6,
+    HTTP2_REFUSED_STREAM     = 0x7,
+    HTTP2_CANCEL             = 0x8,
+    HTTP2_COMPRESSION_ERROR  = 0x9,
+    HTTP2_ENHANCE_YOUR_CALM  = 0xb
+} http2_error_t;
+
+/**
+ * One request on an HTTP/2 connection, free while parent is NULL. The
+ * weather layer holds exchange until it has answered; the answer, a
+ * HEADERS block followed by body, is built in out and framed from there
+ * as the flow control windows allow. waiting is set while the weather
+ * layer still owes something, receiving while it takes the body. A
+ * streamed answer refills out once the previous piece is framed.
+ **/
+typedef struct http2_stream
+{
+    http_exchange_t exchange;
+    struct http2_connection *parent;
+    uint32_t id;
+
+    uint8_t waiting;
+    uint8_t receiving;
+    uint8_t end_stream;
+    uint8_t answered;
+    uint8_t headers_pending;
+    uint8_t finished;
+
+    int32_t window;
+    size_t headers_len;
+    size_t out_len;
+    size_t out_sent;
+
+    http_connection_request_t request;
+    uint8_t out[HTTP2_STREAM_BUFFER_SIZE];
+} http2_stream_t;
+
+/**
+ * HTTP/2 state of a connection slot, free while conn is NULL. Frames
+ * are read into in and handled in place; a header block split over
+ * CONTINUATION frames is assembled in block first. Output is framed
+ * into the slot's response buffer.
+ **/
+typedef struct http2_connection
+{
+    struct http_connection *conn;
+
+    uint8_t preface;
+    uint8_t closing;
+    uint32_t last_stream_id;
+    uint16_t active;
+    uint16_t next_stream;
+
+    /* Send side: what the peer allows */
+    int32_t window;
+    int32_t initial_window;
+    uint32_t max_frame_size;
+
+    /* Header block being continued, 0 when none */
+    uint32_t continuation_stream;
+    uint8_t continuation_flags;
+    size_t block_len;
+    uint8_t block[HTTP2_HEADER_BLOCK_SIZE];
+
+    http_hpack_table_t decoder;
+    char scratch[HTTP2_HEADER_BLOCK_SIZE];
+
+    size_t in_len;
+    uint8_t in[HTTP2_FRAME_HEADER_SIZE + HTTP2_MAX_FRAME_SIZE];
+} http2_connection_t;
+
+int8_t http2_connection_start(http_connection_t *conn, const http_connection_request_t *upgrade,
+                              const char *data, size_t len);
+void http2_connection_work(http2_connection_t *self, uint64_t now_ms);
+void http2_connection_close(http2_connection_t *self);
+
+#endif /* __http2_h__ */
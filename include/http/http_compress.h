@@ -0,0 +1,26 @@
+/**
+ * Header-file: http_compress.h
+ **/
+
+#ifndef __http_compress_h__
+#define __http_compress_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Content codings the server can produce, in order of preference
+ **/
+typedef enum
+{
+    HTTP_ENCODING_IDENTITY = 0,
+    HTTP_ENCODING_GZIP     = 1,
+    HTTP_ENCODING_DEFLATE  = 2,
+    HTTP_ENCODING_COUNT    = 3
+} http_encoding_t;
+
+uint8_t http_encoding_negotiate(const char *accept_encoding);
+const char *http_encoding_name(uint8_t encoding);
+size_t http_compress(uint8_t encoding, const void *in, size_t len, void *out, size_t size);
+
+#endif /* __http_compress_h__ */
@@ -12,6 +12,8 @@
 
 typedef struct http_connection http_connection_t;
 typedef struct http_server http_server_t;
+typedef struct http_exchange http_exchange_t;
+struct http2_connection;
 
 typedef enum
 {
@@ -22,7 +24,11 @@ typedef enum
     HTTP_CONNECTION_WAITING    = 4,
     HTTP_CONNECTION_SENDING    = 5,
     HTTP_CONNECTION_DONE       = 6,
-    HTTP_CONNECTION_ERROR      = 7
+    HTTP_CONNECTION_ERROR      = 7,
+    HTTP_CONNECTION_RECEIVING_BODY = 8,
+    HTTP_CONNECTION_STREAMING  = 9,
+    HTTP_CONNECTION_WEBSOCKET  = 10,
+    HTTP_CONNECTION_HTTP2      = 11
 } http_connection_state_t;
 
 typedef struct http_connection_request
@@ -31,14 +37,67 @@ typedef struct http_connection_request
     char path[HTTP_PATH_SIZE];
     char query[HTTP_QUERY_SIZE];
     char version[16];
-    char body[HTTP_BODY_SIZE];
+
+    /* The path or query did not fit, answered with 414 */
+    uint8_t uri_too_long;
+
+    /* Accept header as sent, the weather layer picks the format */
+    char accept[HTTP_ACCEPT_SIZE];
+    char accept_encoding[HTTP_ACCEPT_SIZE];
+    char if_none_match[HTTP_IF_NONE_MATCH_SIZE];
+
+    /* Set for a valid version 13 WebSocket upgrade, the key answers the handshake */
+    uint8_t websocket;
+    char websocket_key[HTTP_WEBSOCKET_KEY_SIZE];
+
+    /* Upgrade: h2c with its HTTP2-Settings, base64url as sent */
+    uint8_t h2c;
+    char h2c_settings[HTTP2_SETTINGS_HEADER_SIZE];
+
+    size_t content_length;
+    uint8_t expect_continue;
 } http_connection_request_t;
 
+/**
+ * A finished answer from the weather layer. A 304 carries no body and
+ * only the validator headers.
+ **/
+typedef struct http_connection_reply
+{
+    uint16_t status;
+    const char *content_type;
+
+    /* NULL when the body is sent as is */
+    const char *content_encoding;
+
+    /* NULL for no validator; max_age < 0 asks clients to revalidate every time */
+    const char *etag;
+    int32_t max_age;
+
+    const char *body;
+    size_t body_len;
+} http_connection_reply_t;
+
 typedef struct http_connection_cb
 {
-    void (*weather_on_handled_request)(http_connection_t *self, const char *weather_data);
+    void (*weather_on_handled_request)(http_exchange_t *self, const http_connection_reply_t *reply);
+    int8_t (*weather_on_stream)(http_exchange_t *self, uint16_t status, const char *content_type,
+                                const char *data, size_t len, uint8_t last);
+    int8_t (*weather_on_frame)(http_exchange_t *self, const char *frame, size_t len);
 } http_connection_cb_t;
 
+/**
+ * One request as the weather layer sees it, an HTTP/1.1 connection or
+ * an HTTP/2 stream. Answers go back through the callbacks; fd is the
+ * socket when the request has one to itself, -1 for a stream.
+ **/
+struct http_exchange
+{
+    const http_connection_request_t *request;
+    int fd;
+    http_connection_cb_t cb_from_weather_layer;
+};
+
 struct http_connection
 {
     int fd;
@@ -46,22 +105,58 @@ struct http_connection
     struct http_server *parent;
     task_node_t node;
 
+    /* The client's rate limit bucket */
+    uint64_t client_key;
+
     char raw_http_buffer[HTTP_RAW_BUFFER_SIZE];
     size_t raw_http_buffer_len;
     http_connection_request_t parsed_request;
+    size_t body_received;
+
+    /* Body bytes read per chunk, the first ones arrive with the headers */
+    char body[HTTP_BODY_SIZE];
+    size_t body_len;
 
     char response_buffer[HTTP_RESPONSE_BUFFER_SIZE];
     size_t response_len;
     size_t sent_bytes;
 
-    http_connection_cb_t cb_from_weather_layer;
+    /* A streamed response is still being produced, chunked for HTTP/1.1 */
+    uint8_t streaming;
+    uint8_t chunked;
+
+    /* WebSocket: a ping is out unanswered, the connection closes once its output is written */
+    uint8_t ws_ping_sent;
+    uint8_t ws_closing;
+
+    http_exchange_t exchange;
+
+    /* Set while the connection speaks HTTP/2 */
+    struct http2_connection *h2;
 
-	time_t last_activity;
-	int timeout_s;
+    /**
+     * On the scheduler's pass clock. deadline_ms bounds the state in
+     * deadline_state as a whole, 0 for none; progress_bytes counts what
+     * the body or response moved since progress_ms, for the minimum
+     * rate.
+     **/
+    uint64_t last_activity_ms;
+    uint32_t idle_timeout_ms;
+    http_connection_state_t deadline_state;
+    uint64_t deadline_ms;
+    uint64_t progress_ms;
+    size_t progress_bytes;
 };
 
 int8_t http_connection_work(task_node_t *node);
-void http_connection_on_handled_request(struct http_connection *self, const char *weather_data);
+void http_connection_on_handled_request(http_exchange_t *exchange, const http_connection_reply_t *reply);
+int http_etag_matches(const char *if_none_match, const char *etag);
+const char *http_status_text(uint16_t status);
+int8_t http_connection_on_stream(http_exchange_t *exchange, uint16_t status, const char *content_type,
+                                 const char *data, size_t len, uint8_t last);
+int8_t http_connection_on_frame(http_exchange_t *exchange, const char *frame, size_t len);
+char *http_connection_reserve(http_connection_t *self, size_t len);
+size_t http_connection_room(const http_connection_t *self);
 void http_connection_cleanup(http_connection_t *self);
 
 #endif /* __http_connection_h__ */
@@ -0,0 +1,63 @@
+/**
+ * Header-file: http_hpack.h
+ **/
+
+#ifndef __http_hpack_h__
+#define __http_hpack_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../include/config/config.h"
+
+/* Static table names the encoder refers to, RFC 7541 appendix A */
+typedef enum
+{
+    HTTP_HPACK_STATUS           = 8,
+    HTTP_HPACK_CACHE_CONTROL    = 24,
+    HTTP_HPACK_CONTENT_ENCODING = 26,
+    HTTP_HPACK_CONTENT_LENGTH   = 28,
+    HTTP_HPACK_CONTENT_TYPE     = 31,
+    HTTP_HPACK_ETAG             = 34,
+    HTTP_HPACK_RETRY_AFTER      = 53,
+    HTTP_HPACK_VARY             = 59
+} http_hpack_name_t;
+
+/* Every entry costs its name and value plus 32 bytes of the table size */
+#define HTTP_HPACK_ENTRY_OVERHEAD 32
+#define HTTP_HPACK_MAX_ENTRIES (HTTP2_HEADER_TABLE_SIZE / HTTP_HPACK_ENTRY_OVERHEAD)
+
+typedef struct http_hpack_entry
+{
+    uint16_t offset;
+    uint16_t name_len;
+    uint16_t value_len;
+} http_hpack_entry_t;
+
+/**
+ * A decoder's dynamic table. Entries lie oldest first, back to back in
+ * data; evicting the oldest moves the rest down, a few KB at most and
+ * only when a client indexes new headers. size counts what the RFC
+ * counts, which is what max_size limits.
+ **/
+typedef struct http_hpack_table
+{
+    char data[HTTP2_HEADER_TABLE_SIZE];
+    size_t data_len;
+    http_hpack_entry_t entries[HTTP_HPACK_MAX_ENTRIES];
+    uint16_t count;
+    size_t size;
+    size_t max_size;
+} http_hpack_table_t;
+
+/* Called per decoded header, a non-zero return stops decoding */
+typedef int (*http_hpack_on_header_t)(void *ctx, const char *name, size_t name_len,
+                                      const char *value, size_t value_len);
+
+void http_hpack_table_init(http_hpack_table_t *self);
+int http_hpack_decode(http_hpack_table_t *self, const uint8_t *block, size_t len, char *scratch,
+                      size_t scratch_size, http_hpack_on_header_t on_header, void *ctx);
+size_t http_hpack_encode_status(uint16_t status, uint8_t *out, size_t size);
+size_t http_hpack_encode_header(http_hpack_name_t name, const char *value, size_t value_len,
+                                uint8_t *out, size_t size);
+
+#endif /* __http_hpack_h__ */
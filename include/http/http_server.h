@@ -10,6 +10,8 @@
 #include "../../include/task_scheduler/task_scheduler.h"
 #include "../../include/weather/weather_server.h"
 #include "../../include/http/http_connection.h"
+#include "../../include/http/http2.h"
+#include "../../include/tcp/tcp_ratelimit.h"
 #include "../../include/config/config.h"
 
 typedef struct http_connection http_connection_t;
@@ -17,7 +19,10 @@ typedef struct http_server http_server_t;
 
 typedef struct http_server_cb
 {
-    void (*tcp_on_newly_accepted_client)(struct http_server *self, int fd);
+    void (*tcp_on_newly_accepted_client)(struct http_server *self, int fd, uint64_t client_key);
+    void (*tcp_on_rejected_client)(struct http_server *self, int fd);
+    void (*tcp_on_throttled_client)(struct http_server *self, int fd);
+    uint8_t (*tcp_free_slots)(struct http_server *self);
 } http_server_cb_t;
 
 struct http_server
@@ -26,14 +31,25 @@ struct http_server
     uint8_t active_count;
 
     http_connection_t child_http_connection[CONNECTION_POOL_SIZE];
+
+    /* HTTP/2 state for the slots that upgraded, and the streams they share */
+    http2_connection_t child_http2_connection[HTTP2_MAX_CONNECTIONS];
+    http2_stream_t child_http2_stream[HTTP2_MAX_STREAMS];
     struct weather_server *upper_weather_server_layer;
 
+    /* The TCP layer's buckets, charged again for requests after a connection's first */
+    tcp_ratelimit_t *ratelimit;
+
     http_server_cb_t cb_from_tcp_layer;
     task_node_t node;
 };
 
 int8_t http_server_init(http_server_t *self, struct weather_server *upper_weather_server_layer);
 http_connection_t *http_server_allocate_pool_slot(http_server_t *self);
-void http_server_on_new_client_cb(struct http_server *self, int fd);
+void http_server_on_new_client_cb(struct http_server *self, int fd, uint64_t client_key);
+void http_server_on_rejected_client_cb(struct http_server *self, int fd);
+void http_server_on_throttled_client_cb(struct http_server *self, int fd);
+int8_t http_server_take_token(http_server_t *self, uint64_t client_key);
+uint8_t http_server_free_slots_cb(struct http_server *self);
 
 #endif /* __http_server_h__ */
@@ -0,0 +1,40 @@
+/**
+ * Header-file: http_websocket.h
+ **/
+
+#ifndef __http_websocket_h__
+#define __http_websocket_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Longest server frame header: 2 bytes, 16-bit or 64-bit length, never masked */
+#define HTTP_WEBSOCKET_HEADER_MAX 10
+
+typedef enum
+{
+    HTTP_WEBSOCKET_CONTINUATION = 0x0,
+    HTTP_WEBSOCKET_TEXT         = 0x1,
+    HTTP_WEBSOCKET_BINARY       = 0x2,
+    HTTP_WEBSOCKET_CLOSE        = 0x8,
+    HTTP_WEBSOCKET_PING         = 0x9,
+    HTTP_WEBSOCKET_PONG         = 0xA
+} http_websocket_opcode_t;
+
+/**
+ * One client frame, payload points into the buffer it was parsed from
+ * and is already unmasked
+ **/
+typedef struct http_websocket_frame
+{
+    uint8_t fin;
+    uint8_t opcode;
+    char *payload;
+    size_t payload_len;
+} http_websocket_frame_t;
+
+int http_websocket_accept_key(const char *key, char *out, size_t size);
+size_t http_websocket_frame_header(uint8_t opcode, size_t payload_len, uint8_t *out);
+int http_websocket_parse(char *data, size_t len, http_websocket_frame_t *frame);
+
+#endif /* __http_websocket_h__ */
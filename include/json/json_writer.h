@@ -0,0 +1,61 @@
+/**
+ * Header-file: json_writer.h
+ **/
+
+#ifndef __json_writer_h__
+#define __json_writer_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JSON_WRITER_MAX_DEPTH 32
+
+/**
+ * Streams JSON straight into a caller's buffer, nothing is built up in
+ * between and nothing is allocated. Commas and colons are placed by the
+ * writer. A write that does not fit sets overflow and every later write
+ * is dropped; copy the struct before an element and assign it back to
+ * take the element out again.
+ **/
+typedef struct json_writer
+{
+    char *out;
+    size_t size;
+    size_t len;
+    uint8_t overflow;
+
+    /* Bit n set once the container at depth n has a member */
+    uint32_t has_member;
+    uint8_t depth;
+    uint8_t after_key;
+} json_writer_t;
+
+void json_writer_init(json_writer_t *self, char *out, size_t size);
+void json_writer_rebuffer(json_writer_t *self, char *out, size_t size);
+size_t json_writer_finish(json_writer_t *self);
+size_t json_writer_room(const json_writer_t *self);
+
+void json_object_begin(json_writer_t *self);
+void json_object_end(json_writer_t *self);
+void json_array_begin(json_writer_t *self);
+void json_array_end(json_writer_t *self);
+void json_key(json_writer_t *self, const char *key);
+
+void json_string(json_writer_t *self, const char *value);
+void json_string_n(json_writer_t *self, const char *value, size_t len);
+void json_int(json_writer_t *self, int64_t value);
+void json_uint(json_writer_t *self, uint64_t value);
+void json_fixed(json_writer_t *self, int64_t value, uint8_t decimals);
+void json_double(json_writer_t *self, double value, uint8_t decimals);
+void json_bool(json_writer_t *self, int value);
+void json_null(json_writer_t *self);
+
+/* A key and its value in one call */
+void json_key_string(json_writer_t *self, const char *key, const char *value);
+void json_key_int(json_writer_t *self, const char *key, int64_t value);
+void json_key_uint(json_writer_t *self, const char *key, uint64_t value);
+void json_key_fixed(json_writer_t *self, const char *key, int64_t value, uint8_t decimals);
+void json_key_double(json_writer_t *self, const char *key, double value, uint8_t decimals);
+void json_key_bool(json_writer_t *self, const char *key, int value);
+
+#endif /* __json_writer_h__ */
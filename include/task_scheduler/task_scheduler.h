@@ -35,6 +35,7 @@ typedef struct task_scheduler
 {
     task_node_t *head;
     uint8_t     count;
+    uint64_t    pass_ms;
 } task_scheduler_t;
 
 int8_t task_scheduler_init(void);
@@ -43,4 +44,15 @@ int8_t task_scheduler_add(task_node_t *node);
 int8_t task_scheduler_remove(task_node_t *node);
 int8_t task_scheduler_work(void);
 
+/**
+ * Monotonic clock in milliseconds, used for deadlines and TTLs
+ **/
+uint64_t task_scheduler_now_ms(void);
+
+/**
+ * The same clock read once at the start of the current pass, for the
+ * many tasks whose deadlines can afford to be a pass late
+ **/
+uint64_t task_scheduler_pass_ms(void);
+
 #endif /* __task_scheduler_h__ */
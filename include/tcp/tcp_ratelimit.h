@@ -0,0 +1,40 @@
+/**
+ * Header-file: tcp_ratelimit.h
+ **/
+
+#ifndef __tcp_ratelimit_h__
+#define __tcp_ratelimit_h__
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include "../../include/config/config.h"
+
+/**
+ * One client's bucket, free while key is 0. Tokens are kept in
+ * thousandths and only brought up to date when the client shows up.
+ **/
+typedef struct tcp_ratelimit_entry
+{
+    uint64_t key;
+    uint64_t refilled_ms;
+    uint32_t tokens_milli;
+} tcp_ratelimit_entry_t;
+
+/**
+ * now_ms is the clock the buckets refill from, read once per pass of
+ * the TCP layer and shared by every lookup in between
+ **/
+typedef struct tcp_ratelimit
+{
+    tcp_ratelimit_entry_t entries[TCP_RATELIMIT_SIZE];
+    uint64_t now_ms;
+    uint64_t next_evict_ms;
+    uint64_t throttled;
+} tcp_ratelimit_t;
+
+void tcp_ratelimit_init(tcp_ratelimit_t *self);
+void tcp_ratelimit_tick(tcp_ratelimit_t *self, uint64_t now_ms);
+uint64_t tcp_ratelimit_key(const struct sockaddr *addr);
+int8_t tcp_ratelimit_take(tcp_ratelimit_t *self, uint64_t key);
+
+#endif /* __tcp_ratelimit_h__ */
@@ -6,6 +6,7 @@
 #define __tcp_server_h__
 
 #include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/tcp/tcp_ratelimit.h"
 #include "../../include/config/config.h"
 
 struct http_server;
@@ -19,16 +20,40 @@ typedef enum
     TCP_SERVER_DONE      = 4,
 } tcp_server_state_t;
 
+/**
+ * tcp_free_slots tells how many more clients the HTTP layer can take;
+ * a client accepted while it has none goes to tcp_on_rejected_client,
+ * one out of tokens to tcp_on_throttled_client, and either answers and
+ * closes it without a slot. client_key names the client's rate limit
+ * bucket.
+ **/
 typedef struct tcp_server_cb
 {
-    void (*tcp_on_newly_accepted_client)(struct http_server *upper, int fd);
+    void (*tcp_on_newly_accepted_client)(struct http_server *upper, int fd, uint64_t client_key);
+    void (*tcp_on_rejected_client)(struct http_server *upper, int fd);
+    void (*tcp_on_throttled_client)(struct http_server *upper, int fd);
+    uint8_t (*tcp_free_slots)(struct http_server *upper);
 } tcp_server_cb_t;
 
+/**
+ * accept_budget is how many clients one pass may accept, adapted to how
+ * long the passes take (last_pass_ms is when the previous one began).
+ * While paused_until_ms lies ahead the listen socket is not watched and
+ * new clients wait in the kernel backlog.
+ **/
 typedef struct tcp_server
 {
     int listen_fd;
     const char *port;
     tcp_server_state_t state;
+
+    uint8_t accept_budget;
+    uint64_t last_pass_ms;
+    uint64_t paused_until_ms;
+    uint64_t accepted;
+    uint64_t rejected;
+    tcp_ratelimit_t ratelimit;
+
     struct http_server *upper_http_layer;
     tcp_server_cb_t cb_to_http_layer;
     task_node_t node;
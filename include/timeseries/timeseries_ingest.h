@@ -0,0 +1,41 @@
+/**
+ * Header-file: timeseries_ingest.h
+ **/
+
+#ifndef __timeseries_ingest_h__
+#define __timeseries_ingest_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../include/timeseries/timeseries_store.h"
+#include "../../include/catalog/city_catalog.h"
+#include "../../include/config/config.h"
+
+/**
+ * Line protocol parser for posted observations, one record per line:
+ *
+ *   <station id> <unix time> <temperature C> <humidity %> <wind km/h>
+ *   1 1760000000 -3.5 81 12.4
+ *
+ * Station ids are catalog city ids. Fields are separated by spaces,
+ * temperature and wind keep one decimal. Blank lines and lines starting
+ * with '#' are skipped. Bodies arrive in chunks, a line cut by a chunk
+ * boundary is carried over to the next one.
+ **/
+typedef struct timeseries_ingest
+{
+    char carry[TIMESERIES_INGEST_LINE_MAX];
+    size_t carry_len;
+    uint8_t carry_overflow;
+
+    uint32_t accepted;
+    uint32_t rejected;
+} timeseries_ingest_t;
+
+void timeseries_ingest_reset(timeseries_ingest_t *self);
+void timeseries_ingest_feed(timeseries_ingest_t *self, timeseries_store_t *store,
+                            const city_catalog_t *catalog, const char *data, size_t len);
+void timeseries_ingest_finish(timeseries_ingest_t *self, timeseries_store_t *store,
+                              const city_catalog_t *catalog);
+
+#endif /* __timeseries_ingest_h__ */
@@ -0,0 +1,123 @@
+/**
+ * Header-file: timeseries_store.h
+ **/
+
+#ifndef __timeseries_store_h__
+#define __timeseries_store_h__
+
+#include <stdint.h>
+#include "../../include/config/config.h"
+
+typedef enum
+{
+    TIMESERIES_LEVEL_RAW    = 0,
+    TIMESERIES_LEVEL_MINUTE = 1,
+    TIMESERIES_LEVEL_HOUR   = 2,
+    TIMESERIES_LEVEL_DAY    = 3,
+    TIMESERIES_LEVEL_COUNT  = 4
+} timeseries_level_t;
+
+/**
+ * One reading, in the fixed-width units of the forecast store
+ **/
+typedef struct timeseries_observation
+{
+    int64_t time;
+    int16_t temperature;   /* tenths of a degree C */
+    uint16_t wind;         /* tenths of km/h */
+    uint8_t humidity;      /* percent */
+} timeseries_observation_t;
+
+/**
+ * Latest observations in arrival order, one array per field so a range
+ * scan only touches the columns it reads
+ **/
+typedef struct timeseries_raw
+{
+    uint32_t head;
+    uint32_t count;
+    int64_t time[TIMESERIES_RAW_CAPACITY];
+    int16_t temperature[TIMESERIES_RAW_CAPACITY];
+    uint16_t wind[TIMESERIES_RAW_CAPACITY];
+    uint8_t humidity[TIMESERIES_RAW_CAPACITY];
+} timeseries_raw_t;
+
+/**
+ * Aggregate of every observation in [start, start + step). Rollup rings
+ * are dense in time: a bucket lives at (start / step) % capacity, so
+ * appends and lookups need no search and late readings still land.
+ **/
+typedef struct timeseries_bucket
+{
+    int64_t start;
+    uint32_t count;
+    int16_t temperature_min;
+    int16_t temperature_max;
+    int32_t temperature_sum;
+    uint32_t wind_sum;
+    uint32_t humidity_sum;
+} timeseries_bucket_t;
+
+typedef struct timeseries_series
+{
+    uint8_t used;
+    uint8_t observed;      /* fed by posted observations, not forecast samples */
+    uint32_t city_id;
+    int64_t oldest;
+    int64_t newest;
+
+    timeseries_raw_t raw;
+    timeseries_bucket_t minute[TIMESERIES_MINUTE_CAPACITY];
+    timeseries_bucket_t hour[TIMESERIES_HOUR_CAPACITY];
+    timeseries_bucket_t day[TIMESERIES_DAY_CAPACITY];
+} timeseries_series_t;
+
+/**
+ * Every series is preallocated, a city takes one on its first observation
+ **/
+typedef struct timeseries_store
+{
+    uint32_t series_count;
+    timeseries_series_t series[TIMESERIES_SERIES];
+} timeseries_store_t;
+
+/**
+ * Iterates a range in output steps, merging whatever level fits the step
+ **/
+typedef struct timeseries_cursor
+{
+    const timeseries_series_t *series;
+    timeseries_level_t level;
+    int64_t from;
+    int64_t to;
+    int64_t step;
+    int64_t position;
+    uint32_t raw_index;
+} timeseries_cursor_t;
+
+typedef struct timeseries_point
+{
+    int64_t start;
+    uint32_t count;
+    int16_t temperature_min;
+    int16_t temperature_max;
+    int16_t temperature_avg;
+    uint16_t wind_avg;
+    uint8_t humidity_avg;
+} timeseries_point_t;
+
+void timeseries_store_init(timeseries_store_t *self);
+int8_t timeseries_store_append(timeseries_store_t *self, uint32_t city_id,
+                               const timeseries_observation_t *observation);
+uint32_t timeseries_store_append_batch(timeseries_store_t *self, const uint32_t *city_ids,
+                                       const timeseries_observation_t *observations, uint32_t count);
+int8_t timeseries_store_sample(timeseries_store_t *self, uint32_t city_id,
+                               const timeseries_observation_t *observation);
+const timeseries_series_t *timeseries_store_find(const timeseries_store_t *self, uint32_t city_id);
+uint32_t timeseries_raw_span(const timeseries_series_t *series, int64_t from, int64_t to, uint32_t *first_slot);
+int8_t timeseries_cursor_init(timeseries_cursor_t *cursor, const timeseries_series_t *series,
+                              int64_t from, int64_t to, int64_t step);
+int timeseries_cursor_next(timeseries_cursor_t *cursor, timeseries_point_t *point);
+const char *timeseries_level_name(timeseries_level_t level);
+
+#endif /* __timeseries_store_h__ */
@@ -0,0 +1,36 @@
+/**
+ * Header-file: upstream_client.h
+ **/
+
+#ifndef __upstream_client_h__
+#define __upstream_client_h__
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include "../../include/upstream/upstream_connection.h"
+#include "../../include/config/config.h"
+
+typedef struct upstream_client upstream_client_t;
+struct weather_connection;
+
+struct upstream_client
+{
+    uint8_t ready;
+    uint8_t pool_size;
+    uint8_t active_count;
+
+    const char *host;
+    const char *port;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+
+    upstream_connection_t child_upstream_connection[UPSTREAM_POOL_SIZE];
+};
+
+int8_t upstream_client_init(upstream_client_t *self, const char *host, const char *port);
+int8_t upstream_client_request(upstream_client_t *self,
+                               struct weather_connection *requester,
+                               const char *target);
+void upstream_client_close(upstream_client_t *self);
+
+#endif /* __upstream_client_h__ */
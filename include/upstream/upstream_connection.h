@@ -0,0 +1,60 @@
+/**
+ * Header-file: upstream_connection.h
+ **/
+
+#ifndef __upstream_connection_h__
+#define __upstream_connection_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/config/config.h"
+
+typedef struct upstream_connection upstream_connection_t;
+typedef struct upstream_client upstream_client_t;
+struct weather_connection;
+
+typedef enum
+{
+    UPSTREAM_CONNECTION_CLOSED     = 0,
+    UPSTREAM_CONNECTION_CONNECTING = 1,
+    UPSTREAM_CONNECTION_SENDING    = 2,
+    UPSTREAM_CONNECTION_RECEIVING  = 3,
+    UPSTREAM_CONNECTION_IDLE       = 4
+} upstream_connection_state_t;
+
+/**
+ * Status codes handed to the requester when no HTTP response was received
+ **/
+#define UPSTREAM_STATUS_BAD_GATEWAY     502
+#define UPSTREAM_STATUS_GATEWAY_TIMEOUT 504
+
+struct upstream_connection
+{
+    int fd;
+    upstream_connection_state_t state;
+    upstream_client_t *parent;
+    task_node_t node;
+
+    struct weather_connection *requester;
+    uint64_t deadline_ms;
+    uint64_t idle_since_ms;
+    uint8_t reused;
+
+    char request_buffer[UPSTREAM_REQUEST_BUFFER_SIZE];
+    size_t request_len;
+    size_t sent_bytes;
+
+    char response_buffer[UPSTREAM_RESPONSE_BUFFER_SIZE];
+    size_t response_len;
+    size_t header_len;
+    long content_length;
+    uint16_t status;
+    uint8_t keep_alive;
+};
+
+int8_t upstream_connection_work(task_node_t *node);
+int8_t upstream_connection_start(upstream_connection_t *self);
+void upstream_connection_close(upstream_connection_t *self);
+
+#endif /* __upstream_connection_h__ */
@@ -0,0 +1,64 @@
+/**
+ * Header-file: weather_admission.h
+ **/
+
+#ifndef __weather_admission_h__
+#define __weather_admission_h__
+
+#include <stdint.h>
+#include "../../include/weather/weather_connection.h"
+#include "../../include/config/config.h"
+
+struct http_exchange;
+
+typedef enum
+{
+    WEATHER_ADMISSION_EMPTY = 0,
+    WEATHER_ADMISSION_ADMIT = 1,
+    WEATHER_ADMISSION_SHED  = 2
+} weather_admission_result_t;
+
+/**
+ * A request that found the pool full. Its HTTP side stays WAITING, as
+ * for a coalesced request, and a detached one is left as a hole.
+ **/
+typedef struct weather_admission_waiter
+{
+    struct http_exchange *http_conn;
+    weather_request_t request;
+    uint64_t enqueued_ms;
+} weather_admission_waiter_t;
+
+/**
+ * Ring of waiting requests, oldest at head. The CoDel state follows
+ * RFC 8289: first_above_ms is when the wait has been over target for a
+ * whole interval, and while dropping the next head is shed at
+ * drop_next_ms, each time sooner as drop_count grows. last_count lets
+ * a new dropping spell pick up near the rate the previous one ended at.
+ **/
+typedef struct weather_admission
+{
+    weather_admission_waiter_t waiters[WEATHER_ADMISSION_QUEUE_SIZE];
+    uint16_t head;
+    uint16_t count;
+
+    uint64_t first_above_ms;
+    uint64_t drop_next_ms;
+    uint32_t drop_count;
+    uint32_t last_count;
+    uint8_t dropping;
+
+    uint64_t admitted;
+    uint64_t shed;
+    uint64_t expired;
+} weather_admission_t;
+
+void weather_admission_init(weather_admission_t *self);
+int8_t weather_admission_push(weather_admission_t *self, struct http_exchange *http_conn,
+                              const weather_request_t *request, uint64_t now_ms);
+weather_admission_result_t weather_admission_pop(weather_admission_t *self, uint64_t now_ms,
+                                                 weather_admission_waiter_t *out);
+int8_t weather_admission_expire(weather_admission_t *self, uint64_t now_ms, weather_admission_waiter_t *out);
+void weather_admission_remove(weather_admission_t *self, struct http_exchange *http_conn);
+
+#endif /* __weather_admission_h__ */
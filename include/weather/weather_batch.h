@@ -0,0 +1,71 @@
+/**
+ * Header-file: weather_batch.h
+ **/
+
+#ifndef __weather_batch_h__
+#define __weather_batch_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "../../include/catalog/city_catalog.h"
+#include "../../include/forecast/forecast_store.h"
+#include "../../include/config/config.h"
+#include "../../include/json/json_writer.h"
+#include "../../include/cbor/cbor_writer.h"
+#include "../../include/weather/weather_format.h"
+
+/**
+ * Current weather for many cities in one request. Cities are names or
+ * catalog ids separated by ',', '&' or newlines, a leading "city=" is
+ * dropped so query strings and form bodies parse the same. Names may be
+ * percent-encoded. Bodies arrive in chunks, a name cut by a chunk
+ * boundary is carried over to the next one.
+ *
+ * Names resolve to ids as they arrive. Once the list is complete the
+ * values are gathered column by column with the ids sorted, so every
+ * column is read front to back, and rendered in request order.
+ **/
+typedef struct weather_batch
+{
+    char carry[WEATHER_CITY_SIZE];
+    size_t carry_len;
+    uint8_t carry_overflow;
+
+    /* Catalog ids in request order */
+    uint16_t count;
+    uint16_t dropped;
+    uint32_t city_ids[WEATHER_BATCH_MAX_CITIES];
+
+    /* Names the catalog does not know, listed after the cities */
+    uint16_t unknown_count;
+    uint16_t unknown_listed;
+    size_t unknown_len;
+    char unknown[WEATHER_BATCH_UNKNOWN_SIZE];
+
+    /* Gathered from the forecast run, has_data is 0 for cities it lacks */
+    int64_t time;
+    uint8_t has_data[WEATHER_BATCH_MAX_CITIES];
+    int16_t temperature[WEATHER_BATCH_MAX_CITIES];
+    uint16_t wind[WEATHER_BATCH_MAX_CITIES];
+    uint8_t humidity[WEATHER_BATCH_MAX_CITIES];
+    uint8_t condition[WEATHER_BATCH_MAX_CITIES];
+
+    /* Render position: header, cities, then the trailer */
+    uint8_t started;
+    uint16_t next;
+    uint8_t done;
+
+    /* A JSON or CBOR answer is one document across all pieces */
+    json_writer_t json;
+    cbor_writer_t cbor;
+} weather_batch_t;
+
+void weather_batch_reset(weather_batch_t *self);
+void weather_batch_feed(weather_batch_t *self, const city_catalog_t *catalog, const char *data, size_t len);
+void weather_batch_finish(weather_batch_t *self, const city_catalog_t *catalog);
+void weather_batch_gather(weather_batch_t *self, const forecast_store_t *store, time_t now);
+size_t weather_batch_render(weather_batch_t *self, const city_catalog_t *catalog, uint8_t format,
+                            char *out, size_t size);
+
+#endif /* __weather_batch_h__ */
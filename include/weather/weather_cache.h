@@ -0,0 +1,78 @@
+/**
+ * Header-file: weather_cache.h
+ **/
+
+#ifndef __weather_cache_h__
+#define __weather_cache_h__
+
+#include <stdint.h>
+#include "../../include/weather/weather_sketch.h"
+#include "../../include/weather/weather_connection.h"
+#include "../../include/http/http_compress.h"
+#include "../../include/config/config.h"
+
+typedef enum
+{
+    WEATHER_CACHE_MISS  = 0,
+    WEATHER_CACHE_FRESH = 1,
+    WEATHER_CACHE_STALE = 2
+} weather_cache_result_t;
+
+/**
+ * The response in one content coding, len 0 once compressing it turned
+ * out not to pay off
+ **/
+typedef struct weather_cache_variant
+{
+    uint8_t made;
+    size_t len;
+    char body[WEATHER_RESPONSE_SIZE];
+} weather_cache_variant_t;
+
+typedef struct weather_cache_entry
+{
+    uint64_t key;
+    uint8_t used;
+    uint8_t refreshing;
+
+    /* What to fetch again on refresh */
+    weather_request_t request;
+
+    uint16_t status;
+    char response[WEATHER_RESPONSE_SIZE];
+    size_t response_len;
+
+    /* Hash of the response, the ETag clients revalidate with */
+    uint64_t etag;
+
+    /* Compressed copies by coding (gzip first), made on first request */
+    weather_cache_variant_t variants[HTTP_ENCODING_COUNT - 1];
+
+    uint64_t fetched_ms;
+    uint64_t last_hit_ms;
+    uint32_t hits;
+} weather_cache_entry_t;
+
+typedef struct weather_cache
+{
+    uint16_t count;
+    weather_cache_entry_t entries[WEATHER_CACHE_SIZE];
+
+    /* Request frequencies for admission and pinning */
+    weather_sketch_t sketch;
+} weather_cache_t;
+
+void weather_cache_init(weather_cache_t *self);
+weather_cache_result_t weather_cache_lookup(weather_cache_t *self, uint64_t key, uint64_t now_ms,
+                                            weather_cache_entry_t **out);
+weather_cache_entry_t *weather_cache_find(weather_cache_t *self, uint64_t key);
+void weather_cache_store(weather_cache_t *self, const weather_request_t *request,
+                         uint16_t status, const char *response, size_t response_len, uint64_t now_ms);
+uint64_t weather_cache_hash(const char *body, size_t len);
+uint8_t weather_cache_encoded(weather_cache_entry_t *entry, uint8_t encoding,
+                              const char **body, size_t *len);
+void weather_cache_invalidate(weather_cache_t *self);
+uint8_t weather_cache_refresh_candidates(weather_cache_t *self, uint64_t now_ms,
+                                         weather_cache_entry_t **out, uint8_t max);
+
+#endif /* __weather_cache_h__ */
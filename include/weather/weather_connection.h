@@ -6,44 +6,150 @@
 #define __weather_connection_h__
 
 #include <stdint.h>
+#include <stddef.h>
 #include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/timeseries/timeseries_ingest.h"
+#include "../../include/weather/weather_batch.h"
+#include "../../include/weather/weather_format.h"
 #include "../../include/config/config.h"
 
 typedef struct weather_connection weather_connection_t;
 typedef struct weather_server weather_server_t;
 struct http_connection_request;
-struct http_connection;
+struct http_exchange;
+struct weather_snapshot;
 
 typedef enum
 {
-    WEATHER_CONNECTION_IDLE       = 0,
-    WEATHER_CONNECTION_PROCESSING = 1,
-    WEATHER_CONNECTION_DONE       = 2,
-    WEATHER_CONNECTION_ERROR      = 3
+    WEATHER_CONNECTION_IDLE             = 0,
+    WEATHER_CONNECTION_PROCESSING       = 1,
+    WEATHER_CONNECTION_WAITING_UPSTREAM = 2,
+    WEATHER_CONNECTION_DONE             = 3,
+    WEATHER_CONNECTION_ERROR            = 4,
+    WEATHER_CONNECTION_RECEIVING        = 5,
+    WEATHER_CONNECTION_STREAMING        = 6
 } weather_connection_state_t;
 
+/**
+ * Time range of history and aggregate requests, step is 0 for everything
+ * else. Forecasts for coordinates keep hours from now, from is 0.
+ **/
+typedef struct weather_range
+{
+    int64_t from;
+    int64_t to;
+    int64_t step;
+} weather_range_t;
+
+typedef enum
+{
+    WEATHER_FIELD_TEMPERATURE = 0,
+    WEATHER_FIELD_HUMIDITY    = 1,
+    WEATHER_FIELD_WIND        = 2
+} weather_field_t;
+
+/**
+ * What an aggregate request reduces: one field of the forecast run or of
+ * the raw observation history, threshold in stored units (tenths for
+ * temperature and wind)
+ **/
+typedef struct weather_aggregate
+{
+    uint8_t history;
+    uint8_t field;
+    uint8_t has_threshold;
+    int32_t threshold;
+    uint8_t percentile_count;
+    float percentiles[WEATHER_AGGREGATE_PERCENTILES];
+} weather_aggregate_t;
+
+/**
+ * A request reduced to what the weather layer acts on, key identifies
+ * requests that can share one result
+ **/
+typedef struct weather_request
+{
+    char request_type[WEATHER_REQUEST_TYPE_SIZE];
+    char city[WEATHER_CITY_SIZE];
+    uint32_t city_id;
+    weather_range_t range;
+    weather_aggregate_t aggregate;
+    uint8_t format;
+    uint64_t key;
+
+    /* Set when the client sent lat= and lon= instead of city= */
+    uint8_t has_location;
+    float lat;
+    float lon;
+} weather_request_t;
+
 typedef struct weather_connection_cb
 {
     void (*http_on_new_request)(weather_connection_t *self, 
-                                const struct http_connection_request *request);
+                                const weather_request_t *request);
 } weather_connection_cb_t;
 
+typedef struct weather_connection_upstream_cb
+{
+    void (*upstream_on_response)(weather_connection_t *self, uint16_t status,
+                                 const char *body, size_t body_len);
+} weather_connection_upstream_cb_t;
+
 struct weather_connection
 {
     weather_connection_state_t state;
     weather_server_t *parent;
-    struct http_connection *lower_http_connection;
+    struct http_exchange *lower_http_connection;
     task_node_t node;
     
     char request_type[WEATHER_REQUEST_TYPE_SIZE];
     char city[WEATHER_CITY_SIZE];
+    uint32_t city_id;
+    weather_range_t range;
+    weather_aggregate_t aggregate;
+    uint8_t format;
+    uint64_t key;
+    uint8_t has_location;
+    float lat;
+    float lon;
     char response[WEATHER_RESPONSE_SIZE];
+    uint16_t status;
+
+    /* Length of a binary response, 0 when response is a C string */
+    size_t response_len;
+
+    /* Data generation this request reads, pinned until it is done */
+    struct weather_snapshot *snapshot;
+
+    /* Posted observations, parsed as the body streams in */
+    timeseries_ingest_t ingest;
+
+    /* Batch lookups, sent a response buffer at a time, stream_len is a
+     * rendered piece the HTTP layer has not taken yet */
+    weather_batch_t batch;
+    size_t stream_len;
+
+    /* HTTP connections coalesced onto this in-flight request */
+    struct http_exchange *waiters[WEATHER_MAX_WAITERS];
+    uint8_t waiter_count;
     
     weather_connection_cb_t cb_from_http_layer;
+    weather_connection_upstream_cb_t cb_from_upstream_layer;
 };
 
+int8_t weather_request_parse(weather_request_t *out, const struct http_connection_request *request);
+int weather_request_is_data(const char *request_type);
+int weather_request_has_city(const char *request_type);
+const char *weather_format_content_type(uint8_t format);
+size_t weather_error_render(uint8_t format, uint16_t status, const char *message, char *out, size_t size);
+uint64_t weather_request_key_from_id(const weather_request_t *request);
 int8_t weather_connection_work(task_node_t *node);
+int8_t weather_connection_add_waiter(weather_connection_t *self, struct http_exchange *http_conn);
+void weather_connection_remove_waiter(weather_connection_t *self, struct http_exchange *http_conn);
 void weather_connection_on_request_cb(struct weather_connection *self, 
-                                     const struct http_connection_request *request);
+                                     const weather_request_t *request);
+int8_t weather_connection_on_body(weather_connection_t *self, const char *data, size_t len, uint8_t last);
+void weather_connection_on_upstream_response_cb(struct weather_connection *self, uint16_t status,
+                                                const char *body, size_t body_len);
 
 #endif /* __weather_connection_h__ */
@@ -0,0 +1,51 @@
+/**
+ * Header-file: weather_format.h
+ **/
+
+#ifndef __weather_format_h__
+#define __weather_format_h__
+
+/**
+ * Response body format, format= in the query or else the Accept header
+ **/
+typedef enum
+{
+    WEATHER_FORMAT_TEXT = 0,
+    WEATHER_FORMAT_JSON = 1,
+    WEATHER_FORMAT_CBOR = 2
+} weather_format_t;
+
+/**
+ * Map keys of CBOR responses. Values are integers in stored units:
+ * tenths of a degree and of a km/h, percent, unix seconds, 1/10000 of a
+ * degree for coordinates and forecast condition codes. Lists of days or
+ * periods carry TIME and STEP once instead of a time per entry.
+ **/
+typedef enum
+{
+    WEATHER_CBOR_ERROR           = 0,
+    WEATHER_CBOR_STATUS          = 1,
+    WEATHER_CBOR_CITY            = 2,
+    WEATHER_CBOR_ID              = 3,
+    WEATHER_CBOR_TIME            = 4,
+    WEATHER_CBOR_STEP            = 5,
+    WEATHER_CBOR_CONDITION       = 6,
+    WEATHER_CBOR_TEMPERATURE     = 7,
+    WEATHER_CBOR_TEMPERATURE_MIN = 8,
+    WEATHER_CBOR_TEMPERATURE_MAX = 9,
+    WEATHER_CBOR_HUMIDITY        = 10,
+    WEATHER_CBOR_WIND            = 11,
+    WEATHER_CBOR_LAT             = 12,
+    WEATHER_CBOR_LON             = 13,
+    WEATHER_CBOR_GRID_LAT        = 14,
+    WEATHER_CBOR_GRID_LON        = 15,
+    WEATHER_CBOR_ENTRIES         = 16,
+    WEATHER_CBOR_COUNT           = 17,
+    WEATHER_CBOR_NOT_FOUND       = 18,
+    WEATHER_CBOR_SKIPPED         = 19,
+    WEATHER_CBOR_TRUNCATED       = 20,
+    WEATHER_CBOR_UPSTREAM        = 21,
+    WEATHER_CBOR_SAMPLE          = 22
+} weather_cbor_key_t;
+
+#endif /* __weather_format_h__ */
@@ -0,0 +1,33 @@
+/**
+ * Header-file: weather_negative.h
+ **/
+
+#ifndef __weather_negative_h__
+#define __weather_negative_h__
+
+#include <stdint.h>
+#include "../../include/config/config.h"
+
+/**
+ * Keys known to answer 404 for a short while. The bloom filter rejects
+ * normal traffic with a few bit tests, the table confirms and expires.
+ **/
+typedef struct weather_negative_entry
+{
+    uint64_t key;
+    uint64_t expires_ms;
+} weather_negative_entry_t;
+
+typedef struct weather_negative
+{
+    uint8_t bloom[WEATHER_NEGATIVE_BLOOM_BITS / 8];
+    weather_negative_entry_t entries[WEATHER_NEGATIVE_SIZE];
+    uint64_t next_rebuild_ms;
+} weather_negative_t;
+
+void weather_negative_init(weather_negative_t *self);
+void weather_negative_add(weather_negative_t *self, uint64_t key, uint64_t now_ms);
+int weather_negative_contains(const weather_negative_t *self, uint64_t key, uint64_t now_ms);
+void weather_negative_maintain(weather_negative_t *self, uint64_t now_ms);
+
+#endif /* __weather_negative_h__ */
@@ -7,9 +7,43 @@
 
 #include <stdint.h>
 #include "../../include/weather/weather_connection.h"
+#include "../../include/weather/weather_cache.h"
+#include "../../include/weather/weather_negative.h"
+#include "../../include/weather/weather_admission.h"
+#include "../../include/upstream/upstream_client.h"
+#include "../../include/weather/weather_snapshot.h"
+#include "../../include/weather/weather_stream.h"
+#include "../../include/timeseries/timeseries_store.h"
+#include "../../include/task_scheduler/task_scheduler.h"
 #include "../../include/config/config.h"
 
 typedef struct weather_server weather_server_t;
+struct http_connection_request;
+struct http_exchange;
+
+/**
+ * Outcome of handing a request to the weather layer
+ **/
+typedef enum
+{
+    WEATHER_REQUEST_BUSY      = -1,
+    WEATHER_REQUEST_ACCEPTED  = 0,
+    WEATHER_REQUEST_NOT_FOUND = 1,
+    WEATHER_REQUEST_BAD_REQUEST = 2,
+    WEATHER_REQUEST_STREAM_BODY = 3,
+    WEATHER_REQUEST_SUBSCRIBED = 4,
+    WEATHER_REQUEST_UPGRADE = 5
+} weather_request_result_t;
+
+typedef struct weather_server_cb
+{
+    int8_t (*http_on_new_request)(struct weather_server *self, struct http_exchange *http_conn,
+                                  const struct http_connection_request *request);
+    int8_t (*http_on_request_body)(struct weather_server *self, struct http_exchange *http_conn,
+                                   const char *data, size_t len, uint8_t last);
+    int8_t (*http_on_message)(struct weather_server *self, struct http_exchange *http_conn,
+                              const char *data, size_t len);
+} weather_server_cb_t;
 
 struct weather_server
 {
@@ -17,9 +51,38 @@ struct weather_server
     uint8_t active_count;
     
     weather_connection_t child_weather_connection[CONNECTION_POOL_SIZE];
+    upstream_client_t upstream;
+    weather_cache_t cache;
+    weather_negative_t negative;
+    weather_admission_t admission;
+    weather_snapshots_t snapshots;
+    timeseries_store_t history;
+    weather_stream_t stream;
+
+    weather_server_cb_t cb_from_http_layer;
+    task_node_t node;
+    uint64_t next_refresh_ms;
+    uint64_t next_sample_ms;
+
+    /* Compressed bodies of responses that are not cached, used per send */
+    char encoded[WEATHER_RESPONSE_SIZE];
 };
 
 int8_t weather_server_init(weather_server_t *self);
 weather_connection_t *weather_server_allocate_pool_slot(weather_server_t *self);
+weather_connection_t *weather_server_find_in_flight(weather_server_t *self, uint64_t key);
+int8_t weather_server_on_request_cb(struct weather_server *self, struct http_exchange *http_conn,
+                                    const struct http_connection_request *request);
+int8_t weather_server_on_request_body_cb(struct weather_server *self, struct http_exchange *http_conn,
+                                         const char *data, size_t len, uint8_t last);
+int8_t weather_server_on_message_cb(struct weather_server *self, struct http_exchange *http_conn,
+                                    const char *data, size_t len);
+int8_t weather_server_work(task_node_t *node);
+void weather_server_admit(weather_server_t *self);
+int8_t weather_server_refresh(weather_server_t *self, weather_cache_entry_t *entry);
+void weather_server_respond(weather_server_t *self, struct http_exchange *http_conn, uint16_t status,
+                            uint8_t format, const char *body, size_t len, weather_cache_entry_t *entry);
+void weather_server_detach_http_connection(weather_server_t *self, struct http_exchange *http_conn);
+void weather_server_deinit(weather_server_t *self);
 
 #endif /* __weather_server_h__ */
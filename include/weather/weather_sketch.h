@@ -0,0 +1,39 @@
+/**
+ * Header-file: weather_sketch.h
+ **/
+
+#ifndef __weather_sketch_h__
+#define __weather_sketch_h__
+
+#include <stdint.h>
+#include "../../include/config/config.h"
+
+/**
+ * Fixed-memory request frequency estimate (count-min with conservative
+ * update). All counters are halved every WEATHER_SKETCH_SAMPLE_SIZE
+ * increments so old popularity fades, TinyLFU style.
+ **/
+typedef struct weather_sketch_top
+{
+    uint64_t key;
+    uint8_t estimate;
+    char request_type[WEATHER_REQUEST_TYPE_SIZE];
+    char city[WEATHER_CITY_SIZE];
+} weather_sketch_top_t;
+
+typedef struct weather_sketch
+{
+    uint8_t counters[WEATHER_SKETCH_DEPTH][WEATHER_SKETCH_WIDTH];
+    uint32_t additions;
+
+    weather_sketch_top_t top[WEATHER_SKETCH_TOP_K];
+    uint8_t top_count;
+} weather_sketch_t;
+
+void weather_sketch_init(weather_sketch_t *self);
+uint8_t weather_sketch_increment(weather_sketch_t *self, uint64_t key,
+                                 const char *request_type, const char *city);
+uint8_t weather_sketch_estimate(const weather_sketch_t *self, uint64_t key);
+int weather_sketch_is_top(const weather_sketch_t *self, uint64_t key);
+
+#endif /* __weather_sketch_h__ */
@@ -0,0 +1,59 @@
+/**
+ * Header-file: weather_snapshot.h
+ **/
+
+#ifndef __weather_snapshot_h__
+#define __weather_snapshot_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../include/catalog/city_catalog.h"
+#include "../../include/forecast/forecast_store.h"
+#include "../../include/forecast/forecast_grid.h"
+#include "../../include/config/config.h"
+
+/**
+ * One immutable generation of the data files. A snapshot is never
+ * modified after it is published, readers hold a reference for as long
+ * as they look at it and the last reference unmaps it.
+ **/
+typedef struct weather_snapshot
+{
+    uint8_t used;
+    uint32_t refs;
+    uint32_t generation;
+
+    city_catalog_t catalog;
+    forecast_store_t forecast;
+    forecast_grid_t grid;
+} weather_snapshot_t;
+
+typedef enum
+{
+    WEATHER_RELOAD_IDLE    = 0,
+    WEATHER_RELOAD_WARMING = 1
+} weather_reload_state_t;
+
+typedef struct weather_snapshots
+{
+    weather_snapshot_t slots[WEATHER_SNAPSHOT_SLOTS];
+    weather_snapshot_t *current;
+    uint32_t generation;
+
+    /* Loaded but not yet published, its pages are faulted in a few at a time */
+    weather_reload_state_t reload_state;
+    weather_snapshot_t *pending;
+    size_t warm_offset;
+    uint8_t reload_wanted;
+
+    int inotify_fd;
+} weather_snapshots_t;
+
+int8_t weather_snapshots_init(weather_snapshots_t *self);
+weather_snapshot_t *weather_snapshot_acquire(weather_snapshots_t *self);
+void weather_snapshot_release(weather_snapshots_t *self, weather_snapshot_t *snapshot);
+int weather_snapshots_work(weather_snapshots_t *self);
+void weather_snapshots_request_reload(void);
+void weather_snapshots_deinit(weather_snapshots_t *self);
+
+#endif /* __weather_snapshot_h__ */
@@ -0,0 +1,110 @@
+/**
+ * Header-file: weather_stream.h
+ **/
+
+#ifndef __weather_stream_h__
+#define __weather_stream_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "../../include/weather/weather_snapshot.h"
+#include "../../include/config/config.h"
+
+#define WEATHER_STREAM_NONE 0xffff
+
+struct http_exchange;
+
+/**
+ * One open /weather/stream response. The socket belongs to the hub once
+ * the headers are out, subscribers of a city are chained through
+ * prev/next. pending is set while the city's current event is only
+ * partly written, offset is how much of it went out.
+ **/
+typedef struct weather_stream_subscriber
+{
+    int32_t fd;
+    uint16_t city;
+    uint16_t prev;
+    uint16_t next;
+    uint16_t offset;
+    uint8_t pending;
+} weather_stream_subscriber_t;
+
+/**
+ * A WebSocket connection's subscription to one city, chained per city
+ * like subscribers. The connection stays in the HTTP pool and queues
+ * the frames it is given.
+ **/
+typedef struct weather_stream_watch
+{
+    struct http_exchange *conn;
+    uint16_t city;
+    uint16_t prev;
+    uint16_t next;
+} weather_stream_watch_t;
+
+/**
+ * A city with subscribers or watches and its latest update, serialized
+ * once as an SSE event and once as a WebSocket text frame and sent as is
+ * to everyone. hash covers the JSON only, a render that comes out the
+ * same sends nothing.
+ **/
+typedef struct weather_stream_city
+{
+    uint32_t city_id;
+    uint16_t head;
+    uint16_t subscribers;
+    uint32_t sequence;
+    uint64_t hash;
+    uint16_t event_len;
+    char name[WEATHER_CITY_SIZE];
+    char event[WEATHER_STREAM_EVENT_SIZE];
+
+    uint16_t watch_head;
+    uint16_t watchers;
+    uint16_t frame_len;
+    char frame[WEATHER_STREAM_EVENT_SIZE];
+} weather_stream_city_t;
+
+/**
+ * Subscribers and watches indexed by city. Updates are rendered when a
+ * new snapshot is published or the forecast moves on to the next hour,
+ * never per subscriber. A subscriber still writing the previous event
+ * when the next one comes is too slow and dropped, so nothing is ever
+ * queued; a WebSocket connection with no room left for a frame is
+ * closed by the HTTP layer.
+ **/
+typedef struct weather_stream
+{
+    weather_stream_subscriber_t subscribers[WEATHER_STREAM_MAX_SUBSCRIBERS];
+    uint16_t free_head;
+    uint16_t count;
+    uint16_t pending_count;
+
+    weather_stream_watch_t watches[WEATHER_STREAM_MAX_WATCHES];
+    uint16_t watch_free_head;
+    uint16_t watch_count;
+
+    weather_stream_city_t cities[WEATHER_STREAM_MAX_CITIES];
+
+    /* What the events were rendered from */
+    uint32_t generation;
+    uint32_t hour;
+
+    uint64_t next_ping_ms;
+    uint64_t dropped;
+} weather_stream_t;
+
+void weather_stream_init(weather_stream_t *self);
+int8_t weather_stream_subscribe(weather_stream_t *self, int fd, uint32_t city_id, const char *name,
+                                const weather_snapshot_t *snapshot, time_t now);
+int8_t weather_stream_watch(weather_stream_t *self, struct http_exchange *conn, uint32_t city_id,
+                            const char *name, const weather_snapshot_t *snapshot, time_t now);
+int8_t weather_stream_unwatch(weather_stream_t *self, struct http_exchange *conn, uint32_t city_id);
+void weather_stream_unwatch_all(weather_stream_t *self, struct http_exchange *conn);
+void weather_stream_work(weather_stream_t *self, const weather_snapshot_t *snapshot, time_t now,
+                         uint64_t now_ms);
+void weather_stream_deinit(weather_stream_t *self);
+
+#endif /* __weather_stream_h__ */
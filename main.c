@@ -6,6 +6,7 @@
 #include "include/task_scheduler/task_scheduler.h"
 #include "include/event_watcher/event_watcher.h"
 #include "include/logging/logging.h"
+#include "include/weather/weather_snapshot.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <signal.h>
@@ -18,6 +19,12 @@ static void signal_handler(int signum)
     g_running = 0;
 }
 
+static void reload_handler(int signum)
+{
+    (void)signum;
+    weather_snapshots_request_reload();
+}
+
 int main(int argc, char *argv[])
 {
 	/* Get user input for logging level */
@@ -37,9 +44,10 @@ int main(int argc, char *argv[])
 	/* Setup signal-handling */
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGHUP, reload_handler);
 
-	/* Program start */
-	wa_t app;
+	/* Program start, static since the pools outgrow the stack */
+	static wa_t app;
 
     if (app_init(&app, loglvl) != 0)
     {
@@ -0,0 +1,557 @@
+/**
+ * Implementation-file: aggregate.c
+ *
+ * Reductions over weather columns in their stored widths. Unsigned
+ * 16-bit columns are flipped into signed range (x ^ 0x8000) so one set
+ * of int16 kernels serves both, the offset is added back afterwards.
+ * The AVX2 kernels are picked at runtime when the CPU has them.
+ **/
+
+#include "../../include/aggregate/aggregate.h"
+#include "../../include/logging/logging.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AGGREGATE_HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define AGGREGATE_HAVE_AVX2 0
+#endif
+
+/* Vector iterations between spills of the narrow lane accumulators */
+#define AGGREGATE_BLOCK_I16 4096
+#define AGGREGATE_BLOCK_U8  255
+
+/**
+ * One segment reduced in the kernel's domain, before the offset is undone
+ **/
+typedef struct aggregate_partial
+{
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint64_t above;
+} aggregate_partial_t;
+
+typedef struct aggregate_kernels
+{
+    void (*partial_i16)(const int16_t *values, size_t n, uint16_t flip, int16_t threshold,
+                        aggregate_partial_t *out);
+    uint64_t (*above_i16)(const int16_t *values, size_t n, uint16_t flip, int16_t threshold);
+    void (*partial_u8)(const uint8_t *values, size_t n, uint8_t threshold, aggregate_partial_t *out);
+    uint64_t (*above_u8)(const uint8_t *values, size_t n, uint8_t threshold);
+} aggregate_kernels_t;
+
+static const char *g_backend_names[] = { "scalar", "avx2" };
+
+/* ---------------------------------------------------------------------------
+ * Scalar kernels
+ * ------------------------------------------------------------------------- */
+
+static void aggregate_partial_i16_scalar(const int16_t *values, size_t n, uint16_t flip, int16_t threshold,
+                                         aggregate_partial_t *out)
+{
+    int32_t min = INT16_MAX;
+    int32_t max = INT16_MIN;
+    int64_t sum = 0;
+    uint64_t above = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int16_t x = (int16_t)((uint16_t)values[i] ^ flip);
+
+        min = x < min ? x : min;
+        max = x > max ? x : max;
+        sum += x;
+        above += x > threshold;
+    }
+
+    out->min = min;
+    out->max = max;
+    out->sum = sum;
+    out->above = above;
+}
+
+static uint64_t aggregate_above_i16_scalar(const int16_t *values, size_t n, uint16_t flip, int16_t threshold)
+{
+    uint64_t above = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        above += (int16_t)((uint16_t)values[i] ^ flip) > threshold;
+    }
+
+    return above;
+}
+
+static void aggregate_partial_u8_scalar(const uint8_t *values, size_t n, uint8_t threshold,
+                                        aggregate_partial_t *out)
+{
+    int32_t min = UINT8_MAX;
+    int32_t max = 0;
+    int64_t sum = 0;
+    uint64_t above = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t x = values[i];
+
+        min = x < min ? x : min;
+        max = x > max ? x : max;
+        sum += x;
+        above += x > threshold;
+    }
+
+    out->min = min;
+    out->max = max;
+    out->sum = sum;
+    out->above = above;
+}
+
+static uint64_t aggregate_above_u8_scalar(const uint8_t *values, size_t n, uint8_t threshold)
+{
+    uint64_t above = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        above += values[i] > threshold;
+    }
+
+    return above;
+}
+
+static const aggregate_kernels_t g_scalar_kernels =
+{
+    aggregate_partial_i16_scalar,
+    aggregate_above_i16_scalar,
+    aggregate_partial_u8_scalar,
+    aggregate_above_u8_scalar
+};
+
+/* ---------------------------------------------------------------------------
+ * AVX2 kernels: 16 int16 or 32 uint8 lanes per load, comparisons become
+ * masks that are subtracted from lane counters, nothing branches on data
+ * ------------------------------------------------------------------------- */
+
+#if AGGREGATE_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static int64_t aggregate_hsum_epi32(__m256i v)
+{
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, v);
+
+    int64_t sum = 0;
+    for (int i = 0; i < 8; i++) sum += lanes[i];
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static uint64_t aggregate_hsum_epu16(__m256i v)
+{
+    uint16_t lanes[16];
+    _mm256_storeu_si256((__m256i *)lanes, v);
+
+    uint64_t sum = 0;
+    for (int i = 0; i < 16; i++) sum += lanes[i];
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static uint64_t aggregate_hsum_epu64(__m256i v)
+{
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, v);
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2")))
+static void aggregate_partial_i16_avx2(const int16_t *values, size_t n, uint16_t flip, int16_t threshold,
+                                       aggregate_partial_t *out)
+{
+    const __m256i flips = _mm256_set1_epi16((int16_t)flip);
+    const __m256i limit = _mm256_set1_epi16(threshold);
+    const __m256i ones  = _mm256_set1_epi16(1);
+
+    __m256i vmin = _mm256_set1_epi16(INT16_MAX);
+    __m256i vmax = _mm256_set1_epi16(INT16_MIN);
+    int64_t sum = 0;
+    uint64_t above = 0;
+    size_t i = 0;
+    size_t vector_end = n - n % 16;
+
+    while (i < vector_end)
+    {
+        size_t block_end = i + (size_t)AGGREGATE_BLOCK_I16 * 16;
+        if (block_end > vector_end) block_end = vector_end;
+
+        /* madd pairs lanes into int32, safe for far more than a block */
+        __m256i vsum = _mm256_setzero_si256();
+        __m256i vabove = _mm256_setzero_si256();
+
+        for (; i < block_end; i += 16)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(values + i)), flips);
+
+            vmin   = _mm256_min_epi16(vmin, x);
+            vmax   = _mm256_max_epi16(vmax, x);
+            vsum   = _mm256_add_epi32(vsum, _mm256_madd_epi16(x, ones));
+            vabove = _mm256_sub_epi16(vabove, _mm256_cmpgt_epi16(x, limit));
+        }
+
+        sum += aggregate_hsum_epi32(vsum);
+        above += aggregate_hsum_epu16(vabove);
+    }
+
+    int16_t mins[16];
+    int16_t maxs[16];
+    _mm256_storeu_si256((__m256i *)mins, vmin);
+    _mm256_storeu_si256((__m256i *)maxs, vmax);
+
+    aggregate_partial_i16_scalar(values + i, n - i, flip, threshold, out);
+
+    for (int lane = 0; lane < 16; lane++)
+    {
+        if (mins[lane] < out->min) out->min = mins[lane];
+        if (maxs[lane] > out->max) out->max = maxs[lane];
+    }
+
+    out->sum += sum;
+    out->above += above;
+}
+
+__attribute__((target("avx2")))
+static uint64_t aggregate_above_i16_avx2(const int16_t *values, size_t n, uint16_t flip, int16_t threshold)
+{
+    const __m256i flips = _mm256_set1_epi16((int16_t)flip);
+    const __m256i limit = _mm256_set1_epi16(threshold);
+
+    uint64_t above = 0;
+    size_t i = 0;
+    size_t vector_end = n - n % 16;
+
+    while (i < vector_end)
+    {
+        size_t block_end = i + (size_t)AGGREGATE_BLOCK_I16 * 16;
+        if (block_end > vector_end) block_end = vector_end;
+
+        __m256i vabove = _mm256_setzero_si256();
+
+        for (; i < block_end; i += 16)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(values + i)), flips);
+            vabove = _mm256_sub_epi16(vabove, _mm256_cmpgt_epi16(x, limit));
+        }
+
+        above += aggregate_hsum_epu16(vabove);
+    }
+
+    return above + aggregate_above_i16_scalar(values + i, n - i, flip, threshold);
+}
+
+__attribute__((target("avx2")))
+static void aggregate_partial_u8_avx2(const uint8_t *values, size_t n, uint8_t threshold,
+                                      aggregate_partial_t *out)
+{
+    /* Bytes compare signed only, flip both sides into signed order */
+    const __m256i flips = _mm256_set1_epi8((char)0x80);
+    const __m256i limit = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    const __m256i zero  = _mm256_setzero_si256();
+
+    __m256i vmin = _mm256_set1_epi8((char)0xff);
+    __m256i vmax = zero;
+    __m256i vsum = zero;
+    __m256i vabove_total = zero;
+    size_t i = 0;
+    size_t vector_end = n - n % 32;
+
+    while (i < vector_end)
+    {
+        size_t block_end = i + (size_t)AGGREGATE_BLOCK_U8 * 32;
+        if (block_end > vector_end) block_end = vector_end;
+
+        __m256i vabove = zero;
+
+        for (; i < block_end; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(values + i));
+
+            vmin   = _mm256_min_epu8(vmin, x);
+            vmax   = _mm256_max_epu8(vmax, x);
+            vsum   = _mm256_add_epi64(vsum, _mm256_sad_epu8(x, zero));
+            vabove = _mm256_sub_epi8(vabove, _mm256_cmpgt_epi8(_mm256_xor_si256(x, flips), limit));
+        }
+
+        vabove_total = _mm256_add_epi64(vabove_total, _mm256_sad_epu8(vabove, zero));
+    }
+
+    uint8_t mins[32];
+    uint8_t maxs[32];
+    _mm256_storeu_si256((__m256i *)mins, vmin);
+    _mm256_storeu_si256((__m256i *)maxs, vmax);
+
+    aggregate_partial_u8_scalar(values + i, n - i, threshold, out);
+
+    for (int lane = 0; lane < 32; lane++)
+    {
+        if (mins[lane] < out->min) out->min = mins[lane];
+        if (maxs[lane] > out->max) out->max = maxs[lane];
+    }
+
+    out->sum += (int64_t)aggregate_hsum_epu64(vsum);
+    out->above += aggregate_hsum_epu64(vabove_total);
+}
+
+__attribute__((target("avx2")))
+static uint64_t aggregate_above_u8_avx2(const uint8_t *values, size_t n, uint8_t threshold)
+{
+    const __m256i flips = _mm256_set1_epi8((char)0x80);
+    const __m256i limit = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    const __m256i zero  = _mm256_setzero_si256();
+
+    __m256i vabove_total = zero;
+    size_t i = 0;
+    size_t vector_end = n - n % 32;
+
+    while (i < vector_end)
+    {
+        size_t block_end = i + (size_t)AGGREGATE_BLOCK_U8 * 32;
+        if (block_end > vector_end) block_end = vector_end;
+
+        __m256i vabove = zero;
+
+        for (; i < block_end; i += 32)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(values + i)), flips);
+            vabove = _mm256_sub_epi8(vabove, _mm256_cmpgt_epi8(x, limit));
+        }
+
+        vabove_total = _mm256_add_epi64(vabove_total, _mm256_sad_epu8(vabove, zero));
+    }
+
+    return aggregate_hsum_epu64(vabove_total) + aggregate_above_u8_scalar(values + i, n - i, threshold);
+}
+
+static const aggregate_kernels_t g_avx2_kernels =
+{
+    aggregate_partial_i16_avx2,
+    aggregate_above_i16_avx2,
+    aggregate_partial_u8_avx2,
+    aggregate_above_u8_avx2
+};
+
+#endif /* AGGREGATE_HAVE_AVX2 */
+
+/* ---------------------------------------------------------------------------
+ * Dispatch
+ * ------------------------------------------------------------------------- */
+
+static const aggregate_kernels_t *g_kernels = NULL;
+static aggregate_backend_t g_backend = AGGREGATE_BACKEND_SCALAR;
+
+static int aggregate_cpu_has_avx2(void)
+{
+#if AGGREGATE_HAVE_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Switches kernels, -1 when the CPU cannot run the requested ones
+ **/
+int8_t aggregate_set_backend(aggregate_backend_t backend)
+{
+    if (backend == AGGREGATE_BACKEND_SCALAR)
+    {
+        g_kernels = &g_scalar_kernels;
+        g_backend = backend;
+        return 0;
+    }
+
+#if AGGREGATE_HAVE_AVX2
+    if (backend == AGGREGATE_BACKEND_AVX2 && aggregate_cpu_has_avx2())
+    {
+        g_kernels = &g_avx2_kernels;
+        g_backend = backend;
+        return 0;
+    }
+#endif
+
+    return -1;
+}
+
+static const aggregate_kernels_t *aggregate_kernels(void)
+{
+    if (!g_kernels)
+    {
+        if (aggregate_set_backend(AGGREGATE_BACKEND_AVX2) != 0)
+        {
+            aggregate_set_backend(AGGREGATE_BACKEND_SCALAR);
+        }
+
+        LOG_INFO("[AGGREGATE] Using %s kernels", aggregate_backend_name(g_backend));
+    }
+
+    return g_kernels;
+}
+
+aggregate_backend_t aggregate_get_backend(void)
+{
+    aggregate_kernels();
+    return g_backend;
+}
+
+const char *aggregate_backend_name(aggregate_backend_t backend)
+{
+    return backend <= AGGREGATE_BACKEND_AVX2 ? g_backend_names[backend] : "unknown";
+}
+
+/* ---------------------------------------------------------------------------
+ * Columns
+ * ------------------------------------------------------------------------- */
+
+void aggregate_column_add(aggregate_column_t *column, const void *values, size_t length)
+{
+    if (!column || !values || length == 0 || column->segment_count >= AGGREGATE_MAX_SEGMENTS) return;
+
+    column->segment[column->segment_count] = values;
+    column->length[column->segment_count] = length;
+    column->segment_count++;
+}
+
+/**
+ * Kernels work in the column's stored width, the threshold is moved into
+ * that domain. Returns 1 when every value is above it, -1 when none is.
+ **/
+static int aggregate_threshold(aggregate_type_t type, int32_t threshold, int32_t *domain_threshold)
+{
+    int32_t low = INT16_MIN;
+    int32_t high = INT16_MAX;
+
+    if (type == AGGREGATE_UINT16)
+    {
+        threshold -= 32768;
+    }
+    else if (type == AGGREGATE_UINT8)
+    {
+        low = 0;
+        high = UINT8_MAX;
+    }
+
+    if (threshold < low) return 1;
+    if (threshold >= high) return -1;
+
+    *domain_threshold = threshold;
+    return 0;
+}
+
+static uint64_t aggregate_segment_above(const aggregate_kernels_t *kernels, aggregate_type_t type,
+                                        const void *values, size_t length, int32_t threshold)
+{
+    if (type == AGGREGATE_UINT8)
+    {
+        return kernels->above_u8(values, length, (uint8_t)threshold);
+    }
+
+    return kernels->above_i16(values, length, type == AGGREGATE_UINT16 ? 0x8000 : 0, (int16_t)threshold);
+}
+
+uint64_t aggregate_column_count_above(const aggregate_column_t *column, int32_t threshold)
+{
+    if (!column) return 0;
+
+    const aggregate_kernels_t *kernels = aggregate_kernels();
+    int32_t domain_threshold = 0;
+    int all = aggregate_threshold(column->type, threshold, &domain_threshold);
+    uint64_t above = 0;
+
+    for (uint8_t s = 0; s < column->segment_count; s++)
+    {
+        if (all > 0) above += column->length[s];
+        else if (all == 0) above += aggregate_segment_above(kernels, column->type, column->segment[s],
+                                                            column->length[s], domain_threshold);
+    }
+
+    return above;
+}
+
+/**
+ * Count, sum, min, max and how many values exceed threshold, one pass
+ **/
+void aggregate_column_summary(const aggregate_column_t *column, int32_t threshold,
+                              aggregate_summary_t *summary)
+{
+    if (!summary) return;
+
+    memset(summary, 0, sizeof(*summary));
+    summary->min = INT32_MAX;
+    summary->max = INT32_MIN;
+
+    if (!column) return;
+
+    const aggregate_kernels_t *kernels = aggregate_kernels();
+    int32_t domain_threshold = 0;
+    int all = aggregate_threshold(column->type, threshold, &domain_threshold);
+    int32_t offset = column->type == AGGREGATE_UINT16 ? 32768 : 0;
+
+    for (uint8_t s = 0; s < column->segment_count; s++)
+    {
+        aggregate_partial_t partial;
+
+        if (column->type == AGGREGATE_UINT8)
+        {
+            kernels->partial_u8(column->segment[s], column->length[s], (uint8_t)domain_threshold, &partial);
+        }
+        else
+        {
+            kernels->partial_i16(column->segment[s], column->length[s], offset ? 0x8000 : 0,
+                                 (int16_t)domain_threshold, &partial);
+        }
+
+        if (partial.min + offset < summary->min) summary->min = partial.min + offset;
+        if (partial.max + offset > summary->max) summary->max = partial.max + offset;
+
+        summary->count += column->length[s];
+        summary->sum   += partial.sum + (int64_t)offset * (int64_t)column->length[s];
+
+        if (all > 0) summary->above += column->length[s];
+        else if (all == 0) summary->above += partial.above;
+    }
+}
+
+/**
+ * Nearest-rank percentile. Bisects the value range between min and max
+ * with the counting kernel, at most 16 streaming passes and no sort or
+ * copy of the column.
+ **/
+int32_t aggregate_column_percentile(const aggregate_column_t *column, const aggregate_summary_t *summary,
+                                    double percent)
+{
+    if (!column || !summary || summary->count == 0) return 0;
+
+    if (percent < 0.0) percent = 0.0;
+    if (percent > 100.0) percent = 100.0;
+
+    uint64_t rank = (uint64_t)(percent / 100.0 * (double)summary->count + 0.999999);
+    if (rank == 0) rank = 1;
+    if (rank > summary->count) rank = summary->count;
+
+    /* Smallest v with at least rank values <= v, i.e. at most count - rank above it */
+    uint64_t allowed_above = summary->count - rank;
+    int32_t lo = summary->min;
+    int32_t hi = summary->max;
+
+    while (lo < hi)
+    {
+        int32_t mid = lo + (hi - lo) / 2;
+
+        if (aggregate_column_count_above(column, mid) <= allowed_above) hi = mid;
+        else lo = mid + 1;
+    }
+
+    return lo;
+}
@@ -54,6 +54,13 @@ int8_t app_init(wa_t *self, int8_t loglvl)
     self->tcp_layer.upper_http_layer = &self->http_layer;
     self->tcp_layer.cb_to_http_layer.tcp_on_newly_accepted_client =
         self->http_layer.cb_from_tcp_layer.tcp_on_newly_accepted_client;
+    self->tcp_layer.cb_to_http_layer.tcp_on_rejected_client =
+        self->http_layer.cb_from_tcp_layer.tcp_on_rejected_client;
+    self->tcp_layer.cb_to_http_layer.tcp_on_throttled_client =
+        self->http_layer.cb_from_tcp_layer.tcp_on_throttled_client;
+    self->tcp_layer.cb_to_http_layer.tcp_free_slots =
+        self->http_layer.cb_from_tcp_layer.tcp_free_slots;
+    self->http_layer.ratelimit = &self->tcp_layer.ratelimit;
 
     LOG_INFO("[APP] >> Initialization complete");
     return 0;
@@ -75,6 +82,7 @@ int8_t app_deinit(wa_t *self)
 
     LOG_INFO("[APP] >> Shutting down...");
     tcp_server_close(&self->tcp_layer);
+    weather_server_deinit(&self->weather_layer);
     task_scheduler_deinit();
     LOG_INFO("[APP] >> Shutdown complete");
     return 0;
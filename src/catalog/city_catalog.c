@@ -0,0 +1,403 @@
+/**
+ * Implementation-file: city_catalog.c
+ **/
+
+#include "../../include/catalog/city_catalog.h"
+#include "../../include/logging/logging.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Walks the front-coded names one at a time
+ **/
+typedef struct city_catalog_cursor
+{
+    uint32_t bucket;
+    uint32_t index;
+    const uint8_t *p;
+    char name[CITY_CATALOG_NAME_MAX];
+    uint8_t len;
+} city_catalog_cursor_t;
+
+static int city_catalog_section_ok(size_t size, uint32_t offset, size_t length)
+{
+    return (offset % 4) == 0 && offset <= size && length <= size - offset;
+}
+
+int8_t city_catalog_open(city_catalog_t *self, const char *path)
+{
+    if (!self || !path) return -1;
+
+    memset(self, 0, sizeof(*self));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_WARN("[CATALOG] Cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(city_catalog_header_t))
+    {
+        LOG_ERROR("[CATALOG] %s is too small", path);
+        close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR("[CATALOG] mmap failed: %s", strerror(errno));
+        return -1;
+    }
+
+    const city_catalog_header_t *header = base;
+    size_t size = st.st_size;
+
+    if (memcmp(header->magic, CITY_CATALOG_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CITY_CATALOG_VERSION ||
+        header->bucket_size != CITY_CATALOG_BUCKET_SIZE ||
+        header->file_size != size ||
+        header->bucket_count != (header->count + CITY_CATALOG_BUCKET_SIZE - 1) / CITY_CATALOG_BUCKET_SIZE ||
+        !city_catalog_section_ok(size, header->records_offset, (size_t)header->count * sizeof(city_record_t)) ||
+        !city_catalog_section_ok(size, header->by_id_offset, (size_t)header->count * sizeof(uint32_t)) ||
+        !city_catalog_section_ok(size, header->buckets_offset, (size_t)header->bucket_count * sizeof(uint32_t)) ||
+        !city_catalog_section_ok(size, header->names_offset, header->names_size) ||
+        !city_catalog_section_ok(size, header->display_offset, header->display_size) ||
+        !city_catalog_section_ok(size, header->kd_offset, (size_t)header->count * sizeof(city_kd_node_t)) ||
+        (header->display_size > 0 && ((const char *)base)[header->display_offset + header->display_size - 1] != '\0'))
+    {
+        LOG_ERROR("[CATALOG] %s is not a valid catalog", path);
+        munmap(base, size);
+        return -1;
+    }
+
+    self->base    = base;
+    self->size    = size;
+    self->header  = header;
+    self->records = (const city_record_t *)(self->base + header->records_offset);
+    self->by_id   = (const uint32_t *)(self->base + header->by_id_offset);
+    self->buckets = (const uint32_t *)(self->base + header->buckets_offset);
+    self->names   = self->base + header->names_offset;
+    self->display = (const char *)(self->base + header->display_offset);
+    self->kd      = (const city_kd_node_t *)(self->base + header->kd_offset);
+    self->loaded  = 1;
+
+    LOG_INFO("[CATALOG] Mapped %u cities from %s (%zu bytes)", header->count, path, size);
+    return 0;
+}
+
+void city_catalog_close(city_catalog_t *self)
+{
+    if (!self || !self->loaded) return;
+
+    munmap((void *)self->base, self->size);
+    memset(self, 0, sizeof(*self));
+}
+
+/**
+ * Lowercase ASCII, '_' and '+' read as spaces, runs of spaces collapsed
+ **/
+size_t city_catalog_normalize(const char *name, char *out, size_t size)
+{
+    if (!name || !out || size == 0) return 0;
+
+    size_t len = 0;
+    for (const char *c = name; *c && len < size - 1; c++)
+    {
+        unsigned char ch = (unsigned char)*c;
+        if (ch == '_' || ch == '+') ch = ' ';
+
+        if (ch == ' ' && (len == 0 || out[len - 1] == ' ')) continue;
+
+        out[len++] = (char)tolower(ch);
+    }
+
+    while (len > 0 && out[len - 1] == ' ') len--;
+    out[len] = '\0';
+
+    return len;
+}
+
+static int city_catalog_bucket_head(const city_catalog_t *self, uint32_t bucket,
+                                    const uint8_t **name, uint8_t *len)
+{
+    uint32_t offset = self->buckets[bucket];
+    if (offset >= self->header->names_size) return -1;
+
+    *len = self->names[offset];
+    if (*len >= CITY_CATALOG_NAME_MAX || offset + 1 + *len > self->header->names_size) return -1;
+
+    *name = self->names + offset + 1;
+    return 0;
+}
+
+static int city_catalog_compare(const uint8_t *name, uint8_t len, const char *key, size_t key_len)
+{
+    size_t n = len < key_len ? len : key_len;
+    int cmp = memcmp(name, key, n);
+    if (cmp != 0) return cmp;
+    return (len > key_len) - (len < key_len);
+}
+
+/**
+ * Last bucket whose first name compares below (or equal, if inclusive) the key
+ **/
+static uint32_t city_catalog_find_bucket(const city_catalog_t *self, const char *key,
+                                         size_t key_len, int inclusive)
+{
+    uint32_t lo = 0;
+    uint32_t hi = self->header->bucket_count;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const uint8_t *name;
+        uint8_t len;
+
+        if (city_catalog_bucket_head(self, mid, &name, &len) != 0) return 0;
+
+        int cmp = city_catalog_compare(name, len, key, key_len);
+        if (cmp < 0 || (inclusive && cmp == 0))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo > 0 ? lo - 1 : 0;
+}
+
+static int city_catalog_cursor_seek(const city_catalog_t *self, city_catalog_cursor_t *cursor,
+                                    uint32_t bucket)
+{
+    const uint8_t *name;
+    uint8_t len;
+
+    if (bucket >= self->header->bucket_count) return -1;
+    if (city_catalog_bucket_head(self, bucket, &name, &len) != 0) return -1;
+
+    cursor->bucket = bucket;
+    cursor->index  = bucket * CITY_CATALOG_BUCKET_SIZE;
+    cursor->len    = len;
+    cursor->p      = name + len;
+    memcpy(cursor->name, name, len);
+    cursor->name[len] = '\0';
+    return 0;
+}
+
+static int city_catalog_cursor_next(const city_catalog_t *self, city_catalog_cursor_t *cursor)
+{
+    uint32_t next = cursor->index + 1;
+    if (next >= self->header->count) return -1;
+
+    if (next % CITY_CATALOG_BUCKET_SIZE == 0)
+    {
+        return city_catalog_cursor_seek(self, cursor, cursor->bucket + 1);
+    }
+
+    const uint8_t *end = self->names + self->header->names_size;
+    if (cursor->p + 2 > end) return -1;
+
+    uint8_t shared = cursor->p[0];
+    uint8_t suffix = cursor->p[1];
+
+    if (shared > cursor->len || shared + suffix >= CITY_CATALOG_NAME_MAX ||
+        cursor->p + 2 + suffix > end)
+    {
+        return -1;
+    }
+
+    memcpy(cursor->name + shared, cursor->p + 2, suffix);
+    cursor->len = shared + suffix;
+    cursor->name[cursor->len] = '\0';
+    cursor->p += 2 + suffix;
+    cursor->index = next;
+    return 0;
+}
+
+const city_record_t *city_catalog_find(const city_catalog_t *self, const char *name)
+{
+    if (!self || !self->loaded || !name || self->header->count == 0) return NULL;
+
+    char key[CITY_CATALOG_NAME_MAX];
+    size_t key_len = city_catalog_normalize(name, key, sizeof(key));
+    if (key_len == 0) return NULL;
+
+    city_catalog_cursor_t cursor;
+    uint32_t bucket = city_catalog_find_bucket(self, key, key_len, 1);
+    if (city_catalog_cursor_seek(self, &cursor, bucket) != 0) return NULL;
+
+    do
+    {
+        int cmp = city_catalog_compare((const uint8_t *)cursor.name, cursor.len, key, key_len);
+        if (cmp == 0) return &self->records[cursor.index];
+        if (cmp > 0) return NULL;
+    }
+    while (cursor.index % CITY_CATALOG_BUCKET_SIZE != CITY_CATALOG_BUCKET_SIZE - 1 &&
+           city_catalog_cursor_next(self, &cursor) == 0);
+
+    return NULL;
+}
+
+const city_record_t *city_catalog_by_id(const city_catalog_t *self, uint32_t id)
+{
+    if (!self || !self->loaded) return NULL;
+
+    uint32_t lo = 0;
+    uint32_t hi = self->header->count;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t index = self->by_id[mid];
+        if (index >= self->header->count) return NULL;
+
+        uint32_t mid_id = self->records[index].id;
+        if (mid_id == id) return &self->records[index];
+        if (mid_id < id) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return NULL;
+}
+
+/**
+ * At most one bucket of names is skipped before matches start, so the
+ * cost is a binary search plus max + CITY_CATALOG_BUCKET_SIZE decodes
+ **/
+uint32_t city_catalog_prefix(const city_catalog_t *self, const char *prefix,
+                             const city_record_t **out, uint32_t max)
+{
+    if (!self || !self->loaded || !prefix || !out || max == 0 || self->header->count == 0) return 0;
+
+    char key[CITY_CATALOG_NAME_MAX];
+    size_t key_len = city_catalog_normalize(prefix, key, sizeof(key));
+
+    city_catalog_cursor_t cursor;
+    uint32_t bucket = city_catalog_find_bucket(self, key, key_len, 0);
+    if (city_catalog_cursor_seek(self, &cursor, bucket) != 0) return 0;
+
+    uint32_t found = 0;
+    do
+    {
+        if (cursor.len >= key_len && memcmp(cursor.name, key, key_len) == 0)
+        {
+            out[found++] = &self->records[cursor.index];
+        }
+        else if (city_catalog_compare((const uint8_t *)cursor.name, cursor.len, key, key_len) > 0)
+        {
+            break;
+        }
+    }
+    while (found < max && city_catalog_cursor_next(self, &cursor) == 0);
+
+    return found;
+}
+
+void city_catalog_to_xyz(float lat, float lon, float xyz[3])
+{
+    const double rad = M_PI / 180.0;
+    double phi = lat * rad;
+    double lambda = lon * rad;
+
+    xyz[0] = (float)(cos(phi) * cos(lambda));
+    xyz[1] = (float)(cos(phi) * sin(lambda));
+    xyz[2] = (float)sin(phi);
+}
+
+typedef struct city_catalog_nearest_search
+{
+    const city_kd_node_t *kd;
+    float target[3];
+    float best_d2;
+    uint32_t best;
+} city_catalog_nearest_search_t;
+
+/**
+ * Depth is log2(count), the only state is on the call stack
+ **/
+static void city_catalog_nearest_visit(city_catalog_nearest_search_t *search,
+                                       uint32_t lo, uint32_t hi, uint32_t axis)
+{
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const city_kd_node_t *node = &search->kd[mid];
+
+        float dx = node->xyz[0] - search->target[0];
+        float dy = node->xyz[1] - search->target[1];
+        float dz = node->xyz[2] - search->target[2];
+        float d2 = dx * dx + dy * dy + dz * dz;
+
+        if (d2 < search->best_d2)
+        {
+            search->best_d2 = d2;
+            search->best = node->record;
+        }
+
+        float diff = search->target[axis] - node->xyz[axis];
+        uint32_t next = (axis + 1) % 3;
+
+        /* Near side first, the far side only if the split plane is closer than the best */
+        if (diff < 0)
+        {
+            city_catalog_nearest_visit(search, lo, mid, next);
+            if (diff * diff >= search->best_d2) return;
+            lo = mid + 1;
+        }
+        else
+        {
+            city_catalog_nearest_visit(search, mid + 1, hi, next);
+            if (diff * diff >= search->best_d2) return;
+            hi = mid;
+        }
+
+        axis = next;
+    }
+}
+
+const city_record_t *city_catalog_nearest(const city_catalog_t *self, float lat, float lon,
+                                          float *distance_km)
+{
+    if (!self || !self->loaded || self->header->count == 0) return NULL;
+
+    city_catalog_nearest_search_t search;
+    search.kd = self->kd;
+    search.best_d2 = INFINITY;
+    search.best = self->header->count;
+    city_catalog_to_xyz(lat, lon, search.target);
+
+    city_catalog_nearest_visit(&search, 0, self->header->count, 0);
+
+    if (search.best >= self->header->count) return NULL;
+
+    if (distance_km)
+    {
+        /* Chord length back to arc length on a 6371 km sphere */
+        float chord = sqrtf(search.best_d2);
+        *distance_km = 2.0f * 6371.0f * asinf(fminf(chord / 2.0f, 1.0f));
+    }
+
+    return &self->records[search.best];
+}
+
+const char *city_catalog_name(const city_catalog_t *self, const city_record_t *record)
+{
+    if (!self || !self->loaded || !record) return NULL;
+    if (record->display >= self->header->display_size) return NULL;
+
+    return self->display + record->display;
+}
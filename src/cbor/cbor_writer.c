@@ -0,0 +1,197 @@
+/**
+ * Implementation-file: cbor_writer.c
+ *
+ * Every item starts with a head: the major type in the top three bits and
+ * either the value itself (below 24) or the width of the big-endian value
+ * that follows. The width comes from the highest set bit through a table,
+ * and the value is stored as one byte-swapped word of which only the low
+ * bytes are kept, so encoding a number does not branch on its size.
+ **/
+
+#include "../../include/cbor/cbor_writer.h"
+#include <string.h>
+
+#define CBOR_MAJOR_UINT   0
+#define CBOR_MAJOR_NEGINT 1
+#define CBOR_MAJOR_TEXT   3
+#define CBOR_MAJOR_ARRAY  4
+#define CBOR_MAJOR_MAP    5
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_FALSE       0xf4
+#define CBOR_TRUE        0xf5
+#define CBOR_NULL        0xf6
+#define CBOR_INDEFINITE  31
+#define CBOR_BREAK       0xff
+
+/**
+ * Bytes after the head, by the bit length of the value. Values below 24
+ * fit in the head itself whatever the table says.
+ **/
+static const uint8_t cbor_widths[65] =
+{
+    0, 0, 0, 0, 0, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8
+};
+
+/* Additional information for a head followed by 1, 2, 4 or 8 bytes */
+static const uint8_t cbor_width_info[9] = { 0, 24, 25, 0, 26, 0, 0, 0, 27 };
+
+void cbor_writer_init(cbor_writer_t *self, void *out, size_t size)
+{
+    if (!self) return;
+
+    self->out = out;
+    self->size = size;
+    self->len = 0;
+    self->overflow = !out || size == 0;
+}
+
+/**
+ * Carries on with the same item in a fresh buffer, for responses sent
+ * in pieces
+ **/
+void cbor_writer_rebuffer(cbor_writer_t *self, void *out, size_t size)
+{
+    cbor_writer_init(self, out, size);
+}
+
+/**
+ * Returns the encoded length, 0 if it did not fit
+ **/
+size_t cbor_writer_finish(const cbor_writer_t *self)
+{
+    if (!self || self->overflow) return 0;
+
+    return self->len;
+}
+
+static void cbor_put(cbor_writer_t *self, const void *data, size_t len)
+{
+    if (self->overflow) return;
+
+    if (len > self->size - self->len)
+    {
+        self->overflow = 1;
+        return;
+    }
+
+    memcpy(self->out + self->len, data, len);
+    self->len += len;
+}
+
+static void cbor_head(cbor_writer_t *self, uint8_t major, uint64_t value)
+{
+    uint8_t bits = value ? (uint8_t)(64 - __builtin_clzll(value)) : 0;
+    uint8_t width = value < 24 ? 0 : cbor_widths[bits];
+
+    uint8_t head[9];
+    uint8_t big[8];
+    uint64_t swapped = __builtin_bswap64(value);
+    memcpy(big, &swapped, sizeof(big));
+
+    head[0] = (uint8_t)((major << 5) | (width ? cbor_width_info[width] : value));
+    memcpy(head + 1, big + 8 - width, width);
+
+    cbor_put(self, head, 1 + (size_t)width);
+}
+
+void cbor_uint(cbor_writer_t *self, uint64_t value)
+{
+    if (self) cbor_head(self, CBOR_MAJOR_UINT, value);
+}
+
+/**
+ * Negative n is encoded as -1 - n, which is ~n for two's complement
+ **/
+void cbor_int(cbor_writer_t *self, int64_t value)
+{
+    if (!self) return;
+
+    uint64_t sign = (uint64_t)(value >> 63);
+    cbor_head(self, (uint8_t)(sign & CBOR_MAJOR_NEGINT), (uint64_t)value ^ sign);
+}
+
+void cbor_text_n(cbor_writer_t *self, const char *value, size_t len)
+{
+    if (!self) return;
+
+    if (!value) len = 0;
+
+    cbor_head(self, CBOR_MAJOR_TEXT, len);
+    cbor_put(self, value, len);
+}
+
+void cbor_text(cbor_writer_t *self, const char *value)
+{
+    cbor_text_n(self, value, value ? strlen(value) : 0);
+}
+
+void cbor_bool(cbor_writer_t *self, int value)
+{
+    if (!self) return;
+
+    uint8_t byte = value ? CBOR_TRUE : CBOR_FALSE;
+    cbor_put(self, &byte, 1);
+}
+
+void cbor_null(cbor_writer_t *self)
+{
+    if (!self) return;
+
+    uint8_t byte = CBOR_NULL;
+    cbor_put(self, &byte, 1);
+}
+
+void cbor_map(cbor_writer_t *self, uint64_t pairs)
+{
+    if (self) cbor_head(self, CBOR_MAJOR_MAP, pairs);
+}
+
+void cbor_array(cbor_writer_t *self, uint64_t items)
+{
+    if (self) cbor_head(self, CBOR_MAJOR_ARRAY, items);
+}
+
+void cbor_array_begin(cbor_writer_t *self)
+{
+    if (!self) return;
+
+    uint8_t byte = (CBOR_MAJOR_ARRAY << 5) | CBOR_INDEFINITE;
+    cbor_put(self, &byte, 1);
+}
+
+void cbor_break(cbor_writer_t *self)
+{
+    if (!self) return;
+
+    uint8_t byte = CBOR_BREAK;
+    cbor_put(self, &byte, 1);
+}
+
+void cbor_key_uint(cbor_writer_t *self, uint64_t key, uint64_t value)
+{
+    cbor_uint(self, key);
+    cbor_uint(self, value);
+}
+
+void cbor_key_int(cbor_writer_t *self, uint64_t key, int64_t value)
+{
+    cbor_uint(self, key);
+    cbor_int(self, value);
+}
+
+void cbor_key_text(cbor_writer_t *self, uint64_t key, const char *value)
+{
+    cbor_uint(self, key);
+    cbor_text(self, value);
+}
+
+void cbor_key_bool(cbor_writer_t *self, uint64_t key, int value)
+{
+    cbor_uint(self, key);
+    cbor_bool(self, value);
+}
@@ -58,8 +58,14 @@ int8_t event_watcher_dereg_fd(int fd)
 		if (g_event_watcher.fds[i] == fd)
 		{
 			g_event_watcher.fds[i] = g_event_watcher.fds[g_event_watcher.fd_count - 1]; // i = last element
+			g_event_watcher.want_write[i] = g_event_watcher.want_write[g_event_watcher.fd_count - 1];
 			g_event_watcher.fds[g_event_watcher.fd_count - 1] = -1; // fd = -1, inactive
+			g_event_watcher.want_write[g_event_watcher.fd_count - 1] = 0;
 			g_event_watcher.fd_count--;
+
+			/* The number may come back for another socket before the next select */
+			FD_CLR(fd, &g_event_watcher.ready_read);
+			FD_CLR(fd, &g_event_watcher.ready_write);
 			LOG_DEBUG("[EVENT_WATCHER] >> Unregistered fd=%d\n", fd);
 			return 0;
 		}
@@ -68,6 +74,25 @@ int8_t event_watcher_dereg_fd(int fd)
 	return -1; 
 }
 
+/**
+ * Adds a registered fd to, or takes it off, the write set
+ **/
+int8_t event_watcher_want_write(int fd, uint8_t want)
+{
+	if (fd < 0) return -1;
+
+	for (int i = 0; i < g_event_watcher.fd_count; i++)
+	{
+		if (g_event_watcher.fds[i] == fd)
+		{
+			g_event_watcher.want_write[i] = want;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
 /**
  * Returns 1 if fd ready or at timeout
  **/
@@ -77,12 +102,14 @@ int event_watcher_ready(void)
 	 * A  structure  type that can represent a set of file descriptors.
 	 **/
 	fd_set readfds;
+	fd_set writefds;
 	
 	/**
 	 * This  macro  clears (removes all file descriptors from) set.  It should
 	 * be employed as the first step in initializing a file descriptor set.
 	 **/
 	FD_ZERO(&readfds);
+	FD_ZERO(&writefds);
 
 	/**
 	 * nfds:
@@ -97,6 +124,7 @@ int event_watcher_ready(void)
 		if (fd >= 0)
 		{
 			FD_SET(fd, &readfds); // This macro adds the file descriptor fd to set
+			if (g_event_watcher.want_write[i]) FD_SET(fd, &writefds);
 			if (fd > max_fd) max_fd = fd;			
 		}
 	}
@@ -113,13 +141,21 @@ int event_watcher_ready(void)
 	/**
 	 * Will return n ready fds or 0 at timeout and -1 at error
 	 **/
-	int ready = select(max_fd + 1, &readfds, NULL, NULL, &timeout);
-	if (ready < 0 && errno != EINTR)
+	int ready = select(max_fd + 1, &readfds, &writefds, NULL, &timeout);
+	if (ready < 0)
 	{
+		FD_ZERO(&g_event_watcher.ready_read);
+		FD_ZERO(&g_event_watcher.ready_write);
+
+		if (errno == EINTR) return ready;
+
 		LOG_ERROR("[EVENT WATCHER] >> select failed\n %s", strerror(errno));
 		return -1;
 	}
 
+	g_event_watcher.ready_read = readfds;
+	g_event_watcher.ready_write = writefds;
+
 	if (ready > 0)
 	{
 		LOG_DEBUG("[EVENT WATCHER] >> FDs ready %d\n", ready);
@@ -127,3 +163,16 @@ int event_watcher_ready(void)
 	
 	return ready;
 }
+
+/**
+ * Whether the last select() found fd readable, or writable
+ **/
+int event_watcher_readable(int fd)
+{
+	return fd >= 0 && FD_ISSET(fd, &g_event_watcher.ready_read);
+}
+
+int event_watcher_writable(int fd)
+{
+	return fd >= 0 && FD_ISSET(fd, &g_event_watcher.ready_write);
+}
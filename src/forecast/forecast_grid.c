@@ -0,0 +1,394 @@
+/**
+ * Implementation-file: forecast_grid.c
+ *
+ * Bilinear interpolation of a tiled model grid. A point query reads four
+ * contiguous hour runs and blends them with fixed weights, eight hours
+ * per AVX2 step when the CPU has it.
+ **/
+
+#include "../../include/forecast/forecast_grid.h"
+#include "../../include/logging/logging.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FORECAST_GRID_HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define FORECAST_GRID_HAVE_AVX2 0
+#endif
+
+/**
+ * Blends four runs of n values: out = w0*a + w1*b + w2*c + w3*d, rounded
+ * to nearest. Vector and scalar versions add in the same order and give
+ * identical results.
+ **/
+typedef struct forecast_grid_kernels
+{
+    void (*blend_i16)(const int16_t *const runs[4], const float weights[4], size_t n, int16_t *out);
+    void (*blend_u16)(const uint16_t *const runs[4], const float weights[4], size_t n, uint16_t *out);
+    void (*blend_u8)(const uint8_t *const runs[4], const float weights[4], size_t n, uint8_t *out);
+} forecast_grid_kernels_t;
+
+static void forecast_grid_blend_i16_scalar(const int16_t *const runs[4], const float weights[4], size_t n,
+                                           int16_t *out)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        float v = weights[0] * runs[0][i];
+        v += weights[1] * runs[1][i];
+        v += weights[2] * runs[2][i];
+        v += weights[3] * runs[3][i];
+        out[i] = (int16_t)lrintf(v);
+    }
+}
+
+static void forecast_grid_blend_u16_scalar(const uint16_t *const runs[4], const float weights[4], size_t n,
+                                           uint16_t *out)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        float v = weights[0] * runs[0][i];
+        v += weights[1] * runs[1][i];
+        v += weights[2] * runs[2][i];
+        v += weights[3] * runs[3][i];
+        out[i] = (uint16_t)lrintf(v);
+    }
+}
+
+static void forecast_grid_blend_u8_scalar(const uint8_t *const runs[4], const float weights[4], size_t n,
+                                          uint8_t *out)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        float v = weights[0] * runs[0][i];
+        v += weights[1] * runs[1][i];
+        v += weights[2] * runs[2][i];
+        v += weights[3] * runs[3][i];
+        out[i] = (uint8_t)lrintf(v);
+    }
+}
+
+static const forecast_grid_kernels_t g_scalar_kernels =
+{
+    forecast_grid_blend_i16_scalar,
+    forecast_grid_blend_u16_scalar,
+    forecast_grid_blend_u8_scalar
+};
+
+#if FORECAST_GRID_HAVE_AVX2
+
+/* Eight hours widened to float lanes */
+#define FORECAST_GRID_LOAD_I16(p) _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(p))))
+#define FORECAST_GRID_LOAD_U16(p) _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p))))
+#define FORECAST_GRID_LOAD_U8(p)  _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p))))
+
+__attribute__((target("avx2")))
+static __m256i forecast_grid_blend8(__m256 a, __m256 b, __m256 c, __m256 d, const __m256 w[4])
+{
+    __m256 v = _mm256_mul_ps(w[0], a);
+    v = _mm256_add_ps(v, _mm256_mul_ps(w[1], b));
+    v = _mm256_add_ps(v, _mm256_mul_ps(w[2], c));
+    v = _mm256_add_ps(v, _mm256_mul_ps(w[3], d));
+
+    /* Default rounding mode, same as lrintf */
+    return _mm256_cvtps_epi32(v);
+}
+
+__attribute__((target("avx2")))
+static void forecast_grid_blend_i16_avx2(const int16_t *const runs[4], const float weights[4], size_t n,
+                                         int16_t *out)
+{
+    const __m256 w[4] = { _mm256_set1_ps(weights[0]), _mm256_set1_ps(weights[1]),
+                          _mm256_set1_ps(weights[2]), _mm256_set1_ps(weights[3]) };
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i r = forecast_grid_blend8(FORECAST_GRID_LOAD_I16(runs[0] + i), FORECAST_GRID_LOAD_I16(runs[1] + i),
+                                         FORECAST_GRID_LOAD_I16(runs[2] + i), FORECAST_GRID_LOAD_I16(runs[3] + i), w);
+
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+    }
+
+    const int16_t *const tail[4] = { runs[0] + i, runs[1] + i, runs[2] + i, runs[3] + i };
+    forecast_grid_blend_i16_scalar(tail, weights, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void forecast_grid_blend_u16_avx2(const uint16_t *const runs[4], const float weights[4], size_t n,
+                                         uint16_t *out)
+{
+    const __m256 w[4] = { _mm256_set1_ps(weights[0]), _mm256_set1_ps(weights[1]),
+                          _mm256_set1_ps(weights[2]), _mm256_set1_ps(weights[3]) };
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i r = forecast_grid_blend8(FORECAST_GRID_LOAD_U16(runs[0] + i), FORECAST_GRID_LOAD_U16(runs[1] + i),
+                                         FORECAST_GRID_LOAD_U16(runs[2] + i), FORECAST_GRID_LOAD_U16(runs[3] + i), w);
+
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_packus_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+    }
+
+    const uint16_t *const tail[4] = { runs[0] + i, runs[1] + i, runs[2] + i, runs[3] + i };
+    forecast_grid_blend_u16_scalar(tail, weights, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void forecast_grid_blend_u8_avx2(const uint8_t *const runs[4], const float weights[4], size_t n,
+                                        uint8_t *out)
+{
+    const __m256 w[4] = { _mm256_set1_ps(weights[0]), _mm256_set1_ps(weights[1]),
+                          _mm256_set1_ps(weights[2]), _mm256_set1_ps(weights[3]) };
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i r = forecast_grid_blend8(FORECAST_GRID_LOAD_U8(runs[0] + i), FORECAST_GRID_LOAD_U8(runs[1] + i),
+                                         FORECAST_GRID_LOAD_U8(runs[2] + i), FORECAST_GRID_LOAD_U8(runs[3] + i), w);
+
+        __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+        _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(words, words));
+    }
+
+    const uint8_t *const tail[4] = { runs[0] + i, runs[1] + i, runs[2] + i, runs[3] + i };
+    forecast_grid_blend_u8_scalar(tail, weights, n - i, out + i);
+}
+
+static const forecast_grid_kernels_t g_avx2_kernels =
+{
+    forecast_grid_blend_i16_avx2,
+    forecast_grid_blend_u16_avx2,
+    forecast_grid_blend_u8_avx2
+};
+
+#endif /* FORECAST_GRID_HAVE_AVX2 */
+
+static const forecast_grid_kernels_t *g_kernels = NULL;
+
+static const forecast_grid_kernels_t *forecast_grid_kernels(void)
+{
+    if (!g_kernels)
+    {
+        g_kernels = &g_scalar_kernels;
+
+#if FORECAST_GRID_HAVE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) g_kernels = &g_avx2_kernels;
+#endif
+
+        LOG_INFO("[GRID] Using %s interpolation", g_kernels == &g_scalar_kernels ? "scalar" : "avx2");
+    }
+
+    return g_kernels;
+}
+
+static int forecast_grid_section_ok(size_t size, uint64_t offset, uint64_t length)
+{
+    return (offset % 64) == 0 && offset <= size && length <= size - offset;
+}
+
+int8_t forecast_grid_open(forecast_grid_t *self, const char *path)
+{
+    if (!self || !path) return -1;
+
+    memset(self, 0, sizeof(*self));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_WARN("[GRID] Cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(forecast_grid_header_t))
+    {
+        LOG_ERROR("[GRID] %s is too small", path);
+        close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR("[GRID] mmap failed: %s", strerror(errno));
+        return -1;
+    }
+
+    const forecast_grid_header_t *header = base;
+    size_t size = st.st_size;
+    uint64_t tile = header->tile;
+    uint64_t cells = (uint64_t)header->tiles_x * header->tiles_y * tile * tile * header->hours;
+
+    if (memcmp(header->magic, FORECAST_GRID_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != FORECAST_GRID_VERSION ||
+        header->hours == 0 || header->hours > FORECAST_GRID_MAX_HOURS ||
+        header->rows < 2 || header->cols < 2 || tile == 0 ||
+        !(header->resolution > 0.0f) ||
+        (uint64_t)header->tiles_x * tile < header->cols ||
+        (uint64_t)header->tiles_y * tile < header->rows ||
+        header->file_size != size ||
+        !forecast_grid_section_ok(size, header->temperature_offset, cells * sizeof(int16_t)) ||
+        !forecast_grid_section_ok(size, header->wind_offset, cells * sizeof(uint16_t)) ||
+        !forecast_grid_section_ok(size, header->humidity_offset, cells) ||
+        !forecast_grid_section_ok(size, header->condition_offset, cells))
+    {
+        LOG_ERROR("[GRID] %s is not a valid forecast grid", path);
+        munmap(base, size);
+        return -1;
+    }
+
+    self->base        = base;
+    self->size        = size;
+    self->header      = header;
+    self->temperature = (const int16_t *)(self->base + header->temperature_offset);
+    self->wind        = (const uint16_t *)(self->base + header->wind_offset);
+    self->humidity    = self->base + header->humidity_offset;
+    self->condition   = self->base + header->condition_offset;
+    self->loaded      = 1;
+
+    forecast_grid_kernels();
+
+    LOG_INFO("[GRID] Mapped %ux%u points at %.2f° x %u hours from %s (%zu bytes)",
+             header->rows, header->cols, header->resolution, header->hours, path, size);
+    return 0;
+}
+
+void forecast_grid_close(forecast_grid_t *self)
+{
+    if (!self || !self->loaded) return;
+
+    munmap((void *)self->base, self->size);
+    memset(self, 0, sizeof(*self));
+}
+
+/**
+ * Hour of the run covering now, clamped to the hours the run has
+ **/
+uint32_t forecast_grid_hour(const forecast_grid_t *self, time_t now)
+{
+    if (!self || !self->loaded || now <= self->header->base_time) return 0;
+
+    int64_t hour = (now - self->header->base_time) / 3600;
+    if (hour >= self->header->hours) return self->header->hours - 1;
+
+    return (uint32_t)hour;
+}
+
+/**
+ * First value of a grid point's hour run in every section
+ **/
+static size_t forecast_grid_cell(const forecast_grid_header_t *header, uint32_t row, uint32_t col)
+{
+    uint32_t tile = header->tile;
+    size_t index = (size_t)(row / tile) * header->tiles_x + col / tile;
+
+    return (index * tile * tile + (size_t)(row % tile) * tile + col % tile) * header->hours;
+}
+
+/**
+ * Grid coordinate along one axis: the lower neighbour and the fraction
+ * towards the next one. Wraps when the axis spans the globe.
+ **/
+static void forecast_grid_axis(float position, uint32_t count, int wrap, uint32_t *lower, uint32_t *upper,
+                               float *fraction)
+{
+    if (wrap)
+    {
+        position = fmodf(position, (float)count);
+        if (position < 0.0f) position += (float)count;
+    }
+    else
+    {
+        if (!(position > 0.0f)) position = 0.0f;
+        if (position > (float)(count - 1)) position = (float)(count - 1);
+    }
+
+    uint32_t index = (uint32_t)position;
+    if (index >= count) index = count - 1;
+    if (!wrap && index >= count - 1) index = count - 2;
+
+    *lower = index;
+    *upper = wrap ? (index + 1) % count : index + 1;
+    *fraction = position - (float)index;
+}
+
+/**
+ * Fills out with hours values from first_hour on at lat/lon, -1 when
+ * the grid has no such hour
+ **/
+int8_t forecast_grid_interpolate(const forecast_grid_t *self, float lat, float lon, uint32_t first_hour,
+                                 uint32_t hours, forecast_grid_point_t *out)
+{
+    if (!self || !self->loaded || !out) return -1;
+
+    const forecast_grid_header_t *header = self->header;
+    if (first_hour >= header->hours || hours == 0) return -1;
+
+    if (hours > header->hours - first_hour) hours = header->hours - first_hour;
+    if (hours > FORECAST_GRID_MAX_HOURS) hours = FORECAST_GRID_MAX_HOURS;
+
+    int wrap = (float)header->cols * header->resolution >= 359.999f;
+    uint32_t r0, r1, c0, c1;
+    float ty, tx;
+
+    forecast_grid_axis((lat - header->lat0) / header->resolution, header->rows, 0, &r0, &r1, &ty);
+    forecast_grid_axis((lon - header->lon0) / header->resolution, header->cols, wrap, &c0, &c1, &tx);
+
+    size_t cells[4] =
+    {
+        forecast_grid_cell(header, r0, c0) + first_hour,
+        forecast_grid_cell(header, r0, c1) + first_hour,
+        forecast_grid_cell(header, r1, c0) + first_hour,
+        forecast_grid_cell(header, r1, c1) + first_hour
+    };
+
+    const float weights[4] =
+    {
+        (1.0f - tx) * (1.0f - ty),
+        tx * (1.0f - ty),
+        (1.0f - tx) * ty,
+        tx * ty
+    };
+
+    const forecast_grid_kernels_t *kernels = forecast_grid_kernels();
+
+    const int16_t *const temperature[4] = { self->temperature + cells[0], self->temperature + cells[1],
+                                            self->temperature + cells[2], self->temperature + cells[3] };
+    const uint16_t *const wind[4] = { self->wind + cells[0], self->wind + cells[1],
+                                      self->wind + cells[2], self->wind + cells[3] };
+    const uint8_t *const humidity[4] = { self->humidity + cells[0], self->humidity + cells[1],
+                                         self->humidity + cells[2], self->humidity + cells[3] };
+
+    kernels->blend_i16(temperature, weights, hours, out->temperature);
+    kernels->blend_u16(wind, weights, hours, out->wind);
+    kernels->blend_u8(humidity, weights, hours, out->humidity);
+
+    /* Categories do not blend, take the heaviest corner */
+    int nearest = 0;
+    for (int i = 1; i < 4; i++)
+    {
+        if (weights[i] > weights[nearest]) nearest = i;
+    }
+
+    memcpy(out->condition, self->condition + cells[nearest], hours);
+
+    out->hours = hours;
+    out->start = header->base_time + (int64_t)first_hour * 3600;
+    out->nearest_lat = header->lat0 + (float)(nearest < 2 ? r0 : r1) * header->resolution;
+    out->nearest_lon = header->lon0 + (float)(nearest % 2 == 0 ? c0 : c1) * header->resolution;
+    if (out->nearest_lon >= 180.0f) out->nearest_lon -= 360.0f;
+
+    return 0;
+}
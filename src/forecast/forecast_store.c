@@ -0,0 +1,138 @@
+/**
+ * Implementation-file: forecast_store.c
+ **/
+
+#include "../../include/forecast/forecast_store.h"
+#include "../../include/logging/logging.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char *g_condition_names[FORECAST_CONDITION_COUNT] =
+{
+    "Sunny", "Partly Cloudy", "Cloudy", "Rainy", "Snow", "Fog", "Thunderstorm"
+};
+
+static int forecast_store_section_ok(size_t size, uint32_t offset, size_t length)
+{
+    return (offset % 8) == 0 && offset <= size && length <= size - offset;
+}
+
+int8_t forecast_store_open(forecast_store_t *self, const char *path)
+{
+    if (!self || !path) return -1;
+
+    memset(self, 0, sizeof(*self));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_WARN("[FORECAST] Cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(forecast_store_header_t))
+    {
+        LOG_ERROR("[FORECAST] %s is too small", path);
+        close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR("[FORECAST] mmap failed: %s", strerror(errno));
+        return -1;
+    }
+
+    const forecast_store_header_t *header = base;
+    size_t size = st.st_size;
+    size_t cells = (size_t)header->city_count * header->hours;
+
+    if (memcmp(header->magic, FORECAST_STORE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != FORECAST_STORE_VERSION ||
+        header->hours == 0 ||
+        header->file_size != size ||
+        !forecast_store_section_ok(size, header->city_ids_offset, header->city_count * sizeof(uint32_t)) ||
+        !forecast_store_section_ok(size, header->temperature_offset, cells * sizeof(int16_t)) ||
+        !forecast_store_section_ok(size, header->wind_offset, cells * sizeof(uint16_t)) ||
+        !forecast_store_section_ok(size, header->humidity_offset, cells) ||
+        !forecast_store_section_ok(size, header->condition_offset, cells))
+    {
+        LOG_ERROR("[FORECAST] %s is not a valid forecast store", path);
+        munmap(base, size);
+        return -1;
+    }
+
+    self->base        = base;
+    self->size        = size;
+    self->header      = header;
+    self->city_ids    = (const uint32_t *)(self->base + header->city_ids_offset);
+    self->temperature = (const int16_t *)(self->base + header->temperature_offset);
+    self->wind        = (const uint16_t *)(self->base + header->wind_offset);
+    self->humidity    = self->base + header->humidity_offset;
+    self->condition   = self->base + header->condition_offset;
+    self->loaded      = 1;
+
+    LOG_INFO("[FORECAST] Mapped %u cities x %u hours from %s (%zu bytes)",
+             header->city_count, header->hours, path, size);
+    return 0;
+}
+
+void forecast_store_close(forecast_store_t *self)
+{
+    if (!self || !self->loaded) return;
+
+    munmap((void *)self->base, self->size);
+    memset(self, 0, sizeof(*self));
+}
+
+int32_t forecast_store_row(const forecast_store_t *self, uint32_t city_id)
+{
+    if (!self || !self->loaded) return -1;
+
+    uint32_t lo = 0;
+    uint32_t hi = self->header->city_count;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (self->city_ids[mid] == city_id) return (int32_t)mid;
+        if (self->city_ids[mid] < city_id) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return -1;
+}
+
+/**
+ * Hour of the run covering now, clamped to the hours the run has
+ **/
+uint32_t forecast_store_hour(const forecast_store_t *self, time_t now)
+{
+    if (!self || !self->loaded || now <= self->header->base_time) return 0;
+
+    int64_t hour = (now - self->header->base_time) / 3600;
+    if (hour >= self->header->hours) return self->header->hours - 1;
+
+    return (uint32_t)hour;
+}
+
+size_t forecast_store_index(const forecast_store_t *self, uint32_t row, uint32_t hour)
+{
+    return (size_t)row * self->header->hours + hour;
+}
+
+const char *forecast_condition_name(uint8_t condition)
+{
+    if (condition >= FORECAST_CONDITION_COUNT) return "Unknown";
+
+    return g_condition_names[condition];
+}
@@ -0,0 +1,1216 @@
+/**
+ * Implementation-file: http2.c
+ *
+ * HTTP/2 over cleartext (RFC 9113) on a connection slot: by prior
+ * knowledge, the client preface where a request line would be, or by
+ * Upgrade: h2c, where the upgrading request becomes stream 1. Every
+ * stream is a request of its own to the weather layer, through the same
+ * callbacks an HTTP/1.1 connection gets, so answers come back in any
+ * order. Output is framed into the slot's response buffer, taking turns
+ * over the streams with something to send; the flow control windows
+ * only ever hold back response bodies, request bodies are consumed as
+ * they arrive and credited back right away.
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#include "../../include/http/http2.h"
+#include "../../include/http/http_server.h"
+#include "../../include/weather/weather_server.h"
+#include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/logging/logging.h"
+
+#define HTTP2_FLAG_ACK         0x01
+#define HTTP2_FLAG_END_STREAM  0x01
+#define HTTP2_FLAG_END_HEADERS 0x04
+#define HTTP2_FLAG_PADDED      0x08
+#define HTTP2_FLAG_PRIORITY    0x20
+
+#define HTTP2_SETTINGS_ENABLE_PUSH         0x2
+#define HTTP2_SETTINGS_MAX_CONCURRENT      0x3
+#define HTTP2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define HTTP2_SETTINGS_MAX_FRAME_SIZE      0x5
+#define HTTP2_SETTINGS_MAX_HEADER_LIST     0x6
+
+#define HTTP2_MAX_WINDOW 0x7FFFFFFF
+
+static uint32_t http2_get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void http2_put32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static http2_stream_t *http2_streams(http2_connection_t *self)
+{
+    return self->conn->parent->child_http2_stream;
+}
+
+static weather_server_t *http2_weather(http2_connection_t *self)
+{
+    return self->conn->parent->upper_weather_server_layer;
+}
+
+/**
+ * Queues one frame behind what the slot has not sent yet, -1 when it
+ * does not fit
+ **/
+static int8_t http2_queue_frame(http2_connection_t *self, uint8_t type, uint8_t flags, uint32_t stream_id,
+                                const void *payload, size_t len)
+{
+    uint8_t *out = (uint8_t *)http_connection_reserve(self->conn, HTTP2_FRAME_HEADER_SIZE + len);
+    if (!out) return -1;
+
+    out[0] = (uint8_t)(len >> 16);
+    out[1] = (uint8_t)(len >> 8);
+    out[2] = (uint8_t)len;
+    out[3] = type;
+    out[4] = flags;
+    http2_put32(out + 5, stream_id & HTTP2_MAX_WINDOW);
+
+    if (len > 0) memcpy(out + HTTP2_FRAME_HEADER_SIZE, payload, len);
+    return 0;
+}
+
+/**
+ * Control frames are small; a client that leaves no room for one is not
+ * reading and the connection closes
+ **/
+static void http2_send_control(http2_connection_t *self, uint8_t type, uint8_t flags, uint32_t stream_id,
+                               const void *payload, size_t len)
+{
+    if (http2_queue_frame(self, type, flags, stream_id, payload, len) != 0)
+    {
+        LOG_WARN("[HTTP2] fd=%d not reading its frames, closing", self->conn->fd);
+        self->closing = 1;
+    }
+}
+
+/**
+ * Ends the connection: streams already opened are not answered, the
+ * client learns which ones from the last stream id
+ **/
+static void http2_goaway(http2_connection_t *self, uint32_t error)
+{
+    uint8_t payload[8];
+
+    if (self->closing) return;
+
+    LOG_INFO("[HTTP2] GOAWAY fd=%d error=%u", self->conn->fd, error);
+
+    http2_put32(payload, self->last_stream_id);
+    http2_put32(payload + 4, error);
+    http2_send_control(self, HTTP2_GOAWAY, 0, 0, payload, sizeof(payload));
+    self->closing = 1;
+}
+
+static void http2_rst_stream(http2_connection_t *self, uint32_t stream_id, uint32_t error)
+{
+    uint8_t payload[4];
+
+    http2_put32(payload, error);
+    http2_send_control(self, HTTP2_RST_STREAM, 0, stream_id, payload, sizeof(payload));
+}
+
+static void http2_window_update(http2_connection_t *self, uint32_t stream_id, uint32_t increment)
+{
+    uint8_t payload[4];
+
+    http2_put32(payload, increment);
+    http2_send_control(self, HTTP2_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+static void http2_stream_on_handled_request(http_exchange_t *exchange, const http_connection_reply_t *reply);
+static int8_t http2_stream_on_stream(http_exchange_t *exchange, uint16_t status, const char *content_type,
+                                     const char *data, size_t len, uint8_t last);
+static int8_t http2_stream_on_frame(http_exchange_t *exchange, const char *frame, size_t len);
+
+static http2_stream_t *http2_stream_find(http2_connection_t *self, uint32_t id)
+{
+    http2_stream_t *streams = http2_streams(self);
+
+    for (int i = 0; i < HTTP2_MAX_STREAMS; i++)
+    {
+        if (streams[i].parent == self && streams[i].id == id) return &streams[i];
+    }
+
+    return NULL;
+}
+
+static http2_stream_t *http2_stream_open(http2_connection_t *self, uint32_t id)
+{
+    http2_stream_t *streams = http2_streams(self);
+
+    if (self->active >= HTTP2_MAX_CONCURRENT_STREAMS) return NULL;
+
+    for (int i = 0; i < HTTP2_MAX_STREAMS; i++)
+    {
+        http2_stream_t *stream = &streams[i];
+        if (stream->parent) continue;
+
+        /* The out buffer is written before it is read, no need to clear it */
+        memset(stream, 0, offsetof(http2_stream_t, out));
+
+        stream->exchange.request = &stream->request;
+        stream->exchange.fd = -1;
+        stream->exchange.cb_from_weather_layer.weather_on_handled_request = http2_stream_on_handled_request;
+        stream->exchange.cb_from_weather_layer.weather_on_stream = http2_stream_on_stream;
+        stream->exchange.cb_from_weather_layer.weather_on_frame = http2_stream_on_frame;
+
+        stream->parent = self;
+        stream->id = id;
+        stream->window = self->initial_window;
+        strcpy(stream->request.version, "HTTP/2");
+
+        self->active++;
+        return stream;
+    }
+
+    LOG_WARN("[HTTP2] Stream pool full");
+    return NULL;
+}
+
+/**
+ * Gives the stream back. One the weather layer still owes something is
+ * detached from it first, so nothing calls back into a recycled stream.
+ **/
+static void http2_stream_release(http2_stream_t *stream)
+{
+    http2_connection_t *self = stream->parent;
+    weather_server_t *weather = http2_weather(self);
+
+    if ((stream->waiting || stream->receiving) && weather)
+    {
+        weather_server_detach_http_connection(weather, &stream->exchange);
+    }
+
+    stream->parent = NULL;
+    self->active--;
+}
+
+static int8_t http2_put_header(uint8_t *out, size_t size, size_t *o, http_hpack_name_t name, const char *value)
+{
+    size_t n = http_hpack_encode_header(name, value, strlen(value), out + *o, size - *o);
+    if (n == 0) return -1;
+
+    *o += n;
+    return 0;
+}
+
+/**
+ * Starts an answer: the HEADERS block at the front of out, the body
+ * follows it. content_length < 0 leaves the length out, for streamed
+ * answers.
+ **/
+static int8_t http2_stream_begin(http2_stream_t *self, uint16_t status, const char *content_type,
+                                 const char *content_encoding, const char *etag, int32_t max_age,
+                                 long content_length)
+{
+    uint8_t *out = self->out;
+    size_t size = sizeof(self->out);
+    size_t o = http_hpack_encode_status(status, out, size);
+    char value[32];
+    int8_t failed = o == 0;
+
+    if (content_type && status != 304)
+    {
+        failed |= http2_put_header(out, size, &o, HTTP_HPACK_CONTENT_TYPE, content_type);
+    }
+
+    if (content_encoding && status != 304)
+    {
+        failed |= http2_put_header(out, size, &o, HTTP_HPACK_CONTENT_ENCODING, content_encoding);
+    }
+
+    if (etag)
+    {
+        if (max_age >= 0) snprintf(value, sizeof(value), "max-age=%d", (int)max_age);
+        else snprintf(value, sizeof(value), "no-cache");
+
+        failed |= http2_put_header(out, size, &o, HTTP_HPACK_ETAG, etag);
+        failed |= http2_put_header(out, size, &o, HTTP_HPACK_CACHE_CONTROL, value);
+    }
+
+    if (content_type) failed |= http2_put_header(out, size, &o, HTTP_HPACK_VARY, "Accept, Accept-Encoding");
+
+    if (content_length >= 0 && status != 304)
+    {
+        snprintf(value, sizeof(value), "%ld", content_length);
+        failed |= http2_put_header(out, size, &o, HTTP_HPACK_CONTENT_LENGTH, value);
+    }
+
+    if (failed) return -1;
+
+    self->answered = 1;
+    self->headers_pending = 1;
+    self->headers_len = o;
+    self->out_len = o;
+    self->out_sent = 0;
+    return 0;
+}
+
+/**
+ * A short text answer for requests the weather layer turned down, or
+ * that were over their client's rate
+ **/
+static void http2_stream_text(http2_stream_t *self, uint16_t status)
+{
+    char body[64];
+    int len = snprintf(body, sizeof(body), "%s\n", http_status_text(status));
+
+    self->waiting = 0;
+    self->receiving = 0;
+
+    if (http2_stream_begin(self, status, "text/plain", NULL, NULL, -1, len) != 0) return;
+
+    if (status == 429)
+    {
+        char retry_after[16];
+        snprintf(retry_after, sizeof(retry_after), "%d", HTTP_THROTTLED_RETRY_AFTER_S);
+        if (http2_put_header(self->out, sizeof(self->out), &self->out_len, HTTP_HPACK_RETRY_AFTER,
+                             retry_after) == 0)
+        {
+            self->headers_len = self->out_len;
+        }
+    }
+
+    memcpy(self->out + self->out_len, body, (size_t)len);
+    self->out_len += (size_t)len;
+    self->end_stream = 1;
+}
+
+static void http2_stream_on_handled_request(http_exchange_t *exchange, const http_connection_reply_t *reply)
+{
+    http2_stream_t *self = container_of(exchange, http2_stream_t, exchange);
+
+    if (!exchange || !reply || !reply->content_type || (!reply->body && reply->body_len > 0)) return;
+
+    if (!self->parent || !self->waiting)
+    {
+        LOG_WARN("[HTTP2] Late weather response for stream %u, ignoring", self->id);
+        return;
+    }
+
+    self->waiting = 0;
+    self->receiving = 0;
+
+    size_t body_len = reply->status == 304 ? 0 : reply->body_len;
+
+    if (http2_stream_begin(self, reply->status, reply->content_type, reply->content_encoding, reply->etag,
+                           reply->max_age, (long)body_len) != 0 ||
+        body_len > sizeof(self->out) - self->out_len)
+    {
+        LOG_ERROR("[HTTP2] Response for stream %u does not fit", self->id);
+        http2_rst_stream(self->parent, self->id, HTTP2_INTERNAL_ERROR);
+        http2_stream_release(self);
+        return;
+    }
+
+    if (body_len > 0) memcpy(self->out + self->out_len, reply->body, body_len);
+    self->out_len += body_len;
+    self->end_stream = 1;
+}
+
+/**
+ * The next piece of a streamed answer, taken once the previous one is
+ * framed; -1 tells the weather layer to offer it again
+ **/
+static int8_t http2_stream_on_stream(http_exchange_t *exchange, uint16_t status, const char *content_type,
+                                     const char *data, size_t len, uint8_t last)
+{
+    http2_stream_t *self = container_of(exchange, http2_stream_t, exchange);
+
+    if (!exchange || !content_type || (!data && len > 0)) return -1;
+    if (!self->parent || !self->waiting || self->headers_pending || self->out_sent < self->out_len) return -1;
+
+    if (!self->answered)
+    {
+        if (http2_stream_begin(self, status, content_type, NULL, NULL, -1, -1) != 0) return -1;
+    }
+    else
+    {
+        self->out_len = 0;
+        self->out_sent = 0;
+    }
+
+    if (len > sizeof(self->out) - self->out_len)
+    {
+        LOG_ERROR("[HTTP2] Stream piece of %zu bytes does not fit", len);
+        return -1;
+    }
+
+    if (len > 0) memcpy(self->out + self->out_len, data, len);
+    self->out_len += len;
+
+    if (last)
+    {
+        self->waiting = 0;
+        self->end_stream = 1;
+    }
+
+    return 0;
+}
+
+/* WebSocket frames have no place on a stream */
+static int8_t http2_stream_on_frame(http_exchange_t *exchange, const char *frame, size_t len)
+{
+    (void)exchange;
+    (void)frame;
+    (void)len;
+    return -1;
+}
+
+/**
+ * Frames what the stream has ready within the windows. Returns -1 when
+ * the response buffer is full, the stream is done or waiting otherwise.
+ **/
+static int8_t http2_stream_write(http2_connection_t *self, http2_stream_t *stream)
+{
+    if (stream->headers_pending)
+    {
+        uint8_t flags = HTTP2_FLAG_END_HEADERS;
+        if (stream->end_stream && stream->out_len == stream->headers_len) flags |= HTTP2_FLAG_END_STREAM;
+
+        if (http2_queue_frame(self, HTTP2_HEADERS, flags, stream->id, stream->out, stream->headers_len) != 0)
+        {
+            return -1;
+        }
+
+        stream->headers_pending = 0;
+        stream->out_sent = stream->headers_len;
+        stream->finished = (flags & HTTP2_FLAG_END_STREAM) != 0;
+    }
+
+    while (stream->answered && !stream->finished)
+    {
+        size_t left = stream->out_len - stream->out_sent;
+        if (left == 0 && !stream->end_stream) break;
+
+        size_t chunk = left;
+        if (chunk > self->max_frame_size) chunk = self->max_frame_size;
+
+        if (chunk > 0)
+        {
+            if (stream->window <= 0 || self->window <= 0) break;
+            if (chunk > (size_t)stream->window) chunk = (size_t)stream->window;
+            if (chunk > (size_t)self->window) chunk = (size_t)self->window;
+        }
+
+        size_t room = http_connection_room(self->conn);
+        if (room <= HTTP2_FRAME_HEADER_SIZE) return -1;
+        if (chunk > room - HTTP2_FRAME_HEADER_SIZE) chunk = room - HTTP2_FRAME_HEADER_SIZE;
+
+        uint8_t flags = stream->end_stream && chunk == left ? HTTP2_FLAG_END_STREAM : 0;
+
+        http2_queue_frame(self, HTTP2_DATA, flags, stream->id, stream->out + stream->out_sent, chunk);
+
+        stream->out_sent += chunk;
+        stream->window -= (int32_t)chunk;
+        self->window -= (int32_t)chunk;
+        stream->finished = flags != 0;
+    }
+
+    if (stream->finished) http2_stream_release(stream);
+    return 0;
+}
+
+/**
+ * Takes turns over the streams with output, starting where the last
+ * pass ran out of room so every stream gets its share
+ **/
+static void http2_connection_schedule(http2_connection_t *self)
+{
+    http2_stream_t *streams = http2_streams(self);
+
+    for (int k = 0; k < HTTP2_MAX_STREAMS; k++)
+    {
+        uint16_t i = (uint16_t)((self->next_stream + k) % HTTP2_MAX_STREAMS);
+
+        if (streams[i].parent != self) continue;
+
+        if (http2_stream_write(self, &streams[i]) != 0)
+        {
+            self->next_stream = i;
+            return;
+        }
+    }
+}
+
+/**
+ * A chunk of request body to the weather layer, the last one is
+ * answered before the call returns
+ **/
+static void http2_stream_body(http2_stream_t *stream, const char *data, size_t len, uint8_t last)
+{
+    weather_server_t *weather = http2_weather(stream->parent);
+
+    if (last) stream->receiving = 0;
+
+    if (weather->cb_from_http_layer.http_on_request_body(weather, &stream->exchange, data, len, last) != 0)
+    {
+        LOG_WARN("[HTTP2] Body rejected by weather layer, stream %u", stream->id);
+        stream->receiving = 1;
+        http2_rst_stream(stream->parent, stream->id, HTTP2_CANCEL);
+        http2_stream_release(stream);
+    }
+}
+
+/**
+ * Hands a complete request to the weather layer, like an HTTP/1.1
+ * connection in PROCESSING. Cached answers come back before it returns.
+ **/
+static void http2_stream_dispatch(http2_stream_t *stream, uint8_t end_stream)
+{
+    weather_server_t *weather = http2_weather(stream->parent);
+
+    if (!weather)
+    {
+        http2_stream_text(stream, 503);
+        return;
+    }
+
+    stream->waiting = 1;
+
+    int8_t result = weather->cb_from_http_layer.http_on_new_request(weather, &stream->exchange,
+                                                                     &stream->request);
+
+    switch (result)
+    {
+        case WEATHER_REQUEST_ACCEPTED:
+            break;
+
+        case WEATHER_REQUEST_STREAM_BODY:
+            stream->receiving = 1;
+            if (end_stream) http2_stream_body(stream, "", 0, 1);
+            break;
+
+        case WEATHER_REQUEST_NOT_FOUND:
+            http2_stream_text(stream, 404);
+            break;
+
+        case WEATHER_REQUEST_BAD_REQUEST:
+        case WEATHER_REQUEST_UPGRADE:
+        case WEATHER_REQUEST_SUBSCRIBED:
+            http2_stream_text(stream, 400);
+            break;
+
+        default:
+            LOG_WARN("[HTTP2] Weather pool full");
+            http2_stream_text(stream, 503);
+            break;
+    }
+}
+
+static int http2_header_is(const char *name, size_t name_len, const char *expected)
+{
+    return name_len == strlen(expected) && memcmp(name, expected, name_len) == 0;
+}
+
+static void http2_copy_value(char *out, size_t size, const char *value, size_t len)
+{
+    if (len >= size) len = size - 1;
+
+    memcpy(out, value, len);
+    out[len] = '\0';
+}
+
+/**
+ * Fills the stream's request from the pseudo-headers and the headers
+ * the weather layer reads. ctx is NULL for blocks decoded only to keep
+ * the table in step, refused streams and trailers.
+ **/
+static int http2_stream_on_header(void *ctx, const char *name, size_t name_len, const char *value,
+                                  size_t value_len)
+{
+    http2_stream_t *stream = ctx;
+    if (!stream) return 0;
+
+    http_connection_request_t *req = &stream->request;
+
+    if (http2_header_is(name, name_len, ":method"))
+    {
+        http2_copy_value(req->method, sizeof(req->method), value, value_len);
+    }
+    else if (http2_header_is(name, name_len, ":path"))
+    {
+        const char *query = memchr(value, '?', value_len);
+        size_t path_len = query ? (size_t)(query - value) : value_len;
+        size_t query_len = query ? value_len - path_len - 1 : 0;
+
+        /* Refused rather than cut, as for HTTP/1.1 */
+        if (path_len >= sizeof(req->path) || query_len >= sizeof(req->query))
+        {
+            req->uri_too_long = 1;
+            return 0;
+        }
+
+        http2_copy_value(req->path, sizeof(req->path), value, path_len);
+        if (query) http2_copy_value(req->query, sizeof(req->query), query + 1, query_len);
+    }
+    else if (http2_header_is(name, name_len, "accept"))
+    {
+        http2_copy_value(req->accept, sizeof(req->accept), value, value_len);
+    }
+    else if (http2_header_is(name, name_len, "accept-encoding"))
+    {
+        http2_copy_value(req->accept_encoding, sizeof(req->accept_encoding), value, value_len);
+    }
+    else if (http2_header_is(name, name_len, "if-none-match"))
+    {
+        http2_copy_value(req->if_none_match, sizeof(req->if_none_match), value, value_len);
+    }
+    else if (http2_header_is(name, name_len, "content-length"))
+    {
+        size_t length = 0;
+
+        for (size_t i = 0; i < value_len; i++)
+        {
+            if (value[i] < '0' || value[i] > '9') return -1;
+            length = length * 10 + (size_t)(value[i] - '0');
+        }
+
+        req->content_length = length;
+    }
+
+    return 0;
+}
+
+/**
+ * A header block is complete: a new request, or trailers that end the
+ * body of one. Every block is decoded, whatever becomes of its stream,
+ * or the dynamic table would drift from the client's.
+ **/
+static void http2_headers_complete(http2_connection_t *self, uint32_t stream_id, uint8_t flags)
+{
+    http2_stream_t *stream = http2_stream_find(self, stream_id);
+    uint8_t opening = !stream && stream_id > self->last_stream_id;
+
+    if (opening)
+    {
+        self->last_stream_id = stream_id;
+        stream = http2_stream_open(self, stream_id);
+    }
+
+    if (http_hpack_decode(&self->decoder, self->block, self->block_len, self->scratch, sizeof(self->scratch),
+                          http2_stream_on_header, opening ? stream : NULL) != 0)
+    {
+        if (opening && stream) http2_stream_release(stream);
+        http2_goaway(self, HTTP2_COMPRESSION_ERROR);
+        return;
+    }
+
+    if (!opening)
+    {
+        if (!stream)
+        {
+            http2_goaway(self, HTTP2_STREAM_CLOSED);
+        }
+        else if (stream->receiving && (flags & HTTP2_FLAG_END_STREAM))
+        {
+            http2_stream_body(stream, "", 0, 1);
+        }
+
+        return;
+    }
+
+    if (!stream)
+    {
+        http2_rst_stream(self, stream_id, HTTP2_REFUSED_STREAM);
+        return;
+    }
+
+    if (stream->request.uri_too_long)
+    {
+        LOG_WARN("[HTTP2] Stream %u: request target too long", stream_id);
+        http2_stream_text(stream, 414);
+        return;
+    }
+
+    if (!stream->request.method[0] || !stream->request.path[0])
+    {
+        http2_rst_stream(self, stream_id, HTTP2_PROTOCOL_ERROR);
+        http2_stream_release(stream);
+        return;
+    }
+
+    LOG_INFO("[HTTP2] Stream %u: %s %s (query: %s)", stream_id, stream->request.method, stream->request.path,
+             stream->request.query[0] ? stream->request.query : "(none)");
+
+    /* Stream 1 came with the connection, which paid for it when accepted */
+    if (stream_id > 1 && http_server_take_token(self->conn->parent, self->conn->client_key) != 0)
+    {
+        LOG_WARN("[HTTP2] Stream %u over its client's rate", stream_id);
+        http2_stream_text(stream, 429);
+        return;
+    }
+
+    http2_stream_dispatch(stream, (flags & HTTP2_FLAG_END_STREAM) != 0);
+}
+
+/**
+ * Applies a SETTINGS payload, returns an error code for values the
+ * protocol does not allow
+ **/
+static uint32_t http2_apply_settings(http2_connection_t *self, const uint8_t *payload, size_t len)
+{
+    for (size_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t id = (uint16_t)(payload[i] << 8 | payload[i + 1]);
+        uint32_t value = http2_get32(payload + i + 2);
+
+        switch (id)
+        {
+            case HTTP2_SETTINGS_ENABLE_PUSH:
+                if (value > 1) return HTTP2_PROTOCOL_ERROR;
+                break;
+
+            case HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+            {
+                if (value > HTTP2_MAX_WINDOW) return HTTP2_FLOW_CONTROL_ERROR;
+
+                /* Open streams move by the difference, possibly below zero */
+                int32_t delta = (int32_t)value - self->initial_window;
+                http2_stream_t *streams = http2_streams(self);
+
+                for (int s = 0; s < HTTP2_MAX_STREAMS; s++)
+                {
+                    if (streams[s].parent == self) streams[s].window += delta;
+                }
+
+                self->initial_window = (int32_t)value;
+                break;
+            }
+
+            case HTTP2_SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 16777215) return HTTP2_PROTOCOL_ERROR;
+                self->max_frame_size = value;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return HTTP2_NO_ERROR;
+}
+
+static void http2_connection_frame(http2_connection_t *self, uint8_t type, uint8_t flags, uint32_t stream_id,
+                                   const uint8_t *payload, size_t len)
+{
+    if (self->continuation_stream && type != HTTP2_CONTINUATION)
+    {
+        http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    switch (type)
+    {
+        case HTTP2_DATA:
+        {
+            if (stream_id == 0)
+            {
+                http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+
+            size_t data_len = len;
+            const uint8_t *data = payload;
+
+            if (flags & HTTP2_FLAG_PADDED)
+            {
+                if (len < 1 || payload[0] >= len)
+                {
+                    http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                    return;
+                }
+
+                data = payload + 1;
+                data_len = len - 1 - payload[0];
+            }
+
+            /* Bodies are consumed as they come, the credit goes straight back */
+            if (len > 0) http2_window_update(self, 0, (uint32_t)len);
+
+            http2_stream_t *stream = http2_stream_find(self, stream_id);
+
+            if (!stream)
+            {
+                if (stream_id > self->last_stream_id) http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                else http2_rst_stream(self, stream_id, HTTP2_STREAM_CLOSED);
+                return;
+            }
+
+            if (len > 0 && !(flags & HTTP2_FLAG_END_STREAM)) http2_window_update(self, stream_id, (uint32_t)len);
+
+            if (stream->receiving)
+            {
+                http2_stream_body(stream, (const char *)data, data_len, (flags & HTTP2_FLAG_END_STREAM) != 0);
+            }
+
+            return;
+        }
+
+        case HTTP2_HEADERS:
+        {
+            if (stream_id == 0 || (stream_id & 1) == 0)
+            {
+                http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+
+            size_t pad = 0;
+
+            if (flags & HTTP2_FLAG_PADDED)
+            {
+                if (len < 1)
+                {
+                    http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                    return;
+                }
+
+                pad = payload[0];
+                payload++;
+                len--;
+            }
+
+            if (flags & HTTP2_FLAG_PRIORITY)
+            {
+                if (len < 5)
+                {
+                    http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                    return;
+                }
+
+                payload += 5;
+                len -= 5;
+            }
+
+            if (pad > len)
+            {
+                http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+
+            /* The fragment is collected like a continuation */
+            len -= pad;
+            self->block_len = 0;
+        }
+        /* fall through */
+
+        case HTTP2_CONTINUATION:
+        {
+            if (type == HTTP2_CONTINUATION && (self->continuation_stream == 0 ||
+                                               stream_id != self->continuation_stream))
+            {
+                http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+
+            if (len > sizeof(self->block) - self->block_len)
+            {
+                LOG_WARN("[HTTP2] Header block over %d bytes on fd=%d", HTTP2_HEADER_BLOCK_SIZE, self->conn->fd);
+                http2_goaway(self, HTTP2_ENHANCE_YOUR_CALM);
+                return;
+            }
+
+            memcpy(self->block + self->block_len, payload, len);
+            self->block_len += len;
+
+            if (type == HTTP2_HEADERS) self->continuation_flags = flags;
+
+            if (!(flags & HTTP2_FLAG_END_HEADERS))
+            {
+                self->continuation_stream = stream_id;
+                return;
+            }
+
+            self->continuation_stream = 0;
+            http2_headers_complete(self, stream_id, self->continuation_flags);
+            return;
+        }
+
+        case HTTP2_PRIORITY:
+            if (stream_id == 0) http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+            return;
+
+        case HTTP2_RST_STREAM:
+        {
+            if (stream_id == 0 || len != 4)
+            {
+                http2_goaway(self, stream_id == 0 ? HTTP2_PROTOCOL_ERROR : HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+
+            http2_stream_t *stream = http2_stream_find(self, stream_id);
+            if (stream) http2_stream_release(stream);
+            return;
+        }
+
+        case HTTP2_SETTINGS:
+        {
+            if (stream_id != 0)
+            {
+                http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+
+            if (flags & HTTP2_FLAG_ACK)
+            {
+                if (len != 0) http2_goaway(self, HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+
+            if (len % 6 != 0)
+            {
+                http2_goaway(self, HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+
+            uint32_t error = http2_apply_settings(self, payload, len);
+
+            if (error != HTTP2_NO_ERROR) http2_goaway(self, error);
+            else http2_send_control(self, HTTP2_SETTINGS, HTTP2_FLAG_ACK, 0, NULL, 0);
+            return;
+        }
+
+        case HTTP2_PING:
+            if (stream_id != 0 || len != 8)
+            {
+                http2_goaway(self, stream_id != 0 ? HTTP2_PROTOCOL_ERROR : HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+
+            if (!(flags & HTTP2_FLAG_ACK)) http2_send_control(self, HTTP2_PING, HTTP2_FLAG_ACK, 0, payload, len);
+            return;
+
+        case HTTP2_GOAWAY:
+            /* Streams already opened are still answered, the client closes when it has them */
+            LOG_INFO("[HTTP2] Client on fd=%d going away", self->conn->fd);
+            return;
+
+        case HTTP2_WINDOW_UPDATE:
+        {
+            if (len != 4)
+            {
+                http2_goaway(self, HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+
+            uint32_t increment = http2_get32(payload) & HTTP2_MAX_WINDOW;
+
+            if (stream_id == 0)
+            {
+                if (increment == 0 || (int64_t)self->window + increment > HTTP2_MAX_WINDOW)
+                {
+                    http2_goaway(self, increment == 0 ? HTTP2_PROTOCOL_ERROR : HTTP2_FLOW_CONTROL_ERROR);
+                    return;
+                }
+
+                self->window += (int32_t)increment;
+                return;
+            }
+
+            http2_stream_t *stream = http2_stream_find(self, stream_id);
+            if (!stream) return;
+
+            if (increment == 0 || (int64_t)stream->window + increment > HTTP2_MAX_WINDOW)
+            {
+                http2_rst_stream(self, stream_id,
+                                 increment == 0 ? HTTP2_PROTOCOL_ERROR : HTTP2_FLOW_CONTROL_ERROR);
+                http2_stream_release(stream);
+                return;
+            }
+
+            stream->window += (int32_t)increment;
+            return;
+        }
+
+        case HTTP2_PUSH_PROMISE:
+            http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+            return;
+
+        default:
+            /* Unknown frame types are ignored */
+            return;
+    }
+}
+
+/**
+ * Handles the complete frames in the read buffer, the preface first
+ **/
+static void http2_connection_process(http2_connection_t *self)
+{
+    size_t offset = 0;
+
+    if (!self->preface)
+    {
+        size_t n = self->in_len < HTTP2_PREFACE_SIZE ? self->in_len : HTTP2_PREFACE_SIZE;
+
+        if (memcmp(self->in, HTTP2_PREFACE, n) != 0)
+        {
+            http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+            return;
+        }
+
+        if (n < HTTP2_PREFACE_SIZE) return;
+
+        self->preface = 1;
+        offset = HTTP2_PREFACE_SIZE;
+    }
+
+    while (!self->closing && self->in_len - offset >= HTTP2_FRAME_HEADER_SIZE)
+    {
+        const uint8_t *header = self->in + offset;
+        size_t len = (size_t)header[0] << 16 | (size_t)header[1] << 8 | header[2];
+
+        /* Nothing larger was allowed, SETTINGS_MAX_FRAME_SIZE is left at its default */
+        if (len > HTTP2_MAX_FRAME_SIZE)
+        {
+            http2_goaway(self, HTTP2_FRAME_SIZE_ERROR);
+            break;
+        }
+
+        if (self->in_len - offset < HTTP2_FRAME_HEADER_SIZE + len) break;
+
+        http2_connection_frame(self, header[3], header[4], http2_get32(header + 5) & HTTP2_MAX_WINDOW,
+                               header + HTTP2_FRAME_HEADER_SIZE, len);
+
+        offset += HTTP2_FRAME_HEADER_SIZE + len;
+    }
+
+    memmove(self->in, self->in + offset, self->in_len - offset);
+    self->in_len -= offset;
+}
+
+/**
+ * Writes what the slot has queued, -1 when the socket failed
+ **/
+static int8_t http2_connection_flush(http2_connection_t *self)
+{
+    http_connection_t *conn = self->conn;
+
+    if (conn->response_len == conn->sent_bytes) return 0;
+
+    ssize_t written = send(conn->fd, conn->response_buffer + conn->sent_bytes,
+                           conn->response_len - conn->sent_bytes, MSG_NOSIGNAL);
+
+    if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        LOG_DEBUG("[HTTP2] fd=%d write failed: %s", conn->fd, strerror(errno));
+        return -1;
+    }
+
+    if (written > 0) conn->sent_bytes += (size_t)written;
+    if (conn->sent_bytes == conn->response_len) conn->response_len = conn->sent_bytes = 0;
+    return 0;
+}
+
+/**
+ * RFC 7540 3.2.1: the HTTP2-Settings header is a SETTINGS payload in
+ * base64url without padding
+ **/
+static int http2_decode_settings_header(const char *text, uint8_t *out, size_t size, size_t *out_len)
+{
+    uint32_t bits = 0;
+    int nbits = 0;
+    size_t o = 0;
+
+    for (const char *p = text; *p && *p != '='; p++)
+    {
+        int value;
+
+        if (*p >= 'A' && *p <= 'Z') value = *p - 'A';
+        else if (*p >= 'a' && *p <= 'z') value = *p - 'a' + 26;
+        else if (*p >= '0' && *p <= '9') value = *p - '0' + 52;
+        else if (*p == '-' || *p == '+') value = 62;
+        else if (*p == '_' || *p == '/') value = 63;
+        else return -1;
+
+        bits = bits << 6 | (uint32_t)value;
+        nbits += 6;
+
+        if (nbits >= 8)
+        {
+            nbits -= 8;
+            if (o >= size) return -1;
+            out[o++] = (uint8_t)(bits >> nbits);
+        }
+    }
+
+    if (o % 6 != 0) return -1;
+
+    *out_len = o;
+    return 0;
+}
+
+/**
+ * Takes over a connection slot. data is what the client sent past the
+ * request line or upgrade request, the preface included. For an upgrade
+ * the 101 goes out first and the upgrading request is answered as
+ * stream 1. Returns -1, with the slot untouched, when all HTTP/2 slots
+ * are busy or the upgrade is malformed.
+ **/
+int8_t http2_connection_start(http_connection_t *conn, const http_connection_request_t *upgrade,
+                              const char *data, size_t len)
+{
+    static const char switching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+                                    "Connection: Upgrade\r\n"
+                                    "Upgrade: h2c\r\n"
+                                    "\r\n";
+
+    if (!conn || !conn->parent || (!data && len > 0)) return -1;
+
+    http_server_t *server = conn->parent;
+    http2_connection_t *self = NULL;
+    uint8_t settings[HTTP2_SETTINGS_HEADER_SIZE];
+    size_t settings_len = 0;
+
+    for (int i = 0; i < HTTP2_MAX_CONNECTIONS; i++)
+    {
+        if (!server->child_http2_connection[i].conn)
+        {
+            self = &server->child_http2_connection[i];
+            break;
+        }
+    }
+
+    if (!self)
+    {
+        LOG_WARN("[HTTP2] No HTTP/2 slot for fd=%d", conn->fd);
+        return -1;
+    }
+
+    if (len > sizeof(self->in)) return -1;
+
+    if (upgrade && http2_decode_settings_header(upgrade->h2c_settings, settings, sizeof(settings),
+                                                &settings_len) != 0)
+    {
+        LOG_WARN("[HTTP2] Bad HTTP2-Settings from fd=%d", conn->fd);
+        return -1;
+    }
+
+    memset(self, 0, offsetof(http2_connection_t, decoder));
+    http_hpack_table_init(&self->decoder);
+
+    self->conn = conn;
+    self->window = HTTP2_DEFAULT_WINDOW;
+    self->initial_window = HTTP2_DEFAULT_WINDOW;
+    self->max_frame_size = 16384;
+
+    conn->h2 = self;
+    conn->state = HTTP_CONNECTION_HTTP2;
+    conn->idle_timeout_ms = HTTP2_IDLE_TIMEOUT_S * 1000;
+    conn->last_activity_ms = task_scheduler_pass_ms();
+    conn->response_len = 0;
+    conn->sent_bytes = 0;
+
+    if (upgrade)
+    {
+        memcpy(http_connection_reserve(conn, sizeof(switching) - 1), switching, sizeof(switching) - 1);
+
+        if (http2_apply_settings(self, settings, settings_len) != HTTP2_NO_ERROR)
+        {
+            http2_goaway(self, HTTP2_PROTOCOL_ERROR);
+            return 0;
+        }
+    }
+
+    /* The server preface: MAX_CONCURRENT_STREAMS and how large a header
+     * block fits, the rest stays at the defaults */
+    uint8_t preface[12] = { 0, HTTP2_SETTINGS_MAX_CONCURRENT, 0, 0, 0, 0,
+                            0, HTTP2_SETTINGS_MAX_HEADER_LIST, 0, 0, 0, 0 };
+    http2_put32(preface + 2, HTTP2_MAX_CONCURRENT_STREAMS);
+    http2_put32(preface + 8, HTTP2_HEADER_BLOCK_SIZE);
+    http2_send_control(self, HTTP2_SETTINGS, 0, 0, preface, sizeof(preface));
+
+    if (len > 0) memcpy(self->in, data, len);
+    self->in_len = len;
+
+    LOG_INFO("[HTTP2] fd=%d speaking HTTP/2%s", conn->fd, upgrade ? " after upgrade" : "");
+
+    if (upgrade)
+    {
+        /* Half closed from the client's side already: upgrades carry no body */
+        http2_stream_t *stream = http2_stream_open(self, 1);
+        self->last_stream_id = 1;
+
+        if (stream)
+        {
+            memcpy(&stream->request, upgrade, sizeof(stream->request));
+            strcpy(stream->request.version, "HTTP/2");
+            http2_stream_dispatch(stream, 1);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * One pass: write, read, handle the frames, frame the answers and
+ * write again so answers that were ready go out in the same pass
+ **/
+void http2_connection_work(http2_connection_t *self, uint64_t now_ms)
+{
+    http_connection_t *conn = self->conn;
+
+    if (http2_connection_flush(self) != 0)
+    {
+        http_connection_cleanup(conn);
+        return;
+    }
+
+    if (self->closing)
+    {
+        if (conn->response_len == 0) http_connection_cleanup(conn);
+        return;
+    }
+
+    ssize_t r = read(conn->fd, self->in + self->in_len, sizeof(self->in) - self->in_len);
+
+    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        LOG_INFO("[HTTP2] fd=%d closed by client", conn->fd);
+        http_connection_cleanup(conn);
+        return;
+    }
+
+    if (r > 0)
+    {
+        self->in_len += (size_t)r;
+        conn->last_activity_ms = now_ms;
+    }
+
+    http2_connection_process(self);
+    http2_connection_schedule(self);
+
+    if (http2_connection_flush(self) != 0) http_connection_cleanup(conn);
+}
+
+/**
+ * Frees the HTTP/2 state when its connection slot is cleaned up
+ **/
+void http2_connection_close(http2_connection_t *self)
+{
+    if (!self || !self->conn) return;
+
+    http2_stream_t *streams = http2_streams(self);
+
+    for (int i = 0; i < HTTP2_MAX_STREAMS; i++)
+    {
+        if (streams[i].parent == self) http2_stream_release(&streams[i]);
+    }
+
+    self->conn->h2 = NULL;
+    self->conn = NULL;
+}
@@ -0,0 +1,170 @@
+/**
+ * Implementation-file: http_compress.c
+ *
+ * One zlib stream per coding, set up on first use and reset for every
+ * response, so setup cost and memory are paid once. zlib gets its memory
+ * from a static arena instead of malloc; nothing is ever handed back
+ * because the streams live as long as the process.
+ **/
+
+#include "../../include/http/http_compress.h"
+#include "../../include/config/config.h"
+#include "../../include/logging/logging.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+typedef enum
+{
+    HTTP_COMPRESS_UNTRIED = 0,
+    HTTP_COMPRESS_READY   = 1,
+    HTTP_COMPRESS_FAILED  = 2
+} http_compress_state_t;
+
+static struct
+{
+    uint8_t arena[HTTP_COMPRESS_ARENA_SIZE] __attribute__((aligned(16)));
+    size_t arena_used;
+
+    z_stream streams[HTTP_ENCODING_COUNT];
+    uint8_t states[HTTP_ENCODING_COUNT];
+} g_compress;
+
+static voidpf http_compress_alloc(voidpf opaque, uInt items, uInt size)
+{
+    (void)opaque;
+
+    size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+    if (bytes > sizeof(g_compress.arena) - g_compress.arena_used) return Z_NULL;
+
+    voidpf block = g_compress.arena + g_compress.arena_used;
+    g_compress.arena_used += bytes;
+    return block;
+}
+
+static void http_compress_free(voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    (void)address;
+}
+
+static z_stream *http_compress_stream(uint8_t encoding)
+{
+    z_stream *stream = &g_compress.streams[encoding];
+
+    if (g_compress.states[encoding] == HTTP_COMPRESS_READY)
+    {
+        deflateReset(stream);
+        return stream;
+    }
+
+    if (g_compress.states[encoding] == HTTP_COMPRESS_FAILED) return NULL;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->zalloc = http_compress_alloc;
+    stream->zfree = http_compress_free;
+
+    /* gzip is the same deflate data in a different wrapper, selected by +16 */
+    int window_bits = HTTP_COMPRESS_WINDOW_BITS + (encoding == HTTP_ENCODING_GZIP ? 16 : 0);
+
+    if (deflateInit2(stream, HTTP_COMPRESS_LEVEL, Z_DEFLATED, window_bits,
+                     HTTP_COMPRESS_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        LOG_WARN("[HTTP] %s compression unavailable, arena too small", http_encoding_name(encoding));
+        g_compress.states[encoding] = HTTP_COMPRESS_FAILED;
+        return NULL;
+    }
+
+    LOG_DEBUG("[HTTP] %s compression ready, %zu bytes of arena in use",
+              http_encoding_name(encoding), g_compress.arena_used);
+
+    g_compress.states[encoding] = HTTP_COMPRESS_READY;
+    return stream;
+}
+
+/**
+ * Compresses a whole body into out. Returns the compressed length, 0 when
+ * the body is below the threshold, did not get smaller or did not fit.
+ **/
+size_t http_compress(uint8_t encoding, const void *in, size_t len, void *out, size_t size)
+{
+    if (encoding == HTTP_ENCODING_IDENTITY || encoding >= HTTP_ENCODING_COUNT) return 0;
+    if (!in || !out || len < HTTP_COMPRESS_MIN_SIZE) return 0;
+
+    z_stream *stream = http_compress_stream(encoding);
+    if (!stream) return 0;
+
+    stream->next_in = (Bytef *)in;
+    stream->avail_in = (uInt)len;
+    stream->next_out = out;
+    stream->avail_out = (uInt)size;
+
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) return 0;
+
+    size_t produced = size - stream->avail_out;
+    return produced < len ? produced : 0;
+}
+
+/**
+ * Content-Encoding value, NULL for identity
+ **/
+const char *http_encoding_name(uint8_t encoding)
+{
+    static const char *names[] = { NULL, "gzip", "deflate" };
+
+    return encoding < HTTP_ENCODING_COUNT ? names[encoding] : NULL;
+}
+
+/**
+ * Picks a coding from an Accept-Encoding value: gzip before deflate, a
+ * coding with q=0 is refused, "*" stands for any coding not listed
+ **/
+uint8_t http_encoding_negotiate(const char *accept_encoding)
+{
+    if (!accept_encoding || !*accept_encoding) return HTTP_ENCODING_IDENTITY;
+
+    double gzip = -1.0;
+    double deflate = -1.0;
+    double any = -1.0;
+
+    for (const char *p = accept_encoding; *p; )
+    {
+        while (*p == ' ' || *p == ',') p++;
+
+        const char *name = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ') p++;
+        size_t name_len = (size_t)(p - name);
+
+        double q = 1.0;
+        const char *end = strchr(p, ',');
+        if (!end) end = p + strlen(p);
+
+        const char *param = strstr(p, "q=");
+        if (param && param < end) q = strtod(param + 2, NULL);
+
+        if ((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+            (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0))
+        {
+            gzip = q;
+        }
+        else if (name_len == 7 && strncasecmp(name, "deflate", 7) == 0)
+        {
+            deflate = q;
+        }
+        else if (name_len == 1 && *name == '*')
+        {
+            any = q;
+        }
+
+        p = end;
+    }
+
+    if (gzip < 0) gzip = any;
+    if (deflate < 0) deflate = any;
+
+    if (gzip > 0 && gzip >= deflate) return HTTP_ENCODING_GZIP;
+    if (deflate > 0) return HTTP_ENCODING_DEFLATE;
+
+    return HTTP_ENCODING_IDENTITY;
+}
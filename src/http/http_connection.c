@@ -8,15 +8,23 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/socket.h>
 
 #include "../../include/http/http_connection.h"
 #include "../../include/http/http_server.h"
+#include "../../include/http/http_websocket.h"
+#include "../../include/http/http2.h"
 #include "../../include/task_scheduler/task_scheduler.h"
 #include "../../include/event_watcher/event_watcher.h"
 #include "../../include/weather/weather_server.h"
 #include "../../include/weather/weather_connection.h"
 #include "../../include/logging/logging.h"
 
+_Static_assert(HTTP_PROCESSING_TIMEOUT_MS > WEATHER_ADMISSION_DEADLINE_MS + UPSTREAM_TIMEOUT_MS,
+               "HTTP_PROCESSING_TIMEOUT_MS must outlast an admission wait and an upstream fetch");
+
 /**
  * FIXED: Unified cleanup function for proper state management
  */
@@ -37,6 +45,17 @@ void http_connection_cleanup(http_connection_t *self)
     {
         self->parent->active_count--;
     }
+
+    /* Weather work still in flight must not call back into a recycled slot */
+    if ((self->state == HTTP_CONNECTION_WAITING || self->state == HTTP_CONNECTION_RECEIVING_BODY ||
+         self->state == HTTP_CONNECTION_WEBSOCKET || self->streaming) &&
+        self->parent &&
+        self->parent->upper_weather_server_layer)
+    {
+        weather_server_detach_http_connection(self->parent->upper_weather_server_layer, &self->exchange);
+    }
+
+    if (self->h2) http2_connection_close(self->h2);
     
     if (self->node.active)
     {
@@ -47,48 +66,225 @@ void http_connection_cleanup(http_connection_t *self)
     self->raw_http_buffer_len = 0;
     self->response_len = 0;
     self->sent_bytes = 0;
+    self->body_received = 0;
+    self->streaming = 0;
+    self->chunked = 0;
+    self->ws_ping_sent = 0;
+    self->ws_closing = 0;
+    self->body_len = 0;
+    self->exchange.fd = -1;
     
     memset(self->raw_http_buffer, 0, sizeof(self->raw_http_buffer));
     memset(self->response_buffer, 0, sizeof(self->response_buffer));
     memset(&self->parsed_request, 0, sizeof(self->parsed_request));
 }
 
+const char *http_status_text(uint16_t status)
+{
+    switch (status)
+    {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 413: return "Content Too Large";
+        case 414: return "URI Too Long";
+        case 429: return "Too Many Requests";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default:  return "Internal Server Error";
+    }
+}
+
 /**
  * FIXED: Better HTTP response formatting
+ * Bodies may be binary, they are copied by length after the headers.
  */
-void http_connection_on_handled_request(struct http_connection *self, const char *weather_data)
+void http_connection_on_handled_request(http_exchange_t *exchange, const http_connection_reply_t *reply)
 {
-    if (!self || !weather_data)
+    http_connection_t *self = container_of(exchange, http_connection_t, exchange);
+
+    if (!exchange || !reply || !reply->content_type || (!reply->body && reply->body_len > 0))
     {
         LOG_ERROR("[HTTP] Invalid parameters to on_handled_request");
         return;
     }
+
+    if (self->state != HTTP_CONNECTION_WAITING)
+    {
+        LOG_WARN("[HTTP] Late weather response for fd=%d, ignoring", self->fd);
+        return;
+    }
     
-    LOG_INFO("[HTTP] Building response for fd=%d", self->fd);
-    
-    size_t data_len = strlen(weather_data);
-    
-    int written = snprintf(self->response_buffer,
+    LOG_INFO("[HTTP] Building %d response for fd=%d", reply->status, self->fd);
+
+    uint8_t not_modified = reply->status == 304;
+    char validators[HTTP_IF_NONE_MATCH_SIZE + 64] = "";
+
+    if (reply->etag)
+    {
+        if (reply->max_age >= 0)
+        {
+            snprintf(validators, sizeof(validators), "ETag: %s\r\nCache-Control: max-age=%d\r\n",
+                     reply->etag, (int)reply->max_age);
+        }
+        else
+        {
+            snprintf(validators, sizeof(validators), "ETag: %s\r\nCache-Control: no-cache\r\n",
+                     reply->etag);
+        }
+    }
+
+    int written;
+
+    if (not_modified)
+    {
+        /* Validators only, the client already has the body */
+        written = snprintf(self->response_buffer,
+                          sizeof(self->response_buffer),
+                          "HTTP/1.1 304 Not Modified\r\n"
+                          "%s"
+                          "Vary: Accept, Accept-Encoding\r\n"
+                          "Connection: close\r\n"
+                          "\r\n",
+                          validators);
+    }
+    else
+    {
+        written = snprintf(self->response_buffer,
                           sizeof(self->response_buffer),
-                          "HTTP/1.1 200 OK\r\n"
-                          "Content-Type: text/plain\r\n"
+                          "HTTP/1.1 %d %s\r\n"
+                          "Content-Type: %s\r\n"
+                          "%s%s%s"
+                          "%s"
+                          "Vary: Accept, Accept-Encoding\r\n"
                           "Content-Length: %zu\r\n"
                           "Connection: close\r\n"
-                          "\r\n"
-                          "%s",
-                          data_len,
-                          weather_data);
+                          "\r\n",
+                          reply->status,
+                          http_status_text(reply->status),
+                          reply->content_type,
+                          reply->content_encoding ? "Content-Encoding: " : "",
+                          reply->content_encoding ? reply->content_encoding : "",
+                          reply->content_encoding ? "\r\n" : "",
+                          validators,
+                          reply->body_len);
+    }
+
+    size_t body_len = not_modified ? 0 : reply->body_len;
     
-    if (written < 0 || (size_t)written >= sizeof(self->response_buffer))
+    if (written < 0 || (size_t)written + body_len >= sizeof(self->response_buffer))
     {
         LOG_ERROR("[HTTP] Response buffer overflow");
         http_connection_cleanup(self);
         return;
     }
+
+    if (body_len > 0) memcpy(self->response_buffer + written, reply->body, body_len);
     
-    self->response_len = written;
+    self->response_len = (size_t)written + body_len;
+    self->sent_bytes = 0;
+    self->state = HTTP_CONNECTION_SENDING;
+}
+
+/**
+ * Weak comparison against an If-None-Match list: W/ prefixes are
+ * ignored and "*" matches anything
+ **/
+int http_etag_matches(const char *if_none_match, const char *etag)
+{
+    if (!if_none_match || !etag || !*if_none_match) return 0;
+
+    if (strncmp(etag, "W/", 2) == 0) etag += 2;
+    size_t etag_len = strlen(etag);
+
+    for (const char *p = if_none_match; *p; )
+    {
+        while (*p == ' ' || *p == ',') p++;
+
+        if (*p == '*') return 1;
+        if (strncmp(p, "W/", 2) == 0) p += 2;
+
+        const char *end = p;
+        while (*end && *end != ',' && *end != ' ') end++;
+
+        if ((size_t)(end - p) == etag_len && memcmp(p, etag, etag_len) == 0) return 1;
+
+        p = end;
+    }
+
+    return 0;
+}
+
+/**
+ * Takes the next piece of a streamed response. The first call sends the
+ * headers, HTTP/1.1 clients get chunked encoding and HTTP/1.0 ones the raw
+ * body up to the close. Returns -1 while the previous piece is still being
+ * written, the caller keeps it and offers it again.
+ **/
+int8_t http_connection_on_stream(http_exchange_t *exchange, uint16_t status, const char *content_type,
+                                 const char *data, size_t len, uint8_t last)
+{
+    http_connection_t *self = container_of(exchange, http_connection_t, exchange);
+
+    if (!exchange || !content_type || (!data && len > 0)) return -1;
+
+    size_t size = sizeof(self->response_buffer);
+    int written = 0;
+
+    if (self->state == HTTP_CONNECTION_WAITING && !self->streaming)
+    {
+        self->streaming = 1;
+        self->chunked = strcmp(self->parsed_request.version, "HTTP/1.1") == 0;
+
+        LOG_INFO("[HTTP] Streaming %d response for fd=%d", status, self->fd);
+
+        written = snprintf(self->response_buffer, size,
+                           "HTTP/1.1 %d %s\r\n"
+                           "Content-Type: %s\r\n"
+                           "%s"
+                           "Connection: close\r\n"
+                           "\r\n",
+                           status, http_status_text(status), content_type,
+                           self->chunked ? "Transfer-Encoding: chunked\r\n" : "");
+    }
+    else if (self->state != HTTP_CONNECTION_STREAMING)
+    {
+        return -1;
+    }
+
+    /* Chunk size line, data, CRLF and possibly the last chunk */
+    if (written < 0 || (size_t)written + len + 32 > size)
+    {
+        LOG_ERROR("[HTTP] Stream chunk of %zu bytes does not fit", len);
+        return -1;
+    }
+
+    if (len > 0)
+    {
+        if (self->chunked) written += snprintf(self->response_buffer + written, size - written, "%zx\r\n", len);
+
+        memcpy(self->response_buffer + written, data, len);
+        written += (int)len;
+
+        if (self->chunked) written += snprintf(self->response_buffer + written, size - written, "\r\n");
+    }
+
+    if (last)
+    {
+        if (self->chunked) written += snprintf(self->response_buffer + written, size - written, "0\r\n\r\n");
+
+        /* Nothing refers to this connection any more once the last piece is in */
+        self->streaming = 0;
+    }
+
+    if (written == 0) return 0;
+
+    self->response_len = (size_t)written;
     self->sent_bytes = 0;
     self->state = HTTP_CONNECTION_SENDING;
+    return 0;
 }
 
 /**
@@ -113,6 +309,40 @@ static int is_valid_http_method(const char *method)
     return 0;
 }
 
+/**
+ * Copies a header value without its leading spaces, cut to the buffer
+ **/
+static void http_copy_header_value(const char *value, const char *end, char *out, size_t size)
+{
+    while (*value == ' ') value++;
+
+    size_t len = (size_t)(end - value);
+    if (len >= size) len = size - 1;
+
+    memcpy(out, value, len);
+    out[len] = '\0';
+}
+
+/**
+ * Whether a comma separated header value lists token, in any case
+ **/
+static int http_header_has_token(const char *value, const char *end, const char *token)
+{
+    size_t token_len = strlen(token);
+
+    while (value < end)
+    {
+        while (value < end && (*value == ' ' || *value == ',')) value++;
+
+        const char *item = value;
+        while (value < end && *value != ',' && *value != ' ') value++;
+
+        if ((size_t)(value - item) == token_len && strncasecmp(item, token, token_len) == 0) return 1;
+    }
+
+    return 0;
+}
+
 /**
  * FIXED: Better HTTP parsing with validation
  */
@@ -183,43 +413,108 @@ static int parse_http_request(const char *raw, http_connection_request_t *req)
         return -1;
     }
     
-    /* Check for query string */
+    /* Check for query string, a target that does not fit is refused rather than cut */
     const char *query_start = strchr(path_start, '?');
+    if (!query_start || query_start > space2) query_start = space2;
+
+    size_t path_len = query_start - path_start;
+    size_t query_len = query_start < space2 ? (size_t)(space2 - (query_start + 1)) : 0;
+
+    if (path_len >= sizeof(req->path) || query_len >= sizeof(req->query))
+    {
+        LOG_WARN("[HTTP] Request target of %zu bytes too long", (size_t)(space2 - path_start));
+        req->uri_too_long = 1;
+        return -1;
+    }
+
+    memcpy(req->path, path_start, path_len);
+    req->path[path_len] = '\0';
+
+    memcpy(req->query, query_start + (query_len ? 1 : 0), query_len);
+    req->query[query_len] = '\0';
     
-    if (query_start && query_start < space2)
+    /* Headers the connection acts on, the rest are ignored */
+    const char *headers_end = strstr(line_end, "\r\n\r\n");
+    const char *line = line_end + 2;
+
+    /* A WebSocket upgrade needs all four of its headers */
+    uint8_t upgrade_websocket = 0;
+    uint8_t connection_upgrade = 0;
+    uint8_t websocket_version = 0;
+
+    /* h2c needs Upgrade, Connection and HTTP2-Settings */
+    uint8_t upgrade_h2c = 0;
+
+    while (headers_end && line < headers_end)
     {
-        /* Has query string */
-        size_t path_len = query_start - path_start;
-        if (path_len >= sizeof(req->path))
+        const char *next = strstr(line, "\r\n");
+
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+        {
+            char *end;
+            unsigned long long length = strtoull(line + 15, &end, 10);
+
+            if (end == line + 15 || (*end != '\r' && *end != ' ')) return -1;
+            req->content_length = (size_t)length;
+        }
+        else if (strncasecmp(line, "Expect:", 7) == 0)
         {
-            path_len = sizeof(req->path) - 1;
+            const char *value = line + 7;
+            while (*value == ' ') value++;
+            req->expect_continue = strncasecmp(value, "100-continue", 12) == 0;
         }
-        
-        strncpy(req->path, path_start, path_len);
-        req->path[path_len] = '\0';
-        
-        size_t query_len = space2 - (query_start + 1);
-        if (query_len >= sizeof(req->query))
+        else if (strncasecmp(line, "Accept:", 7) == 0)
         {
-            query_len = sizeof(req->query) - 1;
+            http_copy_header_value(line + 7, next, req->accept, sizeof(req->accept));
         }
-        
-        strncpy(req->query, query_start + 1, query_len);
-        req->query[query_len] = '\0';
-    }
-    else
-    {
-        /* No query string */
-        size_t path_len = space2 - path_start;
-        if (path_len >= sizeof(req->path))
+        else if (strncasecmp(line, "Accept-Encoding:", 16) == 0)
+        {
+            http_copy_header_value(line + 16, next, req->accept_encoding, sizeof(req->accept_encoding));
+        }
+        else if (strncasecmp(line, "If-None-Match:", 14) == 0)
+        {
+            http_copy_header_value(line + 14, next, req->if_none_match, sizeof(req->if_none_match));
+        }
+        else if (strncasecmp(line, "Upgrade:", 8) == 0)
+        {
+            char value[32];
+            http_copy_header_value(line + 8, next, value, sizeof(value));
+            upgrade_websocket = strcasecmp(value, "websocket") == 0;
+            upgrade_h2c = http_header_has_token(line + 8, next, "h2c");
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0)
+        {
+            connection_upgrade = http_header_has_token(line + 11, next, "upgrade");
+        }
+        else if (strncasecmp(line, "Sec-WebSocket-Key:", 18) == 0)
         {
-            path_len = sizeof(req->path) - 1;
+            http_copy_header_value(line + 18, next, req->websocket_key, sizeof(req->websocket_key));
         }
-        
-        strncpy(req->path, path_start, path_len);
-        req->path[path_len] = '\0';
+        else if (strncasecmp(line, "Sec-WebSocket-Version:", 22) == 0)
+        {
+            char value[8];
+            http_copy_header_value(line + 22, next, value, sizeof(value));
+            websocket_version = strcmp(value, "13") == 0;
+        }
+        else if (strncasecmp(line, "HTTP2-Settings:", 15) == 0)
+        {
+            http_copy_header_value(line + 15, next, req->h2c_settings, sizeof(req->h2c_settings));
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0)
+        {
+            LOG_WARN("[HTTP] Transfer-Encoding not supported");
+            return -1;
+        }
+
+        line = next + 2;
     }
-    
+
+    req->websocket = upgrade_websocket && connection_upgrade && websocket_version &&
+                     req->websocket_key[0] && strcmp(req->method, "GET") == 0;
+
+    req->h2c = upgrade_h2c && connection_upgrade && req->h2c_settings[0] &&
+               strcmp(req->version, "HTTP/1.1") == 0 && !req->websocket;
+
     LOG_INFO("[HTTP] Parsed: %s %s %s (query: %s)", 
              req->method, req->path, req->version, 
              req->query[0] ? req->query : "(none)");
@@ -227,6 +522,264 @@ static int parse_http_request(const char *raw, http_connection_request_t *req)
     return 0;
 }
 
+/**
+ * Hands one chunk of the request body to the weather layer, the last one
+ * is answered before the call returns
+ **/
+static int8_t http_connection_pass_body(http_connection_t *self, const char *data, size_t len)
+{
+    weather_server_t *weather = self->parent->upper_weather_server_layer;
+
+    self->body_received += len;
+    uint8_t last = self->body_received >= self->parsed_request.content_length;
+
+    if (last) self->state = HTTP_CONNECTION_WAITING;
+
+    if (weather->cb_from_http_layer.http_on_request_body(weather, &self->exchange, data, len, last) != 0)
+    {
+        LOG_WARN("[HTTP] Body rejected by weather layer, fd=%d", self->fd);
+        http_connection_cleanup(self);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Room for len more bytes of output, what is still unsent moves to the
+ * front first. NULL when that is not enough.
+ **/
+char *http_connection_reserve(http_connection_t *self, size_t len)
+{
+    if (self->sent_bytes > 0)
+    {
+        memmove(self->response_buffer, self->response_buffer + self->sent_bytes,
+                self->response_len - self->sent_bytes);
+        self->response_len -= self->sent_bytes;
+        self->sent_bytes = 0;
+    }
+
+    if (len > sizeof(self->response_buffer) - self->response_len) return NULL;
+
+    char *out = self->response_buffer + self->response_len;
+    self->response_len += len;
+    return out;
+}
+
+/**
+ * How much http_connection_reserve can hand out right now
+ **/
+size_t http_connection_room(const http_connection_t *self)
+{
+    return sizeof(self->response_buffer) - (self->response_len - self->sent_bytes);
+}
+
+static int8_t http_connection_ws_send(http_connection_t *self, uint8_t opcode, const char *payload, size_t len)
+{
+    uint8_t header[HTTP_WEBSOCKET_HEADER_MAX];
+    size_t header_len = http_websocket_frame_header(opcode, len, header);
+
+    char *out = http_connection_reserve(self, header_len + len);
+    if (!out) return -1;
+
+    memcpy(out, header, header_len);
+    if (len > 0) memcpy(out + header_len, payload, len);
+    return 0;
+}
+
+/**
+ * Sends a close frame, nothing is read after it and the connection
+ * closes once its output is written
+ **/
+static void http_connection_ws_close(http_connection_t *self, uint16_t code)
+{
+    char payload[2] = { (char)(code >> 8), (char)(code & 0xFF) };
+
+    LOG_DEBUG("[HTTP] Closing WebSocket fd=%d with %u", self->fd, code);
+    http_connection_ws_send(self, HTTP_WEBSOCKET_CLOSE, payload, sizeof(payload));
+    self->ws_closing = 1;
+}
+
+/**
+ * Queues a frame the weather layer encoded, usually one shared by every
+ * connection watching a city. A connection with no room for it is not
+ * keeping up, its output is dropped and it closes on its next pass.
+ **/
+int8_t http_connection_on_frame(http_exchange_t *exchange, const char *frame, size_t len)
+{
+    http_connection_t *self = container_of(exchange, http_connection_t, exchange);
+
+    if (!exchange || !frame || self->state != HTTP_CONNECTION_WEBSOCKET || self->ws_closing) return -1;
+
+    char *out = http_connection_reserve(self, len);
+    if (!out)
+    {
+        LOG_INFO("[HTTP] WebSocket fd=%d not keeping up, closing", self->fd);
+        self->response_len = self->sent_bytes;
+        self->ws_closing = 1;
+        return -1;
+    }
+
+    memcpy(out, frame, len);
+    return 0;
+}
+
+/**
+ * Answers the handshake. From here on the response buffer queues
+ * outgoing frames and the read buffer collects incoming ones, a frame
+ * sent right behind the request is already in it.
+ **/
+static void http_connection_upgrade(http_connection_t *self)
+{
+    char accept[32];
+
+    if (http_websocket_accept_key(self->parsed_request.websocket_key, accept, sizeof(accept)) != 0)
+    {
+        LOG_WARN("[HTTP] Bad WebSocket key from fd=%d", self->fd);
+        http_connection_cleanup(self);
+        return;
+    }
+
+    int written = snprintf(self->response_buffer, sizeof(self->response_buffer),
+                           "HTTP/1.1 101 Switching Protocols\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: %s\r\n"
+                           "\r\n",
+                           accept);
+
+    size_t header_len = strstr(self->raw_http_buffer, "\r\n\r\n") + 4 - self->raw_http_buffer;
+    memmove(self->raw_http_buffer, self->raw_http_buffer + header_len, self->raw_http_buffer_len - header_len);
+    self->raw_http_buffer_len -= header_len;
+
+    self->response_len = (size_t)written;
+    self->sent_bytes = 0;
+    self->state = HTTP_CONNECTION_WEBSOCKET;
+    self->idle_timeout_ms = HTTP_WEBSOCKET_TIMEOUT_S * 1000;
+    self->last_activity_ms = task_scheduler_pass_ms();
+
+    LOG_INFO("[HTTP] WebSocket open on fd=%d", self->fd);
+}
+
+static void http_connection_ws_frame(http_connection_t *self, const http_websocket_frame_t *frame)
+{
+    weather_server_t *weather = self->parent ? self->parent->upper_weather_server_layer : NULL;
+
+    switch (frame->opcode)
+    {
+        case HTTP_WEBSOCKET_TEXT:
+            /* Commands are a few bytes, nobody needs to split them */
+            if (!frame->fin)
+            {
+                http_connection_ws_close(self, 1009);
+                break;
+            }
+
+            if (weather) weather->cb_from_http_layer.http_on_message(weather, &self->exchange, frame->payload,
+                                                                     frame->payload_len);
+            break;
+
+        case HTTP_WEBSOCKET_PING:
+            http_connection_ws_send(self, HTTP_WEBSOCKET_PONG, frame->payload, frame->payload_len);
+            break;
+
+        case HTTP_WEBSOCKET_PONG:
+            break;
+
+        case HTTP_WEBSOCKET_CLOSE:
+            http_connection_ws_close(self, 1000);
+            break;
+
+        default:
+            http_connection_ws_close(self, 1003);
+            break;
+    }
+}
+
+/**
+ * Writes queued frames, then reads and answers the client's. Any frame
+ * from the client counts as activity: an idle client is pinged after
+ * HTTP_WEBSOCKET_PING_S and the connection timeout closes one that does
+ * not answer.
+ **/
+static void http_connection_websocket_work(http_connection_t *self, uint64_t now_ms)
+{
+    if (self->response_len > self->sent_bytes)
+    {
+        ssize_t written = send(self->fd, self->response_buffer + self->sent_bytes,
+                               self->response_len - self->sent_bytes, MSG_NOSIGNAL);
+
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            LOG_DEBUG("[HTTP] WebSocket fd=%d write failed: %s", self->fd, strerror(errno));
+            http_connection_cleanup(self);
+            return;
+        }
+
+        if (written > 0) self->sent_bytes += (size_t)written;
+        if (self->sent_bytes == self->response_len) self->response_len = self->sent_bytes = 0;
+    }
+
+    if (self->ws_closing)
+    {
+        if (self->response_len == 0) http_connection_cleanup(self);
+        return;
+    }
+
+    ssize_t r = read(self->fd, self->raw_http_buffer + self->raw_http_buffer_len,
+                     sizeof(self->raw_http_buffer) - self->raw_http_buffer_len);
+
+    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        LOG_INFO("[HTTP] WebSocket fd=%d closed by client", self->fd);
+        http_connection_cleanup(self);
+        return;
+    }
+
+    if (r > 0)
+    {
+        self->raw_http_buffer_len += (size_t)r;
+        self->last_activity_ms = now_ms;
+        self->ws_ping_sent = 0;
+    }
+
+    /* Frames are unmasked where they lie and handled before the next read */
+    size_t offset = 0;
+
+    while (!self->ws_closing)
+    {
+        http_websocket_frame_t frame;
+        int used = http_websocket_parse(self->raw_http_buffer + offset, self->raw_http_buffer_len - offset,
+                                        &frame);
+
+        if (used == 0) break;
+
+        if (used < 0)
+        {
+            http_connection_ws_close(self, 1002);
+            break;
+        }
+
+        offset += (size_t)used;
+        http_connection_ws_frame(self, &frame);
+    }
+
+    memmove(self->raw_http_buffer, self->raw_http_buffer + offset, self->raw_http_buffer_len - offset);
+    self->raw_http_buffer_len -= offset;
+
+    if (!self->ws_closing && self->raw_http_buffer_len == sizeof(self->raw_http_buffer))
+    {
+        http_connection_ws_close(self, 1009);
+    }
+
+    if (!self->ws_closing && !self->ws_ping_sent &&
+        now_ms - self->last_activity_ms >= HTTP_WEBSOCKET_PING_S * 1000u)
+    {
+        http_connection_ws_send(self, HTTP_WEBSOCKET_PING, NULL, 0);
+        self->ws_ping_sent = 1;
+    }
+}
+
 /**
  * FIXED: Check for complete HTTP request
  */
@@ -236,6 +789,100 @@ static int http_request_is_complete(const char *buffer)
     return strstr(buffer, "\r\n\r\n") != NULL;
 }
 
+/**
+ * Starts the deadline of a state the connection just entered. The head
+ * of a request is timed from accept, through the parsing that may send
+ * it back to READING for more; the answer from the request being
+ * complete, so a slow head does not eat into the admission wait; the
+ * long-lived protocols answer to the idle timeout alone.
+ **/
+static void http_connection_arm_deadline(http_connection_t *self, uint64_t now_ms)
+{
+    self->deadline_state = self->state;
+    self->progress_ms = now_ms;
+    self->progress_bytes = 0;
+
+    switch (self->state)
+    {
+        case HTTP_CONNECTION_READING:
+        case HTTP_CONNECTION_PARSING:
+            break;
+
+        case HTTP_CONNECTION_PROCESSING:
+        case HTTP_CONNECTION_WAITING:
+            self->deadline_ms = now_ms + HTTP_PROCESSING_TIMEOUT_MS;
+            break;
+
+        case HTTP_CONNECTION_RECEIVING_BODY:
+            self->deadline_ms = now_ms + HTTP_BODY_TIMEOUT_MS;
+            break;
+
+        case HTTP_CONNECTION_SENDING:
+            self->deadline_ms = now_ms + HTTP_SEND_TIMEOUT_MS;
+            break;
+
+        default:
+            self->deadline_ms = 0;
+            break;
+    }
+}
+
+/**
+ * Whether the connection has outlived its idle timeout, its state's
+ * deadline or, moving a body or response, the minimum rate. Checked
+ * against the pass clock, so a few compares per connection and pass.
+ **/
+static int http_connection_expired(http_connection_t *self, uint64_t now_ms)
+{
+    if (self->state != self->deadline_state) http_connection_arm_deadline(self, now_ms);
+
+    if (now_ms - self->last_activity_ms > self->idle_timeout_ms)
+    {
+        LOG_INFO("[HTTP] >> Connection timeout for fd=%d", self->fd);
+        return 1;
+    }
+
+    if (self->deadline_ms && now_ms > self->deadline_ms)
+    {
+        LOG_INFO("[HTTP] >> Deadline of state %d passed for fd=%d", self->state, self->fd);
+        return 1;
+    }
+
+    if (self->state != HTTP_CONNECTION_RECEIVING_BODY && self->state != HTTP_CONNECTION_SENDING) return 0;
+
+    uint64_t elapsed = now_ms - self->progress_ms;
+    if (elapsed >= HTTP_MIN_RATE_GRACE_MS &&
+        (uint64_t)self->progress_bytes * 1000u < (uint64_t)HTTP_MIN_RATE_BYTES_PER_S * elapsed)
+    {
+        LOG_INFO("[HTTP] >> fd=%d moved %zu bytes in %llu ms, below the minimum rate", self->fd,
+                 self->progress_bytes, (unsigned long long)elapsed);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Answers a request target that did not fit. Cutting it short would
+ * answer a different request, a batch with fewer cities or a name cut
+ * in two.
+ **/
+static void http_connection_uri_too_long(http_connection_t *self)
+{
+    const char *uri_too_long =
+        "HTTP/1.1 414 URI Too Long\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 13\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "URI Too Long\n";
+
+    strncpy(self->response_buffer, uri_too_long, sizeof(self->response_buffer) - 1);
+    self->response_len = strlen(self->response_buffer);
+    self->sent_bytes = 0;
+    self->state = HTTP_CONNECTION_SENDING;
+}
+
 int8_t http_connection_work(task_node_t *node)
 {
     if (!node) return -1;
@@ -247,15 +894,13 @@ int8_t http_connection_work(task_node_t *node)
         return -1;
     }
 
-	time_t now       = time(NULL);
-	time_t time_idle = now - self->last_activity;
+    uint64_t now_ms = task_scheduler_pass_ms();
 
-	if(time_idle > self->timeout_s)
-	{
-		LOG_INFO("[HTTP] >> Connection timeout for fd=%d", self->fd);
-		http_connection_cleanup(self);
-		return 0;
-	}
+    if (http_connection_expired(self, now_ms))
+    {
+        http_connection_cleanup(self);
+        return 0;
+    }
 
     switch (self->state)
     {
@@ -276,7 +921,7 @@ int8_t http_connection_work(task_node_t *node)
 
             if (r > 0)
             {
-				self->last_activity = time(NULL);
+                self->last_activity_ms = now_ms;
                 self->raw_http_buffer_len += r;
                 self->raw_http_buffer[self->raw_http_buffer_len] = '\0';
                 
@@ -288,6 +933,12 @@ int8_t http_connection_work(task_node_t *node)
                     self->state = HTTP_CONNECTION_PARSING;
                     LOG_DEBUG("[HTTP] Complete request received");
                 }
+                else if (self->raw_http_buffer_len >= HTTP_MAX_HEADER_SIZE &&
+                         !strstr(self->raw_http_buffer, "\r\n"))
+                {
+                    LOG_WARN("[HTTP] Request line too long, sending 414, fd=%d", self->fd);
+                    http_connection_uri_too_long(self);
+                }
                 else if (self->raw_http_buffer_len >= HTTP_MAX_HEADER_SIZE)
                 {
                     LOG_ERROR("[HTTP] Request too large, fd=%d", self->fd);
@@ -310,7 +961,29 @@ int8_t http_connection_work(task_node_t *node)
 
         case HTTP_CONNECTION_PARSING:
         {
-            if (parse_http_request(self->raw_http_buffer, &self->parsed_request) != 0)
+            /* HTTP/2 by prior knowledge, the preface has a blank line of its own */
+            if (strncmp(self->raw_http_buffer, HTTP2_PREFACE, 18) == 0)
+            {
+                if (self->raw_http_buffer_len < HTTP2_PREFACE_SIZE)
+                {
+                    self->state = HTTP_CONNECTION_READING;
+                }
+                else if (http2_connection_start(self, NULL, self->raw_http_buffer,
+                                                self->raw_http_buffer_len) != 0)
+                {
+                    http_connection_cleanup(self);
+                }
+
+                return 0;
+            }
+
+            int parsed = parse_http_request(self->raw_http_buffer, &self->parsed_request);
+
+            if (parsed != 0 && self->parsed_request.uri_too_long)
+            {
+                http_connection_uri_too_long(self);
+            }
+            else if (parsed != 0)
             {
                 LOG_WARN("[HTTP] Failed to parse request, sending 400");
                 
@@ -327,8 +1000,37 @@ int8_t http_connection_work(task_node_t *node)
                 self->sent_bytes = 0;
                 self->state = HTTP_CONNECTION_SENDING;
             }
+            else if (self->parsed_request.content_length > HTTP_MAX_BODY_LENGTH)
+            {
+                LOG_WARN("[HTTP] Body of %zu bytes too large, sending 413",
+                         self->parsed_request.content_length);
+
+                const char *too_large =
+                    "HTTP/1.1 413 Content Too Large\r\n"
+                    "Content-Type: text/plain\r\n"
+                    "Content-Length: 18\r\n"
+                    "Connection: close\r\n"
+                    "\r\n"
+                    "Content Too Large\n";
+
+                strncpy(self->response_buffer, too_large, sizeof(self->response_buffer) - 1);
+                self->response_len = strlen(self->response_buffer);
+                self->sent_bytes = 0;
+                self->state = HTTP_CONNECTION_SENDING;
+            }
             else
             {
+                /* Body bytes that came in with the headers */
+                http_connection_request_t *req = &self->parsed_request;
+                size_t header_len = strstr(self->raw_http_buffer, "\r\n\r\n") + 4 - self->raw_http_buffer;
+                size_t buffered = self->raw_http_buffer_len - header_len;
+
+                if (buffered > req->content_length) buffered = req->content_length;
+                if (buffered > sizeof(self->body)) buffered = sizeof(self->body);
+
+                memcpy(self->body, self->raw_http_buffer + header_len, buffered);
+                self->body_len = buffered;
+
                 self->state = HTTP_CONNECTION_PROCESSING;
             }
             
@@ -339,18 +1041,95 @@ int8_t http_connection_work(task_node_t *node)
         {
             if (self->parent && self->parent->upper_weather_server_layer)
             {
-                weather_connection_t *weather_conn =
-                    weather_server_allocate_pool_slot(self->parent->upper_weather_server_layer);
+                weather_server_t *weather = self->parent->upper_weather_server_layer;
 
-                if (weather_conn)
+                /* Upgrade: h2c carries no body, the request becomes stream 1.
+                 * Without a free HTTP/2 slot it is answered as HTTP/1.1. */
+                if (self->parsed_request.h2c && self->parsed_request.content_length == 0)
                 {
-                    weather_conn->lower_http_connection = self;
-                    weather_conn->cb_from_http_layer.http_on_new_request(
-                        weather_conn, 
-                        &self->parsed_request
-                    );
+                    size_t header_len = strstr(self->raw_http_buffer, "\r\n\r\n") + 4 - self->raw_http_buffer;
 
-                    self->state = HTTP_CONNECTION_WAITING;
+                    if (http2_connection_start(self, &self->parsed_request, self->raw_http_buffer + header_len,
+                                               self->raw_http_buffer_len - header_len) == 0)
+                    {
+                        return 0;
+                    }
+                }
+
+                /* Cached answers come back before the call returns */
+                self->state = HTTP_CONNECTION_WAITING;
+
+                int8_t result = weather->cb_from_http_layer.http_on_new_request(
+                    weather, &self->exchange, &self->parsed_request);
+
+                if (result == WEATHER_REQUEST_ACCEPTED)
+                {
+                    return 0;
+                }
+                else if (result == WEATHER_REQUEST_UPGRADE)
+                {
+                    http_connection_upgrade(self);
+                    return 0;
+                }
+                else if (result == WEATHER_REQUEST_SUBSCRIBED)
+                {
+                    /* The socket is the weather layer's now, only the slot is given back */
+                    event_watcher_dereg_fd(self->fd);
+                    self->fd = -1;
+                    self->exchange.fd = -1;
+                    self->state = HTTP_CONNECTION_DONE;
+                    http_connection_cleanup(self);
+                    return 0;
+                }
+                else if (result == WEATHER_REQUEST_STREAM_BODY)
+                {
+                    self->state = HTTP_CONNECTION_RECEIVING_BODY;
+                    self->body_received = 0;
+
+                    if (self->parsed_request.expect_continue &&
+                        self->body_len < self->parsed_request.content_length)
+                    {
+                        /* Best effort, clients send the body anyway after a short wait */
+                        static const char continue_100[] = "HTTP/1.1 100 Continue\r\n\r\n";
+                        if (write(self->fd, continue_100, sizeof(continue_100) - 1) < 0)
+                        {
+                            LOG_DEBUG("[HTTP] 100 Continue not sent: %s", strerror(errno));
+                        }
+                    }
+
+                    http_connection_pass_body(self, self->body, self->body_len);
+                    return 0;
+                }
+                else if (result == WEATHER_REQUEST_NOT_FOUND)
+                {
+                    const char *not_found =
+                        "HTTP/1.1 404 Not Found\r\n"
+                        "Content-Type: text/plain\r\n"
+                        "Content-Length: 10\r\n"
+                        "Connection: close\r\n"
+                        "\r\n"
+                        "Not Found\n";
+
+                    strncpy(self->response_buffer, not_found, sizeof(self->response_buffer) - 1);
+                    self->response_len = strlen(self->response_buffer);
+                    self->sent_bytes = 0;
+                    self->state = HTTP_CONNECTION_SENDING;
+                    return 0;
+                }
+                else if (result == WEATHER_REQUEST_BAD_REQUEST)
+                {
+                    const char *bad_request =
+                        "HTTP/1.1 400 Bad Request\r\n"
+                        "Content-Type: text/plain\r\n"
+                        "Content-Length: 12\r\n"
+                        "Connection: close\r\n"
+                        "\r\n"
+                        "Bad Request\n";
+
+                    strncpy(self->response_buffer, bad_request, sizeof(self->response_buffer) - 1);
+                    self->response_len = strlen(self->response_buffer);
+                    self->sent_bytes = 0;
+                    self->state = HTTP_CONNECTION_SENDING;
                     return 0;
                 }
                 else
@@ -389,7 +1168,47 @@ int8_t http_connection_work(task_node_t *node)
             return 0;
         }
 
+        case HTTP_CONNECTION_RECEIVING_BODY:
+        {
+            http_connection_request_t *req = &self->parsed_request;
+
+            /* A few chunks per pass so one upload cannot starve other connections */
+            for (int i = 0; i < HTTP_BODY_READS_PER_WORK; i++)
+            {
+                size_t remaining = req->content_length - self->body_received;
+                if (remaining > sizeof(self->body)) remaining = sizeof(self->body);
+
+                ssize_t r = read(self->fd, self->body, remaining);
+
+                if (r > 0)
+                {
+                    self->last_activity_ms = now_ms;
+                    self->progress_bytes += (size_t)r;
+                    if (http_connection_pass_body(self, self->body, r) != 0) return 0;
+                    if (self->state != HTTP_CONNECTION_RECEIVING_BODY) return 0;
+                }
+                else if (r == 0)
+                {
+                    LOG_INFO("[HTTP] Client closed connection mid-body fd=%d", self->fd);
+                    http_connection_cleanup(self);
+                    return 0;
+                }
+                else
+                {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        LOG_ERROR("[HTTP] read failed: %s", strerror(errno));
+                        http_connection_cleanup(self);
+                    }
+                    return 0;
+                }
+            }
+
+            return 0;
+        }
+
         case HTTP_CONNECTION_WAITING:
+        case HTTP_CONNECTION_STREAMING:
         {
             /* Waiting for weather callback */
             return 0;
@@ -405,12 +1224,23 @@ int8_t http_connection_work(task_node_t *node)
 
             if (written > 0)
             {
-				self->last_activity = time(NULL);
+                self->last_activity_ms = now_ms;
+                self->progress_bytes += (size_t)written;
                 self->sent_bytes += written;
                 LOG_DEBUG("[HTTP] Sent %ld bytes, total %zu/%zu", 
                          written, self->sent_bytes, self->response_len);
 
-                if (self->sent_bytes >= self->response_len)
+                if (self->sent_bytes >= self->response_len && self->streaming)
+                {
+                    /* Piece written, ready for the next one */
+                    self->response_len = 0;
+                    self->sent_bytes = 0;
+                    self->state = HTTP_CONNECTION_STREAMING;
+
+                    /* The next piece may come before the next pass, its deadline starts then */
+                    http_connection_arm_deadline(self, now_ms);
+                }
+                else if (self->sent_bytes >= self->response_len)
                 {
                     LOG_INFO("[HTTP] Response complete for fd=%d", self->fd);
                     http_connection_cleanup(self);
@@ -425,6 +1255,18 @@ int8_t http_connection_work(task_node_t *node)
             return 0;
         }
 
+        case HTTP_CONNECTION_WEBSOCKET:
+        {
+            http_connection_websocket_work(self, now_ms);
+            return 0;
+        }
+
+        case HTTP_CONNECTION_HTTP2:
+        {
+            http2_connection_work(self->h2, now_ms);
+            return 0;
+        }
+
         case HTTP_CONNECTION_ERROR:
         case HTTP_CONNECTION_IDLE:
         case HTTP_CONNECTION_DONE:
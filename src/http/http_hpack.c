@@ -0,0 +1,490 @@
+/**
+ * Implementation-file: http_hpack.c
+ *
+ * HPACK (RFC 7541) for the HTTP/2 connections. Requests are decoded in
+ * full, dynamic table and Huffman strings included, since clients use
+ * both from their first request. Responses are encoded without either:
+ * statuses and names come from the static table and values go out as
+ * literals that are never indexed, so the encoder keeps no state.
+ **/
+
+#include "../../include/http/http_hpack.h"
+#include <string.h>
+
+typedef struct http_hpack_static
+{
+    const char *name;
+    const char *value;
+} http_hpack_static_t;
+
+/* Index 0 is not used, lookups are by the wire index */
+static const http_hpack_static_t http_hpack_static_table[] =
+{
+    { "", "" },
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" }
+};
+
+#define HTTP_HPACK_STATIC_COUNT (sizeof(http_hpack_static_table) / sizeof(http_hpack_static_table[0]) - 1)
+
+/**
+ * The Huffman code in canonical form: symbols sorted by code length,
+ * and per length how many codes there are, where their symbols start
+ * and the first code. A code of len bits is complete when it lies in
+ * [first[len], first[len] + count[len]). EOS, the only 30-bit code past
+ * the three listed, is never valid inside a string.
+ **/
+static const uint8_t http_hpack_huffman_symbols[256] =
+{
+     48,  49,  50,  97,  99, 101, 105, 111, 115, 116,  32,  37,  45,  46,  47,  51,
+     52,  53,  54,  55,  56,  57,  61,  65,  95,  98, 100, 102, 103, 104, 108, 109,
+    110, 112, 114, 117,  58,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,
+     77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  89, 106, 107, 113, 118,
+    119, 120, 121, 122,  38,  42,  44,  59,  88,  90,  33,  34,  40,  41,  63,  39,
+     43, 124,  35,  62,   0,  36,  64,  91,  93, 126,  94, 125,  60,  96, 123,  92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+    179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+    163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233,   1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+    158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239,   9, 142,
+    144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+    212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+      2,   3,   4,   5,   6,   7,   8,  11,  12,  14,  15,  16,  17,  18,  19,  20,
+     21,  23,  24,  25,  26,  27,  28,  29,  30,  31, 127, 220, 249,  10,  13,  22
+};
+
+static const uint16_t http_hpack_huffman_count[31] =
+{
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3,
+    0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 3
+};
+
+static const uint16_t http_hpack_huffman_offset[31] =
+{
+    0, 0, 0, 0, 0, 0, 10, 36, 68, 74, 74, 79, 82, 84, 90, 92,
+    95, 95, 95, 95, 98, 106, 119, 145, 174, 186, 190, 205, 224, 253, 253
+};
+
+static const uint32_t http_hpack_huffman_first[31] =
+{
+    0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x14, 0x5c,
+    0xf8, 0x1fc, 0x3f8, 0x7fa, 0xffa, 0x1ff8, 0x3ffc, 0x7ffc,
+    0xfffe, 0x1fffc, 0x3fff8, 0x7fff0, 0xfffe6, 0x1fffdc, 0x3fffd2, 0x7fffd8,
+    0xffffea, 0x1ffffec, 0x3ffffe0, 0x7ffffde, 0xfffffe2, 0x1ffffffe, 0x3ffffffc
+};
+
+void http_hpack_table_init(http_hpack_table_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+    self->max_size = HTTP2_HEADER_TABLE_SIZE;
+}
+
+/**
+ * Drops the oldest entries until size fits under max_size
+ **/
+static void http_hpack_evict(http_hpack_table_t *self, size_t max_size)
+{
+    uint16_t dropped = 0;
+    size_t bytes = 0;
+
+    while (dropped < self->count && self->size > max_size)
+    {
+        const http_hpack_entry_t *entry = &self->entries[dropped];
+
+        self->size -= entry->name_len + entry->value_len + HTTP_HPACK_ENTRY_OVERHEAD;
+        bytes += entry->name_len + entry->value_len;
+        dropped++;
+    }
+
+    if (dropped == 0) return;
+
+    memmove(self->data, self->data + bytes, self->data_len - bytes);
+    self->data_len -= bytes;
+
+    memmove(self->entries, self->entries + dropped, (self->count - dropped) * sizeof(self->entries[0]));
+    self->count -= dropped;
+
+    for (uint16_t i = 0; i < self->count; i++) self->entries[i].offset -= (uint16_t)bytes;
+}
+
+/**
+ * Adds an entry as the newest. One larger than the whole table empties
+ * it and is not added, which is not an error.
+ **/
+static void http_hpack_insert(http_hpack_table_t *self, const char *name, size_t name_len,
+                              const char *value, size_t value_len)
+{
+    size_t entry_size = name_len + value_len + HTTP_HPACK_ENTRY_OVERHEAD;
+
+    if (entry_size > self->max_size)
+    {
+        http_hpack_evict(self, 0);
+        return;
+    }
+
+    http_hpack_evict(self, self->max_size - entry_size);
+
+    /* max_size never exceeds data, and the entry count follows from that */
+    http_hpack_entry_t *entry = &self->entries[self->count++];
+    entry->offset = (uint16_t)self->data_len;
+    entry->name_len = (uint16_t)name_len;
+    entry->value_len = (uint16_t)value_len;
+
+    memcpy(self->data + self->data_len, name, name_len);
+    memcpy(self->data + self->data_len + name_len, value, value_len);
+    self->data_len += name_len + value_len;
+    self->size += entry_size;
+}
+
+/**
+ * Name and value at a wire index: the static table first, then the
+ * dynamic one newest first. Dynamic entries point into the table and
+ * only stay valid until the next insert.
+ **/
+static int http_hpack_lookup(const http_hpack_table_t *self, uint32_t index, const char **name,
+                             size_t *name_len, const char **value, size_t *value_len)
+{
+    if (index == 0) return -1;
+
+    if (index <= HTTP_HPACK_STATIC_COUNT)
+    {
+        *name = http_hpack_static_table[index].name;
+        *name_len = strlen(*name);
+        *value = http_hpack_static_table[index].value;
+        *value_len = strlen(*value);
+        return 0;
+    }
+
+    index -= HTTP_HPACK_STATIC_COUNT + 1;
+    if (index >= self->count) return -1;
+
+    const http_hpack_entry_t *entry = &self->entries[self->count - 1 - index];
+
+    *name = self->data + entry->offset;
+    *name_len = entry->name_len;
+    *value = self->data + entry->offset + entry->name_len;
+    *value_len = entry->value_len;
+    return 0;
+}
+
+/**
+ * An integer with an N-bit prefix. Anything past 2^28 is more than any
+ * length or index here can be and is refused.
+ **/
+static int http_hpack_integer(const uint8_t **p, const uint8_t *end, uint8_t prefix, uint32_t *out)
+{
+    if (*p >= end) return -1;
+
+    uint32_t max = (1u << prefix) - 1;
+    uint32_t value = *(*p)++ & max;
+
+    if (value < max)
+    {
+        *out = value;
+        return 0;
+    }
+
+    for (int shift = 0; shift <= 21; shift += 7)
+    {
+        if (*p >= end) return -1;
+
+        uint8_t byte = *(*p)++;
+        value += (uint32_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *out = value;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Decodes a Huffman string bit by bit against the canonical table. What
+ * is left at the end must be under a byte of EOS prefix, all ones.
+ **/
+static int http_hpack_huffman(const uint8_t *in, size_t len, char *out, size_t size, size_t *out_len)
+{
+    uint32_t code = 0;
+    uint8_t code_len = 0;
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            code = code << 1 | ((in[i] >> bit) & 1);
+            code_len++;
+
+            if (code - http_hpack_huffman_first[code_len] < http_hpack_huffman_count[code_len])
+            {
+                if (o >= size) return -1;
+
+                out[o++] = (char)http_hpack_huffman_symbols[http_hpack_huffman_offset[code_len] + code -
+                                                            http_hpack_huffman_first[code_len]];
+                code = 0;
+                code_len = 0;
+            }
+            else if (code_len == 30)
+            {
+                return -1;
+            }
+        }
+    }
+
+    if (code_len > 7 || code != (1u << code_len) - 1) return -1;
+
+    *out_len = o;
+    return 0;
+}
+
+/**
+ * A string literal. Plain ones point into the block, Huffman ones are
+ * decoded into the scratch space, which then moves past them.
+ **/
+static int http_hpack_string(const uint8_t **p, const uint8_t *end, char **scratch, const char *scratch_end,
+                             const char **out, size_t *out_len)
+{
+    if (*p >= end) return -1;
+
+    uint8_t huffman = **p & 0x80;
+    uint32_t len;
+
+    if (http_hpack_integer(p, end, 7, &len) != 0 || len > (size_t)(end - *p)) return -1;
+
+    if (!huffman)
+    {
+        *out = (const char *)*p;
+        *out_len = len;
+        *p += len;
+        return 0;
+    }
+
+    if (http_hpack_huffman(*p, len, *scratch, (size_t)(scratch_end - *scratch), out_len) != 0) return -1;
+
+    *out = *scratch;
+    *scratch += *out_len;
+    *p += len;
+    return 0;
+}
+
+/**
+ * Decodes a complete header block and calls on_header per header, in
+ * order. The scratch space holds Huffman strings and copied names, it
+ * is reused for every header. Returns -1 on anything malformed, which
+ * leaves the table unusable: the connection has to go.
+ **/
+int http_hpack_decode(http_hpack_table_t *self, const uint8_t *block, size_t len, char *scratch,
+                      size_t scratch_size, http_hpack_on_header_t on_header, void *ctx)
+{
+    if (!self || (!block && len > 0) || !scratch || !on_header) return -1;
+
+    const uint8_t *p = block;
+    const uint8_t *end = block + len;
+    const char *scratch_end = scratch + scratch_size;
+
+    while (p < end)
+    {
+        uint8_t first = *p;
+        char *cursor = scratch;
+        const char *name, *value;
+        size_t name_len, value_len;
+        uint32_t index;
+
+        if (first & 0x80)
+        {
+            /* Indexed header field */
+            if (http_hpack_integer(&p, end, 7, &index) != 0 ||
+                http_hpack_lookup(self, index, &name, &name_len, &value, &value_len) != 0)
+            {
+                return -1;
+            }
+        }
+        else if ((first & 0xE0) == 0x20)
+        {
+            /* Table size update, never beyond what SETTINGS allowed */
+            if (http_hpack_integer(&p, end, 5, &index) != 0 || index > HTTP2_HEADER_TABLE_SIZE) return -1;
+
+            self->max_size = index;
+            http_hpack_evict(self, self->max_size);
+            continue;
+        }
+        else
+        {
+            /* Literal with incremental indexing, without indexing or never indexed */
+            uint8_t indexing = (first & 0xC0) == 0x40;
+
+            if (http_hpack_integer(&p, end, indexing ? 6 : 4, &index) != 0) return -1;
+
+            if (index == 0)
+            {
+                if (http_hpack_string(&p, end, &cursor, scratch_end, &name, &name_len) != 0) return -1;
+            }
+            else
+            {
+                const char *unused;
+                size_t unused_len;
+
+                if (http_hpack_lookup(self, index, &name, &name_len, &unused, &unused_len) != 0) return -1;
+
+                /* A dynamic name would move under the insert below */
+                if (index > HTTP_HPACK_STATIC_COUNT && indexing)
+                {
+                    if (name_len > (size_t)(scratch_end - cursor)) return -1;
+
+                    memcpy(cursor, name, name_len);
+                    name = cursor;
+                    cursor += name_len;
+                }
+            }
+
+            if (http_hpack_string(&p, end, &cursor, scratch_end, &value, &value_len) != 0) return -1;
+
+            if (indexing) http_hpack_insert(self, name, name_len, value, value_len);
+        }
+
+        if (on_header(ctx, name, name_len, value, value_len) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static size_t http_hpack_encode_integer(uint32_t value, uint8_t prefix, uint8_t flags, uint8_t *out, size_t size)
+{
+    uint32_t max = (1u << prefix) - 1;
+    size_t o = 0;
+
+    if (size == 0) return 0;
+
+    if (value < max)
+    {
+        out[o++] = (uint8_t)(flags | value);
+        return o;
+    }
+
+    out[o++] = (uint8_t)(flags | max);
+    value -= max;
+
+    while (value >= 0x80)
+    {
+        if (o >= size) return 0;
+        out[o++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+
+    if (o >= size) return 0;
+    out[o++] = (uint8_t)value;
+    return o;
+}
+
+/**
+ * :status, indexed when the static table has it. Returns the bytes
+ * written, 0 when they do not fit.
+ **/
+size_t http_hpack_encode_status(uint16_t status, uint8_t *out, size_t size)
+{
+    char digits[4];
+
+    if (!out || status < 100 || status > 999) return 0;
+
+    for (uint32_t i = 8; i <= 14; i++)
+    {
+        const char *value = http_hpack_static_table[i].value;
+
+        if ((uint16_t)((value[0] - '0') * 100 + (value[1] - '0') * 10 + (value[2] - '0')) == status)
+        {
+            return http_hpack_encode_integer(i, 7, 0x80, out, size);
+        }
+    }
+
+    digits[0] = (char)('0' + status / 100);
+    digits[1] = (char)('0' + status / 10 % 10);
+    digits[2] = (char)('0' + status % 10);
+    digits[3] = '\0';
+
+    return http_hpack_encode_header(HTTP_HPACK_STATUS, digits, 3, out, size);
+}
+
+/**
+ * A literal without indexing, named by the static table and with the
+ * value as is
+ **/
+size_t http_hpack_encode_header(http_hpack_name_t name, const char *value, size_t value_len,
+                                uint8_t *out, size_t size)
+{
+    if (!out || (!value && value_len > 0)) return 0;
+
+    size_t o = http_hpack_encode_integer((uint32_t)name, 4, 0x00, out, size);
+    if (o == 0) return 0;
+
+    size_t n = http_hpack_encode_integer((uint32_t)value_len, 7, 0x00, out + o, size - o);
+    if (n == 0 || value_len > size - o - n) return 0;
+
+    o += n;
+    memcpy(out + o, value, value_len);
+    return o + value_len;
+}
@@ -7,12 +7,38 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
 
 #include "../../include/http/http_server.h"
 #include "../../include/task_scheduler/task_scheduler.h"
 #include "../../include/event_watcher/event_watcher.h"
 #include "../../include/logging/logging.h"
 
+#define HTTP_SERVER_STRINGIFY(x) #x
+#define HTTP_SERVER_TO_STRING(x) HTTP_SERVER_STRINGIFY(x)
+
+/**
+ * What clients turned away at accept get: built once, sent in one go
+ * and never touching a pool slot
+ **/
+static const char http_server_busy_response[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Type: text/plain\r\n"
+    "Retry-After: " HTTP_SERVER_TO_STRING(HTTP_BUSY_RETRY_AFTER_S) "\r\n"
+    "Content-Length: 12\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Server Busy\n";
+
+static const char http_server_throttled_response[] =
+    "HTTP/1.1 429 Too Many Requests\r\n"
+    "Content-Type: text/plain\r\n"
+    "Retry-After: " HTTP_SERVER_TO_STRING(HTTP_THROTTLED_RETRY_AFTER_S) "\r\n"
+    "Content-Length: 18\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Too Many Requests\n";
+
 int8_t http_server_init(http_server_t *self, struct weather_server *upper_weather_server_layer)
 {
     if (!self)
@@ -34,12 +60,21 @@ int8_t http_server_init(http_server_t *self, struct weather_server *upper_weathe
         self->child_http_connection[i].parent = self;
         self->child_http_connection[i].node.work = http_connection_work;
         self->child_http_connection[i].node.active = 0;
-        self->child_http_connection[i].cb_from_weather_layer.weather_on_handled_request = 
+        self->child_http_connection[i].exchange.request = &self->child_http_connection[i].parsed_request;
+        self->child_http_connection[i].exchange.fd = -1;
+        self->child_http_connection[i].exchange.cb_from_weather_layer.weather_on_handled_request = 
             http_connection_on_handled_request;
+        self->child_http_connection[i].exchange.cb_from_weather_layer.weather_on_stream =
+            http_connection_on_stream;
+        self->child_http_connection[i].exchange.cb_from_weather_layer.weather_on_frame =
+            http_connection_on_frame;
     }
 
     /* Assign callback for TCP -> HTTP hand-off */
     self->cb_from_tcp_layer.tcp_on_newly_accepted_client = http_server_on_new_client_cb;
+    self->cb_from_tcp_layer.tcp_on_rejected_client = http_server_on_rejected_client_cb;
+    self->cb_from_tcp_layer.tcp_on_throttled_client = http_server_on_throttled_client_cb;
+    self->cb_from_tcp_layer.tcp_free_slots = http_server_free_slots_cb;
     
     LOG_INFO("[HTTP SERVER] Initialized with pool size %d", CONNECTION_POOL_SIZE);
     return 0; /* FIXED: Was missing! */
@@ -62,7 +97,7 @@ http_connection_t *http_server_allocate_pool_slot(http_server_t *self)
     return NULL;
 }
 
-void http_server_on_new_client_cb(struct http_server *self, int fd)
+void http_server_on_new_client_cb(struct http_server *self, int fd, uint64_t client_key)
 {
     if (!self || fd < 0)
     {
@@ -74,18 +109,23 @@ void http_server_on_new_client_cb(struct http_server *self, int fd)
     if (!conn || self->active_count >= CONNECTION_POOL_SIZE)
     {
         LOG_WARN("[HTTP SERVER] Pool full, rejecting fd=%d", fd);
-        close(fd);
+        http_server_on_rejected_client_cb(self, fd);
         return;
     }
 
     /* Initialize connection */
     conn->fd                  = fd;
+    conn->exchange.fd         = fd;
+    conn->client_key          = client_key;
     conn->state               = HTTP_CONNECTION_READING;
     conn->raw_http_buffer_len = 0;
     conn->response_len        = 0;
     conn->sent_bytes          = 0;
-	conn->last_activity       = time(NULL);
-	conn->timeout_s           = TCP_TIMEOUT_S;
+    conn->body_received       = 0;
+    conn->last_activity_ms    = task_scheduler_pass_ms();
+    conn->idle_timeout_ms     = TCP_TIMEOUT_S * 1000;
+    conn->deadline_state      = HTTP_CONNECTION_READING;
+    conn->deadline_ms         = conn->last_activity_ms + HTTP_HEADER_TIMEOUT_MS;
     
     memset(conn->raw_http_buffer, 0, sizeof(conn->raw_http_buffer));
     memset(conn->response_buffer, 0, sizeof(conn->response_buffer));
@@ -99,3 +139,49 @@ void http_server_on_new_client_cb(struct http_server *self, int fd)
     LOG_INFO("[HTTP SERVER] Accepted client fd=%d, pool index=%ld, active=%d",
              fd, conn - &self->child_http_connection[0], self->active_count);
 }
+
+/**
+ * Whatever the client already sent is read first: closing with it
+ * unread would reset the connection and could lose the answer on the way
+ **/
+static void http_server_turn_away(int fd, const char *response, size_t len)
+{
+    char drain[HTTP_RAW_BUFFER_SIZE];
+    (void)recv(fd, drain, sizeof(drain), MSG_DONTWAIT);
+
+    if (send(fd, response, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+    {
+        LOG_DEBUG("[HTTP SERVER] Could not answer turned away fd=%d", fd);
+    }
+
+    shutdown(fd, SHUT_WR);
+    close(fd);
+}
+
+void http_server_on_rejected_client_cb(struct http_server *self, int fd)
+{
+    if (!self || fd < 0) return;
+    http_server_turn_away(fd, http_server_busy_response, sizeof(http_server_busy_response) - 1);
+}
+
+void http_server_on_throttled_client_cb(struct http_server *self, int fd)
+{
+    if (!self || fd < 0) return;
+    http_server_turn_away(fd, http_server_throttled_response, sizeof(http_server_throttled_response) - 1);
+}
+
+/**
+ * Charges a request after the first on a connection to its client's
+ * bucket, -1 when the client is over its rate
+ **/
+int8_t http_server_take_token(http_server_t *self, uint64_t client_key)
+{
+    if (!TCP_RATELIMIT_ENABLED || !self || !self->ratelimit) return 0;
+    return tcp_ratelimit_take(self->ratelimit, client_key);
+}
+
+uint8_t http_server_free_slots_cb(struct http_server *self)
+{
+    if (!self || self->active_count >= CONNECTION_POOL_SIZE) return 0;
+    return (uint8_t)(CONNECTION_POOL_SIZE - self->active_count);
+}
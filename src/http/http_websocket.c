@@ -0,0 +1,210 @@
+/**
+ * Implementation-file: http_websocket.c
+ *
+ * The parts of RFC 6455 the connection needs: the handshake key, server
+ * frame headers and parsing of client frames in the read buffer. SHA-1
+ * is only used for the handshake and kept here rather than pulling in a
+ * crypto library for it.
+ **/
+
+#include "../../include/http/http_websocket.h"
+#include <string.h>
+
+static const char http_websocket_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t http_sha1_rotate(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void http_sha1_block(uint32_t state[5], const uint8_t block[64])
+{
+    uint32_t w[80];
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+
+    for (int i = 16; i < 80; i++)
+    {
+        w[i] = http_sha1_rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+
+        if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+        else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+        uint32_t t = http_sha1_rotate(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = http_sha1_rotate(b, 30);
+        b = a;
+        a = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+/**
+ * Messages up to 119 bytes, two blocks with the padding, which covers
+ * every handshake key
+ **/
+static int http_sha1(const uint8_t *data, size_t len, uint8_t digest[20])
+{
+    uint8_t blocks[128];
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    if (len > sizeof(blocks) - 9) return -1;
+
+    size_t total = len + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+
+    memset(blocks, 0, sizeof(blocks));
+    memcpy(blocks, data, len);
+    blocks[len] = 0x80;
+
+    for (int i = 0; i < 8; i++) blocks[total - 1 - i] = (uint8_t)(bits >> (i * 8));
+
+    for (size_t offset = 0; offset < total; offset += 64) http_sha1_block(state, blocks + offset);
+
+    for (int i = 0; i < 5; i++)
+    {
+        digest[i * 4]     = (uint8_t)(state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)state[i];
+    }
+
+    return 0;
+}
+
+/**
+ * Sec-WebSocket-Accept for a client's Sec-WebSocket-Key, 28 characters
+ **/
+int http_websocket_accept_key(const char *key, char *out, size_t size)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint8_t input[64 + sizeof(http_websocket_guid)];
+    uint8_t digest[20];
+
+    if (!key || !out || size < 29) return -1;
+
+    size_t key_len = strlen(key);
+    if (key_len == 0 || key_len > 64) return -1;
+
+    memcpy(input, key, key_len);
+    memcpy(input + key_len, http_websocket_guid, sizeof(http_websocket_guid) - 1);
+
+    if (http_sha1(input, key_len + sizeof(http_websocket_guid) - 1, digest) != 0) return -1;
+
+    /* 20 bytes, six full groups and one with a single '=' */
+    size_t o = 0;
+    for (int i = 0; i < 20; i += 3)
+    {
+        uint32_t group = (uint32_t)digest[i] << 16 | (uint32_t)digest[i + 1] << 8 |
+                         (i + 2 < 20 ? digest[i + 2] : 0);
+
+        out[o++] = alphabet[(group >> 18) & 63];
+        out[o++] = alphabet[(group >> 12) & 63];
+        out[o++] = alphabet[(group >> 6) & 63];
+        out[o++] = i + 2 < 20 ? alphabet[group & 63] : '=';
+    }
+
+    out[o] = '\0';
+    return 0;
+}
+
+/**
+ * Writes the header of an unfragmented server frame, returns its length
+ **/
+size_t http_websocket_frame_header(uint8_t opcode, size_t payload_len, uint8_t *out)
+{
+    if (!out) return 0;
+
+    out[0] = (uint8_t)(0x80 | (opcode & 0x0F));
+
+    if (payload_len < 126)
+    {
+        out[1] = (uint8_t)payload_len;
+        return 2;
+    }
+
+    if (payload_len <= 0xFFFF)
+    {
+        out[1] = 126;
+        out[2] = (uint8_t)(payload_len >> 8);
+        out[3] = (uint8_t)payload_len;
+        return 4;
+    }
+
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) out[2 + i] = (uint8_t)((uint64_t)payload_len >> (56 - i * 8));
+    return 10;
+}
+
+/**
+ * Parses the frame at the start of data and unmasks its payload where it
+ * lies. Returns the bytes it takes up, 0 while it is incomplete and -1
+ * for frames a client must not send: unmasked, reserved bits set or
+ * control frames over 125 bytes.
+ **/
+int http_websocket_parse(char *data, size_t len, http_websocket_frame_t *frame)
+{
+    if (!data || !frame) return -1;
+    if (len < 2) return 0;
+
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    if ((bytes[0] & 0x70) != 0 || (bytes[1] & 0x80) == 0) return -1;
+
+    frame->fin = bytes[0] >> 7;
+    frame->opcode = bytes[0] & 0x0F;
+
+    uint64_t payload_len = bytes[1] & 0x7F;
+    size_t header_len = 2;
+
+    if (payload_len == 126)
+    {
+        if (len < 4) return 0;
+        payload_len = (uint64_t)bytes[2] << 8 | bytes[3];
+        header_len = 4;
+    }
+    else if (payload_len == 127)
+    {
+        if (len < 10) return 0;
+
+        payload_len = 0;
+        for (int i = 0; i < 8; i++) payload_len = payload_len << 8 | bytes[2 + i];
+        header_len = 10;
+    }
+
+    if ((frame->opcode & 0x08) && (payload_len > 125 || !frame->fin)) return -1;
+
+    /* A frame that cannot be complete in an int never fits a read buffer either */
+    if (payload_len > (uint64_t)0x7FFFFFFF - header_len - 4) return -1;
+
+    size_t total = header_len + 4 + (size_t)payload_len;
+    if (len < total) return 0;
+
+    const uint8_t *mask = bytes + header_len;
+    char *payload = data + header_len + 4;
+
+    for (size_t i = 0; i < payload_len; i++) payload[i] ^= (char)mask[i & 3];
+
+    frame->payload = payload;
+    frame->payload_len = (size_t)payload_len;
+    return (int)total;
+}
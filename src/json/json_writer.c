@@ -0,0 +1,379 @@
+/**
+ * Implementation-file: json_writer.c
+ *
+ * Numbers are formatted by hand, two digits per table lookup, and
+ * strings are copied in runs between the characters that need escaping.
+ * Nothing here goes through printf.
+ **/
+
+#include "../../include/json/json_writer.h"
+#include <math.h>
+#include <string.h>
+
+static const char json_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t json_powers_of_ten[] =
+{
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL
+};
+
+void json_writer_init(json_writer_t *self, char *out, size_t size)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+    self->out = out;
+    self->size = size;
+
+    if (!out || size == 0) self->overflow = 1;
+    else out[0] = '\0';
+}
+
+/**
+ * Carries on with the same document in a fresh buffer, for responses
+ * sent in pieces: len restarts at 0, the nesting is kept
+ **/
+void json_writer_rebuffer(json_writer_t *self, char *out, size_t size)
+{
+    if (!self) return;
+
+    self->out = out;
+    self->size = size;
+    self->len = 0;
+    self->overflow = !out || size == 0;
+}
+
+/**
+ * NUL-terminates the document and returns its length, 0 if it did not fit
+ **/
+size_t json_writer_finish(json_writer_t *self)
+{
+    if (!self || self->overflow || self->depth != 0) return 0;
+
+    self->out[self->len] = '\0';
+    return self->len;
+}
+
+/**
+ * Bytes left, one is always kept for the terminating NUL
+ **/
+size_t json_writer_room(const json_writer_t *self)
+{
+    if (!self || self->overflow) return 0;
+
+    return self->size - self->len - 1;
+}
+
+static void json_put(json_writer_t *self, const char *data, size_t len)
+{
+    if (self->overflow) return;
+
+    if (len > self->size - self->len - 1)
+    {
+        self->overflow = 1;
+        return;
+    }
+
+    memcpy(self->out + self->len, data, len);
+    self->len += len;
+}
+
+static void json_put_char(json_writer_t *self, char c)
+{
+    json_put(self, &c, 1);
+}
+
+/**
+ * Comma before every member but the first, nothing right after a key
+ **/
+static void json_separate(json_writer_t *self)
+{
+    if (self->after_key)
+    {
+        self->after_key = 0;
+        return;
+    }
+
+    uint32_t bit = 1u << self->depth;
+
+    if (self->has_member & bit) json_put_char(self, ',');
+    self->has_member |= bit;
+}
+
+static void json_open(json_writer_t *self, char c)
+{
+    json_separate(self);
+    json_put_char(self, c);
+
+    if (self->depth + 1 >= JSON_WRITER_MAX_DEPTH)
+    {
+        self->overflow = 1;
+        return;
+    }
+
+    self->depth++;
+    self->has_member &= ~(1u << self->depth);
+}
+
+static void json_close(json_writer_t *self, char c)
+{
+    if (self->depth == 0)
+    {
+        self->overflow = 1;
+        return;
+    }
+
+    self->depth--;
+    json_put_char(self, c);
+}
+
+void json_object_begin(json_writer_t *self) { if (self) json_open(self, '{'); }
+void json_object_end(json_writer_t *self)   { if (self) json_close(self, '}'); }
+void json_array_begin(json_writer_t *self)  { if (self) json_open(self, '['); }
+void json_array_end(json_writer_t *self)    { if (self) json_close(self, ']'); }
+
+static void json_put_escaped(json_writer_t *self, const char *value, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+
+    json_put_char(self, '"');
+
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        json_put(self, value + run, i - run);
+        run = i + 1;
+
+        char escape[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t escape_len = 2;
+
+        switch (c)
+        {
+            case '"':  escape[1] = '"';  break;
+            case '\\': escape[1] = '\\'; break;
+            case '\n': escape[1] = 'n';  break;
+            case '\r': escape[1] = 'r';  break;
+            case '\t': escape[1] = 't';  break;
+            case '\b': escape[1] = 'b';  break;
+            case '\f': escape[1] = 'f';  break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xf];
+                escape_len = 6;
+                break;
+        }
+
+        json_put(self, escape, escape_len);
+    }
+
+    json_put(self, value + run, len - run);
+    json_put_char(self, '"');
+}
+
+void json_key(json_writer_t *self, const char *key)
+{
+    if (!self || !key) return;
+
+    json_separate(self);
+    json_put_escaped(self, key, strlen(key));
+    json_put_char(self, ':');
+    self->after_key = 1;
+}
+
+void json_string_n(json_writer_t *self, const char *value, size_t len)
+{
+    if (!self) return;
+
+    json_separate(self);
+    json_put_escaped(self, value ? value : "", value ? len : 0);
+}
+
+void json_string(json_writer_t *self, const char *value)
+{
+    json_string_n(self, value, value ? strlen(value) : 0);
+}
+
+/**
+ * Writes the digits of value right-aligned ending at end, returns where they start
+ **/
+static char *json_format_digits(uint64_t value, char *end)
+{
+    char *p = end;
+
+    while (value >= 100)
+    {
+        const char *pair = json_digit_pairs + (value % 100) * 2;
+        value /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+
+    if (value >= 10)
+    {
+        const char *pair = json_digit_pairs + value * 2;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    else
+    {
+        *--p = (char)('0' + value);
+    }
+
+    return p;
+}
+
+static void json_put_number(json_writer_t *self, uint8_t negative, uint64_t magnitude)
+{
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = json_format_digits(magnitude, end);
+
+    if (negative) *--p = '-';
+
+    json_separate(self);
+    json_put(self, p, (size_t)(end - p));
+}
+
+void json_uint(json_writer_t *self, uint64_t value)
+{
+    if (self) json_put_number(self, 0, value);
+}
+
+void json_int(json_writer_t *self, int64_t value)
+{
+    if (!self) return;
+
+    /* Negated as unsigned so INT64_MIN works too */
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    json_put_number(self, value < 0, magnitude);
+}
+
+/**
+ * value / 10^decimals with exactly that many decimals, tenths of a
+ * degree come out as "-3.5"
+ **/
+void json_fixed(json_writer_t *self, int64_t value, uint8_t decimals)
+{
+    if (!self) return;
+
+    if (decimals == 0)
+    {
+        json_int(self, value);
+        return;
+    }
+
+    if (decimals > 9) decimals = 9;
+
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    uint64_t scale = json_powers_of_ten[decimals];
+
+    char digits[40];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+
+    /* Fraction with its leading zeros, then the integer part */
+    uint64_t fraction = magnitude % scale;
+    for (uint8_t i = 0; i < decimals; i++)
+    {
+        *--p = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+
+    *--p = '.';
+    p = json_format_digits(magnitude / scale, p);
+
+    if (value < 0) *--p = '-';
+
+    json_separate(self);
+    json_put(self, p, (size_t)(end - p));
+}
+
+/**
+ * Rounded to a fixed number of decimals, NaN and infinities become null
+ **/
+void json_double(json_writer_t *self, double value, uint8_t decimals)
+{
+    if (!self) return;
+
+    if (decimals > 9) decimals = 9;
+
+    double scaled = value * (double)json_powers_of_ten[decimals];
+
+    if (!isfinite(scaled) || fabs(scaled) >= 9.0e18)
+    {
+        json_null(self);
+        return;
+    }
+
+    json_fixed(self, (int64_t)llround(scaled), decimals);
+}
+
+void json_bool(json_writer_t *self, int value)
+{
+    if (!self) return;
+
+    json_separate(self);
+    if (value) json_put(self, "true", 4);
+    else json_put(self, "false", 5);
+}
+
+void json_null(json_writer_t *self)
+{
+    if (!self) return;
+
+    json_separate(self);
+    json_put(self, "null", 4);
+}
+
+void json_key_string(json_writer_t *self, const char *key, const char *value)
+{
+    json_key(self, key);
+    json_string(self, value);
+}
+
+void json_key_int(json_writer_t *self, const char *key, int64_t value)
+{
+    json_key(self, key);
+    json_int(self, value);
+}
+
+void json_key_uint(json_writer_t *self, const char *key, uint64_t value)
+{
+    json_key(self, key);
+    json_uint(self, value);
+}
+
+void json_key_fixed(json_writer_t *self, const char *key, int64_t value, uint8_t decimals)
+{
+    json_key(self, key);
+    json_fixed(self, value, decimals);
+}
+
+void json_key_double(json_writer_t *self, const char *key, double value, uint8_t decimals)
+{
+    json_key(self, key);
+    json_double(self, value, decimals);
+}
+
+void json_key_bool(json_writer_t *self, const char *key, int value)
+{
+    json_key(self, key);
+    json_bool(self, value);
+}
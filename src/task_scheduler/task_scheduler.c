@@ -8,6 +8,7 @@
 #include <string.h>
 #include <sys/select.h>
 #include <errno.h>
+#include <time.h>
 
 static task_scheduler_t g_task_scheduler;
 
@@ -97,6 +98,7 @@ int8_t task_scheduler_remove(task_node_t *node)
 int8_t task_scheduler_work(void)
 {
     task_node_t *node = g_task_scheduler.head;
+    g_task_scheduler.pass_ms = task_scheduler_now_ms();
     
     while (node)
     {
@@ -122,3 +124,16 @@ int8_t task_scheduler_work(void)
 
     return 0;
 }
+
+uint64_t task_scheduler_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+uint64_t task_scheduler_pass_ms(void)
+{
+    if (g_task_scheduler.pass_ms == 0) g_task_scheduler.pass_ms = task_scheduler_now_ms();
+    return g_task_scheduler.pass_ms;
+}
@@ -0,0 +1,149 @@
+/**
+ * Implementation-file: tcp_ratelimit.c
+ **/
+
+#include "../../include/tcp/tcp_ratelimit.h"
+#include "../../include/logging/logging.h"
+#include <string.h>
+#include <netinet/in.h>
+
+_Static_assert((TCP_RATELIMIT_SIZE & (TCP_RATELIMIT_SIZE - 1)) == 0,
+               "TCP_RATELIMIT_SIZE must be a power of two");
+_Static_assert(TCP_RATELIMIT_PROBE <= TCP_RATELIMIT_SIZE,
+               "TCP_RATELIMIT_PROBE cannot exceed TCP_RATELIMIT_SIZE");
+_Static_assert(TCP_RATELIMIT_RATE > 0, "TCP_RATELIMIT_RATE must be positive");
+
+#define TCP_RATELIMIT_TOKEN 1000u
+#define TCP_RATELIMIT_FULL ((uint32_t)TCP_RATELIMIT_BURST * TCP_RATELIMIT_TOKEN)
+
+/* Time an empty bucket takes to fill, after which it is as good as new */
+#define TCP_RATELIMIT_IDLE_MS ((uint64_t)TCP_RATELIMIT_FULL / TCP_RATELIMIT_RATE)
+
+void tcp_ratelimit_init(tcp_ratelimit_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+    LOG_INFO("[TCP RATELIMIT] Initialized %d buckets, %d/s, burst %d",
+             TCP_RATELIMIT_SIZE, TCP_RATELIMIT_RATE, TCP_RATELIMIT_BURST);
+}
+
+/**
+ * Moves the shared clock on and, once per interval, frees the buckets
+ * that have been left alone long enough to be full again
+ **/
+void tcp_ratelimit_tick(tcp_ratelimit_t *self, uint64_t now_ms)
+{
+    if (!self) return;
+
+    self->now_ms = now_ms;
+    if (now_ms < self->next_evict_ms) return;
+
+    self->next_evict_ms = now_ms + TCP_RATELIMIT_EVICT_INTERVAL_MS;
+
+    for (uint32_t i = 0; i < TCP_RATELIMIT_SIZE; i++)
+    {
+        tcp_ratelimit_entry_t *entry = &self->entries[i];
+        if (entry->key && now_ms - entry->refilled_ms >= TCP_RATELIMIT_IDLE_MS)
+        {
+            entry->key = 0;
+        }
+    }
+}
+
+/**
+ * FNV-1a over the address: IPv4 as it is, IPv4-mapped IPv6 as the IPv4
+ * address and other IPv6 by the /64 a single host usually holds. 0
+ * marks a free bucket, so no key is 0.
+ **/
+uint64_t tcp_ratelimit_key(const struct sockaddr *addr)
+{
+    if (!addr) return 0;
+
+    const uint8_t *bytes = NULL;
+    size_t len = 0;
+
+    if (addr->sa_family == AF_INET)
+    {
+        bytes = (const uint8_t *)&((const struct sockaddr_in *)addr)->sin_addr;
+        len = 4;
+    }
+    else if (addr->sa_family == AF_INET6)
+    {
+        const struct in6_addr *in6 = &((const struct sockaddr_in6 *)addr)->sin6_addr;
+        bytes = in6->s6_addr;
+        len = 8;
+
+        if (IN6_IS_ADDR_V4MAPPED(in6))
+        {
+            bytes = in6->s6_addr + 12;
+            len = 4;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash ? hash : 1;
+}
+
+/**
+ * Takes a token from key's bucket, -1 when there is none. A key not in
+ * its probe window gets a full bucket in a free slot there or, with the
+ * window taken, in the one whose client was seen longest ago.
+ **/
+int8_t tcp_ratelimit_take(tcp_ratelimit_t *self, uint64_t key)
+{
+    if (!self || key == 0) return 0;
+
+    uint32_t home = (uint32_t)(key >> 32) & (TCP_RATELIMIT_SIZE - 1);
+    tcp_ratelimit_entry_t *bucket = NULL;
+    tcp_ratelimit_entry_t *spare = NULL;
+
+    for (uint32_t i = 0; i < TCP_RATELIMIT_PROBE; i++)
+    {
+        tcp_ratelimit_entry_t *entry = &self->entries[(home + i) & (TCP_RATELIMIT_SIZE - 1)];
+
+        if (entry->key == key)
+        {
+            bucket = entry;
+            break;
+        }
+
+        if (!spare || (spare->key && (!entry->key || entry->refilled_ms < spare->refilled_ms)))
+        {
+            spare = entry;
+        }
+    }
+
+    if (!bucket)
+    {
+        bucket = spare;
+        bucket->key = key;
+        bucket->refilled_ms = self->now_ms;
+        bucket->tokens_milli = TCP_RATELIMIT_FULL;
+    }
+
+    uint64_t elapsed = self->now_ms > bucket->refilled_ms ? self->now_ms - bucket->refilled_ms : 0;
+    uint64_t tokens = bucket->tokens_milli + elapsed * TCP_RATELIMIT_RATE;
+
+    bucket->tokens_milli = tokens > TCP_RATELIMIT_FULL ? TCP_RATELIMIT_FULL : (uint32_t)tokens;
+    bucket->refilled_ms = self->now_ms;
+
+    if (bucket->tokens_milli < TCP_RATELIMIT_TOKEN)
+    {
+        self->throttled++;
+        return -1;
+    }
+
+    bucket->tokens_milli -= TCP_RATELIMIT_TOKEN;
+    return 0;
+}
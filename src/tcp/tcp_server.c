@@ -42,6 +42,8 @@ int8_t tcp_server_init(tcp_server_t *self, const char *port)
     self->port = port;
     self->state = TCP_SERVER_INIT;
     self->listen_fd = -1;
+    self->accept_budget = TCP_ACCEPT_BUDGET_INITIAL;
+    tcp_ratelimit_init(&self->ratelimit);
     
     struct addrinfo hints;
     struct addrinfo *res = NULL;
@@ -116,49 +118,169 @@ int8_t tcp_server_init(tcp_server_t *self, const char *port)
 }
 
 /**
- * FIXED: Removed duplicate select() call
- * Now relies on scheduler's select() result
- * FIXED: Proper error handling on fcntl failure
- */
-int8_t tcp_server_work(task_node_t *node)
+ * Next client off the backlog, already non-blocking, or -1 once there
+ * is none. key, when asked for, gets the client's rate limit key.
+ **/
+static int tcp_server_accept(tcp_server_t *self, uint64_t *key)
 {
-    if (!node) return -1;
-
-    tcp_server_t *self = container_of(node, tcp_server_t, node);
-    if (!self || self->state != TCP_SERVER_LISTENING || self->listen_fd < 0)
-    {
-        return 0;
-    }
-
-    for (int8_t i = 0; i < ACCEPTS_PER_ITERATION; i++)
+    for (;;)
     {
         struct sockaddr_storage client_addr;
         socklen_t addrlen = sizeof(client_addr);
-        
-        int client_fd = accept(self->listen_fd, 
-                              (struct sockaddr*)&client_addr, 
+
+        int client_fd = accept(self->listen_fd,
+                              (struct sockaddr*)&client_addr,
                               &addrlen);
-        
+
         if (client_fd < 0)
         {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
             {
-                break; /* No more clients waiting */
+                LOG_ERROR("[TCP] accept failed: %s", strerror(errno));
             }
-            
-            LOG_ERROR("[TCP] accept failed: %s", strerror(errno));
-            break;
+            return -1;
         }
 
         if (set_nonblocking_fd(client_fd) != 0)
         {
-            LOG_ERROR("[TCP] fcntl failed for client fd=%d: %s", 
+            LOG_ERROR("[TCP] fcntl failed for client fd=%d: %s",
                      client_fd, strerror(errno));
             close(client_fd);
             continue; /* Try next connection */
         }
 
+        if (key) *key = tcp_ratelimit_key((const struct sockaddr *)&client_addr);
+        return client_fd;
+    }
+}
+
+static void tcp_server_pause(tcp_server_t *self, uint64_t now_ms)
+{
+    if (self->paused_until_ms == 0)
+    {
+        event_watcher_dereg_fd(self->listen_fd);
+        LOG_DEBUG("[TCP] Pool full, pausing accept for %d ms", TCP_ACCEPT_PAUSE_MS);
+    }
+    self->paused_until_ms = now_ms + TCP_ACCEPT_PAUSE_MS;
+}
+
+static void tcp_server_resume(tcp_server_t *self)
+{
+    self->paused_until_ms = 0;
+    event_watcher_reg_fd(self->listen_fd);
+}
+
+/**
+ * With the pool full, turns away up to a budget of queued clients with
+ * the HTTP layer's 503 and goes back to pausing
+ **/
+static void tcp_server_reject(tcp_server_t *self, uint64_t now_ms)
+{
+    uint8_t rejected = 0;
+
+    while (rejected < self->accept_budget)
+    {
+        int client_fd = tcp_server_accept(self, NULL);
+        if (client_fd < 0) break;
+
+        if (self->upper_http_layer && self->cb_to_http_layer.tcp_on_rejected_client)
+        {
+            self->cb_to_http_layer.tcp_on_rejected_client(self->upper_http_layer, client_fd);
+        }
+        else
+        {
+            close(client_fd);
+        }
+        rejected++;
+    }
+
+    if (rejected > 0)
+    {
+        self->rejected += rejected;
+        LOG_WARN("[TCP] Pool full, rejected %d client(s) with 503 (%llu in total)",
+                 rejected, (unsigned long long)self->rejected);
+    }
+
+    if (TCP_ACCEPT_PAUSE_MS > 0) tcp_server_pause(self, now_ms);
+}
+
+/**
+ * Relies on the scheduler's select() result. Accepts at most the budget
+ * and never more than the HTTP layer has slots for; the budget halves
+ * after a slow pass and grows after one that used it all. A full pool
+ * first pauses accepting and only rejects those still waiting when the
+ * pause is over. A client out of tokens is throttled instead of served.
+ */
+int8_t tcp_server_work(task_node_t *node)
+{
+    if (!node) return -1;
+
+    tcp_server_t *self = container_of(node, tcp_server_t, node);
+    if (!self || self->state != TCP_SERVER_LISTENING || self->listen_fd < 0)
+    {
+        return 0;
+    }
+
+    uint64_t now_ms = task_scheduler_pass_ms();
+    uint64_t lag_ms = self->last_pass_ms ? now_ms - self->last_pass_ms : 0;
+    self->last_pass_ms = now_ms;
+    tcp_ratelimit_tick(&self->ratelimit, now_ms);
+
+    uint8_t resumed = 0;
+    if (self->paused_until_ms)
+    {
+        if (now_ms < self->paused_until_ms) return 0;
+        tcp_server_resume(self);
+        resumed = 1;
+    }
+
+    uint8_t free_slots = self->accept_budget;
+    if (self->upper_http_layer && self->cb_to_http_layer.tcp_free_slots)
+    {
+        free_slots = self->cb_to_http_layer.tcp_free_slots(self->upper_http_layer);
+    }
+
+    if (free_slots == 0)
+    {
+        if (resumed || TCP_ACCEPT_PAUSE_MS == 0)
+        {
+            tcp_server_reject(self, now_ms);
+        }
+        else
+        {
+            tcp_server_pause(self, now_ms);
+        }
+        return 0;
+    }
+
+    uint8_t limit = free_slots < self->accept_budget ? free_slots : self->accept_budget;
+    uint8_t accepted = 0;
+    uint8_t taken = 0;
+
+    /* Throttled clients count against the budget but not the free slots */
+    while (taken < self->accept_budget && accepted < limit)
+    {
+        uint64_t client_key = 0;
+        int client_fd = tcp_server_accept(self, &client_key);
+        if (client_fd < 0) break;
+        taken++;
+
+        if (TCP_RATELIMIT_ENABLED && tcp_ratelimit_take(&self->ratelimit, client_key) != 0)
+        {
+            LOG_WARN("[TCP] Client fd=%d over its rate, throttled", client_fd);
+            if (self->upper_http_layer && self->cb_to_http_layer.tcp_on_throttled_client)
+            {
+                self->cb_to_http_layer.tcp_on_throttled_client(self->upper_http_layer, client_fd);
+            }
+            else
+            {
+                close(client_fd);
+            }
+            continue;
+        }
+
         LOG_INFO("[TCP] Accepted client fd=%d", client_fd);
+        accepted++;
 
         /* Hand over to HTTP layer */
         if (self->upper_http_layer && 
@@ -166,7 +288,8 @@ int8_t tcp_server_work(task_node_t *node)
         {
             self->cb_to_http_layer.tcp_on_newly_accepted_client(
                 self->upper_http_layer, 
-                client_fd
+                client_fd,
+                client_key
             );
         }
         else
@@ -175,6 +298,17 @@ int8_t tcp_server_work(task_node_t *node)
             close(client_fd);
         }
     }
+    self->accepted += accepted;
+
+    if (lag_ms > TCP_ACCEPT_LAG_MS)
+    {
+        self->accept_budget /= 2;
+        if (self->accept_budget < TCP_ACCEPT_BUDGET_MIN) self->accept_budget = TCP_ACCEPT_BUDGET_MIN;
+    }
+    else if (taken == self->accept_budget && self->accept_budget < TCP_ACCEPT_BUDGET_MAX)
+    {
+        self->accept_budget++;
+    }
 
     return 0;
 }
@@ -185,7 +319,7 @@ void tcp_server_close(tcp_server_t *self)
     
     if (self->listen_fd >= 0)
     {
-        event_watcher_dereg_fd(self->listen_fd);
+        if (!self->paused_until_ms) event_watcher_dereg_fd(self->listen_fd);
         close(self->listen_fd);
         LOG_INFO("[TCP] Closed listen socket fd=%d", self->listen_fd);
     }
@@ -0,0 +1,268 @@
+/**
+ * Implementation-file: timeseries_ingest.c
+ **/
+
+#include "../../include/timeseries/timeseries_ingest.h"
+#include "../../include/logging/logging.h"
+#include <string.h>
+
+/**
+ * Parsed records wait here and go to the store in one call
+ **/
+typedef struct timeseries_ingest_batch
+{
+    uint32_t count;
+    uint8_t validated;
+    uint32_t valid_id;
+    uint32_t city_ids[TIMESERIES_INGEST_BATCH];
+    timeseries_observation_t observations[TIMESERIES_INGEST_BATCH];
+} timeseries_ingest_batch_t;
+
+void timeseries_ingest_reset(timeseries_ingest_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+}
+
+static const char *timeseries_ingest_skip_spaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static int timeseries_ingest_uint(const char **cursor, const char *end, uint64_t max, uint64_t *out)
+{
+    const char *p = timeseries_ingest_skip_spaces(*cursor, end);
+    const char *start = p;
+    uint64_t value = 0;
+
+    while (p < end && (unsigned)(*p - '0') < 10)
+    {
+        value = value * 10 + (uint64_t)(*p - '0');
+        if (value > max) return -1;
+        p++;
+    }
+
+    if (p == start) return -1;
+
+    *cursor = p;
+    *out = value;
+    return 0;
+}
+
+/**
+ * "-3", "-3.5" or "-3.54" as tenths, digits past the first decimal are dropped
+ **/
+static int timeseries_ingest_tenths(const char **cursor, const char *end, int32_t min, int32_t max,
+                                    int32_t *out)
+{
+    const char *p = timeseries_ingest_skip_spaces(*cursor, end);
+    int negative = 0;
+
+    if (p < end && *p == '-')
+    {
+        negative = 1;
+        p++;
+    }
+
+    uint64_t whole;
+    if (timeseries_ingest_uint(&p, end, 100000, &whole) != 0) return -1;
+
+    int32_t value = (int32_t)whole * 10;
+
+    if (p < end && *p == '.')
+    {
+        p++;
+        if (p >= end || (unsigned)(*p - '0') >= 10) return -1;
+
+        value += *p - '0';
+        while (p < end && (unsigned)(*p - '0') < 10) p++;
+    }
+
+    if (negative) value = -value;
+    if (value < min || value > max) return -1;
+
+    *cursor = p;
+    *out = value;
+    return 0;
+}
+
+/**
+ * Returns 1 for a record, 0 for a line to skip, -1 for a malformed one
+ **/
+static int timeseries_ingest_parse_line(const char *p, const char *end, uint32_t *city_id,
+                                        timeseries_observation_t *observation)
+{
+    if (end > p && end[-1] == '\r') end--;
+
+    p = timeseries_ingest_skip_spaces(p, end);
+    if (p == end || *p == '#') return 0;
+
+    uint64_t id, time, humidity;
+    int32_t temperature, wind;
+
+    if (timeseries_ingest_uint(&p, end, UINT32_MAX, &id) != 0 ||
+        timeseries_ingest_uint(&p, end, INT64_MAX, &time) != 0 ||
+        timeseries_ingest_tenths(&p, end, -1000, 1000, &temperature) != 0 ||
+        timeseries_ingest_uint(&p, end, 100, &humidity) != 0 ||
+        timeseries_ingest_tenths(&p, end, 0, 5000, &wind) != 0)
+    {
+        return -1;
+    }
+
+    if (timeseries_ingest_skip_spaces(p, end) != end || time == 0) return -1;
+
+    *city_id = (uint32_t)id;
+    observation->time        = (int64_t)time;
+    observation->temperature = (int16_t)temperature;
+    observation->humidity    = (uint8_t)humidity;
+    observation->wind        = (uint16_t)wind;
+    return 1;
+}
+
+static void timeseries_ingest_flush(timeseries_ingest_t *self, timeseries_ingest_batch_t *batch,
+                                    timeseries_store_t *store)
+{
+    if (batch->count == 0) return;
+
+    uint32_t appended = timeseries_store_append_batch(store, batch->city_ids, batch->observations,
+                                                      batch->count);
+
+    self->accepted += appended;
+    self->rejected += batch->count - appended;
+    batch->count = 0;
+}
+
+static void timeseries_ingest_line(timeseries_ingest_t *self, timeseries_ingest_batch_t *batch,
+                                   timeseries_store_t *store, const city_catalog_t *catalog,
+                                   const char *p, const char *end)
+{
+    uint32_t city_id;
+    timeseries_observation_t *observation = &batch->observations[batch->count];
+
+    int result = timeseries_ingest_parse_line(p, end, &city_id, observation);
+    if (result <= 0)
+    {
+        if (result < 0) self->rejected++;
+        return;
+    }
+
+    /* Gateways send runs of the same station, check the catalog for the first record and on a change */
+    if (catalog && catalog->loaded && (!batch->validated || city_id != batch->valid_id))
+    {
+        if (!city_catalog_by_id(catalog, city_id))
+        {
+            self->rejected++;
+            return;
+        }
+
+        batch->validated = 1;
+        batch->valid_id = city_id;
+    }
+
+    batch->city_ids[batch->count++] = city_id;
+
+    if (batch->count == TIMESERIES_INGEST_BATCH)
+    {
+        timeseries_ingest_flush(self, batch, store);
+    }
+}
+
+/**
+ * Parses every complete line in the chunk, the cut-off tail waits for
+ * the next one
+ **/
+void timeseries_ingest_feed(timeseries_ingest_t *self, timeseries_store_t *store,
+                            const city_catalog_t *catalog, const char *data, size_t len)
+{
+    if (!self || !store || !data || len == 0) return;
+
+    timeseries_ingest_batch_t batch;
+    batch.count = 0;
+    batch.validated = 0;
+    batch.valid_id = 0;
+
+    const char *p = data;
+    const char *end = data + len;
+
+    if (self->carry_len > 0 || self->carry_overflow)
+    {
+        const char *newline = memchr(p, '\n', len);
+        size_t take = newline ? (size_t)(newline - p) : len;
+
+        if (!self->carry_overflow && self->carry_len + take <= sizeof(self->carry))
+        {
+            memcpy(self->carry + self->carry_len, p, take);
+            self->carry_len += take;
+        }
+        else
+        {
+            self->carry_overflow = 1;
+        }
+
+        if (!newline) return;
+
+        if (self->carry_overflow) self->rejected++;
+        else timeseries_ingest_line(self, &batch, store, catalog, self->carry, self->carry + self->carry_len);
+
+        self->carry_len = 0;
+        self->carry_overflow = 0;
+        p = newline + 1;
+    }
+
+    while (p < end)
+    {
+        const char *newline = memchr(p, '\n', end - p);
+
+        if (!newline)
+        {
+            size_t rest = end - p;
+
+            if (rest <= sizeof(self->carry))
+            {
+                memcpy(self->carry, p, rest);
+                self->carry_len = rest;
+            }
+            else
+            {
+                self->carry_overflow = 1;
+            }
+            break;
+        }
+
+        timeseries_ingest_line(self, &batch, store, catalog, p, newline);
+        p = newline + 1;
+    }
+
+    timeseries_ingest_flush(self, &batch, store);
+}
+
+/**
+ * The body may end without a newline after the last record
+ **/
+void timeseries_ingest_finish(timeseries_ingest_t *self, timeseries_store_t *store,
+                              const city_catalog_t *catalog)
+{
+    if (!self || !store) return;
+
+    if (self->carry_overflow)
+    {
+        self->rejected++;
+    }
+    else if (self->carry_len > 0)
+    {
+        timeseries_ingest_batch_t batch;
+        batch.count = 0;
+        batch.validated = 0;
+        batch.valid_id = 0;
+
+        timeseries_ingest_line(self, &batch, store, catalog, self->carry, self->carry + self->carry_len);
+        timeseries_ingest_flush(self, &batch, store);
+    }
+
+    self->carry_len = 0;
+    self->carry_overflow = 0;
+
+    LOG_DEBUG("[INGEST] Accepted %u, rejected %u", self->accepted, self->rejected);
+}
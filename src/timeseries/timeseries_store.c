@@ -0,0 +1,458 @@
+/**
+ * Implementation-file: timeseries_store.c
+ **/
+
+#include "../../include/timeseries/timeseries_store.h"
+#include "../../include/logging/logging.h"
+#include <string.h>
+
+static const int64_t g_level_step[TIMESERIES_LEVEL_COUNT] = { 1, 60, 3600, 86400 };
+
+static const char *g_level_names[TIMESERIES_LEVEL_COUNT] = { "raw", "minute", "hour", "day" };
+
+const char *timeseries_level_name(timeseries_level_t level)
+{
+    return level < TIMESERIES_LEVEL_COUNT ? g_level_names[level] : "unknown";
+}
+
+static const timeseries_bucket_t *timeseries_level_buckets(const timeseries_series_t *series,
+                                                           timeseries_level_t level, uint32_t *capacity)
+{
+    switch (level)
+    {
+        case TIMESERIES_LEVEL_MINUTE: *capacity = TIMESERIES_MINUTE_CAPACITY; return series->minute;
+        case TIMESERIES_LEVEL_HOUR:   *capacity = TIMESERIES_HOUR_CAPACITY;   return series->hour;
+        case TIMESERIES_LEVEL_DAY:    *capacity = TIMESERIES_DAY_CAPACITY;    return series->day;
+        default:                      *capacity = 0;                          return NULL;
+    }
+}
+
+void timeseries_store_init(timeseries_store_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+    LOG_INFO("[TIMESERIES] Initialized %d series, %zu bytes each", TIMESERIES_SERIES,
+             sizeof(timeseries_series_t));
+}
+
+/**
+ * Open addressing on the city id, series are never removed
+ **/
+static timeseries_series_t *timeseries_store_slot(timeseries_store_t *self, uint32_t city_id, int add)
+{
+    uint32_t start = (uint32_t)((city_id * 2654435761u) % TIMESERIES_SERIES);
+
+    for (uint32_t i = 0; i < TIMESERIES_SERIES; i++)
+    {
+        timeseries_series_t *series = &self->series[(start + i) % TIMESERIES_SERIES];
+
+        if (series->used && series->city_id == city_id) return series;
+
+        if (!series->used)
+        {
+            if (!add) return NULL;
+
+            series->used = 1;
+            series->city_id = city_id;
+            self->series_count++;
+            return series;
+        }
+    }
+
+    return NULL;
+}
+
+const timeseries_series_t *timeseries_store_find(const timeseries_store_t *self, uint32_t city_id)
+{
+    if (!self) return NULL;
+
+    return timeseries_store_slot((timeseries_store_t *)self, city_id, 0);
+}
+
+static void timeseries_bucket_merge(timeseries_bucket_t *buckets, uint32_t capacity, int64_t step,
+                                    const timeseries_observation_t *observation)
+{
+    int64_t start = observation->time - observation->time % step;
+    timeseries_bucket_t *bucket = &buckets[(start / step) % capacity];
+
+    if (bucket->count > 0 && bucket->start > start)
+    {
+        /* The slot already holds a newer period, this one has aged out */
+        return;
+    }
+
+    if (bucket->count == 0 || bucket->start < start)
+    {
+        bucket->start = start;
+        bucket->count = 0;
+        bucket->temperature_min = INT16_MAX;
+        bucket->temperature_max = INT16_MIN;
+        bucket->temperature_sum = 0;
+        bucket->wind_sum = 0;
+        bucket->humidity_sum = 0;
+    }
+
+    bucket->count++;
+    bucket->temperature_sum += observation->temperature;
+    bucket->wind_sum += observation->wind;
+    bucket->humidity_sum += observation->humidity;
+
+    if (observation->temperature < bucket->temperature_min) bucket->temperature_min = observation->temperature;
+    if (observation->temperature > bucket->temperature_max) bucket->temperature_max = observation->temperature;
+}
+
+/**
+ * Raw readings must arrive in time order, late ones only reach the rollups
+ **/
+static void timeseries_series_append(timeseries_series_t *series, const timeseries_observation_t *observation)
+{
+    timeseries_raw_t *raw = &series->raw;
+
+    if (series->oldest == 0 || observation->time < series->oldest) series->oldest = observation->time;
+
+    if (raw->count == 0 || observation->time >= series->newest)
+    {
+        raw->time[raw->head]        = observation->time;
+        raw->temperature[raw->head] = observation->temperature;
+        raw->wind[raw->head]        = observation->wind;
+        raw->humidity[raw->head]    = observation->humidity;
+
+        raw->head = (raw->head + 1) % TIMESERIES_RAW_CAPACITY;
+        if (raw->count < TIMESERIES_RAW_CAPACITY) raw->count++;
+
+        series->newest = observation->time;
+    }
+
+    timeseries_bucket_merge(series->minute, TIMESERIES_MINUTE_CAPACITY,
+                            g_level_step[TIMESERIES_LEVEL_MINUTE], observation);
+    timeseries_bucket_merge(series->hour, TIMESERIES_HOUR_CAPACITY,
+                            g_level_step[TIMESERIES_LEVEL_HOUR], observation);
+    timeseries_bucket_merge(series->day, TIMESERIES_DAY_CAPACITY,
+                            g_level_step[TIMESERIES_LEVEL_DAY], observation);
+}
+
+int8_t timeseries_store_append(timeseries_store_t *self, uint32_t city_id,
+                               const timeseries_observation_t *observation)
+{
+    if (!self || !observation || observation->time <= 0) return -1;
+
+    timeseries_series_t *series = timeseries_store_slot(self, city_id, 1);
+    if (!series)
+    {
+        LOG_WARN("[TIMESERIES] No free series for city %u", city_id);
+        return -1;
+    }
+
+    timeseries_series_append(series, observation);
+    return 0;
+}
+
+/**
+ * Forecast samples keep to series of their own: none for a city whose
+ * series holds posted observations, and none once the table is full.
+ * One slot lookup per sample.
+ **/
+int8_t timeseries_store_sample(timeseries_store_t *self, uint32_t city_id,
+                               const timeseries_observation_t *observation)
+{
+    if (!self || !observation || observation->time <= 0) return -1;
+
+    timeseries_series_t *series = timeseries_store_slot(self, city_id, 1);
+    if (!series || series->observed) return -1;
+
+    timeseries_series_append(series, observation);
+    return 0;
+}
+
+static void timeseries_series_reset(timeseries_series_t *series, uint32_t city_id)
+{
+    memset(series, 0, sizeof(*series));
+    series->used = 1;
+    series->city_id = city_id;
+}
+
+/**
+ * The series posted observations go to. A series that only held
+ * forecast samples is cleared first so measured and forecast values
+ * never share a rollup, and with the table full a sampled series is
+ * given up to a reporting city.
+ **/
+static timeseries_series_t *timeseries_store_observed_slot(timeseries_store_t *self, uint32_t city_id)
+{
+    timeseries_series_t *series = timeseries_store_slot(self, city_id, 1);
+
+    if (!series)
+    {
+        for (uint32_t i = 0; i < TIMESERIES_SERIES && !series; i++)
+        {
+            if (!self->series[i].observed) series = &self->series[i];
+        }
+
+        if (!series) return NULL;
+
+        LOG_INFO("[TIMESERIES] City %u takes the sampled series of city %u", city_id, series->city_id);
+        timeseries_series_reset(series, city_id);
+    }
+    else if (!series->observed)
+    {
+        timeseries_series_reset(series, city_id);
+    }
+
+    series->observed = 1;
+    return series;
+}
+
+/**
+ * Appends posted observations, consecutive records of one city share the
+ * series lookup. Returns how many were stored.
+ **/
+uint32_t timeseries_store_append_batch(timeseries_store_t *self, const uint32_t *city_ids,
+                                       const timeseries_observation_t *observations, uint32_t count)
+{
+    if (!self || !city_ids || !observations) return 0;
+
+    timeseries_series_t *series = NULL;
+    uint32_t appended = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (observations[i].time <= 0) continue;
+
+        if (!series || series->city_id != city_ids[i])
+        {
+            series = timeseries_store_observed_slot(self, city_ids[i]);
+            if (!series)
+            {
+                LOG_WARN("[TIMESERIES] No free series for city %u", city_ids[i]);
+                continue;
+            }
+        }
+
+        timeseries_series_append(series, &observations[i]);
+        appended++;
+    }
+
+    return appended;
+}
+
+/**
+ * Physical slot of the i-th oldest raw reading
+ **/
+static uint32_t timeseries_raw_slot(const timeseries_raw_t *raw, uint32_t i)
+{
+    return (raw->head + TIMESERIES_RAW_CAPACITY - raw->count + i) % TIMESERIES_RAW_CAPACITY;
+}
+
+/**
+ * Raw readings with from <= time <= to: returns how many and the physical
+ * slot of the first, the run may wrap past the end of the ring
+ **/
+uint32_t timeseries_raw_span(const timeseries_series_t *series, int64_t from, int64_t to, uint32_t *first_slot)
+{
+    if (!series || !first_slot || from > to) return 0;
+
+    const timeseries_raw_t *raw = &series->raw;
+    uint32_t bounds[2];
+    int64_t targets[2] = { from, to };
+
+    for (int b = 0; b < 2; b++)
+    {
+        /* First reading at or after from, first one after to */
+        uint32_t lo = 0;
+        uint32_t hi = raw->count;
+
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int64_t time = raw->time[timeseries_raw_slot(raw, mid)];
+
+            if (b == 0 ? time < targets[b] : time <= targets[b]) lo = mid + 1;
+            else hi = mid;
+        }
+
+        bounds[b] = lo;
+    }
+
+    *first_slot = timeseries_raw_slot(raw, bounds[0]);
+    return bounds[1] - bounds[0];
+}
+
+/**
+ * Oldest time a level still holds data for, INT64_MIN while it has
+ * dropped nothing
+ **/
+static int64_t timeseries_level_oldest(const timeseries_series_t *series, timeseries_level_t level)
+{
+    if (level == TIMESERIES_LEVEL_RAW)
+    {
+        /* Until the ring wraps nothing has been dropped */
+        if (series->raw.count < TIMESERIES_RAW_CAPACITY) return INT64_MIN;
+
+        return series->raw.time[timeseries_raw_slot(&series->raw, 0)];
+    }
+
+    uint32_t capacity;
+    timeseries_level_buckets(series, level, &capacity);
+
+    int64_t step = g_level_step[level];
+    int64_t bound = series->newest - series->newest % step - (int64_t)(capacity - 1) * step;
+
+    return series->oldest >= bound ? INT64_MIN : bound;
+}
+
+/**
+ * Starts on the finest level that is no finer than the step and still
+ * covers from; the step is rounded up to whole buckets of that level
+ **/
+int8_t timeseries_cursor_init(timeseries_cursor_t *cursor, const timeseries_series_t *series,
+                              int64_t from, int64_t to, int64_t step)
+{
+    if (!cursor || !series || from > to || step <= 0) return -1;
+
+    memset(cursor, 0, sizeof(*cursor));
+
+    timeseries_level_t level = TIMESERIES_LEVEL_DAY;
+    while (level > TIMESERIES_LEVEL_RAW && g_level_step[level] > step) level--;
+
+    while (level < TIMESERIES_LEVEL_DAY && timeseries_level_oldest(series, level) > from) level++;
+
+    /* Whole level buckets per output step */
+    int64_t level_step = g_level_step[level];
+    step = (step + level_step - 1) / level_step * level_step;
+
+    /* Never walk periods the level no longer has */
+    int64_t oldest = timeseries_level_oldest(series, level);
+    if (from < oldest) from = oldest;
+    if (from < series->oldest) from = series->oldest;
+    if (to > series->newest) to = series->newest;
+
+    cursor->series   = series;
+    cursor->level    = level;
+    cursor->from     = from;
+    cursor->to       = to;
+    cursor->step     = step;
+    cursor->position = from - from % step;
+
+    if (level == TIMESERIES_LEVEL_RAW)
+    {
+        /* Raw times are ascending, binary search the first one in range */
+        const timeseries_raw_t *raw = &series->raw;
+        uint32_t lo = 0;
+        uint32_t hi = raw->count;
+
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (raw->time[timeseries_raw_slot(raw, mid)] < from) lo = mid + 1;
+            else hi = mid;
+        }
+
+        cursor->raw_index = lo;
+    }
+
+    return 0;
+}
+
+static void timeseries_point_reset(timeseries_point_t *point, int64_t start)
+{
+    memset(point, 0, sizeof(*point));
+    point->start = start;
+    point->temperature_min = INT16_MAX;
+    point->temperature_max = INT16_MIN;
+}
+
+static void timeseries_point_finish(timeseries_point_t *point, int64_t temperature_sum,
+                                    uint64_t wind_sum, uint64_t humidity_sum)
+{
+    int64_t count = point->count;
+    int64_t half = count / 2;
+
+    point->temperature_avg = (int16_t)((temperature_sum + (temperature_sum < 0 ? -half : half)) / count);
+    point->wind_avg        = (uint16_t)((wind_sum + half) / count);
+    point->humidity_avg    = (uint8_t)((humidity_sum + half) / count);
+}
+
+static int timeseries_cursor_next_raw(timeseries_cursor_t *cursor, timeseries_point_t *point)
+{
+    const timeseries_raw_t *raw = &cursor->series->raw;
+
+    if (cursor->raw_index >= raw->count) return 0;
+
+    uint32_t slot = timeseries_raw_slot(raw, cursor->raw_index);
+    if (raw->time[slot] > cursor->to) return 0;
+
+    int64_t start = raw->time[slot] - raw->time[slot] % cursor->step;
+    int64_t temperature_sum = 0;
+    uint64_t wind_sum = 0;
+    uint64_t humidity_sum = 0;
+
+    timeseries_point_reset(point, start);
+
+    while (cursor->raw_index < raw->count)
+    {
+        slot = timeseries_raw_slot(raw, cursor->raw_index);
+        if (raw->time[slot] >= start + cursor->step || raw->time[slot] > cursor->to) break;
+
+        int16_t temperature = raw->temperature[slot];
+        if (temperature < point->temperature_min) point->temperature_min = temperature;
+        if (temperature > point->temperature_max) point->temperature_max = temperature;
+
+        temperature_sum += temperature;
+        wind_sum += raw->wind[slot];
+        humidity_sum += raw->humidity[slot];
+        point->count++;
+        cursor->raw_index++;
+    }
+
+    timeseries_point_finish(point, temperature_sum, wind_sum, humidity_sum);
+    return 1;
+}
+
+/**
+ * Fills the next non-empty output step, returns 0 at the end of the range
+ **/
+int timeseries_cursor_next(timeseries_cursor_t *cursor, timeseries_point_t *point)
+{
+    if (!cursor || !cursor->series || !point) return 0;
+
+    if (cursor->level == TIMESERIES_LEVEL_RAW) return timeseries_cursor_next_raw(cursor, point);
+
+    uint32_t capacity;
+    const timeseries_bucket_t *buckets = timeseries_level_buckets(cursor->series, cursor->level, &capacity);
+    int64_t level_step = g_level_step[cursor->level];
+
+    while (cursor->position <= cursor->to)
+    {
+        int64_t start = cursor->position;
+        int64_t end = start + cursor->step;
+        int64_t temperature_sum = 0;
+        uint64_t wind_sum = 0;
+        uint64_t humidity_sum = 0;
+
+        timeseries_point_reset(point, start);
+        cursor->position = end;
+
+        for (int64_t t = start; t < end && t <= cursor->to; t += level_step)
+        {
+            const timeseries_bucket_t *bucket = &buckets[(t / level_step) % capacity];
+            if (bucket->count == 0 || bucket->start != t) continue;
+
+            if (bucket->temperature_min < point->temperature_min) point->temperature_min = bucket->temperature_min;
+            if (bucket->temperature_max > point->temperature_max) point->temperature_max = bucket->temperature_max;
+
+            temperature_sum += bucket->temperature_sum;
+            wind_sum += bucket->wind_sum;
+            humidity_sum += bucket->humidity_sum;
+            point->count += bucket->count;
+        }
+
+        if (point->count > 0)
+        {
+            timeseries_point_finish(point, temperature_sum, wind_sum, humidity_sum);
+            return 1;
+        }
+    }
+
+    return 0;
+}
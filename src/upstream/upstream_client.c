@@ -0,0 +1,157 @@
+/**
+ * Implementation-file: upstream_client.c
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "../../include/upstream/upstream_client.h"
+#include "../../include/upstream/upstream_connection.h"
+#include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/logging/logging.h"
+
+int8_t upstream_client_init(upstream_client_t *self, const char *host, const char *port)
+{
+    if (!self || !host || !port)
+    {
+        LOG_ERROR("[UPSTREAM] Invalid parameters");
+        return -1;
+    }
+
+    memset(self, 0, sizeof(*self));
+    self->pool_size = UPSTREAM_POOL_SIZE;
+    self->host = host;
+    self->port = port;
+
+    /**
+     * Resolved once at startup so the event loop never waits on DNS
+     **/
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int ret = getaddrinfo(host, port, &hints, &res);
+    if (ret != 0 || !res)
+    {
+        LOG_ERROR("[UPSTREAM] getaddrinfo failed for %s:%s: %s", host, port, gai_strerror(ret));
+        return -1;
+    }
+
+    memcpy(&self->addr, res->ai_addr, res->ai_addrlen);
+    self->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    for (int i = 0; i < UPSTREAM_POOL_SIZE; i++)
+    {
+        self->child_upstream_connection[i].fd = -1;
+        self->child_upstream_connection[i].state = UPSTREAM_CONNECTION_CLOSED;
+        self->child_upstream_connection[i].parent = self;
+        self->child_upstream_connection[i].node.work = upstream_connection_work;
+        self->child_upstream_connection[i].node.active = 0;
+    }
+
+    self->ready = 1;
+    LOG_INFO("[UPSTREAM] Initialized %s:%s with pool size %d", host, port, UPSTREAM_POOL_SIZE);
+    return 0;
+}
+
+/**
+ * Prefers a kept-alive connection, otherwise opens a new one
+ **/
+static upstream_connection_t *upstream_client_allocate_pool_slot(upstream_client_t *self)
+{
+    upstream_connection_t *closed = NULL;
+
+    for (int i = 0; i < UPSTREAM_POOL_SIZE; i++)
+    {
+        upstream_connection_t *conn = &self->child_upstream_connection[i];
+
+        if (conn->state == UPSTREAM_CONNECTION_IDLE)
+        {
+            LOG_DEBUG("[UPSTREAM] Reusing kept-alive slot [%d]", i);
+            return conn;
+        }
+
+        if (!closed && conn->state == UPSTREAM_CONNECTION_CLOSED)
+        {
+            closed = conn;
+        }
+    }
+
+    if (!closed)
+    {
+        LOG_WARN("[UPSTREAM] Pool full!");
+    }
+
+    return closed;
+}
+
+int8_t upstream_client_request(upstream_client_t *self,
+                               struct weather_connection *requester,
+                               const char *target)
+{
+    if (!self || !requester || !target) return -1;
+    if (!self->ready) return -1;
+
+    upstream_connection_t *conn = upstream_client_allocate_pool_slot(self);
+    if (!conn) return -1;
+
+    int written = snprintf(conn->request_buffer, sizeof(conn->request_buffer),
+                           "GET %s HTTP/1.1\r\n"
+                           "Host: %s:%s\r\n"
+                           "Accept: text/plain\r\n"
+                           "Connection: keep-alive\r\n"
+                           "\r\n",
+                           target, self->host, self->port);
+
+    if (written < 0 || (size_t)written >= sizeof(conn->request_buffer))
+    {
+        LOG_ERROR("[UPSTREAM] Request target too long");
+        return -1;
+    }
+
+    conn->request_len    = written;
+    conn->sent_bytes     = 0;
+    conn->response_len   = 0;
+    conn->header_len     = 0;
+    conn->content_length = -1;
+    conn->status         = 0;
+    conn->keep_alive     = 0;
+    conn->requester      = requester;
+    conn->deadline_ms    = task_scheduler_pass_ms() + UPSTREAM_TIMEOUT_MS;
+
+    if (conn->state == UPSTREAM_CONNECTION_IDLE)
+    {
+        conn->reused = 1;
+        conn->state  = UPSTREAM_CONNECTION_SENDING;
+    }
+    else if (upstream_connection_start(conn) != 0)
+    {
+        conn->requester = NULL;
+        return -1;
+    }
+
+    self->active_count++;
+
+    LOG_DEBUG("[UPSTREAM] GET %s on fd=%d, active=%d", target, conn->fd, self->active_count);
+    return 0;
+}
+
+void upstream_client_close(upstream_client_t *self)
+{
+    /* Never initialized, the pool fds are zeroes rather than -1 */
+    if (!self || !self->ready) return;
+
+    for (int i = 0; i < UPSTREAM_POOL_SIZE; i++)
+    {
+        upstream_connection_close(&self->child_upstream_connection[i]);
+    }
+
+    self->ready = 0;
+    self->active_count = 0;
+}
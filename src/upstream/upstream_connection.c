@@ -0,0 +1,384 @@
+/**
+ * Implementation-file: upstream_connection.c
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../../include/upstream/upstream_connection.h"
+#include "../../include/upstream/upstream_client.h"
+#include "../../include/weather/weather_connection.h"
+#include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/event_watcher/event_watcher.h"
+#include "../../include/logging/logging.h"
+
+static int set_nonblocking_fd(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) return -1;
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) return -1;
+    return 0;
+}
+
+void upstream_connection_close(upstream_connection_t *self)
+{
+    if (!self) return;
+
+    if (self->fd >= 0)
+    {
+        LOG_DEBUG("[UPSTREAM] Closing fd=%d", self->fd);
+        event_watcher_dereg_fd(self->fd);
+        close(self->fd);
+        self->fd = -1;
+    }
+
+    if (self->node.active)
+    {
+        task_scheduler_remove(&self->node);
+    }
+
+    self->state = UPSTREAM_CONNECTION_CLOSED;
+    self->reused = 0;
+}
+
+/**
+ * Opens a non-blocking socket, work() picks up completion once select
+ * reports it writable
+ **/
+int8_t upstream_connection_start(upstream_connection_t *self)
+{
+    if (!self || !self->parent) return -1;
+
+    upstream_client_t *client = self->parent;
+
+    int fd = socket(client->addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("[UPSTREAM] socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    if (set_nonblocking_fd(fd) != 0)
+    {
+        LOG_ERROR("[UPSTREAM] fcntl failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    int ret = connect(fd, (struct sockaddr *)&client->addr, client->addrlen);
+    if (ret != 0 && errno != EINPROGRESS)
+    {
+        LOG_WARN("[UPSTREAM] connect failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    self->fd     = fd;
+    self->reused = 0;
+    self->state  = (ret == 0) ? UPSTREAM_CONNECTION_SENDING : UPSTREAM_CONNECTION_CONNECTING;
+
+    event_watcher_reg_fd(fd);
+    if (self->state == UPSTREAM_CONNECTION_CONNECTING) event_watcher_want_write(fd, 1);
+
+    if (!self->node.active)
+    {
+        task_scheduler_add(&self->node);
+    }
+
+    return 0;
+}
+
+/**
+ * Hands the result to the requester and either parks or closes the socket
+ **/
+static void upstream_connection_finish(upstream_connection_t *self, uint16_t status,
+                                       const char *body, size_t body_len)
+{
+    struct weather_connection *requester = self->requester;
+    self->requester = NULL;
+
+    if (self->parent && self->parent->active_count > 0)
+    {
+        self->parent->active_count--;
+    }
+
+    if (requester && requester->cb_from_upstream_layer.upstream_on_response)
+    {
+        requester->cb_from_upstream_layer.upstream_on_response(requester, status, body, body_len);
+    }
+
+    if (self->state == UPSTREAM_CONNECTION_RECEIVING && self->keep_alive && self->fd >= 0)
+    {
+        self->state         = UPSTREAM_CONNECTION_IDLE;
+        self->idle_since_ms = task_scheduler_pass_ms();
+        self->response_len  = 0;
+        self->request_len   = 0;
+        LOG_DEBUG("[UPSTREAM] Keeping fd=%d alive", self->fd);
+    }
+    else
+    {
+        upstream_connection_close(self);
+    }
+}
+
+static void upstream_connection_fail(upstream_connection_t *self, uint16_t status)
+{
+    LOG_WARN("[UPSTREAM] Request failed with %d on fd=%d", status, self->fd);
+    self->keep_alive = 0;
+    upstream_connection_finish(self, status, NULL, 0);
+}
+
+/**
+ * A kept-alive socket may have been closed by the peer while parked,
+ * that is retried once on a fresh connection
+ **/
+static void upstream_connection_retry_or_fail(upstream_connection_t *self)
+{
+    if (self->reused && self->response_len == 0)
+    {
+        LOG_DEBUG("[UPSTREAM] Stale kept-alive fd=%d, reconnecting", self->fd);
+        upstream_connection_close(self);
+        self->sent_bytes = 0;
+
+        if (upstream_connection_start(self) == 0)
+        {
+            return;
+        }
+    }
+
+    upstream_connection_fail(self, UPSTREAM_STATUS_BAD_GATEWAY);
+}
+
+/**
+ * Returns 1 when headers are complete, 0 when more data is needed, -1 on error
+ **/
+static int upstream_parse_headers(upstream_connection_t *self)
+{
+    const char *end = strstr(self->response_buffer, "\r\n\r\n");
+    if (!end) return 0;
+
+    self->header_len = (end - self->response_buffer) + 4;
+
+    /* Status line: "HTTP/1.1 200 OK" */
+    if (strncmp(self->response_buffer, "HTTP/1.", 7) != 0) return -1;
+
+    self->keep_alive = (self->response_buffer[7] == '1');
+
+    const char *code = strchr(self->response_buffer, ' ');
+    if (!code || code > end) return -1;
+
+    long status = strtol(code + 1, NULL, 10);
+    if (status < 100 || status > 599) return -1;
+    self->status = (uint16_t)status;
+
+    if (self->status == 204 || self->status == 304)
+    {
+        self->content_length = 0;
+    }
+
+    const char *line = strstr(self->response_buffer, "\r\n") + 2;
+    while (line < end)
+    {
+        const char *line_end = strstr(line, "\r\n");
+
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+        {
+            self->content_length = strtol(line + 15, NULL, 10);
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0)
+        {
+            const char *value = line + 11;
+            while (*value == ' ') value++;
+            if (strncasecmp(value, "close", 5) == 0) self->keep_alive = 0;
+            if (strncasecmp(value, "keep-alive", 10) == 0) self->keep_alive = 1;
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0)
+        {
+            LOG_WARN("[UPSTREAM] Transfer-Encoding not supported");
+            return -1;
+        }
+
+        line = line_end + 2;
+    }
+
+    /* No length given: body ends when the upstream closes */
+    if (self->content_length < 0)
+    {
+        self->keep_alive = 0;
+    }
+
+    return 1;
+}
+
+static void upstream_connection_complete(upstream_connection_t *self)
+{
+    size_t body_len = self->response_len - self->header_len;
+
+    LOG_DEBUG("[UPSTREAM] Response %d with %zu bytes on fd=%d", self->status, body_len, self->fd);
+    upstream_connection_finish(self, self->status,
+                               self->response_buffer + self->header_len, body_len);
+}
+
+int8_t upstream_connection_work(task_node_t *node)
+{
+    if (!node) return -1;
+
+    upstream_connection_t *self = container_of(node, upstream_connection_t, node);
+    if (!self || self->fd < 0)
+    {
+        LOG_ERROR("[UPSTREAM] Invalid connection state");
+        return -1;
+    }
+
+    uint64_t now = task_scheduler_pass_ms();
+
+    if (self->state == UPSTREAM_CONNECTION_IDLE)
+    {
+        /* Parked: the peer closing shows up as readable, our own idle limit is a compare */
+        if (now - self->idle_since_ms > UPSTREAM_IDLE_TIMEOUT_MS)
+        {
+            upstream_connection_close(self);
+            return 0;
+        }
+
+        if (!event_watcher_readable(self->fd)) return 0;
+
+        char probe;
+        ssize_t r = recv(self->fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+
+        if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            upstream_connection_close(self);
+        }
+
+        return 0;
+    }
+
+    if (now >= self->deadline_ms)
+    {
+        LOG_WARN("[UPSTREAM] Deadline exceeded on fd=%d", self->fd);
+        upstream_connection_fail(self, UPSTREAM_STATUS_GATEWAY_TIMEOUT);
+        return 0;
+    }
+
+    switch (self->state)
+    {
+        case UPSTREAM_CONNECTION_CONNECTING:
+        {
+            if (!event_watcher_writable(self->fd))
+            {
+                return 0; /* Still connecting */
+            }
+
+            event_watcher_want_write(self->fd, 0);
+
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(self->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+            {
+                LOG_WARN("[UPSTREAM] connect failed: %s", strerror(err ? err : errno));
+                upstream_connection_fail(self, UPSTREAM_STATUS_BAD_GATEWAY);
+                return 0;
+            }
+
+            LOG_DEBUG("[UPSTREAM] Connected fd=%d", self->fd);
+            self->state = UPSTREAM_CONNECTION_SENDING;
+            return 0;
+        }
+
+        case UPSTREAM_CONNECTION_SENDING:
+        {
+            ssize_t written = send(self->fd,
+                                   self->request_buffer + self->sent_bytes,
+                                   self->request_len - self->sent_bytes,
+                                   MSG_NOSIGNAL);
+
+            if (written > 0)
+            {
+                self->sent_bytes += written;
+                if (self->sent_bytes >= self->request_len)
+                {
+                    self->response_len = 0;
+                    self->response_buffer[0] = '\0';
+                    self->state = UPSTREAM_CONNECTION_RECEIVING;
+                }
+            }
+            else if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                upstream_connection_retry_or_fail(self);
+            }
+
+            return 0;
+        }
+
+        case UPSTREAM_CONNECTION_RECEIVING:
+        {
+            if (!event_watcher_readable(self->fd)) return 0;
+
+            size_t available = sizeof(self->response_buffer) - self->response_len - 1;
+            if (available == 0)
+            {
+                LOG_ERROR("[UPSTREAM] Response too large on fd=%d", self->fd);
+                upstream_connection_fail(self, UPSTREAM_STATUS_BAD_GATEWAY);
+                return 0;
+            }
+
+            ssize_t r = recv(self->fd, self->response_buffer + self->response_len, available, 0);
+
+            if (r > 0)
+            {
+                self->response_len += r;
+                self->response_buffer[self->response_len] = '\0';
+
+                if (self->header_len == 0)
+                {
+                    int parsed = upstream_parse_headers(self);
+                    if (parsed < 0)
+                    {
+                        LOG_WARN("[UPSTREAM] Malformed response on fd=%d", self->fd);
+                        upstream_connection_fail(self, UPSTREAM_STATUS_BAD_GATEWAY);
+                        return 0;
+                    }
+                    if (parsed == 0) return 0;
+                }
+
+                if (self->content_length >= 0 &&
+                    self->response_len - self->header_len >= (size_t)self->content_length)
+                {
+                    self->response_len = self->header_len + self->content_length;
+                    upstream_connection_complete(self);
+                }
+            }
+            else if (r == 0)
+            {
+                if (self->header_len > 0 && self->content_length < 0)
+                {
+                    upstream_connection_complete(self);
+                }
+                else
+                {
+                    upstream_connection_retry_or_fail(self);
+                }
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                upstream_connection_retry_or_fail(self);
+            }
+
+            return 0;
+        }
+
+        case UPSTREAM_CONNECTION_CLOSED:
+        case UPSTREAM_CONNECTION_IDLE:
+        default:
+            return 0;
+    }
+
+    return 0;
+}
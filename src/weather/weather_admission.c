@@ -0,0 +1,178 @@
+/**
+ * Implementation-file: weather_admission.c
+ *
+ * Waiting room for requests that arrive while every weather slot is
+ * busy. Slots free up within a pass or two, so a burst above the pool
+ * size only has to wait a moment instead of getting 503s. CoDel tells a
+ * burst from overload by how long requests wait, not how many there
+ * are: a queue that drains keeps its wait under target, one that
+ * stays above target for a whole interval is shed at the head until it
+ * drains, and a request never waits past its deadline either way.
+ **/
+
+#include <string.h>
+#include <math.h>
+
+#include "../../include/weather/weather_admission.h"
+#include "../../include/logging/logging.h"
+
+void weather_admission_init(weather_admission_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+}
+
+/**
+ * Drops holes left by detached requests from the head
+ **/
+static void weather_admission_trim(weather_admission_t *self)
+{
+    while (self->count > 0 && !self->waiters[self->head].http_conn)
+    {
+        self->head = (uint16_t)((self->head + 1) % WEATHER_ADMISSION_QUEUE_SIZE);
+        self->count--;
+    }
+}
+
+static void weather_admission_take(weather_admission_t *self, weather_admission_waiter_t *out)
+{
+    *out = self->waiters[self->head];
+    self->waiters[self->head].http_conn = NULL;
+    self->head = (uint16_t)((self->head + 1) % WEATHER_ADMISSION_QUEUE_SIZE);
+    self->count--;
+}
+
+/* Sheds get closer together with the square root of how many there were */
+static uint64_t weather_admission_control_law(uint64_t t, uint32_t count)
+{
+    return t + (uint64_t)(WEATHER_ADMISSION_INTERVAL_MS / sqrt((double)count));
+}
+
+/**
+ * Queues a request behind the others, -1 when the queue is full
+ **/
+int8_t weather_admission_push(weather_admission_t *self, struct http_exchange *http_conn,
+                              const weather_request_t *request, uint64_t now_ms)
+{
+    if (!self || !http_conn || !request) return -1;
+    if (self->count >= WEATHER_ADMISSION_QUEUE_SIZE) return -1;
+
+    uint16_t tail = (uint16_t)((self->head + self->count) % WEATHER_ADMISSION_QUEUE_SIZE);
+    weather_admission_waiter_t *waiter = &self->waiters[tail];
+
+    waiter->http_conn = http_conn;
+    waiter->request = *request;
+    waiter->enqueued_ms = now_ms;
+    self->count++;
+
+    return 0;
+}
+
+/**
+ * Takes the oldest request for a free slot, or to be shed when CoDel
+ * says the queue is standing
+ **/
+weather_admission_result_t weather_admission_pop(weather_admission_t *self, uint64_t now_ms,
+                                                 weather_admission_waiter_t *out)
+{
+    if (!self || !out) return WEATHER_ADMISSION_EMPTY;
+
+    weather_admission_trim(self);
+
+    if (self->count == 0)
+    {
+        self->first_above_ms = 0;
+        self->dropping = 0;
+        return WEATHER_ADMISSION_EMPTY;
+    }
+
+    weather_admission_take(self, out);
+
+    uint64_t sojourn = now_ms - out->enqueued_ms;
+    uint8_t ok_to_drop = 0;
+
+    if (sojourn < WEATHER_ADMISSION_TARGET_MS)
+    {
+        self->first_above_ms = 0;
+    }
+    else if (self->first_above_ms == 0)
+    {
+        self->first_above_ms = now_ms + WEATHER_ADMISSION_INTERVAL_MS;
+    }
+    else
+    {
+        ok_to_drop = now_ms >= self->first_above_ms;
+    }
+
+    if (self->dropping)
+    {
+        if (!ok_to_drop)
+        {
+            self->dropping = 0;
+        }
+        else if (now_ms >= self->drop_next_ms)
+        {
+            self->drop_count++;
+            self->drop_next_ms = weather_admission_control_law(self->drop_next_ms, self->drop_count);
+            self->shed++;
+            return WEATHER_ADMISSION_SHED;
+        }
+    }
+    else if (ok_to_drop)
+    {
+        uint32_t delta = self->drop_count - self->last_count;
+
+        self->dropping = 1;
+        self->drop_count = delta > 1 && now_ms - self->drop_next_ms < 16 * WEATHER_ADMISSION_INTERVAL_MS
+                               ? delta : 1;
+        self->last_count = self->drop_count;
+        self->drop_next_ms = weather_admission_control_law(now_ms, self->drop_count);
+
+        LOG_WARN("[ADMISSION] Queue standing at %llu ms, shedding",
+                 (unsigned long long)sojourn);
+
+        self->shed++;
+        return WEATHER_ADMISSION_SHED;
+    }
+
+    self->admitted++;
+    return WEATHER_ADMISSION_ADMIT;
+}
+
+/**
+ * Takes the oldest request once it has waited past its deadline,
+ * returns 0 when there was none
+ **/
+int8_t weather_admission_expire(weather_admission_t *self, uint64_t now_ms, weather_admission_waiter_t *out)
+{
+    if (!self || !out) return 0;
+
+    weather_admission_trim(self);
+
+    if (self->count == 0 ||
+        now_ms - self->waiters[self->head].enqueued_ms < WEATHER_ADMISSION_DEADLINE_MS)
+    {
+        return 0;
+    }
+
+    weather_admission_take(self, out);
+    self->expired++;
+    return 1;
+}
+
+/**
+ * Forgets a request whose HTTP side went away
+ **/
+void weather_admission_remove(weather_admission_t *self, struct http_exchange *http_conn)
+{
+    if (!self || !http_conn) return;
+
+    for (uint16_t i = 0; i < self->count; i++)
+    {
+        weather_admission_waiter_t *waiter =
+            &self->waiters[(self->head + i) % WEATHER_ADMISSION_QUEUE_SIZE];
+
+        if (waiter->http_conn == http_conn) waiter->http_conn = NULL;
+    }
+}
@@ -0,0 +1,556 @@
+/**
+ * Implementation-file: weather_batch.c
+ **/
+
+#include "../../include/weather/weather_batch.h"
+#include "../../include/logging/logging.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void weather_batch_reset(weather_batch_t *self)
+{
+    if (!self) return;
+
+    /* The per-city columns are only read up to count, no need to clear them */
+    self->carry_len = 0;
+    self->carry_overflow = 0;
+    self->count = 0;
+    self->dropped = 0;
+    self->unknown_count = 0;
+    self->unknown_listed = 0;
+    self->unknown_len = 0;
+    self->unknown[0] = '\0';
+    self->started = 0;
+    self->next = 0;
+    self->done = 0;
+}
+
+static int weather_batch_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Percent-decodes a form value, '+' is a space. Returns the decoded length.
+ **/
+static size_t weather_batch_decode(const char *in, size_t len, char *out, size_t size)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < len && n + 1 < size; i++)
+    {
+        if (in[i] == '%' && i + 2 < len && weather_batch_hex(in[i + 1]) >= 0 &&
+            weather_batch_hex(in[i + 2]) >= 0)
+        {
+            out[n++] = (char)(weather_batch_hex(in[i + 1]) * 16 + weather_batch_hex(in[i + 2]));
+            i += 2;
+        }
+        else
+        {
+            out[n++] = in[i] == '+' ? ' ' : in[i];
+        }
+    }
+
+    out[n] = '\0';
+    return n;
+}
+
+/**
+ * Remembers a name the catalog did not know, echoed with anything but
+ * letters, digits, space, dash and underscore replaced
+ **/
+static void weather_batch_add_unknown(weather_batch_t *self, const char *name)
+{
+    self->unknown_count++;
+
+    size_t room = sizeof(self->unknown) - self->unknown_len;
+    int written = snprintf(self->unknown + self->unknown_len, room, "%s%s",
+                           self->unknown_len ? ", " : "", name);
+
+    if (written < 0 || (size_t)written >= room)
+    {
+        /* Full, the count still says how many there were */
+        self->unknown[self->unknown_len] = '\0';
+        return;
+    }
+
+    for (char *c = self->unknown + self->unknown_len; *c; c++)
+    {
+        if (!isalnum((unsigned char)*c) && *c != ' ' && *c != '-' && *c != '_' && *c != ',')
+        {
+            *c = '_';
+        }
+    }
+
+    self->unknown_len += (size_t)written;
+    self->unknown_listed++;
+}
+
+static void weather_batch_resolve(weather_batch_t *self, const city_catalog_t *catalog,
+                                  const char *name, uint8_t overflow)
+{
+    while (*name == ' ') name++;
+
+    size_t name_len = strlen(name);
+    while (name_len > 0 && name[name_len - 1] == ' ') name_len--;
+
+    if (name_len == 0) return;
+
+    if (self->count >= WEATHER_BATCH_MAX_CITIES)
+    {
+        self->dropped++;
+        return;
+    }
+
+    char trimmed[WEATHER_CITY_SIZE];
+    memcpy(trimmed, name, name_len);
+    trimmed[name_len] = '\0';
+
+    const city_record_t *record = NULL;
+
+    if (!overflow)
+    {
+        size_t digits = strspn(trimmed, "0123456789");
+
+        record = (digits == name_len && digits < 10) ?
+                 city_catalog_by_id(catalog, (uint32_t)strtoul(trimmed, NULL, 10)) :
+                 city_catalog_find(catalog, trimmed);
+    }
+
+    if (record)
+    {
+        self->city_ids[self->count++] = record->id;
+    }
+    else
+    {
+        weather_batch_add_unknown(self, trimmed);
+    }
+}
+
+static void weather_batch_token(weather_batch_t *self, const city_catalog_t *catalog,
+                                const char *token, size_t len, uint8_t overflow)
+{
+    while (len > 0 && (*token == ' ' || *token == '\t'))
+    {
+        token++;
+        len--;
+    }
+
+    while (len > 0 && (token[len - 1] == ' ' || token[len - 1] == '\t')) len--;
+
+    if (len == 0) return;
+
+    if (len >= 5 && memcmp(token, "city=", 5) == 0)
+    {
+        token += 5;
+        len -= 5;
+        if (len == 0) return;
+    }
+    else if (memchr(token, '=', len))
+    {
+        /* Some other form field */
+        return;
+    }
+
+    /* An encoded comma the scan could not see */
+    char decoded[WEATHER_CITY_SIZE];
+    weather_batch_decode(token, len, decoded, sizeof(decoded));
+
+    for (char *name = decoded; name; )
+    {
+        char *comma = strchr(name, ',');
+        if (comma) *comma = '\0';
+
+        /* Only the last name can have lost its tail to the size limit */
+        weather_batch_resolve(self, catalog, name, comma ? 0 : overflow);
+        name = comma ? comma + 1 : NULL;
+    }
+}
+
+/**
+ * Length of the separator at p, 0 for none. An encoded comma split by a
+ * chunk boundary is caught after decoding instead.
+ **/
+static size_t weather_batch_separator(const char *p, const char *end)
+{
+    if (*p == ',' || *p == '&' || *p == '\n' || *p == '\r') return 1;
+
+    if (*p == '%' && end - p >= 3 && p[1] == '2' && (p[2] == 'C' || p[2] == 'c')) return 3;
+
+    return 0;
+}
+
+void weather_batch_feed(weather_batch_t *self, const city_catalog_t *catalog, const char *data, size_t len)
+{
+    if (!self || !data) return;
+
+    const char *p = data;
+    const char *end = data + len;
+
+    while (p < end)
+    {
+        const char *stop = p;
+        size_t separator = 0;
+
+        while (stop < end && (separator = weather_batch_separator(stop, end)) == 0) stop++;
+
+        /* Whole token in this chunk and nothing carried, use it in place */
+        if (stop < end && self->carry_len == 0 && !self->carry_overflow)
+        {
+            weather_batch_token(self, catalog, p, (size_t)(stop - p), 0);
+            p = stop + separator;
+            continue;
+        }
+
+        size_t piece = (size_t)(stop - p);
+        size_t room = sizeof(self->carry) - self->carry_len;
+
+        if (piece > room)
+        {
+            piece = room;
+            self->carry_overflow = 1;
+        }
+
+        memcpy(self->carry + self->carry_len, p, piece);
+        self->carry_len += piece;
+
+        if (stop == end) return;
+
+        weather_batch_token(self, catalog, self->carry, self->carry_len, self->carry_overflow);
+        self->carry_len = 0;
+        self->carry_overflow = 0;
+        p = stop + separator;
+    }
+}
+
+/**
+ * A list that does not end in a separator still has its last name carried
+ **/
+void weather_batch_finish(weather_batch_t *self, const city_catalog_t *catalog)
+{
+    if (!self) return;
+
+    if (self->carry_len > 0)
+    {
+        weather_batch_token(self, catalog, self->carry, self->carry_len, self->carry_overflow);
+    }
+
+    self->carry_len = 0;
+    self->carry_overflow = 0;
+}
+
+static int weather_batch_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Looks up the current hour for every city. The ids are sorted and
+ * merged against the run's sorted id column in one pass, then each
+ * column is read with ascending offsets.
+ **/
+void weather_batch_gather(weather_batch_t *self, const forecast_store_t *store, time_t now)
+{
+    if (!self) return;
+
+    memset(self->has_data, 0, self->count);
+    self->time = 0;
+    if (!store || !store->loaded || self->count == 0) return;
+
+    /* Id in the high bits, request position in the low 16 */
+    uint64_t order[WEATHER_BATCH_MAX_CITIES];
+    for (uint16_t i = 0; i < self->count; i++)
+    {
+        order[i] = ((uint64_t)self->city_ids[i] << 16) | i;
+    }
+
+    qsort(order, self->count, sizeof(order[0]), weather_batch_compare);
+
+    uint32_t hour = forecast_store_hour(store, now);
+    self->time = store->header->base_time + (int64_t)hour * 3600;
+
+    uint32_t rows = store->header->city_count;
+    uint32_t row = 0;
+
+    size_t index[WEATHER_BATCH_MAX_CITIES];
+    uint16_t slot[WEATHER_BATCH_MAX_CITIES];
+    uint16_t found = 0;
+
+    for (uint16_t k = 0; k < self->count; k++)
+    {
+        uint32_t id = (uint32_t)(order[k] >> 16);
+
+        while (row < rows && store->city_ids[row] < id) row++;
+        if (row == rows) break;
+
+        if (store->city_ids[row] == id)
+        {
+            index[found] = forecast_store_index(store, row, hour);
+            slot[found] = (uint16_t)(order[k] & 0xffff);
+            found++;
+        }
+    }
+
+    for (uint16_t f = 0; f < found; f++) self->temperature[slot[f]] = store->temperature[index[f]];
+    for (uint16_t f = 0; f < found; f++) self->wind[slot[f]] = store->wind[index[f]];
+    for (uint16_t f = 0; f < found; f++) self->humidity[slot[f]] = store->humidity[index[f]];
+    for (uint16_t f = 0; f < found; f++) self->condition[slot[f]] = store->condition[index[f]];
+    for (uint16_t f = 0; f < found; f++) self->has_data[slot[f]] = 1;
+}
+
+/**
+ * JSON counterpart of the text render, whole city objects per piece.
+ * The writer keeps its nesting between pieces, so the pieces join into
+ * one document.
+ **/
+static size_t weather_batch_render_json(weather_batch_t *self, const city_catalog_t *catalog,
+                                        char *out, size_t size)
+{
+    json_writer_t *json = &self->json;
+
+    if (!self->started)
+    {
+        json_writer_init(json, out, size);
+        json_object_begin(json);
+        json_key_uint(json, "count", self->count);
+        json_key(json, "cities");
+        json_array_begin(json);
+
+        if (json->overflow) return 0;
+        self->started = 1;
+    }
+    else
+    {
+        json_writer_rebuffer(json, out, size);
+    }
+
+    while (self->next < self->count)
+    {
+        uint16_t i = self->next;
+        const city_record_t *record = city_catalog_by_id(catalog, self->city_ids[i]);
+        json_writer_t mark = *json;
+
+        json_object_begin(json);
+        json_key_string(json, "city", record ? city_catalog_name(catalog, record) : "?");
+        json_key_uint(json, "id", self->city_ids[i]);
+
+        if (self->has_data[i])
+        {
+            json_key_string(json, "condition", forecast_condition_name(self->condition[i]));
+            json_key_fixed(json, "temperature_c", self->temperature[i], 1);
+            json_key_uint(json, "humidity_pct", self->humidity[i]);
+            json_key_fixed(json, "wind_kmh", self->wind[i], 1);
+        }
+        else
+        {
+            json_key_string(json, "error", "no data");
+        }
+
+        json_object_end(json);
+
+        /* Out of room, the city goes first in the next piece */
+        if (json->overflow)
+        {
+            *json = mark;
+            return json->len;
+        }
+
+        self->next++;
+    }
+
+    json_writer_t mark = *json;
+
+    json_array_end(json);
+    json_key(json, "not_found");
+    json_array_begin(json);
+
+    /* The sanitized list has no commas left in names, split it back up */
+    for (const char *name = self->unknown; *name; )
+    {
+        const char *comma = strstr(name, ", ");
+        size_t len = comma ? (size_t)(comma - name) : strlen(name);
+
+        json_string_n(json, name, len);
+        name = comma ? comma + 2 : name + len;
+    }
+
+    json_array_end(json);
+    json_key_uint(json, "not_found_count", self->unknown_count);
+    json_key_uint(json, "skipped", self->dropped);
+    json_object_end(json);
+
+    if (json->overflow)
+    {
+        *json = mark;
+        return json->len;
+    }
+
+    self->done = 1;
+    return json->len;
+}
+
+/**
+ * CBOR counterpart, ids in request order instead of names. The city
+ * list is indefinite so pieces can end anywhere between cities.
+ **/
+static size_t weather_batch_render_cbor(weather_batch_t *self, char *out, size_t size)
+{
+    cbor_writer_t *cbor = &self->cbor;
+
+    cbor_writer_init(cbor, out, size);
+
+    if (!self->started)
+    {
+        cbor_map(cbor, 5);
+        cbor_key_uint(cbor, WEATHER_CBOR_COUNT, self->count);
+        cbor_key_int(cbor, WEATHER_CBOR_TIME, self->time);
+        cbor_uint(cbor, WEATHER_CBOR_ENTRIES);
+        cbor_array_begin(cbor);
+
+        if (cbor->overflow) return 0;
+        self->started = 1;
+    }
+
+    while (self->next < self->count)
+    {
+        uint16_t i = self->next;
+        cbor_writer_t mark = *cbor;
+
+        if (self->has_data[i])
+        {
+            cbor_map(cbor, 5);
+            cbor_key_uint(cbor, WEATHER_CBOR_ID, self->city_ids[i]);
+            cbor_key_uint(cbor, WEATHER_CBOR_CONDITION, self->condition[i]);
+            cbor_key_int(cbor, WEATHER_CBOR_TEMPERATURE, self->temperature[i]);
+            cbor_key_uint(cbor, WEATHER_CBOR_HUMIDITY, self->humidity[i]);
+            cbor_key_uint(cbor, WEATHER_CBOR_WIND, self->wind[i]);
+        }
+        else
+        {
+            cbor_map(cbor, 2);
+            cbor_key_uint(cbor, WEATHER_CBOR_ID, self->city_ids[i]);
+            cbor_key_text(cbor, WEATHER_CBOR_ERROR, "no data");
+        }
+
+        if (cbor->overflow)
+        {
+            *cbor = mark;
+            return cbor->len;
+        }
+
+        self->next++;
+    }
+
+    cbor_writer_t mark = *cbor;
+
+    cbor_break(cbor);
+    cbor_uint(cbor, WEATHER_CBOR_NOT_FOUND);
+    cbor_array_begin(cbor);
+
+    for (const char *name = self->unknown; *name; )
+    {
+        const char *comma = strstr(name, ", ");
+        size_t len = comma ? (size_t)(comma - name) : strlen(name);
+
+        cbor_text_n(cbor, name, len);
+        name = comma ? comma + 2 : name + len;
+    }
+
+    cbor_break(cbor);
+    cbor_key_uint(cbor, WEATHER_CBOR_SKIPPED, self->dropped);
+
+    if (cbor->overflow)
+    {
+        *cbor = mark;
+        return cbor->len;
+    }
+
+    self->done = 1;
+    return cbor->len;
+}
+
+/**
+ * Appends whole lines to out, as many as fit, and returns the bytes
+ * written. done is set once the trailer is out.
+ **/
+size_t weather_batch_render(weather_batch_t *self, const city_catalog_t *catalog, uint8_t format,
+                            char *out, size_t size)
+{
+    if (!self || !out || size == 0 || self->done) return 0;
+
+    if (format == WEATHER_FORMAT_JSON) return weather_batch_render_json(self, catalog, out, size);
+    if (format == WEATHER_FORMAT_CBOR) return weather_batch_render_cbor(self, out, size);
+
+    size_t written = 0;
+    int line;
+
+    if (!self->started)
+    {
+        line = snprintf(out, size, "Current weather for %u cities:\n", self->count);
+        if (line < 0 || (size_t)line >= size) return 0;
+
+        written = (size_t)line;
+        self->started = 1;
+    }
+
+    while (self->next < self->count)
+    {
+        uint16_t i = self->next;
+        const city_record_t *record = city_catalog_by_id(catalog, self->city_ids[i]);
+        const char *name = record ? city_catalog_name(catalog, record) : "?";
+
+        if (self->has_data[i])
+        {
+            int16_t t = self->temperature[i];
+            line = snprintf(out + written, size - written, "  %s: %s, %s%d.%d°C, %u%%, %u km/h\n",
+                            name, forecast_condition_name(self->condition[i]),
+                            t < 0 ? "-" : "", abs(t) / 10, abs(t) % 10,
+                            self->humidity[i], (self->wind[i] + 5) / 10);
+        }
+        else
+        {
+            line = snprintf(out + written, size - written, "  %s: no data\n", name);
+        }
+
+        /* Out of room, the line goes first in the next chunk */
+        if (line < 0 || (size_t)line >= size - written)
+        {
+            out[written] = '\0';
+            return written;
+        }
+
+        written += (size_t)line;
+        self->next++;
+    }
+
+    char trailer[WEATHER_BATCH_UNKNOWN_SIZE + 128];
+    int n = 0;
+
+    if (self->unknown_count > 0)
+    {
+        n += snprintf(trailer + n, sizeof(trailer) - n, "Not found (%u): %s%s\n", self->unknown_count,
+                      self->unknown, self->unknown_listed < self->unknown_count ? ", ..." : "");
+    }
+
+    if (self->dropped > 0 && n >= 0 && (size_t)n < sizeof(trailer))
+    {
+        n += snprintf(trailer + n, sizeof(trailer) - n, "Skipped %u cities over the limit of %d\n",
+                      self->dropped, WEATHER_BATCH_MAX_CITIES);
+    }
+
+    if (n < 0 || (size_t)n >= sizeof(trailer)) n = 0;
+    if ((size_t)n >= size - written) return written;
+
+    memcpy(out + written, trailer, (size_t)n + 1);
+    written += (size_t)n;
+    self->done = 1;
+
+    return written;
+}
@@ -0,0 +1,238 @@
+/**
+ * Implementation-file: weather_cache.c
+ **/
+
+#include "../../include/weather/weather_cache.h"
+#include "../../include/logging/logging.h"
+#include <string.h>
+
+void weather_cache_init(weather_cache_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+    weather_sketch_init(&self->sketch);
+    LOG_INFO("[WEATHER CACHE] Initialized with %d entries, ttl=%dms, stale=%dms",
+             WEATHER_CACHE_SIZE, WEATHER_CACHE_TTL_MS, WEATHER_CACHE_STALE_MS);
+}
+
+weather_cache_entry_t *weather_cache_find(weather_cache_t *self, uint64_t key)
+{
+    if (!self) return NULL;
+
+    for (int i = 0; i < WEATHER_CACHE_SIZE; i++)
+    {
+        if (self->entries[i].used && self->entries[i].key == key)
+        {
+            return &self->entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Fresh within the TTL, stale (still served) for a while after it
+ **/
+weather_cache_result_t weather_cache_lookup(weather_cache_t *self, uint64_t key, uint64_t now_ms,
+                                            weather_cache_entry_t **out)
+{
+    weather_cache_entry_t *entry = weather_cache_find(self, key);
+    if (!entry) return WEATHER_CACHE_MISS;
+
+    uint64_t age = now_ms - entry->fetched_ms;
+    if (age >= WEATHER_CACHE_TTL_MS + WEATHER_CACHE_STALE_MS)
+    {
+        return WEATHER_CACHE_MISS;
+    }
+
+    entry->hits++;
+    entry->last_hit_ms = now_ms;
+    if (out) *out = entry;
+
+    return (age < WEATHER_CACHE_TTL_MS) ? WEATHER_CACHE_FRESH : WEATHER_CACHE_STALE;
+}
+
+/**
+ * Replaces the entry for key, else takes a free slot, else evicts the
+ * least recently hit entry that is not among the most requested ones.
+ * A newcomer only gets in if it is requested more often than its victim,
+ * so one-off names cannot push out popular cities.
+ **/
+void weather_cache_store(weather_cache_t *self, const weather_request_t *request,
+                         uint16_t status, const char *response, size_t response_len, uint64_t now_ms)
+{
+    if (!self || !request || !response) return;
+
+    uint64_t key = request->key;
+    weather_cache_entry_t *entry = weather_cache_find(self, key);
+
+    if (entry)
+    {
+        /* Halve on every refresh so old popularity fades */
+        entry->hits >>= 1;
+    }
+    else
+    {
+        weather_cache_entry_t *victim = NULL;
+
+        for (int i = 0; i < WEATHER_CACHE_SIZE; i++)
+        {
+            weather_cache_entry_t *candidate = &self->entries[i];
+
+            if (!candidate->used)
+            {
+                victim = candidate;
+                break;
+            }
+
+            if (!candidate->refreshing &&
+                (!victim || candidate->last_hit_ms < victim->last_hit_ms) &&
+                !weather_sketch_is_top(&self->sketch, candidate->key))
+            {
+                victim = candidate;
+            }
+        }
+
+        if (!victim) return;
+
+        if (victim->used &&
+            weather_sketch_estimate(&self->sketch, key) <=
+            weather_sketch_estimate(&self->sketch, victim->key))
+        {
+            LOG_DEBUG("[WEATHER CACHE] Not admitting %s/%s", request->request_type, request->city);
+            return;
+        }
+
+        if (!victim->used)
+        {
+            self->count++;
+        }
+
+        LOG_DEBUG("[WEATHER CACHE] Storing %s/%s%s", request->request_type, request->city,
+                  victim->used ? " (evicting)" : "");
+
+        entry = victim;
+        entry->used = 1;
+        entry->key = key;
+        entry->hits = 0;
+        entry->last_hit_ms = now_ms;
+        entry->request = *request;
+    }
+
+    entry->refreshing = 0;
+    entry->status = status;
+    entry->fetched_ms = now_ms;
+
+    /* Binary bodies are copied by length, text stays NUL-terminated */
+    if (response_len > sizeof(entry->response) - 1) response_len = sizeof(entry->response) - 1;
+    memcpy(entry->response, response, response_len);
+    entry->response[response_len] = '\0';
+    entry->response_len = response_len;
+    entry->etag = weather_cache_hash(entry->response, response_len);
+
+    for (int i = 0; i < HTTP_ENCODING_COUNT - 1; i++) entry->variants[i].made = 0;
+}
+
+/**
+ * Content hash for ETags, eight bytes per multiply. Only has to tell one
+ * response apart from the next version of it.
+ **/
+uint64_t weather_cache_hash(const char *body, size_t len)
+{
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ len;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, body + i, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, body + i, len - i);
+    hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+
+    return hash ^ (hash >> 29);
+}
+
+/**
+ * The entry's body in the wanted coding, compressed the first time it is
+ * asked for and kept until the response is replaced. Returns the coding
+ * actually used, identity when compressing does not pay off.
+ **/
+uint8_t weather_cache_encoded(weather_cache_entry_t *entry, uint8_t encoding,
+                              const char **body, size_t *len)
+{
+    *body = entry->response;
+    *len = entry->response_len;
+
+    if (encoding == HTTP_ENCODING_IDENTITY || encoding >= HTTP_ENCODING_COUNT) return HTTP_ENCODING_IDENTITY;
+
+    weather_cache_variant_t *variant = &entry->variants[encoding - 1];
+
+    if (!variant->made)
+    {
+        variant->len = http_compress(encoding, entry->response, entry->response_len,
+                                     variant->body, sizeof(variant->body));
+        variant->made = 1;
+    }
+
+    if (variant->len == 0) return HTTP_ENCODING_IDENTITY;
+
+    *body = variant->body;
+    *len = variant->len;
+    return encoding;
+}
+
+/**
+ * Drops every response but keeps the request frequencies, for when the
+ * data behind the cached responses has been replaced
+ **/
+void weather_cache_invalidate(weather_cache_t *self)
+{
+    if (!self) return;
+
+    memset(self->entries, 0, sizeof(self->entries));
+    self->count = 0;
+}
+
+/**
+ * Most requested entries that expire soon or already serve stale,
+ * sorted by hits, highest first
+ **/
+uint8_t weather_cache_refresh_candidates(weather_cache_t *self, uint64_t now_ms,
+                                         weather_cache_entry_t **out, uint8_t max)
+{
+    if (!self || !out || max == 0) return 0;
+
+    uint8_t found = 0;
+
+    for (int i = 0; i < WEATHER_CACHE_SIZE; i++)
+    {
+        weather_cache_entry_t *entry = &self->entries[i];
+        if (!entry->used || entry->refreshing || entry->hits == 0) continue;
+
+        uint64_t age = now_ms - entry->fetched_ms;
+        if (age + WEATHER_CACHE_REFRESH_AHEAD_MS < WEATHER_CACHE_TTL_MS) continue;
+        if (age >= WEATHER_CACHE_TTL_MS + WEATHER_CACHE_STALE_MS) continue;
+
+        /* Insertion into the small sorted output */
+        uint8_t pos = found;
+        while (pos > 0 && out[pos - 1]->hits < entry->hits)
+        {
+            if (pos < max) out[pos] = out[pos - 1];
+            pos--;
+        }
+
+        if (pos < max)
+        {
+            out[pos] = entry;
+            if (found < max) found++;
+        }
+    }
+
+    return found;
+}
@@ -6,10 +6,16 @@
 #include "../../include/weather/weather_connection.h"
 #include "../../include/http/http_connection.h"
 #include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/aggregate/aggregate.h"
+#include "../../include/json/json_writer.h"
+#include "../../include/cbor/cbor_writer.h"
 #include "../../include/logging/logging.h"
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 /**
  * FIXED: Better input validation for city parameter
@@ -22,7 +28,7 @@ static void sanitize_city_name(char *city, size_t max_len)
     for (size_t i = 0; i < len && i < max_len - 1; i++)
     {
         /* Only allow alphanumeric, space, dash, underscore */
-        if (!isalnum(city[i]) && city[i] != ' ' && 
+        if (!isalnum((unsigned char)city[i]) && city[i] != ' ' && 
             city[i] != '-' && city[i] != '_')
         {
             city[i] = '_';
@@ -30,74 +36,1929 @@ static void sanitize_city_name(char *city, size_t max_len)
     }
 }
 
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Copies the value of name=... from a query string, %XX and '+' decoded.
+ * Returns 0 when the parameter is present.
+ **/
+static int weather_query_param(const char *query, const char *name, char *out, size_t size)
+{
+    size_t name_len = strlen(name);
+    const char *p = query;
+
+    while (p && *p)
+    {
+        if (strncmp(p, name, name_len) == 0 && p[name_len] == '=')
+        {
+            const char *value = p + name_len + 1;
+            size_t len = 0;
+
+            while (*value && *value != '&' && len < size - 1)
+            {
+                if (*value == '%' && hex_value(value[1]) >= 0 && hex_value(value[2]) >= 0)
+                {
+                    out[len++] = (char)(hex_value(value[1]) * 16 + hex_value(value[2]));
+                    value += 3;
+                }
+                else
+                {
+                    out[len++] = (*value == '+') ? ' ' : *value;
+                    value++;
+                }
+            }
+
+            out[len] = '\0';
+            return 0;
+        }
+
+        p = strchr(p, '&');
+        if (p) p++;
+    }
+
+    return -1;
+}
+
+/**
+ * Reads a coordinate parameter, -1 when it is malformed or outside [min, max]
+ **/
+static int weather_query_coordinate(const char *value, float min, float max, float *out)
+{
+    char *end;
+    float parsed = strtof(value, &end);
+
+    if (end == value || *end != '\0' || !(parsed >= min && parsed <= max)) return -1;
+
+    *out = parsed;
+    return 0;
+}
+
+/**
+ * FNV-1a over type and city, equal keys mean an identical response
+ **/
+static uint64_t weather_request_key(const char *request_type, const char *city)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (const char *c = request_type; *c; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+    }
+
+    hash = (hash ^ '/') * 1099511628211ULL;
+
+    for (const char *c = city; *c; c++)
+    {
+        hash = (hash ^ (uint8_t)tolower((unsigned char)*c)) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static uint64_t weather_request_mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * History requests only share a result when they ask for the same range
+ **/
+static uint64_t weather_request_key_range(uint64_t key, const weather_range_t *range)
+{
+    if (range->step == 0) return key;
+
+    key = weather_request_mix(key ^ (uint64_t)range->from);
+    key = weather_request_mix(key ^ (uint64_t)range->to);
+    return weather_request_mix(key ^ (uint64_t)range->step);
+}
+
+/**
+ * Aggregates only share a result when they reduce the same way
+ **/
+static uint64_t weather_request_key_aggregate(uint64_t key, const weather_aggregate_t *aggregate)
+{
+    if (aggregate->percentile_count == 0) return key;
+
+    key = weather_request_mix(key ^ (aggregate->history | (uint64_t)aggregate->field << 8 |
+                                     (uint64_t)aggregate->has_threshold << 16 |
+                                     (uint64_t)(uint32_t)aggregate->threshold << 32));
+
+    for (uint8_t i = 0; i < aggregate->percentile_count; i++)
+    {
+        uint32_t bits;
+        memcpy(&bits, &aggregate->percentiles[i], sizeof(bits));
+        key = weather_request_mix(key ^ bits ^ (uint64_t)i << 32);
+    }
+
+    return key;
+}
+
+/**
+ * Text keeps the keys it always had, other formats get their own entries
+ **/
+static uint64_t weather_request_key_format(uint64_t key, uint8_t format)
+{
+    if (format == WEATHER_FORMAT_TEXT) return key;
+
+    return weather_request_mix(key ^ ((uint64_t)format << 56));
+}
+
+/**
+ * Key for a city resolved through the catalog, mixed so that the sketch
+ * and the negative cache can split it into independent hash halves
+ **/
+uint64_t weather_request_key_from_id(const weather_request_t *request)
+{
+    uint64_t key = weather_request_mix(weather_request_key(request->request_type, "") ^ request->city_id);
+
+    key = weather_request_key_range(key, &request->range);
+    key = weather_request_key_aggregate(key, &request->aggregate);
+    return weather_request_key_format(key, request->format);
+}
+
+/**
+ * Unix seconds, "now", or seconds relative to now when zero or negative
+ **/
+static int weather_query_time(const char *value, time_t now, int64_t *out)
+{
+    if (strcmp(value, "now") == 0)
+    {
+        *out = now;
+        return 0;
+    }
+
+    char *end;
+    long long parsed = strtoll(value, &end, 10);
+    if (end == value || *end != '\0') return -1;
+
+    *out = parsed <= 0 ? now + parsed : parsed;
+    return 0;
+}
+
+/**
+ * Seconds with an optional s, m, h or d suffix
+ **/
+static int weather_query_duration(const char *value, int64_t *out)
+{
+    char *end;
+    long long parsed = strtoll(value, &end, 10);
+    if (end == value || parsed <= 0) return -1;
+
+    int64_t unit = 1;
+    if      (strcmp(end, "m") == 0) unit = 60;
+    else if (strcmp(end, "h") == 0) unit = 3600;
+    else if (strcmp(end, "d") == 0) unit = 86400;
+    else if (*end != '\0' && strcmp(end, "s") != 0) return -1;
+
+    if (parsed > INT32_MAX / unit) return -1;
+
+    *out = parsed * unit;
+    return 0;
+}
+
+/**
+ * from= and to= default to the last day, step= to an hour
+ **/
+static int weather_request_parse_range(weather_request_t *out, const char *query)
+{
+    char value[WEATHER_COORDINATE_SIZE];
+    time_t now = time(NULL);
+
+    out->range.to = now;
+    out->range.step = 3600;
+
+    if (weather_query_param(query, "to", value, sizeof(value)) == 0 &&
+        weather_query_time(value, now, &out->range.to) != 0)
+    {
+        return -1;
+    }
+
+    out->range.from = out->range.to - 86400;
+
+    if (weather_query_param(query, "from", value, sizeof(value)) == 0 &&
+        weather_query_time(value, now, &out->range.from) != 0)
+    {
+        return -1;
+    }
+
+    if (weather_query_param(query, "step", value, sizeof(value)) == 0 &&
+        weather_query_duration(value, &out->range.step) != 0)
+    {
+        return -1;
+    }
+
+    return out->range.from <= out->range.to ? 0 : -1;
+}
+
+/**
+ * source=forecast|history, field=temperature|humidity|wind, above= in
+ * display units and p= as a comma separated list. Forecasts cover hours=
+ * from now, history from= and to= like /history.
+ **/
+static int weather_request_parse_aggregate(weather_request_t *out, const char *query)
+{
+    char value[WEATHER_COORDINATE_SIZE];
+    weather_aggregate_t *aggregate = &out->aggregate;
+
+    if (weather_query_param(query, "source", value, sizeof(value)) == 0)
+    {
+        if (strcmp(value, "history") == 0) aggregate->history = 1;
+        else if (strcmp(value, "forecast") != 0) return -1;
+    }
+
+    aggregate->field = WEATHER_FIELD_TEMPERATURE;
+    if (weather_query_param(query, "field", value, sizeof(value)) == 0)
+    {
+        if (strcmp(value, "humidity") == 0) aggregate->field = WEATHER_FIELD_HUMIDITY;
+        else if (strcmp(value, "wind") == 0) aggregate->field = WEATHER_FIELD_WIND;
+        else if (strcmp(value, "temperature") != 0) return -1;
+    }
+
+    if (weather_query_param(query, "above", value, sizeof(value)) == 0)
+    {
+        char *end;
+        double above = strtod(value, &end);
+        if (end == value || *end != '\0' || !(above > -100000.0 && above < 100000.0)) return -1;
+
+        /* x > above in display units is x > floor(above) in stored units */
+        double scale = aggregate->field == WEATHER_FIELD_HUMIDITY ? 1.0 : 10.0;
+        aggregate->threshold = (int32_t)floor(above * scale + 1e-6);
+        aggregate->has_threshold = 1;
+    }
+
+    aggregate->percentiles[0] = 50.0f;
+    aggregate->percentiles[1] = 90.0f;
+    aggregate->percentile_count = 2;
+
+    if (weather_query_param(query, "p", value, sizeof(value)) == 0)
+    {
+        const char *p = value;
+        aggregate->percentile_count = 0;
+
+        while (*p)
+        {
+            char *end;
+            double percent = strtod(p, &end);
+
+            if (end == p || !(percent >= 0.0 && percent <= 100.0) ||
+                aggregate->percentile_count >= WEATHER_AGGREGATE_PERCENTILES)
+            {
+                return -1;
+            }
+
+            aggregate->percentiles[aggregate->percentile_count++] = (float)percent;
+
+            if (*end == ',') end++;
+            else if (*end != '\0') return -1;
+            p = end;
+        }
+
+        if (aggregate->percentile_count == 0) return -1;
+    }
+
+    if (aggregate->history)
+    {
+        if (weather_request_parse_range(out, query) != 0) return -1;
+
+        /* Reduced over raw readings, the step only keys the request */
+        out->range.step = 1;
+        return 0;
+    }
+
+    int64_t hours = WEATHER_AGGREGATE_HOURS;
+    if (weather_query_param(query, "hours", value, sizeof(value)) == 0)
+    {
+        char *end;
+        hours = strtoll(value, &end, 10);
+        if (end == value || *end != '\0' || hours <= 0 || hours > 24 * 16) return -1;
+    }
+
+    out->range.from = time(NULL);
+    out->range.to = out->range.from + hours * 3600;
+    out->range.step = 3600;
+    return 0;
+}
+
+/**
+ * hours= ahead and step= per summary line, rounded up to whole hours.
+ * Relative to now so the key does not change from second to second.
+ **/
+static int weather_request_parse_grid(weather_request_t *out, const char *query)
+{
+    char value[WEATHER_COORDINATE_SIZE];
+    int64_t hours = FORECAST_DAYS * 24;
+
+    if (weather_query_param(query, "hours", value, sizeof(value)) == 0)
+    {
+        char *end;
+        hours = strtoll(value, &end, 10);
+        if (end == value || *end != '\0' || hours <= 0 || hours > FORECAST_GRID_MAX_HOURS) return -1;
+    }
+
+    out->range.step = 86400;
+
+    if (weather_query_param(query, "step", value, sizeof(value)) == 0 &&
+        weather_query_duration(value, &out->range.step) != 0)
+    {
+        return -1;
+    }
+
+    out->range.step = (out->range.step + 3599) / 3600 * 3600;
+    out->range.from = 0;
+    out->range.to = hours * 3600;
+    return 0;
+}
+
+int8_t weather_request_parse(weather_request_t *out, const struct http_connection_request *request)
+{
+    if (!out || !request) return -1;
+
+    memset(out, 0, sizeof(*out));
+    
+    /* Route based on path */
+    if (strcmp(request->path, "/weather") == 0)
+    {
+        strncpy(out->request_type, "current", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/weather/batch") == 0)
+    {
+        strncpy(out->request_type, "batch", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/weather/stream") == 0)
+    {
+        strncpy(out->request_type, "stream", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/weather/ws") == 0)
+    {
+        strncpy(out->request_type, "websocket", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/forecast") == 0)
+    {
+        strncpy(out->request_type, "forecast", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/history") == 0)
+    {
+        strncpy(out->request_type, "history", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/aggregate") == 0)
+    {
+        strncpy(out->request_type, "aggregate", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/cities") == 0)
+    {
+        strncpy(out->request_type, "cities", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/top") == 0)
+    {
+        strncpy(out->request_type, "top", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/observations") == 0)
+    {
+        /* Readings are posted, there is nothing to get */
+        if (strcmp(request->method, "POST") != 0) return -1;
+
+        strncpy(out->request_type, "observations", sizeof(out->request_type) - 1);
+    }
+    else if (strcmp(request->path, "/") == 0)
+    {
+        strncpy(out->request_type, "default", sizeof(out->request_type) - 1);
+    }
+    else
+    {
+        strncpy(out->request_type, "unknown", sizeof(out->request_type) - 1);
+    }
+    
+    char lat[WEATHER_COORDINATE_SIZE];
+    char lon[WEATHER_COORDINATE_SIZE];
+
+    /* Parse city from query, /cities takes a name prefix instead */
+    if (strcmp(out->request_type, "cities") == 0)
+    {
+        weather_query_param(request->query, "prefix", out->city, sizeof(out->city));
+        sanitize_city_name(out->city, sizeof(out->city));
+    }
+    else if (weather_query_param(request->query, "lat", lat, sizeof(lat)) == 0 &&
+             weather_query_param(request->query, "lon", lon, sizeof(lon)) == 0)
+    {
+        /* Resolved to the nearest catalog city by the server */
+        if (weather_query_coordinate(lat, -90.0f, 90.0f, &out->lat) != 0 ||
+            weather_query_coordinate(lon, -180.0f, 180.0f, &out->lon) != 0)
+        {
+            return -1;
+        }
+
+        out->has_location = 1;
+        snprintf(out->city, sizeof(out->city), "%.4f,%.4f", out->lat, out->lon);
+    }
+    else if (weather_query_param(request->query, "city", out->city, sizeof(out->city)) == 0)
+    {
+        /* FIXED: Sanitize user input */
+        sanitize_city_name(out->city, sizeof(out->city));
+    }
+    else
+    {
+        strncpy(out->city, "Stockholm", sizeof(out->city) - 1);
+    }
+    
+    out->city[sizeof(out->city) - 1] = '\0';
+
+    if (strcmp(out->request_type, "history") == 0 &&
+        weather_request_parse_range(out, request->query) != 0)
+    {
+        return -1;
+    }
+
+    if (strcmp(out->request_type, "aggregate") == 0 &&
+        weather_request_parse_aggregate(out, request->query) != 0)
+    {
+        return -1;
+    }
+
+    if (strcmp(out->request_type, "forecast") == 0 && out->has_location &&
+        weather_request_parse_grid(out, request->query) != 0)
+    {
+        return -1;
+    }
+
+    char format[WEATHER_COORDINATE_SIZE];
+
+    /* CBOR is for the data polled by machines, everything else is text or JSON */
+    uint8_t binary = strcmp(out->request_type, "current") == 0 ||
+                     strcmp(out->request_type, "forecast") == 0 ||
+                     strcmp(out->request_type, "batch") == 0;
+
+    if (weather_query_param(request->query, "format", format, sizeof(format)) == 0)
+    {
+        if (strcmp(format, "json") == 0) out->format = WEATHER_FORMAT_JSON;
+        else if (strcmp(format, "cbor") == 0 && binary) out->format = WEATHER_FORMAT_CBOR;
+        else if (strcmp(format, "text") != 0) return -1;
+    }
+    else if (binary && strstr(request->accept, "application/cbor"))
+    {
+        out->format = WEATHER_FORMAT_CBOR;
+    }
+    else if (strstr(request->accept, "application/json"))
+    {
+        out->format = WEATHER_FORMAT_JSON;
+    }
+
+    out->key = weather_request_key_range(weather_request_key(out->request_type, out->city), &out->range);
+    out->key = weather_request_key_aggregate(out->key, &out->aggregate);
+    out->key = weather_request_key_format(out->key, out->format);
+
+    return 0;
+}
+
+/**
+ * Requests about one city, resolved through the catalog
+ **/
+int weather_request_has_city(const char *request_type)
+{
+    if (!request_type) return 0;
+
+    return weather_request_is_data(request_type) || strcmp(request_type, "history") == 0 ||
+           strcmp(request_type, "aggregate") == 0 || strcmp(request_type, "stream") == 0;
+}
+
+const char *weather_format_content_type(uint8_t format)
+{
+    static const char *types[] = { "text/plain", "application/json", "application/cbor" };
+
+    return format <= WEATHER_FORMAT_CBOR ? types[format] : types[WEATHER_FORMAT_TEXT];
+}
+
+/**
+ * Requests answered with weather data, the ones worth caching
+ **/
+int weather_request_is_data(const char *request_type)
+{
+    if (!request_type) return 0;
+
+    return strcmp(request_type, "current") == 0 ||
+           strcmp(request_type, "forecast") == 0;
+}
+
 void weather_connection_on_request_cb(struct weather_connection *self, 
-                                     const struct http_connection_request *request)
+                                     const weather_request_t *request)
+{
+    if (!self || !request)
+    {
+        LOG_ERROR("[WEATHER CONN CB] Invalid parameters");
+        return;
+    }
+    
+    self->state = WEATHER_CONNECTION_PROCESSING;
+
+    memcpy(self->request_type, request->request_type, sizeof(self->request_type));
+    memcpy(self->city, request->city, sizeof(self->city));
+    self->city_id = request->city_id;
+    self->range = request->range;
+    self->aggregate = request->aggregate;
+    self->format = request->format;
+    self->key = request->key;
+    self->has_location = request->has_location;
+    self->lat = request->lat;
+    self->lon = request->lon;
+    self->waiter_count = 0;
+    self->snapshot = self->parent ? weather_snapshot_acquire(&self->parent->snapshots) : NULL;
+
+    /* Uploads wait for their body before there is anything to process */
+    if (strcmp(self->request_type, "observations") == 0)
+    {
+        self->state = WEATHER_CONNECTION_RECEIVING;
+        timeseries_ingest_reset(&self->ingest);
+    }
+    else if (strcmp(self->request_type, "batch") == 0)
+    {
+        self->state = WEATHER_CONNECTION_RECEIVING;
+        self->stream_len = 0;
+        weather_batch_reset(&self->batch);
+    }
+    
+    task_scheduler_add(&self->node);
+    
+    if (self->parent)
+    {
+        self->parent->active_count++;
+    }
+    
+    LOG_INFO("[WEATHER CONN CB] Processing for city: %s, type: %s", 
+             self->city, self->request_type);
+}
+
+int8_t weather_connection_add_waiter(weather_connection_t *self, struct http_exchange *http_conn)
+{
+    if (!self || !http_conn) return -1;
+    if (self->waiter_count >= WEATHER_MAX_WAITERS) return -1;
+
+    self->waiters[self->waiter_count++] = http_conn;
+
+    LOG_DEBUG("[WEATHER CONN] Coalesced request for %s, waiters=%d", 
+              self->city, self->waiter_count);
+    return 0;
+}
+
+void weather_connection_remove_waiter(weather_connection_t *self, struct http_exchange *http_conn)
+{
+    if (!self || !http_conn) return;
+
+    for (uint8_t i = 0; i < self->waiter_count; i++)
+    {
+        if (self->waiters[i] == http_conn)
+        {
+            self->waiters[i] = self->waiters[--self->waiter_count];
+            self->waiters[self->waiter_count] = NULL;
+            return;
+        }
+    }
+}
+
+static size_t weather_connection_response_len(const weather_connection_t *self)
+{
+    return self->response_len ? self->response_len : strlen(self->response);
+}
+
+/**
+ * entry is the cache entry now holding this response, if it was admitted,
+ * so every client shares its compressed copies
+ **/
+static void weather_connection_deliver(weather_connection_t *self, http_exchange_t *http_conn,
+                                       weather_cache_entry_t *entry)
+{
+    if (!http_conn || !self->parent) return;
+
+    weather_server_respond(self->parent, http_conn, self->status, self->format, self->response,
+                           weather_connection_response_len(self), entry);
+}
+
+
+/**
+ * Successful data responses go to the cache, unknown cities to the
+ * negative cache, a failed refresh leaves the stale copy in place
+ **/
+static void weather_connection_update_cache(weather_connection_t *self)
+{
+    if (!self->parent || !weather_request_is_data(self->request_type)) return;
+
+    if (self->status == 200)
+    {
+        weather_request_t request;
+        memset(&request, 0, sizeof(request));
+        memcpy(request.request_type, self->request_type, sizeof(request.request_type));
+        memcpy(request.city, self->city, sizeof(request.city));
+        request.city_id = self->city_id;
+        request.range = self->range;
+        request.format = self->format;
+        request.key = self->key;
+
+        /* A background refresh has to interpolate at the same point */
+        request.has_location = self->has_location;
+        request.lat = self->lat;
+        request.lon = self->lon;
+
+        weather_cache_store(&self->parent->cache, &request, self->status, self->response,
+                            weather_connection_response_len(self),
+                            task_scheduler_pass_ms());
+        return;
+    }
+
+    if (self->status == 404)
+    {
+        weather_negative_add(&self->parent->negative, self->key, task_scheduler_pass_ms());
+    }
+
+    weather_cache_entry_t *entry = weather_cache_find(&self->parent->cache, self->key);
+    if (entry)
+    {
+        entry->refreshing = 0;
+    }
+}
+
+/**
+ * Hands the finished response to the HTTP layer, if it is still there,
+ * and to every request coalesced onto this one
+ **/
+static void weather_connection_reply(weather_connection_t *self)
+{
+    weather_connection_update_cache(self);
+
+    weather_cache_entry_t *entry = NULL;
+    if (self->parent && self->status == 200 && weather_request_is_data(self->request_type))
+    {
+        entry = weather_cache_find(&self->parent->cache, self->key);
+    }
+
+    LOG_DEBUG("[WEATHER CONN] Generated response %d (%zu bytes), waiters=%d", 
+             self->status, weather_connection_response_len(self), self->waiter_count);
+    
+    if (self->lower_http_connection)
+    {
+        weather_connection_deliver(self, self->lower_http_connection, entry);
+    }
+    else
+    {
+        LOG_DEBUG("[WEATHER CONN] No HTTP connection waiting, dropping response");
+    }
+
+    for (uint8_t i = 0; i < self->waiter_count; i++)
+    {
+        weather_connection_deliver(self, self->waiters[i], entry);
+        self->waiters[i] = NULL;
+    }
+
+    self->waiter_count = 0;
+    self->state = WEATHER_CONNECTION_DONE;
+}
+
+/* Room kept at the end of a JSON list for closing it and flagging it truncated */
+#define WEATHER_JSON_TAIL 48
+
+/**
+ * An error body in the requested format, returns its length. message
+ * comes without a trailing newline, plain text gets one added.
+ **/
+size_t weather_error_render(uint8_t format, uint16_t status, const char *message, char *out, size_t size)
+{
+    if (format == WEATHER_FORMAT_CBOR)
+    {
+        cbor_writer_t cbor;
+        cbor_writer_init(&cbor, out, size);
+        cbor_map(&cbor, 2);
+        cbor_key_text(&cbor, WEATHER_CBOR_ERROR, message);
+        cbor_key_uint(&cbor, WEATHER_CBOR_STATUS, status);
+        return cbor_writer_finish(&cbor);
+    }
+
+    if (format == WEATHER_FORMAT_JSON)
+    {
+        json_writer_t json;
+        json_writer_init(&json, out, size);
+        json_object_begin(&json);
+        json_key_string(&json, "error", message);
+        json_key_uint(&json, "status", status);
+        json_object_end(&json);
+        return json_writer_finish(&json);
+    }
+
+    int written = snprintf(out, size, "%s\n", message);
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
+
+static void weather_connection_error(weather_connection_t *self, uint16_t status, const char *message)
+{
+    self->status = status;
+    self->response_len = weather_error_render(self->format, status, message, self->response,
+                                              sizeof(self->response));
+}
+
+/**
+ * Completes a JSON response, one that did not fit becomes an error
+ **/
+static void weather_connection_finish_json(weather_connection_t *self, json_writer_t *json)
+{
+    if (json_writer_finish(json) > 0) return;
+
+    LOG_ERROR("[WEATHER CONN] JSON response for %s did not fit", self->city);
+    weather_connection_error(self, 500, "Response too large");
+}
+
+/**
+ * Same for CBOR, the length marks the response as binary
+ **/
+static void weather_connection_finish_cbor(weather_connection_t *self, const cbor_writer_t *cbor)
+{
+    self->response_len = cbor_writer_finish(cbor);
+    if (self->response_len > 0) return;
+
+    LOG_ERROR("[WEATHER CONN] CBOR response for %s did not fit", self->city);
+    weather_connection_error(self, 500, "Response too large");
+}
+
+/**
+ * Whether the element just written still leaves room to close the list
+ **/
+static int weather_json_fits(const json_writer_t *json)
+{
+    return !json->overflow && json_writer_room(json) >= WEATHER_JSON_TAIL;
+}
+
+/* Break and a closing key of a CBOR list */
+#define WEATHER_CBOR_TAIL 8
+
+static int weather_cbor_fits(const cbor_writer_t *cbor)
+{
+    return !cbor->overflow && cbor->size - cbor->len >= WEATHER_CBOR_TAIL;
+}
+
+/**
+ * Most requested cities according to the frequency sketch
+ **/
+static void weather_connection_render_top(weather_connection_t *self)
+{
+    const weather_sketch_t *sketch = &self->parent->cache.sketch;
+    weather_sketch_top_t top[WEATHER_SKETCH_TOP_K];
+    uint8_t count = sketch->top_count;
+
+    memcpy(top, sketch->top, count * sizeof(top[0]));
+
+    /* Tiny list, insertion sort by estimate */
+    for (uint8_t i = 1; i < count; i++)
+    {
+        weather_sketch_top_t item = top[i];
+        uint8_t j = i;
+        while (j > 0 && top[j - 1].estimate < item.estimate)
+        {
+            top[j] = top[j - 1];
+            j--;
+        }
+        top[j] = item;
+    }
+
+    if (self->format == WEATHER_FORMAT_JSON)
+    {
+        json_writer_t json;
+        json_writer_init(&json, self->response, sizeof(self->response));
+        json_object_begin(&json);
+        json_key(&json, "top");
+        json_array_begin(&json);
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            json_object_begin(&json);
+            json_key_string(&json, "type", top[i].request_type);
+            json_key_string(&json, "city", top[i].city);
+            json_key_uint(&json, "estimate", top[i].estimate);
+            json_object_end(&json);
+        }
+
+        json_array_end(&json);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+        return;
+    }
+
+    size_t size = sizeof(self->response);
+    int written = snprintf(self->response, size, "Most requested (top %d):\n", WEATHER_SKETCH_TOP_K);
+
+    for (uint8_t i = 0; i < count && written > 0 && (size_t)written < size; i++)
+    {
+        written += snprintf(self->response + written, size - written,
+                            "  %2d. %-8s %-24s ~%d\n",
+                            i + 1, top[i].request_type, top[i].city, top[i].estimate);
+    }
+}
+
+/**
+ * Autocomplete over the city catalog, self->city holds the prefix
+ **/
+static void weather_connection_render_cities(weather_connection_t *self)
+{
+    const city_catalog_t *catalog = &self->snapshot->catalog;
+
+    if (!catalog->loaded)
+    {
+        weather_connection_error(self, 503, "City catalog not loaded");
+        return;
+    }
+
+    const city_record_t *matches[CITY_PREFIX_MAX_RESULTS];
+    uint32_t count = city_catalog_prefix(catalog, self->city, matches, CITY_PREFIX_MAX_RESULTS);
+
+    if (self->format == WEATHER_FORMAT_JSON)
+    {
+        json_writer_t json;
+        json_writer_init(&json, self->response, sizeof(self->response));
+        json_object_begin(&json);
+        json_key_string(&json, "prefix", self->city);
+        json_key(&json, "cities");
+        json_array_begin(&json);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            json_object_begin(&json);
+            json_key_string(&json, "name", city_catalog_name(catalog, matches[i]));
+            json_key_uint(&json, "id", matches[i]->id);
+            json_key_double(&json, "lat", matches[i]->lat, 4);
+            json_key_double(&json, "lon", matches[i]->lon, 4);
+            json_object_end(&json);
+        }
+
+        json_array_end(&json);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+        return;
+    }
+
+    size_t size = sizeof(self->response);
+    int written = snprintf(self->response, size, "Cities matching '%s':\n", self->city);
+
+    for (uint32_t i = 0; i < count && written > 0 && (size_t)written < size; i++)
+    {
+        written += snprintf(self->response + written, size - written,
+                            "  %-24s id=%-8u %.4f,%.4f\n",
+                            city_catalog_name(catalog, matches[i]), matches[i]->id,
+                            matches[i]->lat, matches[i]->lon);
+    }
+}
+
+/**
+ * Conditions at the current hour, read straight from the store columns
+ **/
+static void weather_connection_render_current(weather_connection_t *self,
+                                              const forecast_store_t *store, uint32_t row)
+{
+    uint32_t hour = forecast_store_hour(store, time(NULL));
+    size_t i = forecast_store_index(store, row, hour);
+    int16_t temperature = store->temperature[i];
+
+    if (self->format == WEATHER_FORMAT_CBOR)
+    {
+        cbor_writer_t cbor;
+        cbor_writer_init(&cbor, self->response, sizeof(self->response));
+        cbor_map(&cbor, 7);
+        cbor_key_text(&cbor, WEATHER_CBOR_CITY, self->city);
+        cbor_key_uint(&cbor, WEATHER_CBOR_ID, self->city_id);
+        cbor_key_int(&cbor, WEATHER_CBOR_TIME, store->header->base_time + (int64_t)hour * 3600);
+        cbor_key_uint(&cbor, WEATHER_CBOR_CONDITION, store->condition[i]);
+        cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE, temperature);
+        cbor_key_uint(&cbor, WEATHER_CBOR_HUMIDITY, store->humidity[i]);
+        cbor_key_uint(&cbor, WEATHER_CBOR_WIND, store->wind[i]);
+        weather_connection_finish_cbor(self, &cbor);
+        return;
+    }
+
+    if (self->format == WEATHER_FORMAT_JSON)
+    {
+        json_writer_t json;
+        json_writer_init(&json, self->response, sizeof(self->response));
+        json_object_begin(&json);
+        json_key_string(&json, "city", self->city);
+        json_key_uint(&json, "id", self->city_id);
+        json_key_int(&json, "time", store->header->base_time + (int64_t)hour * 3600);
+        json_key_string(&json, "condition", forecast_condition_name(store->condition[i]));
+        json_key_fixed(&json, "temperature_c", temperature, 1);
+        json_key_uint(&json, "humidity_pct", store->humidity[i]);
+        json_key_fixed(&json, "wind_kmh", store->wind[i], 1);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+        return;
+    }
+
+    snprintf(self->response, sizeof(self->response),
+        "Current weather in %s:\n"
+        "  Condition: %s\n"
+        "  Temperature: %s%d.%d°C\n"
+        "  Humidity: %u%%\n"
+        "  Wind: %u km/h\n",
+        self->city,
+        forecast_condition_name(store->condition[i]),
+        temperature < 0 ? "-" : "", abs(temperature) / 10, abs(temperature) % 10,
+        store->humidity[i],
+        (store->wind[i] + 5) / 10);
+}
+
+/**
+ * Daily range and most frequent condition over the remaining hours of the run
+ **/
+static void weather_connection_render_forecast(weather_connection_t *self,
+                                               const forecast_store_t *store, uint32_t row)
+{
+    time_t now = time(NULL);
+    uint32_t hours = store->header->hours;
+    uint32_t hour = forecast_store_hour(store, now);
+    uint8_t json_format = self->format == WEATHER_FORMAT_JSON;
+    uint8_t cbor_format = self->format == WEATHER_FORMAT_CBOR;
+
+    size_t size = sizeof(self->response);
+    int written = 0;
+    json_writer_t json;
+    cbor_writer_t cbor;
+
+    if (cbor_format)
+    {
+        cbor_writer_init(&cbor, self->response, size);
+        cbor_map(&cbor, 5);
+        cbor_key_text(&cbor, WEATHER_CBOR_CITY, self->city);
+        cbor_key_uint(&cbor, WEATHER_CBOR_ID, self->city_id);
+        cbor_key_int(&cbor, WEATHER_CBOR_TIME, store->header->base_time + (int64_t)hour * 3600);
+        cbor_key_uint(&cbor, WEATHER_CBOR_STEP, 86400);
+        cbor_uint(&cbor, WEATHER_CBOR_ENTRIES);
+        cbor_array_begin(&cbor);
+    }
+    else if (json_format)
+    {
+        json_writer_init(&json, self->response, size);
+        json_object_begin(&json);
+        json_key_string(&json, "city", self->city);
+        json_key_uint(&json, "id", self->city_id);
+        json_key(&json, "days");
+        json_array_begin(&json);
+    }
+    else
+    {
+        written = snprintf(self->response, size, "%d-day forecast for %s:\n", FORECAST_DAYS, self->city);
+    }
+
+    for (int day = 0; day < FORECAST_DAYS && hour < hours && written >= 0 && (size_t)written < size; day++)
+    {
+        uint32_t end = hour + 24 < hours ? hour + 24 : hours;
+        size_t base = forecast_store_index(store, row, 0);
+        int16_t low = store->temperature[base + hour];
+        int16_t high = low;
+        uint8_t counts[FORECAST_CONDITION_COUNT] = { 0 };
+
+        for (uint32_t h = hour; h < end; h++)
+        {
+            int16_t t = store->temperature[base + h];
+            if (t < low) low = t;
+            if (t > high) high = t;
+
+            if (store->condition[base + h] < FORECAST_CONDITION_COUNT)
+            {
+                counts[store->condition[base + h]]++;
+            }
+        }
+
+        uint8_t condition = 0;
+        for (uint8_t c = 1; c < FORECAST_CONDITION_COUNT; c++)
+        {
+            if (counts[c] > counts[condition]) condition = c;
+        }
+
+        if (cbor_format)
+        {
+            cbor_map(&cbor, 3);
+            cbor_key_uint(&cbor, WEATHER_CBOR_CONDITION, condition);
+            cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE_MIN, low);
+            cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE_MAX, high);
+        }
+        else if (json_format)
+        {
+            json_object_begin(&json);
+            json_key_int(&json, "time", store->header->base_time + (int64_t)hour * 3600);
+            json_key_string(&json, "condition", forecast_condition_name(condition));
+            json_key_fixed(&json, "temperature_min_c", low, 1);
+            json_key_fixed(&json, "temperature_max_c", high, 1);
+            json_object_end(&json);
+        }
+        else
+        {
+            char day_name[8];
+            time_t day_time = now + (time_t)day * 86400;
+            struct tm tm;
+            gmtime_r(&day_time, &tm);
+            strftime(day_name, sizeof(day_name), "%a", &tm);
+
+            /* Rounded to whole degrees like the summary line of a forecast */
+            written += snprintf(self->response + written, size - written,
+                                "  %s: %s, %d to %d°C\n", day_name, forecast_condition_name(condition),
+                                (low + (low < 0 ? -5 : 5)) / 10, (high + (high < 0 ? -5 : 5)) / 10);
+        }
+
+        hour = end;
+    }
+
+    if (cbor_format)
+    {
+        cbor_break(&cbor);
+        weather_connection_finish_cbor(self, &cbor);
+    }
+    else if (json_format)
+    {
+        json_array_end(&json);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+    }
+}
+
+/**
+ * Interpolated run at the requested point, one line per step with the
+ * temperature range, mean wind and humidity and most frequent condition.
+ * The hours reported are the ones the periods that fit cover.
+ **/
+static void weather_connection_render_grid(weather_connection_t *self, const forecast_grid_t *grid)
+{
+    forecast_grid_point_t point;
+    uint32_t hour = forecast_grid_hour(grid, time(NULL));
+    uint32_t step = (uint32_t)(self->range.step / 3600);
+    uint8_t json_format = self->format == WEATHER_FORMAT_JSON;
+    uint8_t cbor_format = self->format == WEATHER_FORMAT_CBOR;
+
+    if (forecast_grid_interpolate(grid, self->lat, self->lon, hour, (uint32_t)(self->range.to / 3600),
+                                  &point) != 0)
+    {
+        char message[WEATHER_CITY_SIZE + 32];
+        snprintf(message, sizeof(message), "No gridded forecast for %s", self->city);
+        weather_connection_error(self, 404, message);
+        return;
+    }
+
+    size_t size = sizeof(self->response);
+    int written = 0;
+    json_writer_t json;
+    cbor_writer_t cbor;
+
+    if (cbor_format)
+    {
+        cbor_writer_init(&cbor, self->response, size);
+        cbor_map(&cbor, 8);
+        cbor_key_int(&cbor, WEATHER_CBOR_LAT, lroundf(self->lat * 10000.0f));
+        cbor_key_int(&cbor, WEATHER_CBOR_LON, lroundf(self->lon * 10000.0f));
+        cbor_key_int(&cbor, WEATHER_CBOR_GRID_LAT, lroundf(point.nearest_lat * 10000.0f));
+        cbor_key_int(&cbor, WEATHER_CBOR_GRID_LON, lroundf(point.nearest_lon * 10000.0f));
+        cbor_key_int(&cbor, WEATHER_CBOR_TIME, point.start);
+        cbor_key_uint(&cbor, WEATHER_CBOR_STEP, (uint64_t)step * 3600);
+        cbor_uint(&cbor, WEATHER_CBOR_ENTRIES);
+        cbor_array_begin(&cbor);
+    }
+    else if (json_format)
+    {
+        json_writer_init(&json, self->response, size);
+        json_object_begin(&json);
+        json_key_double(&json, "lat", self->lat, 4);
+        json_key_double(&json, "lon", self->lon, 4);
+        json_key_double(&json, "grid_lat", point.nearest_lat, 2);
+        json_key_double(&json, "grid_lon", point.nearest_lon, 2);
+        json_key_uint(&json, "step_hours", step);
+        json_key(&json, "periods");
+        json_array_begin(&json);
+    }
+    else
+    {
+        /* Title for the whole run, rewritten below if fewer hours fit */
+        written = snprintf(self->response, size, "%u-hour forecast for %s (grid point %.2f,%.2f):\n",
+                           point.hours, self->city, point.nearest_lat, point.nearest_lon);
+    }
+
+    int title_len = written;
+    uint32_t served = 0;
+    uint8_t truncated = 0;
+
+    for (uint32_t h = 0; h < point.hours && written >= 0 && (size_t)written < size; h += step)
+    {
+        uint32_t end = h + step < point.hours ? h + step : point.hours;
+        int16_t low = point.temperature[h];
+        int16_t high = low;
+        uint32_t wind = 0;
+        uint32_t humidity = 0;
+        uint16_t counts[FORECAST_CONDITION_COUNT] = { 0 };
+
+        for (uint32_t i = h; i < end; i++)
+        {
+            if (point.temperature[i] < low) low = point.temperature[i];
+            if (point.temperature[i] > high) high = point.temperature[i];
+            wind += point.wind[i];
+            humidity += point.humidity[i];
+
+            if (point.condition[i] < FORECAST_CONDITION_COUNT) counts[point.condition[i]]++;
+        }
+
+        uint8_t condition = 0;
+        for (uint8_t c = 1; c < FORECAST_CONDITION_COUNT; c++)
+        {
+            if (counts[c] > counts[condition]) condition = c;
+        }
+
+        if (cbor_format)
+        {
+            cbor_writer_t mark = cbor;
+
+            cbor_map(&cbor, 5);
+            cbor_key_uint(&cbor, WEATHER_CBOR_CONDITION, condition);
+            cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE_MIN, low);
+            cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE_MAX, high);
+            cbor_key_uint(&cbor, WEATHER_CBOR_HUMIDITY, humidity / (end - h));
+            cbor_key_uint(&cbor, WEATHER_CBOR_WIND, wind / (end - h));
+
+            if (!weather_cbor_fits(&cbor))
+            {
+                cbor = mark;
+                truncated = 1;
+                break;
+            }
+
+            served = end;
+            continue;
+        }
+
+        if (json_format)
+        {
+            json_writer_t mark = json;
+
+            json_object_begin(&json);
+            json_key_int(&json, "time", point.start + (int64_t)h * 3600);
+            json_key_string(&json, "condition", forecast_condition_name(condition));
+            json_key_fixed(&json, "temperature_min_c", low, 1);
+            json_key_fixed(&json, "temperature_max_c", high, 1);
+            json_key_uint(&json, "humidity_pct", humidity / (end - h));
+            json_key_fixed(&json, "wind_kmh", wind / (end - h), 1);
+            json_object_end(&json);
+
+            if (!weather_json_fits(&json))
+            {
+                json = mark;
+                truncated = 1;
+                break;
+            }
+
+            served = end;
+            continue;
+        }
+
+        char when[20];
+        time_t start = (time_t)(point.start + (int64_t)h * 3600);
+        struct tm tm;
+        gmtime_r(&start, &tm);
+        strftime(when, sizeof(when), "%a %d %H:%M", &tm);
+
+        int line = snprintf(self->response + written, size - written,
+                            "  %s  %-13s %5.1f/%5.1f°C  %3u%%  %3u km/h\n",
+                            when, forecast_condition_name(condition), low / 10.0, high / 10.0,
+                            humidity / (end - h), (wind / (end - h) + 5) / 10);
+
+        if (line < 0 || (size_t)(written + line) >= size)
+        {
+            /* Out of room, say so instead of cutting a line */
+            self->response[written] = '\0';
+            snprintf(self->response + written, size - written, "  ... truncated, raise step=\n");
+            break;
+        }
+
+        written += line;
+        served = end;
+    }
+
+    if (cbor_format)
+    {
+        cbor_break(&cbor);
+        cbor_key_bool(&cbor, WEATHER_CBOR_TRUNCATED, truncated);
+        weather_connection_finish_cbor(self, &cbor);
+    }
+    else if (json_format)
+    {
+        json_array_end(&json);
+        json_key_uint(&json, "hours", served);
+        json_key_bool(&json, "truncated", truncated);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+    }
+    else if (served < point.hours && title_len > 0 && (size_t)title_len < size)
+    {
+        /* The shorter count never needs more room than the one it replaces */
+        char title[WEATHER_CITY_SIZE + 96];
+        int len = snprintf(title, sizeof(title), "%u-hour forecast for %s (grid point %.2f,%.2f):\n",
+                           served, self->city, point.nearest_lat, point.nearest_lon);
+
+        if (len > 0 && len <= title_len)
+        {
+            memmove(self->response + len, self->response + title_len, strlen(self->response + title_len) + 1);
+            memcpy(self->response, title, (size_t)len);
+        }
+    }
+}
+
+/**
+ * Answers from the mapped forecast run, -1 when the city is not in it
+ **/
+static int weather_connection_render_from_store(weather_connection_t *self)
+{
+    if (!self->snapshot || self->city_id == 0) return -1;
+
+    const forecast_store_t *store = &self->snapshot->forecast;
+    int32_t row = forecast_store_row(store, self->city_id);
+    if (row < 0) return -1;
+
+    if (strcmp(self->request_type, "forecast") == 0)
+    {
+        weather_connection_render_forecast(self, store, (uint32_t)row);
+    }
+    else
+    {
+        weather_connection_render_current(self, store, (uint32_t)row);
+    }
+
+    return 0;
+}
+
+/**
+ * Observed conditions over self->range, one line per step
+ **/
+static void weather_connection_render_history(weather_connection_t *self)
+{
+    const timeseries_series_t *series = timeseries_store_find(&self->parent->history, self->city_id);
+    timeseries_cursor_t cursor;
+
+    if (!series || timeseries_cursor_init(&cursor, series, self->range.from, self->range.to,
+                                          self->range.step) != 0)
+    {
+        char message[WEATHER_CITY_SIZE + 32];
+        snprintf(message, sizeof(message), "No observations for %s", self->city);
+        weather_connection_error(self, 404, message);
+        return;
+    }
+
+    size_t size = sizeof(self->response);
+    int written = 0;
+    uint8_t json_format = self->format == WEATHER_FORMAT_JSON;
+    uint8_t truncated = 0;
+    json_writer_t json;
+
+    if (json_format)
+    {
+        json_writer_init(&json, self->response, size);
+        json_object_begin(&json);
+        json_key_string(&json, "city", self->city);
+        json_key_int(&json, "step", cursor.step);
+        json_key_string(&json, "level", timeseries_level_name(cursor.level));
+        json_key(&json, "points");
+        json_array_begin(&json);
+    }
+    else
+    {
+        written = snprintf(self->response, size, "History for %s, step %llds (%s):\n", self->city,
+                           (long long)cursor.step, timeseries_level_name(cursor.level));
+    }
+
+    timeseries_point_t point;
+    while (written >= 0 && (size_t)written < size && timeseries_cursor_next(&cursor, &point))
+    {
+        if (json_format)
+        {
+            json_writer_t mark = json;
+
+            json_object_begin(&json);
+            json_key_int(&json, "time", point.start);
+            json_key_uint(&json, "count", point.count);
+            json_key_fixed(&json, "temperature_min_c", point.temperature_min, 1);
+            json_key_fixed(&json, "temperature_avg_c", point.temperature_avg, 1);
+            json_key_fixed(&json, "temperature_max_c", point.temperature_max, 1);
+            json_key_uint(&json, "humidity_pct", point.humidity_avg);
+            json_key_fixed(&json, "wind_kmh", point.wind_avg, 1);
+            json_object_end(&json);
+
+            if (!weather_json_fits(&json))
+            {
+                json = mark;
+                truncated = 1;
+                break;
+            }
+
+            continue;
+        }
+
+        char when[20];
+        time_t start = (time_t)point.start;
+        struct tm tm;
+        gmtime_r(&start, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+
+        int line = snprintf(self->response + written, size - written,
+                            "  %s  %5.1f/%5.1f/%5.1f°C  %3u%%  %3u km/h  n=%u\n",
+                            when, point.temperature_min / 10.0, point.temperature_avg / 10.0,
+                            point.temperature_max / 10.0, point.humidity_avg,
+                            (point.wind_avg + 5) / 10, point.count);
+
+        if (line < 0 || (size_t)(written + line) >= size)
+        {
+            /* Out of room, say so instead of cutting a line */
+            self->response[written] = '\0';
+            snprintf(self->response + written, size - written, "  ... truncated, raise step=\n");
+            break;
+        }
+
+        written += line;
+    }
+
+    if (json_format)
+    {
+        json_array_end(&json);
+        json_key_bool(&json, "truncated", truncated);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+    }
+}
+
+/**
+ * A field in display units, values are in stored units
+ **/
+static void weather_format_field(char *out, size_t size, uint8_t field, double value)
+{
+    switch (field)
+    {
+        case WEATHER_FIELD_HUMIDITY: snprintf(out, size, "%.1f%%", value); break;
+        case WEATHER_FIELD_WIND:     snprintf(out, size, "%.1f km/h", value / 10.0); break;
+        default:                     snprintf(out, size, "%.1f°C", value / 10.0); break;
+    }
+}
+
+/**
+ * The same in JSON, a plain number in the units the field is named for
+ **/
+static void weather_json_field(json_writer_t *json, const char *key, uint8_t field, double value)
 {
-    if (!self || !request)
+    json_key_double(json, key, field == WEATHER_FIELD_HUMIDITY ? value : value / 10.0, 2);
+}
+
+/**
+ * Points the column at the requested field in place: a slice of the
+ * forecast row or the raw history ring, which may wrap into two segments.
+ * Reports the times actually covered.
+ **/
+static int weather_connection_aggregate_column(weather_connection_t *self, aggregate_column_t *column,
+                                               int64_t *from, int64_t *to)
+{
+    static const aggregate_type_t types[] = { AGGREGATE_INT16, AGGREGATE_UINT8, AGGREGATE_UINT16 };
+    static const size_t widths[] = { sizeof(int16_t), sizeof(uint8_t), sizeof(uint16_t) };
+
+    uint8_t field = self->aggregate.field;
+
+    memset(column, 0, sizeof(*column));
+    column->type = types[field];
+
+    if (self->aggregate.history)
     {
-        LOG_ERROR("[WEATHER CONN CB] Invalid parameters");
+        const timeseries_series_t *series = timeseries_store_find(&self->parent->history, self->city_id);
+        if (!series) return -1;
+
+        uint32_t first;
+        uint32_t count = timeseries_raw_span(series, self->range.from, self->range.to, &first);
+        if (count == 0) return -1;
+
+        const timeseries_raw_t *raw = &series->raw;
+        const void *columns[] = { raw->temperature, raw->humidity, raw->wind };
+        const uint8_t *base = columns[field];
+        uint32_t until_wrap = TIMESERIES_RAW_CAPACITY - first;
+        uint32_t head = count < until_wrap ? count : until_wrap;
+
+        aggregate_column_add(column, base + (size_t)first * widths[field], head);
+        aggregate_column_add(column, base, count - head);
+
+        *from = raw->time[first];
+        *to = raw->time[(first + count - 1) % TIMESERIES_RAW_CAPACITY];
+        return 0;
+    }
+
+    if (!self->snapshot) return -1;
+
+    const forecast_store_t *store = &self->snapshot->forecast;
+    int32_t row = forecast_store_row(store, self->city_id);
+    if (row < 0) return -1;
+
+    uint32_t hour = forecast_store_hour(store, (time_t)self->range.from);
+    int64_t hours = (self->range.to - self->range.from) / 3600;
+    uint32_t end = hour + hours < store->header->hours ? hour + (uint32_t)hours : store->header->hours;
+
+    const void *columns[] = { store->temperature, store->humidity, store->wind };
+    const uint8_t *base = columns[field];
+
+    aggregate_column_add(column, base + forecast_store_index(store, (uint32_t)row, hour) * widths[field],
+                         end - hour);
+
+    *from = store->header->base_time + (int64_t)hour * 3600;
+    *to = store->header->base_time + (int64_t)(end - 1) * 3600;
+    return 0;
+}
+
+/**
+ * Min, max, mean, threshold count and percentiles of one field
+ **/
+static void weather_connection_render_aggregate(weather_connection_t *self)
+{
+    static const char *field_names[] = { "temperature", "humidity", "wind" };
+
+    aggregate_column_t column;
+    int64_t from;
+    int64_t to;
+
+    if (weather_connection_aggregate_column(self, &column, &from, &to) != 0)
+    {
+        char message[WEATHER_CITY_SIZE + 32];
+        snprintf(message, sizeof(message), "No %s data for %s",
+                 self->aggregate.history ? "observation" : "forecast", self->city);
+        weather_connection_error(self, 404, message);
         return;
     }
-    
-    LOG_INFO("[WEATHER CONN CB] Received request: %s %s", 
-             request->method, request->path);
-    
-    self->state = WEATHER_CONNECTION_PROCESSING;
-    
-    /* Route based on path */
-    if (strcmp(request->path, "/weather") == 0)
+
+    aggregate_summary_t summary;
+    aggregate_column_summary(&column, self->aggregate.threshold, &summary);
+
+    uint8_t field = self->aggregate.field;
+    double mean_value = (double)summary.sum / summary.count;
+
+    if (self->format == WEATHER_FORMAT_JSON)
     {
-        strncpy(self->request_type, "current", sizeof(self->request_type) - 1);
+        json_writer_t json;
+        json_writer_init(&json, self->response, sizeof(self->response));
+        json_object_begin(&json);
+        json_key_string(&json, "city", self->city);
+        json_key_string(&json, "field", field_names[field]);
+        json_key_string(&json, "source", self->aggregate.history ? "observed" : "forecast");
+        json_key_int(&json, "from", from);
+        json_key_int(&json, "to", to);
+        json_key_uint(&json, "count", summary.count);
+        weather_json_field(&json, "min", field, summary.min);
+        weather_json_field(&json, "max", field, summary.max);
+        weather_json_field(&json, "mean", field, mean_value);
+
+        if (self->aggregate.has_threshold)
+        {
+            weather_json_field(&json, "threshold", field, self->aggregate.threshold);
+            json_key_uint(&json, "above", summary.above);
+        }
+
+        json_key(&json, "percentiles");
+        json_array_begin(&json);
+
+        for (uint8_t i = 0; i < self->aggregate.percentile_count; i++)
+        {
+            json_object_begin(&json);
+            json_key_double(&json, "p", self->aggregate.percentiles[i], 3);
+            weather_json_field(&json, "value", field,
+                               aggregate_column_percentile(&column, &summary, self->aggregate.percentiles[i]));
+            json_object_end(&json);
+        }
+
+        json_array_end(&json);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+        return;
     }
-    else if (strcmp(request->path, "/forecast") == 0)
+
+    char from_text[20];
+    char to_text[20];
+    time_t from_time = (time_t)from;
+    time_t to_time = (time_t)to;
+    struct tm tm;
+    gmtime_r(&from_time, &tm);
+    strftime(from_text, sizeof(from_text), "%Y-%m-%d %H:%M", &tm);
+    gmtime_r(&to_time, &tm);
+    strftime(to_text, sizeof(to_text), "%Y-%m-%d %H:%M", &tm);
+
+    char min[24];
+    char max[24];
+    char mean[24];
+    weather_format_field(min, sizeof(min), field, summary.min);
+    weather_format_field(max, sizeof(max), field, summary.max);
+    weather_format_field(mean, sizeof(mean), field, mean_value);
+
+    size_t size = sizeof(self->response);
+    int written = snprintf(self->response, size,
+                           "Aggregate %s for %s, %s %s to %s:\n"
+                           "  Samples: %llu\n"
+                           "  Min: %s\n"
+                           "  Max: %s\n"
+                           "  Mean: %s\n",
+                           field_names[field], self->city,
+                           self->aggregate.history ? "observed" : "forecast", from_text, to_text,
+                           (unsigned long long)summary.count, min, max, mean);
+
+    if (self->aggregate.has_threshold && written > 0 && (size_t)written < size)
     {
-        strncpy(self->request_type, "forecast", sizeof(self->request_type) - 1);
+        char threshold[24];
+        weather_format_field(threshold, sizeof(threshold), field, self->aggregate.threshold);
+
+        written += snprintf(self->response + written, size - written, "  Above %s: %llu (%.1f%%)\n",
+                            threshold, (unsigned long long)summary.above,
+                            100.0 * summary.above / summary.count);
     }
-    else if (strcmp(request->path, "/") == 0)
+
+    for (uint8_t i = 0; i < self->aggregate.percentile_count && written > 0 && (size_t)written < size; i++)
     {
-        strncpy(self->request_type, "default", sizeof(self->request_type) - 1);
+        char value[24];
+        weather_format_field(value, sizeof(value), field,
+                             aggregate_column_percentile(&column, &summary, self->aggregate.percentiles[i]));
+
+        written += snprintf(self->response + written, size - written, "  p%g: %s\n",
+                            self->aggregate.percentiles[i], value);
     }
-    else
+}
+
+/**
+ * Fixed sample data for cities neither the store nor upstream can answer
+ **/
+static void weather_connection_render_sample(weather_connection_t *self)
+{
+    static const struct
+    {
+        const char *day;
+        const char *condition;
+        uint8_t code;
+        int low;
+        int high;
+    } days[] =
     {
-        strncpy(self->request_type, "unknown", sizeof(self->request_type) - 1);
+        { "Mon", "Sunny", FORECAST_CONDITION_SUNNY, 18, 22 },
+        { "Tue", "Cloudy", FORECAST_CONDITION_CLOUDY, 16, 20 },
+        { "Wed", "Rainy", FORECAST_CONDITION_RAINY, 14, 18 },
+        { "Thu", "Sunny", FORECAST_CONDITION_SUNNY, 17, 21 },
+        { "Fri", "Partly Cloudy", FORECAST_CONDITION_PARTLY_CLOUDY, 19, 23 }
+    };
+
+    uint8_t forecast = strcmp(self->request_type, "forecast") == 0;
+    size_t size = sizeof(self->response);
+
+    if (self->format == WEATHER_FORMAT_CBOR)
+    {
+        cbor_writer_t cbor;
+        cbor_writer_init(&cbor, self->response, size);
+        cbor_map(&cbor, forecast ? 4 : 6);
+        cbor_key_text(&cbor, WEATHER_CBOR_CITY, self->city);
+        cbor_key_bool(&cbor, WEATHER_CBOR_SAMPLE, 1);
+
+        if (forecast)
+        {
+            cbor_key_uint(&cbor, WEATHER_CBOR_STEP, 86400);
+            cbor_uint(&cbor, WEATHER_CBOR_ENTRIES);
+            cbor_array(&cbor, sizeof(days) / sizeof(days[0]));
+
+            for (size_t i = 0; i < sizeof(days) / sizeof(days[0]); i++)
+            {
+                cbor_map(&cbor, 3);
+                cbor_key_uint(&cbor, WEATHER_CBOR_CONDITION, days[i].code);
+                cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE_MIN, days[i].low * 10);
+                cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE_MAX, days[i].high * 10);
+            }
+        }
+        else
+        {
+            cbor_key_uint(&cbor, WEATHER_CBOR_CONDITION, FORECAST_CONDITION_SUNNY);
+            cbor_key_int(&cbor, WEATHER_CBOR_TEMPERATURE, 200);
+            cbor_key_uint(&cbor, WEATHER_CBOR_HUMIDITY, 65);
+            cbor_key_uint(&cbor, WEATHER_CBOR_WIND, 100);
+        }
+
+        weather_connection_finish_cbor(self, &cbor);
+        return;
     }
-    
-    /* Parse city from query */
-    const char *city_param = strstr(request->query, "city=");
-    if (city_param)
+
+    if (self->format == WEATHER_FORMAT_JSON)
     {
-        const char *city_value = city_param + 5;
-        size_t copy_len = 0;
-        
-        /* Find end of city parameter (& or end of string) */
-        while (city_value[copy_len] && city_value[copy_len] != '&' && 
-               copy_len < sizeof(self->city) - 1)
+        json_writer_t json;
+        json_writer_init(&json, self->response, size);
+        json_object_begin(&json);
+        json_key_string(&json, "city", self->city);
+        json_key_bool(&json, "sample", 1);
+
+        if (forecast)
         {
-            copy_len++;
+            json_key(&json, "days");
+            json_array_begin(&json);
+
+            for (size_t i = 0; i < sizeof(days) / sizeof(days[0]); i++)
+            {
+                json_object_begin(&json);
+                json_key_string(&json, "day", days[i].day);
+                json_key_string(&json, "condition", days[i].condition);
+                json_key_int(&json, "temperature_min_c", days[i].low);
+                json_key_int(&json, "temperature_max_c", days[i].high);
+                json_object_end(&json);
+            }
+
+            json_array_end(&json);
         }
-        
-        strncpy(self->city, city_value, copy_len);
-        self->city[copy_len] = '\0';
-        
-        /* FIXED: Sanitize user input */
-        sanitize_city_name(self->city, sizeof(self->city));
+        else
+        {
+            json_key_string(&json, "condition", "Sunny");
+            json_key_int(&json, "temperature_c", 20);
+            json_key_uint(&json, "humidity_pct", 65);
+            json_key_uint(&json, "wind_kmh", 10);
+        }
+
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+        return;
+    }
+
+    if (!forecast)
+    {
+        snprintf(self->response, size,
+            "Current weather in %s:\n"
+            "  Condition: Sunny\n"
+            "  Temperature: 20°C\n"
+            "  Humidity: 65%%\n"
+            "  Wind: 10 km/h\n",
+            self->city);
+        return;
+    }
+
+    int written = snprintf(self->response, size, "5-day forecast for %s:\n", self->city);
+
+    for (size_t i = 0; i < sizeof(days) / sizeof(days[0]) && written > 0 && (size_t)written < size; i++)
+    {
+        written += snprintf(self->response + written, size - written, "  %s: %s, %d-%d°C\n",
+                            days[i].day, days[i].condition, days[i].low, days[i].high);
+    }
+}
+
+/**
+ * The endpoint listing. Consecutive entries sharing a description are
+ * listed together in text.
+ **/
+static void weather_connection_render_endpoints(weather_connection_t *self)
+{
+    static const char batch[] = "Current weather for many cities in one response";
+    static const struct
+    {
+        const char *method;
+        const char *path;
+        const char *description;
+    } endpoints[] =
+    {
+        { "GET", "/weather?city=NAME", "Get current weather for a city" },
+        { "GET", "/weather?lat=LAT&lon=LON", "Get current weather for the nearest city" },
+        { "GET", "/weather/batch?city=NAME,NAME,...", batch },
+        { "POST", "/weather/batch (city=NAME,NAME,... or one name or id per line)", batch },
+        { "GET", "/weather/stream?city=NAME", "Server-sent events with the current weather as it changes" },
+        { "GET", "/weather/ws", "WebSocket, send 'subscribe NAME' and 'unsubscribe NAME' for updates" },
+        { "GET", "/forecast?city=NAME", "Get 5-day forecast for a city" },
+        { "GET", "/forecast?lat=LAT&lon=LON&hours=240&step=6h", "Forecast interpolated from the model grid" },
+        { "GET", "/history?city=NAME&from=T&to=T&step=1h",
+          "Observed min/avg/max, T is unix time or seconds before now" },
+        { "GET", "/aggregate?city=NAME&source=forecast&field=temperature&hours=168&above=25&p=50,90",
+          "Min/max/mean, count above a threshold and percentiles" },
+        { "GET", "/cities?prefix=TEXT", "City name autocomplete" },
+        { "GET", "/top", "Most requested cities" },
+        { "POST", "/observations", "Station readings, one 'id time temp humidity wind' per line" }
+    };
+    const size_t count = sizeof(endpoints) / sizeof(endpoints[0]);
+    size_t size = sizeof(self->response);
+
+    if (self->format == WEATHER_FORMAT_JSON)
+    {
+        json_writer_t json;
+        json_writer_init(&json, self->response, size);
+        json_object_begin(&json);
+        json_key(&json, "endpoints");
+        json_array_begin(&json);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            json_object_begin(&json);
+            json_key_string(&json, "method", endpoints[i].method);
+            json_key_string(&json, "path", endpoints[i].path);
+            json_key_string(&json, "description", endpoints[i].description);
+            json_object_end(&json);
+        }
+
+        json_array_end(&json);
+        json_object_end(&json);
+        weather_connection_finish_json(self, &json);
+        return;
+    }
+
+    int written = snprintf(self->response, size,
+                           "Weather API - Available Endpoints\n"
+                           "==================================\n\n");
+
+    for (size_t i = 0; i < count && written > 0 && (size_t)written < size; i++)
+    {
+        uint8_t shared = i + 1 < count && endpoints[i + 1].description == endpoints[i].description;
+
+        written += snprintf(self->response + written, size - written, "%s %s\n",
+                            endpoints[i].method, endpoints[i].path);
+
+        if (!shared && written > 0 && (size_t)written < size)
+        {
+            written += snprintf(self->response + written, size - written, "  %s\n\n",
+                                endpoints[i].description);
+        }
+    }
+
+    if (written > 0 && (size_t)written < size)
+    {
+        snprintf(self->response + written, size - written,
+                 "Example:\n"
+                 "  curl http://localhost:8080/weather?city=Stockholm\n");
+    }
+}
+
+/**
+ * Builds "/weather?city=New%20York" style targets for the upstream API
+ **/
+static int weather_connection_upstream_target(weather_connection_t *self, char *target, size_t size)
+{
+    const char *path = (strcmp(self->request_type, "forecast") == 0) ? "/forecast" : "/weather";
+    int written = snprintf(target, size, "%s?city=", path);
+    if (written < 0 || (size_t)written >= size) return -1;
+
+    size_t pos = written;
+    for (const char *c = self->city; *c; c++)
+    {
+        if (*c == ' ')
+        {
+            if (pos + 3 >= size) return -1;
+            memcpy(target + pos, "%20", 3);
+            pos += 3;
+        }
+        else
+        {
+            if (pos + 1 >= size) return -1;
+            target[pos++] = *c;
+        }
+    }
+
+    target[pos] = '\0';
+    return 0;
+}
+
+void weather_connection_on_upstream_response_cb(struct weather_connection *self, uint16_t status,
+                                                const char *body, size_t body_len)
+{
+    if (!self || self->state != WEATHER_CONNECTION_WAITING_UPSTREAM)
+    {
+        LOG_ERROR("[WEATHER CONN CB] Unexpected upstream response");
+        return;
+    }
+
+    LOG_INFO("[WEATHER CONN CB] Upstream answered %d for city: %s", status, self->city);
+
+    if (!body)
+    {
+        char message[WEATHER_CITY_SIZE + 48];
+        uint8_t timed_out = status == UPSTREAM_STATUS_GATEWAY_TIMEOUT;
+
+        snprintf(message, sizeof(message), "Weather service %s for %s",
+                 timed_out ? "timed out" : "unavailable", self->city);
+        weather_connection_error(self, timed_out ? 504 : 502, message);
     }
     else
     {
-        strncpy(self->city, "Stockholm", sizeof(self->city) - 1);
+        /* Pass upstream client errors through, anything else is our problem */
+        self->status = (status >= 200 && status < 300) ? 200 :
+                       (status == 404)                 ? 404 : 502;
+
+        if (self->format == WEATHER_FORMAT_CBOR)
+        {
+            cbor_writer_t cbor;
+            cbor_writer_init(&cbor, self->response, sizeof(self->response));
+            cbor_map(&cbor, 2);
+            cbor_key_text(&cbor, WEATHER_CBOR_CITY, self->city);
+            cbor_uint(&cbor, WEATHER_CBOR_UPSTREAM);
+            cbor_text_n(&cbor, body, body_len);
+            weather_connection_finish_cbor(self, &cbor);
+            weather_connection_reply(self);
+            return;
+        }
+
+        if (self->format == WEATHER_FORMAT_JSON)
+        {
+            /* The upstream body is opaque text, carried as a string */
+            json_writer_t json;
+            json_writer_init(&json, self->response, sizeof(self->response));
+            json_object_begin(&json);
+            json_key_string(&json, "city", self->city);
+            json_key(&json, "upstream");
+            json_string_n(&json, body, body_len);
+            json_object_end(&json);
+            weather_connection_finish_json(self, &json);
+            weather_connection_reply(self);
+            return;
+        }
+
+        size_t copy_len = body_len < sizeof(self->response) - 1 ?
+                          body_len : sizeof(self->response) - 1;
+        memcpy(self->response, body, copy_len);
+        self->response[copy_len] = '\0';
     }
-    
-    self->city[sizeof(self->city) - 1] = '\0';
-    
-    task_scheduler_add(&self->node);
-    
-    if (self->parent)
+
+    weather_connection_reply(self);
+}
+
+/**
+ * Parses a chunk of posted observations straight into the history store,
+ * the last chunk answers with the counts. Batch city lists are resolved
+ * as they arrive and answered from work() once complete.
+ **/
+int8_t weather_connection_on_body(weather_connection_t *self, const char *data, size_t len, uint8_t last)
+{
+    if (!self || !self->parent || self->state != WEATHER_CONNECTION_RECEIVING) return -1;
+
+    const city_catalog_t *catalog = self->snapshot ? &self->snapshot->catalog : NULL;
+
+    if (strcmp(self->request_type, "batch") == 0)
     {
-        self->parent->active_count++;
+        weather_batch_feed(&self->batch, catalog, data, len);
+        if (!last) return 0;
+
+        weather_batch_finish(&self->batch, catalog);
+        self->state = WEATHER_CONNECTION_PROCESSING;
+        return 0;
+    }
+
+    timeseries_ingest_feed(&self->ingest, &self->parent->history, catalog, data, len);
+    if (!last) return 0;
+
+    timeseries_ingest_finish(&self->ingest, &self->parent->history, catalog);
+
+    self->status = 200;
+
+    if (self->format == WEATHER_FORMAT_JSON)
+    {
+        json_writer_t json;
+        json_writer_init(&json, self->response, sizeof(self->response));
+        json_object_begin(&json);
+        json_key_uint(&json, "accepted", self->ingest.accepted);
+        json_key_uint(&json, "rejected", self->ingest.rejected);
+        json_object_end(&json);
+        json_writer_finish(&json);
+    }
+    else
+    {
+        snprintf(self->response, sizeof(self->response), "Accepted %u observations, rejected %u\n",
+                 self->ingest.accepted, self->ingest.rejected);
+    }
+
+    LOG_INFO("[WEATHER CONN] Ingested %u observations, rejected %u",
+             self->ingest.accepted, self->ingest.rejected);
+
+    weather_connection_reply(self);
+    return 0;
+}
+
+/**
+ * Offers the batch answer to the HTTP layer one response buffer at a
+ * time, the next piece is rendered only once the previous one was taken
+ **/
+static void weather_connection_stream(weather_connection_t *self)
+{
+    http_exchange_t *http_conn = self->lower_http_connection;
+
+    if (!http_conn || !http_conn->cb_from_weather_layer.weather_on_stream)
+    {
+        self->state = WEATHER_CONNECTION_DONE;
+        return;
+    }
+
+    if (self->stream_len == 0)
+    {
+        self->stream_len = weather_batch_render(&self->batch, &self->snapshot->catalog,
+                                                self->format,
+                                                self->response, sizeof(self->response));
+    }
+
+    if (http_conn->cb_from_weather_layer.weather_on_stream(http_conn, 200,
+                                                           weather_format_content_type(self->format),
+                                                           self->response, self->stream_len,
+                                                           self->batch.done) != 0)
+    {
+        return;
+    }
+
+    self->stream_len = 0;
+
+    if (self->batch.done)
+    {
+        LOG_DEBUG("[WEATHER CONN] Streamed %u cities", self->batch.count);
+        self->state = WEATHER_CONNECTION_DONE;
     }
-    
-    LOG_INFO("[WEATHER CONN CB] Processing for city: %s, type: %s", 
-             self->city, self->request_type);
 }
 
 int8_t weather_connection_work(task_node_t *node)
@@ -117,44 +1978,80 @@ int8_t weather_connection_work(task_node_t *node)
         {
             LOG_DEBUG("[WEATHER CONN] Processing weather request");
             
+            self->status = 200;
+            self->response_len = 0;
+
+            /* Batches are too big for one response buffer, they stream */
+            if (strcmp(self->request_type, "batch") == 0 && self->snapshot)
+            {
+                weather_batch_gather(&self->batch, &self->snapshot->forecast, time(NULL));
+                self->state = WEATHER_CONNECTION_STREAMING;
+                weather_connection_stream(self);
+                return 0;
+            }
+
+            /* Coordinates the server left unresolved are interpolated from the grid */
+            if (strcmp(self->request_type, "forecast") == 0 && self->has_location &&
+                self->city_id == 0 && self->snapshot && self->snapshot->grid.loaded)
+            {
+                weather_connection_render_grid(self, &self->snapshot->grid);
+            }
+            /* The forecast store answers for the cities it has */
+            else if (weather_request_is_data(self->request_type) &&
+                weather_connection_render_from_store(self) == 0)
+            {
+                LOG_DEBUG("[WEATHER CONN] Served %s from forecast store", self->city);
+            }
+            /* Route to the upstream API when one is configured */
+            else if (weather_request_is_data(self->request_type) &&
+                self->parent && self->parent->upstream.ready)
+            {
+                char target[WEATHER_CITY_SIZE * 3 + 32];
+
+                if (weather_connection_upstream_target(self, target, sizeof(target)) == 0 &&
+                    upstream_client_request(&self->parent->upstream, self, target) == 0)
+                {
+                    self->state = WEATHER_CONNECTION_WAITING_UPSTREAM;
+                    return 0;
+                }
+
+                weather_connection_error(self, 503, "Weather service busy, try again");
+            }
             /* Route to backend based on request type */
-            if (strcmp(self->request_type, "current") == 0)
+            else if (strcmp(self->request_type, "current") == 0 ||
+                     strcmp(self->request_type, "forecast") == 0)
             {
-                /* TODO: Call actual weather API */
-                snprintf(self->response, sizeof(self->response),
-                    "Current weather in %s:\n"
-                    "  Condition: Sunny\n"
-                    "  Temperature: 20°C\n"
-                    "  Humidity: 65%%\n"
-                    "  Wind: 10 km/h\n",
-                    self->city);
+                weather_connection_render_sample(self);
             }
-            else if (strcmp(self->request_type, "forecast") == 0)
+            else if (strcmp(self->request_type, "history") == 0 && self->parent)
             {
-                /* TODO: Call actual forecast API */
-                snprintf(self->response, sizeof(self->response),
-                    "5-day forecast for %s:\n"
-                    "  Mon: Sunny, 18-22°C\n"
-                    "  Tue: Cloudy, 16-20°C\n"
-                    "  Wed: Rainy, 14-18°C\n"
-                    "  Thu: Sunny, 17-21°C\n"
-                    "  Fri: Partly Cloudy, 19-23°C\n",
-                    self->city);
+                weather_connection_render_history(self);
+            }
+            else if (strcmp(self->request_type, "aggregate") == 0 && self->parent)
+            {
+                weather_connection_render_aggregate(self);
+            }
+            else if (strcmp(self->request_type, "cities") == 0 && self->snapshot)
+            {
+                weather_connection_render_cities(self);
+            }
+            else if (strcmp(self->request_type, "top") == 0 && self->parent)
+            {
+                weather_connection_render_top(self);
             }
             else if (strcmp(self->request_type, "default") == 0)
             {
-                snprintf(self->response, sizeof(self->response),
-                    "Weather API - Available Endpoints\n"
-                    "==================================\n\n"
-                    "GET /weather?city=NAME\n"
-                    "  Get current weather for a city\n\n"
-                    "GET /forecast?city=NAME\n"
-                    "  Get 5-day forecast for a city\n\n"
-                    "Example:\n"
-                    "  curl http://localhost:8080/weather?city=Stockholm\n");
+                weather_connection_render_endpoints(self);
+            }
+            else if (self->format == WEATHER_FORMAT_JSON)
+            {
+                char message[WEATHER_REQUEST_TYPE_SIZE + 32];
+                snprintf(message, sizeof(message), "Unknown endpoint: %s", self->request_type);
+                weather_connection_error(self, 404, message);
             }
             else
             {
+                self->status = 404;
                 snprintf(self->response, sizeof(self->response),
                     "404 Not Found\n\n"
                     "Unknown endpoint: %s\n\n"
@@ -164,25 +2061,25 @@ int8_t weather_connection_work(task_node_t *node)
                     self->request_type);
             }
             
-            LOG_DEBUG("[WEATHER CONN] Generated response (%zu bytes)", 
-                     strlen(self->response));
-            
-            /* FIXED: Save callback pointer before using it */
-            http_connection_t *http_conn = self->lower_http_connection;
-            if (http_conn && http_conn->cb_from_weather_layer.weather_on_handled_request)
-            {
-                LOG_DEBUG("[WEATHER CONN] Calling HTTP callback");
-                http_conn->cb_from_weather_layer.weather_on_handled_request(
-                    http_conn,
-                    self->response
-                );
-            }
-            else
-            {
-                LOG_ERROR("[WEATHER CONN] No HTTP callback available");
-            }
-            
-            self->state = WEATHER_CONNECTION_DONE;
+            weather_connection_reply(self);
+            return 0;
+        }
+
+        case WEATHER_CONNECTION_WAITING_UPSTREAM:
+        {
+            /* Upstream connection calls back on response or deadline */
+            return 0;
+        }
+
+        case WEATHER_CONNECTION_RECEIVING:
+        {
+            /* The HTTP layer pushes body chunks through weather_connection_on_body */
+            return 0;
+        }
+
+        case WEATHER_CONNECTION_STREAMING:
+        {
+            weather_connection_stream(self);
             return 0;
         }
         
@@ -192,6 +2089,20 @@ int8_t weather_connection_work(task_node_t *node)
             
             self->state = WEATHER_CONNECTION_IDLE;
             self->lower_http_connection = NULL;
+            self->status = 0;
+            self->key = 0;
+            self->city_id = 0;
+            memset(&self->range, 0, sizeof(self->range));
+            memset(&self->aggregate, 0, sizeof(self->aggregate));
+            self->format = WEATHER_FORMAT_TEXT;
+            self->response_len = 0;
+            self->waiter_count = 0;
+
+            if (self->parent)
+            {
+                weather_snapshot_release(&self->parent->snapshots, self->snapshot);
+            }
+            self->snapshot = NULL;
             
             memset(self->request_type, 0, sizeof(self->request_type));
             memset(self->city, 0, sizeof(self->city));
@@ -206,6 +2117,12 @@ int8_t weather_connection_work(task_node_t *node)
             {
                 self->parent->active_count--;
             }
+
+            /* The slot goes straight to whoever queued for one */
+            if (self->parent)
+            {
+                weather_server_admit(self->parent);
+            }
             
             return 0;
         }
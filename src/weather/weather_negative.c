@@ -0,0 +1,125 @@
+/**
+ * Implementation-file: weather_negative.c
+ **/
+
+#include "../../include/weather/weather_negative.h"
+#include "../../include/logging/logging.h"
+#include <string.h>
+
+_Static_assert((WEATHER_NEGATIVE_BLOOM_BITS & (WEATHER_NEGATIVE_BLOOM_BITS - 1)) == 0,
+               "WEATHER_NEGATIVE_BLOOM_BITS must be a power of two");
+_Static_assert((WEATHER_NEGATIVE_SIZE & (WEATHER_NEGATIVE_SIZE - 1)) == 0,
+               "WEATHER_NEGATIVE_SIZE must be a power of two");
+
+void weather_negative_init(weather_negative_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+    LOG_INFO("[WEATHER NEGATIVE] Initialized %d entries, ttl=%dms",
+             WEATHER_NEGATIVE_SIZE, WEATHER_NEGATIVE_TTL_MS);
+}
+
+static inline uint32_t weather_negative_bit(uint64_t key, uint32_t i)
+{
+    uint32_t h1 = (uint32_t)key;
+    uint32_t h2 = (uint32_t)(key >> 32) | 1u;
+    return (h1 + i * h2) & (WEATHER_NEGATIVE_BLOOM_BITS - 1);
+}
+
+static void weather_negative_bloom_set(weather_negative_t *self, uint64_t key)
+{
+    for (uint32_t i = 0; i < WEATHER_NEGATIVE_BLOOM_HASHES; i++)
+    {
+        uint32_t bit = weather_negative_bit(key, i);
+        self->bloom[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+    }
+}
+
+static int weather_negative_bloom_test(const weather_negative_t *self, uint64_t key)
+{
+    for (uint32_t i = 0; i < WEATHER_NEGATIVE_BLOOM_HASHES; i++)
+    {
+        uint32_t bit = weather_negative_bit(key, i);
+        if (!(self->bloom[bit >> 3] & (1u << (bit & 7)))) return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Entries live in a short probe window from their home slot, a full
+ * window gives up the entry closest to expiry
+ **/
+void weather_negative_add(weather_negative_t *self, uint64_t key, uint64_t now_ms)
+{
+    if (!self || key == 0) return;
+
+    uint32_t home = (uint32_t)(key >> 32) & (WEATHER_NEGATIVE_SIZE - 1);
+    weather_negative_entry_t *slot = NULL;
+
+    for (uint32_t i = 0; i < WEATHER_NEGATIVE_PROBE; i++)
+    {
+        weather_negative_entry_t *entry = &self->entries[(home + i) & (WEATHER_NEGATIVE_SIZE - 1)];
+
+        if (entry->key == key || entry->expires_ms <= now_ms)
+        {
+            slot = entry;
+            break;
+        }
+
+        if (!slot || entry->expires_ms < slot->expires_ms)
+        {
+            slot = entry;
+        }
+    }
+
+    slot->key = key;
+    slot->expires_ms = now_ms + WEATHER_NEGATIVE_TTL_MS;
+    weather_negative_bloom_set(self, key);
+}
+
+int weather_negative_contains(const weather_negative_t *self, uint64_t key, uint64_t now_ms)
+{
+    if (!self || !weather_negative_bloom_test(self, key)) return 0;
+
+    uint32_t home = (uint32_t)(key >> 32) & (WEATHER_NEGATIVE_SIZE - 1);
+
+    for (uint32_t i = 0; i < WEATHER_NEGATIVE_PROBE; i++)
+    {
+        const weather_negative_entry_t *entry =
+            &self->entries[(home + i) & (WEATHER_NEGATIVE_SIZE - 1)];
+
+        if (entry->key == key)
+        {
+            return entry->expires_ms > now_ms;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Bloom filters cannot forget, so the bits are rebuilt from the live
+ * entries once per TTL to keep false positives down
+ **/
+void weather_negative_maintain(weather_negative_t *self, uint64_t now_ms)
+{
+    if (!self || now_ms < self->next_rebuild_ms) return;
+
+    self->next_rebuild_ms = now_ms + WEATHER_NEGATIVE_TTL_MS;
+    memset(self->bloom, 0, sizeof(self->bloom));
+
+    for (uint32_t i = 0; i < WEATHER_NEGATIVE_SIZE; i++)
+    {
+        if (self->entries[i].expires_ms > now_ms)
+        {
+            weather_negative_bloom_set(self, self->entries[i].key);
+        }
+        else
+        {
+            self->entries[i].key = 0;
+            self->entries[i].expires_ms = 0;
+        }
+    }
+}
@@ -3,10 +3,16 @@
  **/
 
 #include "../../include/weather/weather_server.h"
+#include "../../include/http/http_connection.h"
+#include "../../include/http/http_websocket.h"
+#include "../../include/json/json_writer.h"
 #include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/aggregate/aggregate.h"
 #include "../../include/logging/logging.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
 int8_t weather_server_init(weather_server_t *self)
 {
@@ -29,7 +35,43 @@ int8_t weather_server_init(weather_server_t *self)
         self->child_weather_connection[i].node.active = 0;
         self->child_weather_connection[i].cb_from_http_layer.http_on_new_request = 
             weather_connection_on_request_cb;
+        self->child_weather_connection[i].cb_from_upstream_layer.upstream_on_response =
+            weather_connection_on_upstream_response_cb;
     }
+
+    /* Assign callback for HTTP -> weather hand-off */
+    self->cb_from_http_layer.http_on_new_request = weather_server_on_request_cb;
+    self->cb_from_http_layer.http_on_request_body = weather_server_on_request_body_cb;
+    self->cb_from_http_layer.http_on_message = weather_server_on_message_cb;
+
+    weather_cache_init(&self->cache);
+    weather_negative_init(&self->negative);
+    weather_admission_init(&self->admission);
+
+    weather_snapshots_init(&self->snapshots);
+    timeseries_store_init(&self->history);
+    weather_stream_init(&self->stream);
+
+    /* Picks the aggregation kernels for this CPU once, logged at startup */
+    aggregate_get_backend();
+
+    if (!self->snapshots.current->catalog.loaded)
+    {
+        LOG_WARN("[WEATHER SERVER] No city catalog, cities are keyed by name");
+    }
+
+    /* Background refresher for popular cache entries */
+    self->node.work = weather_server_work;
+    self->next_refresh_ms = task_scheduler_now_ms() + WEATHER_CACHE_REFRESH_INTERVAL_MS;
+    self->next_sample_ms = task_scheduler_now_ms();
+    task_scheduler_add(&self->node);
+
+#if UPSTREAM_ENABLED
+    if (upstream_client_init(&self->upstream, UPSTREAM_HOST, UPSTREAM_PORT) != 0)
+    {
+        LOG_WARN("[WEATHER SERVER] Upstream unavailable, serving sample data");
+    }
+#endif
     
     LOG_INFO("[WEATHER SERVER] Initialized with pool size %d", CONNECTION_POOL_SIZE);
     return 0;
@@ -51,3 +93,613 @@ weather_connection_t *weather_server_allocate_pool_slot(weather_server_t *self)
     LOG_WARN("[WEATHER SERVER] Pool full!");
     return NULL;
 }
+
+/**
+ * Requests already being worked on, either computing or waiting on upstream
+ **/
+weather_connection_t *weather_server_find_in_flight(weather_server_t *self, uint64_t key)
+{
+    if (!self) return NULL;
+
+    for (int i = 0; i < CONNECTION_POOL_SIZE; i++)
+    {
+        weather_connection_t *conn = &self->child_weather_connection[i];
+
+        if (conn->key == key &&
+            (conn->state == WEATHER_CONNECTION_PROCESSING ||
+             conn->state == WEATHER_CONNECTION_WAITING_UPSTREAM))
+        {
+            return conn;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Hands a finished response to the HTTP layer in the coding the client
+ * accepts. Cached responses keep their compressed copies, anything else
+ * is compressed into the shared scratch buffer for this one send. A
+ * client that already holds the same body gets a 304 instead, before
+ * anything is compressed.
+ **/
+void weather_server_respond(weather_server_t *self, struct http_exchange *http_conn, uint16_t status,
+                            uint8_t format, const char *body, size_t len, weather_cache_entry_t *entry)
+{
+    if (!self || !http_conn || !http_conn->cb_from_weather_layer.weather_on_handled_request) return;
+
+    const http_connection_request_t *request = http_conn->request;
+    http_connection_reply_t reply =
+    {
+        .status = status,
+        .content_type = weather_format_content_type(format),
+        .max_age = -1,
+        .body = body,
+        .body_len = len
+    };
+
+    /* Successful reads carry a validator, cached ones say how long they stay fresh */
+    char etag[24];
+
+    if (status == 200 && strcmp(request->method, "GET") == 0)
+    {
+        snprintf(etag, sizeof(etag), "W/\"%016llx\"",
+                 (unsigned long long)(entry ? entry->etag : weather_cache_hash(body, len)));
+        reply.etag = etag;
+
+        if (entry)
+        {
+            uint64_t age = task_scheduler_pass_ms() - entry->fetched_ms;
+            reply.max_age = age < WEATHER_CACHE_TTL_MS ? (int32_t)((WEATHER_CACHE_TTL_MS - age) / 1000) : 0;
+        }
+
+        if (http_etag_matches(request->if_none_match, etag))
+        {
+            reply.status = 304;
+            reply.body = NULL;
+            reply.body_len = 0;
+            http_conn->cb_from_weather_layer.weather_on_handled_request(http_conn, &reply);
+            return;
+        }
+    }
+
+    uint8_t encoding = http_encoding_negotiate(request->accept_encoding);
+
+    if (entry)
+    {
+        encoding = weather_cache_encoded(entry, encoding, &reply.body, &reply.body_len);
+    }
+    else if (encoding != HTTP_ENCODING_IDENTITY)
+    {
+        size_t compressed = http_compress(encoding, body, len, self->encoded, sizeof(self->encoded));
+
+        if (compressed > 0)
+        {
+            reply.body = self->encoded;
+            reply.body_len = compressed;
+        }
+        else
+        {
+            encoding = HTTP_ENCODING_IDENTITY;
+        }
+    }
+
+    reply.content_encoding = http_encoding_name(encoding);
+    http_conn->cb_from_weather_layer.weather_on_handled_request(http_conn, &reply);
+}
+
+static int8_t weather_server_dispatch(weather_server_t *self, struct http_exchange *http_conn,
+                                      const weather_request_t *request, uint64_t now);
+
+/**
+ * Single-flight entry point: the first request for a key takes a pool slot
+ * and does the work, later ones wait on it without taking a slot.
+ * Returns WEATHER_REQUEST_NOT_FOUND for requests known to 404,
+ * WEATHER_REQUEST_BAD_REQUEST for malformed parameters,
+ * WEATHER_REQUEST_STREAM_BODY when the body should follow through
+ * http_on_request_body and WEATHER_REQUEST_BUSY when the request can be
+ * neither coalesced nor scheduled.
+ **/
+int8_t weather_server_on_request_cb(struct weather_server *self, struct http_exchange *http_conn,
+                                    const struct http_connection_request *request)
+{
+    if (!self || !http_conn || !request)
+    {
+        LOG_ERROR("[WEATHER SERVER] Invalid request parameters");
+        return WEATHER_REQUEST_BUSY;
+    }
+
+    LOG_INFO("[WEATHER SERVER] Received request: %s %s", request->method, request->path);
+
+    weather_request_t parsed;
+    if (weather_request_parse(&parsed, request) != 0) return WEATHER_REQUEST_BAD_REQUEST;
+
+    /* Uploads are never cached or shared, each one gets its own slot */
+    if (strcmp(parsed.request_type, "observations") == 0)
+    {
+        weather_connection_t *conn = weather_server_allocate_pool_slot(self);
+        if (!conn) return WEATHER_REQUEST_BUSY;
+
+        conn->lower_http_connection = http_conn;
+        conn->cb_from_http_layer.http_on_new_request(conn, &parsed);
+        return WEATHER_REQUEST_STREAM_BODY;
+    }
+
+    /* The connection stays with the HTTP layer, subscriptions come as messages */
+    if (strcmp(parsed.request_type, "websocket") == 0)
+    {
+        return request->websocket ? WEATHER_REQUEST_UPGRADE : WEATHER_REQUEST_BAD_REQUEST;
+    }
+
+    /* Batches take cities from the query and, when posted, the body */
+    if (strcmp(parsed.request_type, "batch") == 0)
+    {
+        weather_connection_t *conn = weather_server_allocate_pool_slot(self);
+        if (!conn) return WEATHER_REQUEST_BUSY;
+
+        uint8_t posted = strcmp(request->method, "POST") == 0;
+
+        conn->lower_http_connection = http_conn;
+        conn->cb_from_http_layer.http_on_new_request(conn, &parsed);
+        weather_connection_on_body(conn, request->query, strlen(request->query), !posted);
+
+        return posted ? WEATHER_REQUEST_STREAM_BODY : WEATHER_REQUEST_ACCEPTED;
+    }
+
+    /* Resolution finishes within this call, no need to pin the snapshot */
+    const city_catalog_t *catalog = &self->snapshots.current->catalog;
+
+    /* Forecasts for coordinates come straight from the grid when one is loaded */
+    int gridded = parsed.has_location && strcmp(parsed.request_type, "forecast") == 0 &&
+                  self->snapshots.current->grid.loaded;
+
+    /* Otherwise coordinates only mean something through the catalog */
+    if (parsed.has_location && !gridded && !catalog->loaded) return WEATHER_REQUEST_NOT_FOUND;
+
+    /* Names and coordinates resolve to catalog ids once, everything downstream keys on the id */
+    if (catalog->loaded && weather_request_has_city(parsed.request_type) && !gridded)
+    {
+        const city_record_t *record;
+
+        if (parsed.has_location)
+        {
+            float distance_km = 0.0f;
+            record = city_catalog_nearest(catalog, parsed.lat, parsed.lon, &distance_km);
+            LOG_DEBUG("[WEATHER SERVER] %s is %.1f km from %s", parsed.city, distance_km,
+                      record ? city_catalog_name(catalog, record) : "nothing");
+        }
+        else
+        {
+            record = city_catalog_find(catalog, parsed.city);
+        }
+
+        if (!record)
+        {
+            LOG_DEBUG("[WEATHER SERVER] City not in catalog: %s", parsed.city);
+            return WEATHER_REQUEST_NOT_FOUND;
+        }
+
+        parsed.city_id = record->id;
+        parsed.key = weather_request_key_from_id(&parsed);
+        strncpy(parsed.city, city_catalog_name(catalog, record), sizeof(parsed.city) - 1);
+    }
+
+    /* Subscribers leave the HTTP layer, the hub writes to the socket from here on */
+    if (strcmp(parsed.request_type, "stream") == 0)
+    {
+        if (parsed.city_id == 0) return WEATHER_REQUEST_NOT_FOUND;
+
+        /* An HTTP/2 stream has no socket of its own to hand over */
+        if (http_conn->fd < 0) return WEATHER_REQUEST_BAD_REQUEST;
+
+        if (weather_stream_subscribe(&self->stream, http_conn->fd, parsed.city_id, parsed.city,
+                                     self->snapshots.current, time(NULL)) != 0)
+        {
+            return WEATHER_REQUEST_BUSY;
+        }
+
+        return WEATHER_REQUEST_SUBSCRIBED;
+    }
+
+    /* Unknown endpoints and cities recently answered 404 never take a slot */
+    uint64_t now = task_scheduler_pass_ms();
+    if (strcmp(parsed.request_type, "unknown") == 0 ||
+        weather_negative_contains(&self->negative, parsed.key, now))
+    {
+        LOG_DEBUG("[WEATHER SERVER] Known not found: %s %s", request->path, parsed.city);
+        return WEATHER_REQUEST_NOT_FOUND;
+    }
+
+    /* Every data request counts, including ones answered from cache */
+    if (weather_request_is_data(parsed.request_type))
+    {
+        weather_sketch_increment(&self->cache.sketch, parsed.key, parsed.request_type, parsed.city);
+    }
+
+    if (weather_server_dispatch(self, http_conn, &parsed, now) == WEATHER_REQUEST_ACCEPTED)
+    {
+        return WEATHER_REQUEST_ACCEPTED;
+    }
+
+    /* A full pool is usually a burst that clears within a pass or two */
+    if (weather_admission_push(&self->admission, http_conn, &parsed, now) == 0)
+    {
+        LOG_DEBUG("[WEATHER SERVER] Queued %s for a slot, %u waiting", parsed.city, self->admission.count);
+        return WEATHER_REQUEST_ACCEPTED;
+    }
+
+    return WEATHER_REQUEST_BUSY;
+}
+
+/**
+ * Serves a data request from the cache, onto the request already
+ * working on its key or in a free slot, WEATHER_REQUEST_BUSY when none
+ * of them can take it
+ **/
+static int8_t weather_server_dispatch(weather_server_t *self, struct http_exchange *http_conn,
+                                      const weather_request_t *request, uint64_t now)
+{
+    /* Stale entries are still answered at once, refreshed in the background */
+    weather_cache_entry_t *cached = NULL;
+    weather_cache_result_t result =
+        weather_cache_lookup(&self->cache, request->key, now, &cached);
+
+    if (result != WEATHER_CACHE_MISS)
+    {
+        LOG_DEBUG("[WEATHER SERVER] Cache %s for %s", 
+                  result == WEATHER_CACHE_FRESH ? "hit" : "stale hit", request->city);
+
+        weather_server_respond(self, http_conn, cached->status, cached->request.format,
+                               cached->response, cached->response_len, cached);
+
+        if (result == WEATHER_CACHE_STALE)
+        {
+            weather_server_refresh(self, cached);
+        }
+
+        return WEATHER_REQUEST_ACCEPTED;
+    }
+
+    weather_connection_t *leader = weather_server_find_in_flight(self, request->key);
+    if (leader && weather_connection_add_waiter(leader, http_conn) == 0)
+    {
+        return WEATHER_REQUEST_ACCEPTED;
+    }
+
+    weather_connection_t *conn = weather_server_allocate_pool_slot(self);
+    if (!conn) return WEATHER_REQUEST_BUSY;
+
+    conn->lower_http_connection = http_conn;
+    conn->cb_from_http_layer.http_on_new_request(conn, request);
+    return WEATHER_REQUEST_ACCEPTED;
+}
+
+/**
+ * Answers a queued request with a 503 in the format it asked for
+ **/
+static void weather_server_shed(weather_server_t *self, const weather_admission_waiter_t *waiter,
+                                const char *message)
+{
+    char body[128];
+    size_t len = weather_error_render(waiter->request.format, 503, message, body, sizeof(body));
+
+    weather_server_respond(self, waiter->http_conn, 503, waiter->request.format, body, len, NULL);
+}
+
+/**
+ * Gives queued requests the slots that are free, oldest first. Each one
+ * is dispatched afresh, so one that waited behind a request for the
+ * same key is answered from the cache or coalesced onto it.
+ **/
+void weather_server_admit(weather_server_t *self)
+{
+    if (!self) return;
+
+    uint64_t now = task_scheduler_pass_ms();
+    weather_admission_waiter_t waiter;
+
+    while (self->active_count < CONNECTION_POOL_SIZE)
+    {
+        weather_admission_result_t result = weather_admission_pop(&self->admission, now, &waiter);
+
+        if (result == WEATHER_ADMISSION_EMPTY) break;
+
+        if (result == WEATHER_ADMISSION_SHED)
+        {
+            weather_server_shed(self, &waiter, "Weather service overloaded, try again");
+            continue;
+        }
+
+        if (weather_server_dispatch(self, waiter.http_conn, &waiter.request, now) != WEATHER_REQUEST_ACCEPTED)
+        {
+            weather_server_shed(self, &waiter, "Weather service busy, try again");
+        }
+    }
+}
+
+/**
+ * Routes a chunk of a request body to the weather connection receiving it
+ **/
+int8_t weather_server_on_request_body_cb(struct weather_server *self, struct http_exchange *http_conn,
+                                         const char *data, size_t len, uint8_t last)
+{
+    if (!self || !http_conn) return -1;
+
+    for (int i = 0; i < CONNECTION_POOL_SIZE; i++)
+    {
+        weather_connection_t *conn = &self->child_weather_connection[i];
+
+        if (conn->state == WEATHER_CONNECTION_RECEIVING && conn->lower_http_connection == http_conn)
+        {
+            return weather_connection_on_body(conn, data, len, last);
+        }
+    }
+
+    LOG_WARN("[WEATHER SERVER] Body for a request nobody is receiving");
+    return -1;
+}
+
+/**
+ * A JSON text frame for one WebSocket connection, for answers that are
+ * not updates
+ **/
+static void weather_server_ws_reply(struct http_exchange *http_conn, const char *key, const char *value,
+                                    uint32_t city_id)
+{
+    char body[WEATHER_CITY_SIZE + 128];
+    char frame[HTTP_WEBSOCKET_HEADER_MAX + sizeof(body)];
+
+    json_writer_t json;
+    json_writer_init(&json, body, sizeof(body));
+    json_object_begin(&json);
+    json_key_string(&json, key, value);
+    if (city_id != 0) json_key_uint(&json, "id", city_id);
+    json_object_end(&json);
+
+    size_t len = json_writer_finish(&json);
+    if (len == 0) return;
+
+    size_t header_len = http_websocket_frame_header(HTTP_WEBSOCKET_TEXT, len, (uint8_t *)frame);
+    memcpy(frame + header_len, body, len);
+    http_conn->cb_from_weather_layer.weather_on_frame(http_conn, frame, header_len + len);
+}
+
+/**
+ * One WebSocket text message: "subscribe NAME" or "unsubscribe NAME",
+ * one command per line, a name or a catalog id. Subscribing answers
+ * with the city's current update, everything else with a small JSON
+ * object.
+ **/
+int8_t weather_server_on_message_cb(struct weather_server *self, struct http_exchange *http_conn,
+                                    const char *data, size_t len)
+{
+    if (!self || !http_conn || (!data && len > 0)) return -1;
+
+    const city_catalog_t *catalog = &self->snapshots.current->catalog;
+    const char *end = data + len;
+
+    while (data < end)
+    {
+        const char *line_end = memchr(data, '\n', (size_t)(end - data));
+        if (!line_end) line_end = end;
+
+        const char *p = data;
+        data = line_end + 1;
+
+        while (p < line_end && *p == ' ') p++;
+
+        const char *verb = p;
+        while (p < line_end && *p != ' ') p++;
+        size_t verb_len = (size_t)(p - verb);
+
+        while (p < line_end && *p == ' ') p++;
+
+        const char *name_end = line_end;
+        while (name_end > p && (name_end[-1] == ' ' || name_end[-1] == '\r')) name_end--;
+
+        if (verb_len == 0) continue;
+
+        uint8_t subscribe = verb_len == 9 && strncmp(verb, "subscribe", 9) == 0;
+        uint8_t unsubscribe = verb_len == 11 && strncmp(verb, "unsubscribe", 11) == 0;
+
+        if (!subscribe && !unsubscribe)
+        {
+            weather_server_ws_reply(http_conn, "error", "Send 'subscribe NAME' or 'unsubscribe NAME'", 0);
+            continue;
+        }
+
+        char name[WEATHER_CITY_SIZE];
+        size_t name_len = (size_t)(name_end - p);
+        if (name_len >= sizeof(name)) name_len = sizeof(name) - 1;
+
+        memcpy(name, p, name_len);
+        name[name_len] = '\0';
+
+        char *id_end;
+        unsigned long id = strtoul(name, &id_end, 10);
+        const city_record_t *record = NULL;
+
+        if (catalog->loaded && name_len > 0)
+        {
+            record = *id_end == '\0' ? city_catalog_by_id(catalog, (uint32_t)id)
+                                     : city_catalog_find(catalog, name);
+        }
+
+        if (!record)
+        {
+            weather_server_ws_reply(http_conn, "error", "Unknown city", 0);
+            continue;
+        }
+
+        const char *city = city_catalog_name(catalog, record);
+
+        if (subscribe)
+        {
+            if (weather_stream_watch(&self->stream, http_conn, record->id, city, self->snapshots.current,
+                                     time(NULL)) != 0)
+            {
+                weather_server_ws_reply(http_conn, "error", "Too many subscriptions", record->id);
+            }
+        }
+        else if (weather_stream_unwatch(&self->stream, http_conn, record->id) == 0)
+        {
+            weather_server_ws_reply(http_conn, "unsubscribed", city, record->id);
+        }
+        else
+        {
+            weather_server_ws_reply(http_conn, "error", "Not subscribed", record->id);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Starts a background fetch for a cached entry, the result lands in the
+ * cache when the weather connection replies. Requests that miss meanwhile
+ * coalesce onto it.
+ **/
+int8_t weather_server_refresh(weather_server_t *self, weather_cache_entry_t *entry)
+{
+    if (!self || !entry || entry->refreshing) return -1;
+    if (weather_server_find_in_flight(self, entry->key)) return 0;
+
+    weather_connection_t *conn = weather_server_allocate_pool_slot(self);
+    if (!conn) return -1; /* Retried on the next stale hit or refresher pass */
+
+    LOG_DEBUG("[WEATHER SERVER] Refreshing %s/%s in background",
+              entry->request.request_type, entry->request.city);
+
+    entry->refreshing = 1;
+    conn->lower_http_connection = NULL;
+    conn->cb_from_http_layer.http_on_new_request(conn, &entry->request);
+    return 0;
+}
+
+#if TIMESERIES_SAMPLE_INTERVAL_MS > 0
+/**
+ * Records the current hour of the forecast run as an observation for
+ * every city it covers, the history feed until stations report. Cities
+ * with posted observations are left to their stations.
+ **/
+static void weather_server_sample_forecast(weather_server_t *self)
+{
+    const forecast_store_t *store = &self->snapshots.current->forecast;
+    if (!store->loaded) return;
+
+    time_t now = time(NULL);
+    uint32_t hour = forecast_store_hour(store, now);
+
+    for (uint32_t row = 0; row < store->header->city_count; row++)
+    {
+        size_t i = forecast_store_index(store, row, hour);
+        timeseries_observation_t observation =
+        {
+            .time        = now,
+            .temperature = store->temperature[i],
+            .wind        = store->wind[i],
+            .humidity    = store->humidity[i]
+        };
+
+        timeseries_store_sample(&self->history, store->city_ids[row], &observation);
+    }
+}
+#endif
+
+/**
+ * Publishes reloaded data files, samples the history feed and re-warms the most requested entries
+ * before they expire
+ **/
+int8_t weather_server_work(task_node_t *node)
+{
+    if (!node) return -1;
+
+    weather_server_t *self = container_of(node, weather_server_t, node);
+
+    uint64_t now = task_scheduler_pass_ms();
+    weather_negative_maintain(&self->negative, now);
+
+    weather_admission_waiter_t expired;
+    while (weather_admission_expire(&self->admission, now, &expired))
+    {
+        weather_server_shed(self, &expired, "Timed out waiting for the weather service");
+    }
+
+    weather_server_admit(self);
+
+    if (weather_snapshots_work(&self->snapshots))
+    {
+        /* Cached responses were rendered from the previous generation */
+        weather_cache_invalidate(&self->cache);
+    }
+
+    weather_stream_work(&self->stream, self->snapshots.current, time(NULL), now);
+
+#if TIMESERIES_SAMPLE_INTERVAL_MS > 0
+    if (now >= self->next_sample_ms)
+    {
+        self->next_sample_ms = now + TIMESERIES_SAMPLE_INTERVAL_MS;
+        weather_server_sample_forecast(self);
+    }
+#endif
+
+    if (now < self->next_refresh_ms) return 0;
+    self->next_refresh_ms = now + WEATHER_CACHE_REFRESH_INTERVAL_MS;
+
+    weather_cache_entry_t *candidates[WEATHER_CACHE_REFRESH_TOP_N];
+    uint8_t count = weather_cache_refresh_candidates(&self->cache, now, candidates,
+                                                     WEATHER_CACHE_REFRESH_TOP_N);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (weather_server_refresh(self, candidates[i]) != 0) break;
+    }
+
+    return 0;
+}
+
+/**
+ * Called when an HTTP connection goes away while a weather request
+ * is still in flight for it
+ **/
+void weather_server_detach_http_connection(weather_server_t *self, struct http_exchange *http_conn)
+{
+    if (!self || !http_conn) return;
+
+    for (int i = 0; i < CONNECTION_POOL_SIZE; i++)
+    {
+        if (self->child_weather_connection[i].lower_http_connection == http_conn)
+        {
+            LOG_DEBUG("[WEATHER SERVER] Detached HTTP connection from slot [%d]", i);
+            self->child_weather_connection[i].lower_http_connection = NULL;
+
+            /* An upload cut off mid-body keeps what was parsed and frees the slot,
+             * a stream with nobody to read it stops */
+            if (self->child_weather_connection[i].state == WEATHER_CONNECTION_RECEIVING ||
+                self->child_weather_connection[i].state == WEATHER_CONNECTION_STREAMING)
+            {
+                self->child_weather_connection[i].state = WEATHER_CONNECTION_DONE;
+            }
+        }
+
+        weather_connection_remove_waiter(&self->child_weather_connection[i], http_conn);
+    }
+
+    weather_admission_remove(&self->admission, http_conn);
+    weather_stream_unwatch_all(&self->stream, http_conn);
+}
+
+void weather_server_deinit(weather_server_t *self)
+{
+    if (!self) return;
+
+    if (self->node.active)
+    {
+        task_scheduler_remove(&self->node);
+    }
+
+    upstream_client_close(&self->upstream);
+    weather_stream_deinit(&self->stream);
+    weather_snapshots_deinit(&self->snapshots);
+    LOG_INFO("[WEATHER SERVER] Deinitialized");
+}
@@ -0,0 +1,150 @@
+/**
+ * Implementation-file: weather_sketch.c
+ **/
+
+#include "../../include/weather/weather_sketch.h"
+#include "../../include/logging/logging.h"
+#include <string.h>
+
+_Static_assert((WEATHER_SKETCH_WIDTH & (WEATHER_SKETCH_WIDTH - 1)) == 0,
+               "WEATHER_SKETCH_WIDTH must be a power of two");
+
+void weather_sketch_init(weather_sketch_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+    LOG_INFO("[WEATHER SKETCH] Initialized %dx%d counters, aging every %d requests",
+             WEATHER_SKETCH_DEPTH, WEATHER_SKETCH_WIDTH, WEATHER_SKETCH_SAMPLE_SIZE);
+}
+
+/**
+ * Double hashing from the two halves of the 64-bit request key
+ **/
+static inline uint32_t weather_sketch_index(uint64_t key, uint32_t row)
+{
+    uint32_t h1 = (uint32_t)key;
+    uint32_t h2 = (uint32_t)(key >> 32) | 1u;
+    return (h1 + row * h2) & (WEATHER_SKETCH_WIDTH - 1);
+}
+
+uint8_t weather_sketch_estimate(const weather_sketch_t *self, uint64_t key)
+{
+    if (!self) return 0;
+
+    uint8_t min = UINT8_MAX;
+    for (uint32_t row = 0; row < WEATHER_SKETCH_DEPTH; row++)
+    {
+        uint8_t value = self->counters[row][weather_sketch_index(key, row)];
+        if (value < min) min = value;
+    }
+
+    return min;
+}
+
+/**
+ * Halves every counter, the top list keeps its order
+ **/
+static void weather_sketch_age(weather_sketch_t *self)
+{
+    for (uint32_t row = 0; row < WEATHER_SKETCH_DEPTH; row++)
+    {
+        for (uint32_t i = 0; i < WEATHER_SKETCH_WIDTH; i++)
+        {
+            self->counters[row][i] >>= 1;
+        }
+    }
+
+    for (uint8_t i = 0; i < self->top_count; i++)
+    {
+        self->top[i].estimate >>= 1;
+    }
+
+    self->additions = 0;
+    LOG_DEBUG("[WEATHER SKETCH] Aged counters");
+}
+
+static void weather_sketch_update_top(weather_sketch_t *self, uint64_t key, uint8_t estimate,
+                                      const char *request_type, const char *city)
+{
+    weather_sketch_top_t *slot = NULL;
+    uint8_t min_index = 0;
+
+    for (uint8_t i = 0; i < self->top_count; i++)
+    {
+        if (self->top[i].key == key)
+        {
+            self->top[i].estimate = estimate;
+            return;
+        }
+
+        if (self->top[i].estimate < self->top[min_index].estimate)
+        {
+            min_index = i;
+        }
+    }
+
+    if (self->top_count < WEATHER_SKETCH_TOP_K)
+    {
+        slot = &self->top[self->top_count++];
+    }
+    else if (estimate > self->top[min_index].estimate)
+    {
+        slot = &self->top[min_index];
+    }
+
+    if (!slot) return;
+
+    slot->key = key;
+    slot->estimate = estimate;
+    strncpy(slot->request_type, request_type, sizeof(slot->request_type) - 1);
+    slot->request_type[sizeof(slot->request_type) - 1] = '\0';
+    strncpy(slot->city, city, sizeof(slot->city) - 1);
+    slot->city[sizeof(slot->city) - 1] = '\0';
+}
+
+/**
+ * Conservative update: only the counters at the current minimum grow,
+ * which keeps collisions from inflating rare keys
+ **/
+uint8_t weather_sketch_increment(weather_sketch_t *self, uint64_t key,
+                                 const char *request_type, const char *city)
+{
+    if (!self) return 0;
+
+    uint8_t min = weather_sketch_estimate(self, key);
+
+    if (min < UINT8_MAX)
+    {
+        for (uint32_t row = 0; row < WEATHER_SKETCH_DEPTH; row++)
+        {
+            uint8_t *counter = &self->counters[row][weather_sketch_index(key, row)];
+            if (*counter == min) (*counter)++;
+        }
+        min++;
+    }
+
+    if (request_type && city)
+    {
+        weather_sketch_update_top(self, key, min, request_type, city);
+    }
+
+    if (++self->additions >= WEATHER_SKETCH_SAMPLE_SIZE)
+    {
+        weather_sketch_age(self);
+    }
+
+    return min;
+}
+
+int weather_sketch_is_top(const weather_sketch_t *self, uint64_t key)
+{
+    if (!self) return 0;
+
+    for (uint8_t i = 0; i < self->top_count; i++)
+    {
+        if (self->top[i].key == key) return 1;
+    }
+
+    return 0;
+}
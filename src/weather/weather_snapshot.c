@@ -0,0 +1,303 @@
+/**
+ * Implementation-file: weather_snapshot.c
+ **/
+
+#include "../../include/weather/weather_snapshot.h"
+#include "../../include/event_watcher/event_watcher.h"
+#include "../../include/logging/logging.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+
+/**
+ * Set from the SIGHUP handler, picked up on the next work() call
+ **/
+static volatile sig_atomic_t g_reload_requested = 0;
+
+void weather_snapshots_request_reload(void)
+{
+    g_reload_requested = 1;
+}
+
+static const char *weather_snapshot_base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void weather_snapshot_unload(weather_snapshot_t *snapshot)
+{
+    city_catalog_close(&snapshot->catalog);
+    forecast_store_close(&snapshot->forecast);
+    forecast_grid_close(&snapshot->grid);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+/**
+ * Maps every data file into a free slot. A file that is missing or
+ * fails validation only makes it into a snapshot if the current one
+ * lacks it too, a broken file never replaces a good one.
+ **/
+static int8_t weather_snapshot_load(weather_snapshots_t *self, weather_snapshot_t *snapshot)
+{
+    const weather_snapshot_t *current = self->current;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    int catalog_ok  = city_catalog_open(&snapshot->catalog, CITY_CATALOG_PATH) == 0;
+    int forecast_ok = forecast_store_open(&snapshot->forecast, FORECAST_STORE_PATH) == 0;
+    int grid_ok     = forecast_grid_open(&snapshot->grid, FORECAST_GRID_PATH) == 0;
+
+    if (current && ((!catalog_ok && current->catalog.loaded) ||
+                    (!forecast_ok && current->forecast.loaded) ||
+                    (!grid_ok && current->grid.loaded)))
+    {
+        weather_snapshot_unload(snapshot);
+        return -1;
+    }
+
+    /* Ask for read-ahead now, warming touches the pages later */
+    if (snapshot->catalog.loaded)
+    {
+        madvise((void *)snapshot->catalog.base, snapshot->catalog.size, MADV_WILLNEED);
+    }
+
+    if (snapshot->forecast.loaded)
+    {
+        madvise((void *)snapshot->forecast.base, snapshot->forecast.size, MADV_WILLNEED);
+    }
+
+    if (snapshot->grid.loaded)
+    {
+        madvise((void *)snapshot->grid.base, snapshot->grid.size, MADV_WILLNEED);
+    }
+
+    snapshot->used = 1;
+    snapshot->generation = ++self->generation;
+    return 0;
+}
+
+static weather_snapshot_t *weather_snapshots_free_slot(weather_snapshots_t *self)
+{
+    for (int i = 0; i < WEATHER_SNAPSHOT_SLOTS; i++)
+    {
+        if (!self->slots[i].used) return &self->slots[i];
+    }
+
+    return NULL;
+}
+
+int8_t weather_snapshots_init(weather_snapshots_t *self)
+{
+    if (!self) return -1;
+
+    memset(self, 0, sizeof(*self));
+    self->inotify_fd = -1;
+
+    /* The first generation is published as is, even when files are missing */
+    weather_snapshot_t *first = &self->slots[0];
+    weather_snapshot_load(self, first);
+    first->refs = 1;
+    self->current = first;
+
+    self->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (self->inotify_fd < 0 ||
+        inotify_add_watch(self->inotify_fd, WEATHER_DATA_DIR, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        LOG_WARN("[SNAPSHOT] Not watching %s (%s), reload with SIGHUP",
+                 WEATHER_DATA_DIR, strerror(errno));
+
+        if (self->inotify_fd >= 0) close(self->inotify_fd);
+        self->inotify_fd = -1;
+    }
+    else
+    {
+        event_watcher_reg_fd(self->inotify_fd);
+    }
+
+    LOG_INFO("[SNAPSHOT] Generation %u published", first->generation);
+    return 0;
+}
+
+/**
+ * Readers pin the snapshot they start on, a reload in the meantime
+ * does not change what they see
+ **/
+weather_snapshot_t *weather_snapshot_acquire(weather_snapshots_t *self)
+{
+    if (!self || !self->current) return NULL;
+
+    self->current->refs++;
+    return self->current;
+}
+
+/**
+ * The last reference to a replaced snapshot ends its grace period
+ **/
+void weather_snapshot_release(weather_snapshots_t *self, weather_snapshot_t *snapshot)
+{
+    if (!self || !snapshot || snapshot->refs == 0) return;
+
+    if (--snapshot->refs > 0) return;
+
+    LOG_DEBUG("[SNAPSHOT] Generation %u reclaimed", snapshot->generation);
+    weather_snapshot_unload(snapshot);
+}
+
+/**
+ * Only whole files renamed or written into place under the data file
+ * names count, temporary files next to them do not
+ **/
+static void weather_snapshots_read_events(weather_snapshots_t *self)
+{
+    char buffer[1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;)
+    {
+        ssize_t len = read(self->inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) return;
+
+        for (char *p = buffer; p < buffer + len; )
+        {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+
+            if (event->len > 0 &&
+                (strcmp(event->name, weather_snapshot_base_name(CITY_CATALOG_PATH)) == 0 ||
+                 strcmp(event->name, weather_snapshot_base_name(FORECAST_STORE_PATH)) == 0 ||
+                 strcmp(event->name, weather_snapshot_base_name(FORECAST_GRID_PATH)) == 0))
+            {
+                LOG_DEBUG("[SNAPSHOT] %s changed", event->name);
+                self->reload_wanted = 1;
+            }
+
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/**
+ * Faults in up to WEATHER_SNAPSHOT_WARM_PAGES pages of the pending
+ * snapshot, so the first requests after the swap do not pay for them.
+ * Returns 1 once every page has been touched.
+ **/
+static int weather_snapshots_warm(weather_snapshots_t *self)
+{
+    const weather_snapshot_t *snapshot = self->pending;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    volatile uint8_t sink;
+
+    /* The mappings back to back, warm_offset runs across all of them */
+    const uint8_t *bases[] = { snapshot->catalog.base, snapshot->forecast.base, snapshot->grid.base };
+    size_t sizes[] =
+    {
+        snapshot->catalog.loaded ? snapshot->catalog.size : 0,
+        snapshot->forecast.loaded ? snapshot->forecast.size : 0,
+        snapshot->grid.loaded ? snapshot->grid.size : 0
+    };
+
+    for (int i = 0; i < WEATHER_SNAPSHOT_WARM_PAGES; i++)
+    {
+        size_t offset = self->warm_offset;
+        size_t m = 0;
+
+        while (m < sizeof(sizes) / sizeof(sizes[0]) && offset >= sizes[m])
+        {
+            offset -= sizes[m];
+            m++;
+        }
+
+        if (m == sizeof(sizes) / sizeof(sizes[0])) return 1;
+
+        sink = bases[m][offset];
+        self->warm_offset += page;
+    }
+
+    (void)sink;
+    return 0;
+}
+
+static void weather_snapshots_publish(weather_snapshots_t *self)
+{
+    weather_snapshot_t *previous = self->current;
+
+    self->pending->refs = 1;
+    self->current = self->pending;
+    self->pending = NULL;
+    self->reload_state = WEATHER_RELOAD_IDLE;
+
+    LOG_INFO("[SNAPSHOT] Generation %u published", self->current->generation);
+
+    /* Drops the reference held by being current, readers keep it alive */
+    weather_snapshot_release(self, previous);
+}
+
+/**
+ * Returns 1 when a new snapshot was published on this call
+ **/
+int weather_snapshots_work(weather_snapshots_t *self)
+{
+    if (!self) return 0;
+
+    if (self->inotify_fd >= 0)
+    {
+        weather_snapshots_read_events(self);
+    }
+
+    if (g_reload_requested)
+    {
+        g_reload_requested = 0;
+        self->reload_wanted = 1;
+        LOG_INFO("[SNAPSHOT] Reload requested");
+    }
+
+    if (self->reload_state == WEATHER_RELOAD_IDLE && self->reload_wanted)
+    {
+        /* Every slot still pinned by readers, try again on the next pass */
+        weather_snapshot_t *slot = weather_snapshots_free_slot(self);
+        if (!slot) return 0;
+
+        self->reload_wanted = 0;
+
+        if (weather_snapshot_load(self, slot) != 0)
+        {
+            LOG_WARN("[SNAPSHOT] Reload failed, keeping generation %u", self->current->generation);
+            return 0;
+        }
+
+        self->pending = slot;
+        self->warm_offset = 0;
+        self->reload_state = WEATHER_RELOAD_WARMING;
+    }
+
+    if (self->reload_state == WEATHER_RELOAD_WARMING && weather_snapshots_warm(self))
+    {
+        weather_snapshots_publish(self);
+        return 1;
+    }
+
+    return 0;
+}
+
+void weather_snapshots_deinit(weather_snapshots_t *self)
+{
+    if (!self) return;
+
+    if (self->inotify_fd >= 0)
+    {
+        event_watcher_dereg_fd(self->inotify_fd);
+        close(self->inotify_fd);
+        self->inotify_fd = -1;
+    }
+
+    /* Shutting down, nothing reads the mappings any more */
+    for (int i = 0; i < WEATHER_SNAPSHOT_SLOTS; i++)
+    {
+        if (self->slots[i].used) weather_snapshot_unload(&self->slots[i]);
+    }
+
+    self->current = NULL;
+    self->pending = NULL;
+}
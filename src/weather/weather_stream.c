@@ -0,0 +1,480 @@
+/**
+ * Implementation-file: weather_stream.c
+ *
+ * Sockets handed over by the HTTP layer are only ever written, with
+ * MSG_DONTWAIT so a full send buffer never blocks the loop. A client
+ * that went away is noticed when a write to it fails, the periodic
+ * ping makes sure that happens for idle cities too.
+ **/
+
+#include "../../include/weather/weather_stream.h"
+#include "../../include/weather/weather_cache.h"
+#include "../../include/http/http_connection.h"
+#include "../../include/http/http_websocket.h"
+#include "../../include/json/json_writer.h"
+#include "../../include/task_scheduler/task_scheduler.h"
+#include "../../include/logging/logging.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * No length and no chunking, the body runs until either side closes
+ **/
+static const char weather_stream_headers[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char weather_stream_ping[] = ":\n\n";
+
+void weather_stream_init(weather_stream_t *self)
+{
+    if (!self) return;
+
+    memset(self, 0, sizeof(*self));
+
+    for (uint16_t i = 0; i < WEATHER_STREAM_MAX_SUBSCRIBERS; i++)
+    {
+        self->subscribers[i].fd = -1;
+        self->subscribers[i].next = i + 1 < WEATHER_STREAM_MAX_SUBSCRIBERS ? i + 1 : WEATHER_STREAM_NONE;
+    }
+
+    for (uint16_t i = 0; i < WEATHER_STREAM_MAX_WATCHES; i++)
+    {
+        self->watches[i].next = i + 1 < WEATHER_STREAM_MAX_WATCHES ? i + 1 : WEATHER_STREAM_NONE;
+    }
+
+    self->free_head = 0;
+    self->watch_free_head = 0;
+}
+
+/**
+ * Current conditions as the JSON of /weather?format=json, framed as an
+ * SSE event and as a WebSocket text frame. Returns 1 when they changed.
+ **/
+static int weather_stream_render(weather_stream_city_t *city, const weather_snapshot_t *snapshot, time_t now)
+{
+    char data[WEATHER_STREAM_EVENT_SIZE - 48];
+    const forecast_store_t *store = &snapshot->forecast;
+    int32_t row = forecast_store_row(store, city->city_id);
+
+    json_writer_t json;
+    json_writer_init(&json, data, sizeof(data));
+    json_object_begin(&json);
+    json_key_string(&json, "city", city->name);
+    json_key_uint(&json, "id", city->city_id);
+
+    if (row < 0)
+    {
+        json_key_string(&json, "error", "No forecast for this city");
+    }
+    else
+    {
+        uint32_t hour = forecast_store_hour(store, now);
+        size_t i = forecast_store_index(store, (uint32_t)row, hour);
+
+        json_key_int(&json, "time", store->header->base_time + (int64_t)hour * 3600);
+        json_key_string(&json, "condition", forecast_condition_name(store->condition[i]));
+        json_key_fixed(&json, "temperature_c", store->temperature[i], 1);
+        json_key_uint(&json, "humidity_pct", store->humidity[i]);
+        json_key_fixed(&json, "wind_kmh", store->wind[i], 1);
+    }
+
+    json_object_end(&json);
+
+    size_t len = json_writer_finish(&json);
+    if (len == 0) return 0;
+
+    uint64_t hash = weather_cache_hash(data, len);
+    if (city->event_len > 0 && hash == city->hash) return 0;
+
+    int written = snprintf(city->event, sizeof(city->event), "event: weather\nid: %u\ndata: %s\n\n",
+                           city->sequence + 1, data);
+    if (written <= 0 || (size_t)written >= sizeof(city->event)) return 0;
+
+    uint8_t header[HTTP_WEBSOCKET_HEADER_MAX];
+    size_t header_len = http_websocket_frame_header(HTTP_WEBSOCKET_TEXT, len, header);
+    if (header_len + len > sizeof(city->frame)) return 0;
+
+    memcpy(city->frame, header, header_len);
+    memcpy(city->frame + header_len, data, len);
+
+    city->hash = hash;
+    city->sequence++;
+    city->event_len = (uint16_t)written;
+    city->frame_len = (uint16_t)(header_len + len);
+    return 1;
+}
+
+static weather_stream_city_t *weather_stream_city(weather_stream_t *self, uint32_t city_id, const char *name,
+                                                  const weather_snapshot_t *snapshot, time_t now)
+{
+    weather_stream_city_t *free_slot = NULL;
+
+    for (int i = 0; i < WEATHER_STREAM_MAX_CITIES; i++)
+    {
+        if (self->cities[i].city_id == city_id) return &self->cities[i];
+        if (!free_slot && self->cities[i].city_id == 0) free_slot = &self->cities[i];
+    }
+
+    if (!free_slot) return NULL;
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->city_id = city_id;
+    free_slot->head = WEATHER_STREAM_NONE;
+    free_slot->watch_head = WEATHER_STREAM_NONE;
+    strncpy(free_slot->name, name, sizeof(free_slot->name) - 1);
+
+    weather_stream_render(free_slot, snapshot, now);
+    return free_slot;
+}
+
+static void weather_stream_set_pending(weather_stream_t *self, weather_stream_subscriber_t *sub, uint8_t pending)
+{
+    if (sub->pending == pending) return;
+
+    sub->pending = pending;
+    if (pending) self->pending_count++;
+    else self->pending_count--;
+}
+
+/**
+ * Closes the socket and gives the record back, the city goes with its
+ * last subscriber
+ **/
+static void weather_stream_drop(weather_stream_t *self, uint16_t index)
+{
+    weather_stream_subscriber_t *sub = &self->subscribers[index];
+    weather_stream_city_t *city = &self->cities[sub->city];
+
+    close(sub->fd);
+    weather_stream_set_pending(self, sub, 0);
+
+    if (sub->prev != WEATHER_STREAM_NONE) self->subscribers[sub->prev].next = sub->next;
+    else city->head = sub->next;
+
+    if (sub->next != WEATHER_STREAM_NONE) self->subscribers[sub->next].prev = sub->prev;
+
+    if (--city->subscribers == 0 && city->watchers == 0) city->city_id = 0;
+
+    sub->fd = -1;
+    sub->next = self->free_head;
+    self->free_head = index;
+    self->count--;
+}
+
+/**
+ * Writes what is left of the city's event, -1 once the subscriber is gone
+ **/
+static int weather_stream_flush(weather_stream_t *self, uint16_t index)
+{
+    weather_stream_subscriber_t *sub = &self->subscribers[index];
+    const weather_stream_city_t *city = &self->cities[sub->city];
+
+    if (sub->offset < city->event_len)
+    {
+        ssize_t sent = send(sub->fd, city->event + sub->offset, city->event_len - sub->offset,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            LOG_DEBUG("[STREAM] fd=%d closed: %s", sub->fd, strerror(errno));
+            weather_stream_drop(self, index);
+            return -1;
+        }
+
+        if (sent > 0) sub->offset += (uint16_t)sent;
+    }
+
+    weather_stream_set_pending(self, sub, sub->offset < city->event_len);
+    return 0;
+}
+
+/**
+ * Takes over fd, which must have nothing written to it yet. Headers and
+ * the city's latest event leave in one call. Returns -1 without touching
+ * the socket when every record or city slot is taken, from then on the
+ * socket is the hub's even if the first write fails.
+ **/
+int8_t weather_stream_subscribe(weather_stream_t *self, int fd, uint32_t city_id, const char *name,
+                                const weather_snapshot_t *snapshot, time_t now)
+{
+    if (!self || fd < 0 || city_id == 0 || !name || !snapshot) return -1;
+
+    if (self->free_head == WEATHER_STREAM_NONE)
+    {
+        LOG_WARN("[STREAM] %d subscribers, turning %s away", self->count, name);
+        return -1;
+    }
+
+    weather_stream_city_t *city = weather_stream_city(self, city_id, name, snapshot, now);
+    if (!city)
+    {
+        LOG_WARN("[STREAM] %d cities streamed, turning %s away", WEATHER_STREAM_MAX_CITIES, name);
+        return -1;
+    }
+
+    if (self->count == 0) self->next_ping_ms = task_scheduler_pass_ms() + WEATHER_STREAM_PING_MS;
+
+    uint16_t index = self->free_head;
+    weather_stream_subscriber_t *sub = &self->subscribers[index];
+    self->free_head = sub->next;
+
+    sub->fd = fd;
+    sub->city = (uint16_t)(city - self->cities);
+    sub->prev = WEATHER_STREAM_NONE;
+    sub->next = city->head;
+    sub->offset = 0;
+    sub->pending = 0;
+
+    if (city->head != WEATHER_STREAM_NONE) self->subscribers[city->head].prev = index;
+    city->head = index;
+    city->subscribers++;
+    self->count++;
+
+    struct iovec iov[2] =
+    {
+        { (void *)weather_stream_headers, sizeof(weather_stream_headers) - 1 },
+        { city->event, city->event_len }
+    };
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = 2;
+
+    ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    /* A fresh socket takes a few hundred bytes, one that does not is not worth keeping */
+    if (sent < (ssize_t)iov[0].iov_len)
+    {
+        LOG_DEBUG("[STREAM] fd=%d lost before the headers were out", fd);
+        weather_stream_drop(self, index);
+        return 0;
+    }
+
+    sub->offset = (uint16_t)(sent - (ssize_t)iov[0].iov_len);
+    weather_stream_set_pending(self, sub, sub->offset < city->event_len);
+
+    LOG_DEBUG("[STREAM] fd=%d subscribed to %s, %u subscribers", fd, name, city->subscribers);
+    return 0;
+}
+
+static weather_stream_city_t *weather_stream_find_city(weather_stream_t *self, uint32_t city_id)
+{
+    for (int i = 0; i < WEATHER_STREAM_MAX_CITIES; i++)
+    {
+        if (self->cities[i].city_id == city_id) return &self->cities[i];
+    }
+
+    return NULL;
+}
+
+static void weather_stream_unlink_watch(weather_stream_t *self, uint16_t index)
+{
+    weather_stream_watch_t *watch = &self->watches[index];
+    weather_stream_city_t *city = &self->cities[watch->city];
+
+    if (watch->prev != WEATHER_STREAM_NONE) self->watches[watch->prev].next = watch->next;
+    else city->watch_head = watch->next;
+
+    if (watch->next != WEATHER_STREAM_NONE) self->watches[watch->next].prev = watch->prev;
+
+    if (--city->watchers == 0 && city->subscribers == 0) city->city_id = 0;
+
+    watch->conn = NULL;
+    watch->next = self->watch_free_head;
+    self->watch_free_head = index;
+    self->watch_count--;
+}
+
+/**
+ * Subscribes a WebSocket connection to a city and queues the city's
+ * latest frame on it, also when it was subscribed already. -1 when
+ * every watch or city slot is taken.
+ **/
+int8_t weather_stream_watch(weather_stream_t *self, struct http_exchange *conn, uint32_t city_id,
+                            const char *name, const weather_snapshot_t *snapshot, time_t now)
+{
+    if (!self || !conn || city_id == 0 || !name || !snapshot) return -1;
+
+    weather_stream_city_t *city = weather_stream_find_city(self, city_id);
+    uint8_t watching = 0;
+
+    for (uint16_t i = city ? city->watch_head : WEATHER_STREAM_NONE; i != WEATHER_STREAM_NONE;
+         i = self->watches[i].next)
+    {
+        if (self->watches[i].conn == conn) watching = 1;
+    }
+
+    if (!watching)
+    {
+        if (self->watch_free_head == WEATHER_STREAM_NONE) return -1;
+
+        if (!city) city = weather_stream_city(self, city_id, name, snapshot, now);
+        if (!city) return -1;
+
+        uint16_t index = self->watch_free_head;
+        weather_stream_watch_t *watch = &self->watches[index];
+        self->watch_free_head = watch->next;
+
+        watch->conn = conn;
+        watch->city = (uint16_t)(city - self->cities);
+        watch->prev = WEATHER_STREAM_NONE;
+        watch->next = city->watch_head;
+
+        if (city->watch_head != WEATHER_STREAM_NONE) self->watches[city->watch_head].prev = index;
+        city->watch_head = index;
+        city->watchers++;
+        self->watch_count++;
+
+        LOG_DEBUG("[STREAM] fd=%d watching %s, %u watchers", conn->fd, city->name, city->watchers);
+    }
+
+    if (city->frame_len > 0) conn->cb_from_weather_layer.weather_on_frame(conn, city->frame, city->frame_len);
+    return 0;
+}
+
+int8_t weather_stream_unwatch(weather_stream_t *self, struct http_exchange *conn, uint32_t city_id)
+{
+    if (!self || !conn) return -1;
+
+    weather_stream_city_t *city = weather_stream_find_city(self, city_id);
+
+    for (uint16_t i = city ? city->watch_head : WEATHER_STREAM_NONE; i != WEATHER_STREAM_NONE;
+         i = self->watches[i].next)
+    {
+        if (self->watches[i].conn == conn)
+        {
+            weather_stream_unlink_watch(self, i);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Everything a closing connection watched
+ **/
+void weather_stream_unwatch_all(weather_stream_t *self, struct http_exchange *conn)
+{
+    if (!self || !conn || self->watch_count == 0) return;
+
+    for (uint16_t i = 0; i < WEATHER_STREAM_MAX_WATCHES; i++)
+    {
+        if (self->watches[i].conn == conn) weather_stream_unlink_watch(self, i);
+    }
+}
+
+/**
+ * The same bytes to every subscriber of the city. Whoever has not
+ * finished the previous event by now is dropped. Watching connections
+ * queue the frame, one that cannot closes itself.
+ **/
+static void weather_stream_fan_out(weather_stream_t *self, weather_stream_city_t *city)
+{
+    uint16_t next;
+
+    for (uint16_t i = city->head; i != WEATHER_STREAM_NONE; i = next)
+    {
+        weather_stream_subscriber_t *sub = &self->subscribers[i];
+        next = sub->next;
+
+        if (sub->pending)
+        {
+            LOG_INFO("[STREAM] fd=%d too slow for %s, dropped", sub->fd, city->name);
+            self->dropped++;
+            weather_stream_drop(self, i);
+            continue;
+        }
+
+        sub->offset = 0;
+        weather_stream_flush(self, i);
+    }
+
+    for (uint16_t i = city->watch_head; i != WEATHER_STREAM_NONE; i = self->watches[i].next)
+    {
+        struct http_exchange *conn = self->watches[i].conn;
+        conn->cb_from_weather_layer.weather_on_frame(conn, city->frame, city->frame_len);
+    }
+}
+
+/**
+ * Comments are ignored by clients. A ping that does not go out whole
+ * means the client is gone or has not read in a long while.
+ **/
+static void weather_stream_ping_all(weather_stream_t *self)
+{
+    for (uint16_t i = 0; i < WEATHER_STREAM_MAX_SUBSCRIBERS; i++)
+    {
+        weather_stream_subscriber_t *sub = &self->subscribers[i];
+        if (sub->fd < 0 || sub->pending) continue;
+
+        ssize_t sent = send(sub->fd, weather_stream_ping, sizeof(weather_stream_ping) - 1,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent != (ssize_t)sizeof(weather_stream_ping) - 1)
+        {
+            LOG_DEBUG("[STREAM] fd=%d did not take a ping, dropped", sub->fd);
+            weather_stream_drop(self, i);
+        }
+    }
+}
+
+/**
+ * Finishes partial writes, renders and fans out events when the data
+ * moved on, and pings. Costs nothing while there are no subscribers.
+ **/
+void weather_stream_work(weather_stream_t *self, const weather_snapshot_t *snapshot, time_t now,
+                         uint64_t now_ms)
+{
+    if (!self || !snapshot || (self->count == 0 && self->watch_count == 0)) return;
+
+    for (uint16_t i = 0; i < WEATHER_STREAM_MAX_SUBSCRIBERS && self->pending_count > 0; i++)
+    {
+        if (self->subscribers[i].fd >= 0 && self->subscribers[i].pending) weather_stream_flush(self, i);
+    }
+
+    uint32_t hour = forecast_store_hour(&snapshot->forecast, now);
+
+    if (snapshot->generation != self->generation || hour != self->hour)
+    {
+        self->generation = snapshot->generation;
+        self->hour = hour;
+
+        for (int i = 0; i < WEATHER_STREAM_MAX_CITIES; i++)
+        {
+            weather_stream_city_t *city = &self->cities[i];
+
+            if (city->city_id != 0 && weather_stream_render(city, snapshot, now))
+            {
+                LOG_DEBUG("[STREAM] Event %u for %s to %u subscribers and %u watchers", city->sequence,
+                          city->name, city->subscribers, city->watchers);
+                weather_stream_fan_out(self, city);
+            }
+        }
+    }
+
+    if (now_ms >= self->next_ping_ms)
+    {
+        self->next_ping_ms = now_ms + WEATHER_STREAM_PING_MS;
+        weather_stream_ping_all(self);
+    }
+}
+
+void weather_stream_deinit(weather_stream_t *self)
+{
+    if (!self) return;
+
+    for (uint16_t i = 0; i < WEATHER_STREAM_MAX_SUBSCRIBERS; i++)
+    {
+        if (self->subscribers[i].fd >= 0) weather_stream_drop(self, i);
+    }
+}
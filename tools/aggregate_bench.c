@@ -0,0 +1,159 @@
+/**
+ * Tool: aggregate_bench.c
+ *
+ * Times the aggregation kernels on every backend the CPU supports, over
+ * column sizes from a forecast row up to well past the caches, and checks
+ * that the backends agree.
+ *
+ *   aggregate_bench [max values]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../include/aggregate/aggregate.h"
+
+#define DEFAULT_MAX_VALUES (16u * 1024 * 1024)
+#define TARGET_BYTES (512ull * 1024 * 1024)
+
+typedef struct bench_result
+{
+    double summary_ns;
+    double above_ns;
+    double percentile_ns;
+    aggregate_summary_t summary;
+    int32_t p90;
+} bench_result_t;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Values shaped like the stored columns: tenths of a degree around a
+ * daily cycle, humidity in percent
+ **/
+static void fill(aggregate_type_t type, void *values, size_t n)
+{
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        int32_t noise = (int32_t)(x % 200) - 100;
+
+        switch (type)
+        {
+            case AGGREGATE_INT16:  ((int16_t *)values)[i] = (int16_t)((int32_t)(i % 24) * 10 - 120 + noise); break;
+            case AGGREGATE_UINT16: ((uint16_t *)values)[i] = (uint16_t)(150 + noise); break;
+            case AGGREGATE_UINT8:  ((uint8_t *)values)[i] = (uint8_t)(50 + noise / 3); break;
+        }
+    }
+}
+
+static void run(const aggregate_column_t *column, size_t n, int32_t threshold, bench_result_t *result)
+{
+    /* Enough repetitions to move TARGET_BYTES, at least a few */
+    size_t width = column->type == AGGREGATE_UINT8 ? 1 : 2;
+    uint64_t reps = TARGET_BYTES / (n * width);
+    if (reps < 3) reps = 3;
+
+    volatile uint64_t sink = 0;
+
+    double start = now_ns();
+    for (uint64_t r = 0; r < reps; r++)
+    {
+        aggregate_column_summary(column, threshold, &result->summary);
+        sink += result->summary.above;
+    }
+    result->summary_ns = (now_ns() - start) / reps;
+
+    start = now_ns();
+    for (uint64_t r = 0; r < reps; r++)
+    {
+        sink += aggregate_column_count_above(column, threshold + (int32_t)(r & 1));
+    }
+    result->above_ns = (now_ns() - start) / reps;
+
+    uint64_t percentile_reps = reps / 8 ? reps / 8 : 1;
+    start = now_ns();
+    for (uint64_t r = 0; r < percentile_reps; r++)
+    {
+        result->p90 = aggregate_column_percentile(column, &result->summary, 90.0);
+    }
+    result->percentile_ns = (now_ns() - start) / percentile_reps;
+
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_values = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MAX_VALUES;
+    if (max_values < 128) max_values = 128;
+
+    static const char *type_names[] = { "int16", "uint16", "uint8" };
+    static const aggregate_backend_t backends[] = { AGGREGATE_BACKEND_SCALAR, AGGREGATE_BACKEND_AVX2 };
+
+    void *values = malloc(max_values * sizeof(int16_t));
+    if (!values)
+    {
+        fprintf(stderr, "Cannot allocate %zu values\n", max_values);
+        return 1;
+    }
+
+    printf("%-7s %10s %-7s %12s %10s %12s %12s\n",
+           "type", "values", "kernel", "summary ns", "GB/s", "above ns", "p90 ns");
+
+    int mismatches = 0;
+
+    for (int type = AGGREGATE_INT16; type <= AGGREGATE_UINT8; type++)
+    {
+        fill((aggregate_type_t)type, values, max_values);
+        size_t width = type == AGGREGATE_UINT8 ? 1 : 2;
+
+        /* A forecast row, a day of raw history, then L2 and memory sized */
+        for (size_t n = 128; n <= max_values; n *= (n < 2048 ? 16 : 8))
+        {
+            aggregate_column_t column;
+            memset(&column, 0, sizeof(column));
+            column.type = (aggregate_type_t)type;
+            aggregate_column_add(&column, values, n);
+
+            bench_result_t results[2];
+            int ran[2] = { 0, 0 };
+
+            for (int b = 0; b < 2; b++)
+            {
+                if (aggregate_set_backend(backends[b]) != 0) continue;
+
+                run(&column, n, type == AGGREGATE_UINT8 ? 60 : 100, &results[b]);
+                ran[b] = 1;
+
+                printf("%-7s %10zu %-7s %12.0f %10.2f %12.0f %12.0f\n",
+                       type_names[type], n, aggregate_backend_name(backends[b]),
+                       results[b].summary_ns, (double)(n * width) / results[b].summary_ns,
+                       results[b].above_ns, results[b].percentile_ns);
+            }
+
+            if (ran[0] && ran[1] &&
+                (memcmp(&results[0].summary, &results[1].summary, sizeof(aggregate_summary_t)) != 0 ||
+                 results[0].p90 != results[1].p90))
+            {
+                printf("  MISMATCH between backends\n");
+                mismatches++;
+            }
+        }
+    }
+
+    free(values);
+    return mismatches ? 1 : 0;
+}
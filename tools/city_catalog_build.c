@@ -0,0 +1,270 @@
+/**
+ * Tool: city_catalog_build.c
+ *
+ * Builds the memory-mapped city catalog from a CSV file:
+ *   id,name,lat,lon
+ * Runs offline, so unlike the server it is free to allocate.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../include/catalog/city_catalog.h"
+
+typedef struct city_input
+{
+    uint32_t id;
+    float lat;
+    float lon;
+    char name[CITY_CATALOG_NAME_MAX];
+    char normalized[CITY_CATALOG_NAME_MAX];
+} city_input_t;
+
+static city_input_t *g_cities;
+static uint32_t g_count;
+
+static int compare_name(const void *a, const void *b)
+{
+    return strcmp(((const city_input_t *)a)->normalized, ((const city_input_t *)b)->normalized);
+}
+
+static int compare_id(const void *a, const void *b)
+{
+    uint32_t ia = g_cities[*(const uint32_t *)a].id;
+    uint32_t ib = g_cities[*(const uint32_t *)b].id;
+    return (ia > ib) - (ia < ib);
+}
+
+static uint32_t g_axis;
+
+static int compare_axis(const void *a, const void *b)
+{
+    float fa = ((const city_kd_node_t *)a)->xyz[g_axis];
+    float fb = ((const city_kd_node_t *)b)->xyz[g_axis];
+    return (fa > fb) - (fa < fb);
+}
+
+/**
+ * Lays the tree out in place: the median of [lo, hi) on this level's
+ * axis goes to the middle slot, both halves recurse on the next axis
+ **/
+static void build_kd(city_kd_node_t *nodes, uint32_t lo, uint32_t hi, uint32_t axis)
+{
+    if (hi - lo <= 1) return;
+
+    g_axis = axis;
+    qsort(nodes + lo, hi - lo, sizeof(*nodes), compare_axis);
+
+    uint32_t mid = lo + (hi - lo) / 2;
+    build_kd(nodes, lo, mid, (axis + 1) % 3);
+    build_kd(nodes, mid + 1, hi, (axis + 1) % 3);
+}
+
+static size_t align4(size_t n)
+{
+    return (n + 3) & ~(size_t)3;
+}
+
+static int read_csv(const char *path)
+{
+    FILE *in = fopen(path, "r");
+    if (!in)
+    {
+        perror(path);
+        return -1;
+    }
+
+    size_t capacity = 1024;
+    g_cities = malloc(capacity * sizeof(*g_cities));
+    if (!g_cities)
+    {
+        fclose(in);
+        return -1;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), in))
+    {
+        unsigned long id;
+        char name[CITY_CATALOG_NAME_MAX];
+        float lat, lon;
+
+        if (sscanf(line, "%lu,%63[^,],%f,%f", &id, name, &lat, &lon) != 4) continue;
+
+        if (g_count == capacity)
+        {
+            capacity *= 2;
+            city_input_t *grown = realloc(g_cities, capacity * sizeof(*g_cities));
+            if (!grown)
+            {
+                fclose(in);
+                return -1;
+            }
+            g_cities = grown;
+        }
+
+        city_input_t *city = &g_cities[g_count];
+        city->id  = (uint32_t)id;
+        city->lat = lat;
+        city->lon = lon;
+        snprintf(city->name, sizeof(city->name), "%s", name);
+
+        if (city_catalog_normalize(name, city->normalized, sizeof(city->normalized)) > 0)
+        {
+            g_count++;
+        }
+    }
+
+    fclose(in);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s <cities.csv> <cities.bin>\n", argv[0]);
+        return -1;
+    }
+
+    if (read_csv(argv[1]) != 0) return -1;
+
+    qsort(g_cities, g_count, sizeof(*g_cities), compare_name);
+
+    /* Drop duplicate names, the first one wins */
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < g_count; i++)
+    {
+        if (unique > 0 && strcmp(g_cities[unique - 1].normalized, g_cities[i].normalized) == 0) continue;
+        g_cities[unique++] = g_cities[i];
+    }
+    g_count = unique;
+
+    uint32_t bucket_count = (g_count + CITY_CATALOG_BUCKET_SIZE - 1) / CITY_CATALOG_BUCKET_SIZE;
+
+    /* Worst case sizes, front coding only shrinks the names section */
+    size_t names_max   = (size_t)g_count * (CITY_CATALOG_NAME_MAX + 2);
+    size_t display_max = (size_t)g_count * CITY_CATALOG_NAME_MAX;
+
+    uint8_t *names    = calloc(1, names_max + 1);
+    char *display     = calloc(1, display_max + 1);
+    uint32_t *buckets = calloc(bucket_count + 1, sizeof(uint32_t));
+    uint32_t *by_id   = calloc(g_count + 1, sizeof(uint32_t));
+    city_record_t *records = calloc(g_count + 1, sizeof(city_record_t));
+    city_kd_node_t *kd     = calloc(g_count + 1, sizeof(city_kd_node_t));
+
+    if (!names || !display || !buckets || !by_id || !records || !kd)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    size_t names_size = 0;
+    size_t display_size = 0;
+
+    for (uint32_t i = 0; i < g_count; i++)
+    {
+        const char *name = g_cities[i].normalized;
+        size_t len = strlen(name);
+
+        if (i % CITY_CATALOG_BUCKET_SIZE == 0)
+        {
+            buckets[i / CITY_CATALOG_BUCKET_SIZE] = (uint32_t)names_size;
+            names[names_size++] = (uint8_t)len;
+            memcpy(names + names_size, name, len);
+            names_size += len;
+        }
+        else
+        {
+            const char *prev = g_cities[i - 1].normalized;
+            size_t shared = 0;
+            while (shared < len && prev[shared] == name[shared]) shared++;
+
+            names[names_size++] = (uint8_t)shared;
+            names[names_size++] = (uint8_t)(len - shared);
+            memcpy(names + names_size, name + shared, len - shared);
+            names_size += len - shared;
+        }
+
+        records[i].id      = g_cities[i].id;
+        records[i].lat     = g_cities[i].lat;
+        records[i].lon     = g_cities[i].lon;
+        records[i].display = (uint32_t)display_size;
+
+        size_t display_len = strlen(g_cities[i].name) + 1;
+        memcpy(display + display_size, g_cities[i].name, display_len);
+        display_size += display_len;
+
+        by_id[i] = i;
+
+        city_catalog_to_xyz(g_cities[i].lat, g_cities[i].lon, kd[i].xyz);
+        kd[i].record = i;
+    }
+
+    qsort(by_id, g_count, sizeof(uint32_t), compare_id);
+    build_kd(kd, 0, g_count, 0);
+
+    city_catalog_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CITY_CATALOG_MAGIC, sizeof(header.magic));
+    header.version        = CITY_CATALOG_VERSION;
+    header.count          = g_count;
+    header.bucket_size    = CITY_CATALOG_BUCKET_SIZE;
+    header.bucket_count   = bucket_count;
+    header.records_offset = (uint32_t)align4(sizeof(header));
+    header.by_id_offset   = header.records_offset + (uint32_t)align4(g_count * sizeof(city_record_t));
+    header.buckets_offset = header.by_id_offset + (uint32_t)align4(g_count * sizeof(uint32_t));
+    header.names_offset   = header.buckets_offset + (uint32_t)align4(bucket_count * sizeof(uint32_t));
+    header.names_size     = (uint32_t)names_size;
+    header.display_offset = header.names_offset + (uint32_t)align4(names_size);
+    header.display_size   = (uint32_t)display_size;
+    header.kd_offset      = header.display_offset + (uint32_t)align4(display_size);
+    header.file_size      = header.kd_offset + (uint32_t)align4(g_count * sizeof(city_kd_node_t));
+
+    uint8_t *file = calloc(1, header.file_size);
+    if (!file)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + header.records_offset, records, g_count * sizeof(city_record_t));
+    memcpy(file + header.by_id_offset, by_id, g_count * sizeof(uint32_t));
+    memcpy(file + header.buckets_offset, buckets, bucket_count * sizeof(uint32_t));
+    memcpy(file + header.names_offset, names, names_size);
+    memcpy(file + header.display_offset, display, display_size);
+    memcpy(file + header.kd_offset, kd, g_count * sizeof(city_kd_node_t));
+
+    /* Write next to the target and rename, a running server never sees half a file */
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", argv[2]);
+
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out || fwrite(file, 1, header.file_size, out) != header.file_size || fclose(out) != 0)
+    {
+        perror(tmp_path);
+        return -1;
+    }
+
+    if (rename(tmp_path, argv[2]) != 0)
+    {
+        perror(argv[2]);
+        return -1;
+    }
+
+    printf("Wrote %u cities (%u bytes, names %zu bytes front-coded) to %s\n",
+           g_count, header.file_size, names_size, argv[2]);
+
+    free(file);
+    free(kd);
+    free(records);
+    free(by_id);
+    free(buckets);
+    free(display);
+    free(names);
+    free(g_cities);
+    return 0;
+}
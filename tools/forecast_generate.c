@@ -0,0 +1,161 @@
+/**
+ * Tool: forecast_generate.c
+ *
+ * Writes a synthetic model run for every city in the catalog, in the
+ * columnar layout the server maps. Stands in for the ingest job that
+ * converts real model output.
+ *
+ *   forecast_generate <cities.bin> <forecast.bin> [hours]
+ **/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../include/catalog/city_catalog.h"
+#include "../include/forecast/forecast_store_format.h"
+
+#define DEFAULT_HOURS 120
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/**
+ * Repeatable noise in [-1, 1] per city, hour and model run
+ **/
+static double noise(uint32_t city_id, int64_t hour, int64_t run)
+{
+    uint64_t x = ((uint64_t)city_id << 32) ^ (uint64_t)hour ^ ((uint64_t)run * 0x9e3779b97f4a7c15ULL);
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    return (double)(x >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+static uint8_t pick_condition(double temperature, double humidity, double wind)
+{
+    if (humidity > 92 && wind < 8) return FORECAST_CONDITION_FOG;
+    if (humidity > 80) return temperature < 0.5 ? FORECAST_CONDITION_SNOW :
+                              (wind > 30 ? FORECAST_CONDITION_THUNDER : FORECAST_CONDITION_RAINY);
+    if (humidity > 68) return FORECAST_CONDITION_CLOUDY;
+    if (humidity > 52) return FORECAST_CONDITION_PARTLY_CLOUDY;
+    return FORECAST_CONDITION_SUNNY;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || argc > 4)
+    {
+        printf("Usage: %s <cities.bin> <forecast.bin> [hours]\n", argv[0]);
+        return -1;
+    }
+
+    uint32_t hours = (argc == 4) ? (uint32_t)strtoul(argv[3], NULL, 10) : DEFAULT_HOURS;
+    if (hours == 0 || hours > 24 * 16)
+    {
+        fprintf(stderr, "hours must be 1..%d\n", 24 * 16);
+        return -1;
+    }
+
+    city_catalog_t catalog;
+    if (city_catalog_open(&catalog, argv[1]) != 0) return -1;
+
+    uint32_t count = catalog.header->count;
+    size_t cells = (size_t)count * hours;
+    int64_t run_time = time(NULL);
+    int64_t base_time = run_time - run_time % 3600;
+
+    forecast_store_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FORECAST_STORE_MAGIC, sizeof(header.magic));
+    header.version            = FORECAST_STORE_VERSION;
+    header.city_count         = count;
+    header.hours              = hours;
+    header.base_time          = base_time;
+    header.run_time           = run_time;
+    header.city_ids_offset    = (uint32_t)align8(sizeof(header));
+    header.temperature_offset = header.city_ids_offset + (uint32_t)align8(count * sizeof(uint32_t));
+    header.wind_offset        = header.temperature_offset + (uint32_t)align8(cells * sizeof(int16_t));
+    header.humidity_offset    = header.wind_offset + (uint32_t)align8(cells * sizeof(uint16_t));
+    header.condition_offset   = header.humidity_offset + (uint32_t)align8(cells);
+    header.file_size          = header.condition_offset + (uint32_t)align8(cells);
+
+    uint8_t *file = calloc(1, header.file_size);
+    if (!file)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    memcpy(file, &header, sizeof(header));
+
+    uint32_t *city_ids    = (uint32_t *)(file + header.city_ids_offset);
+    int16_t *temperature  = (int16_t *)(file + header.temperature_offset);
+    uint16_t *wind        = (uint16_t *)(file + header.wind_offset);
+    uint8_t *humidity     = file + header.humidity_offset;
+    uint8_t *condition    = file + header.condition_offset;
+
+    /* by_id already lists the records in ascending id order */
+    for (uint32_t row = 0; row < count; row++)
+    {
+        const city_record_t *city = &catalog.records[catalog.by_id[row]];
+        city_ids[row] = city->id;
+
+        double climate = 28.0 - 0.45 * fabs(city->lat);
+
+        for (uint32_t h = 0; h < hours; h++)
+        {
+            int64_t t = base_time + (int64_t)h * 3600;
+            double local_hour = fmod((double)(t % 86400) / 3600.0 + city->lon / 15.0 + 48.0, 24.0);
+            double daily = 5.0 * sin((local_hour - 9.0) * M_PI / 12.0);
+            int64_t abs_hour = t / 3600;
+
+            /* Slow weather systems plus a little hourly jitter */
+            double system = noise(city->id, abs_hour / 18, 0);
+            double temp = climate + daily + 4.0 * system + 0.8 * noise(city->id, abs_hour, run_time);
+            double hum = 60.0 + 30.0 * noise(city->id, abs_hour / 12, 1) - 1.5 * daily;
+            double wnd = 14.0 + 12.0 * noise(city->id, abs_hour / 6, 2) + 6.0 * fabs(system);
+
+            if (hum < 5) hum = 5;
+            if (hum > 100) hum = 100;
+            if (wnd < 0) wnd = 0;
+
+            size_t i = (size_t)row * hours + h;
+            temperature[i] = (int16_t)lround(temp * 10.0);
+            wind[i]        = (uint16_t)lround(wnd * 10.0);
+            humidity[i]    = (uint8_t)lround(hum);
+            condition[i]   = pick_condition(temp, hum, wnd);
+        }
+    }
+
+    city_catalog_close(&catalog);
+
+    /* Write next to the target and rename, the server picks up whole files only */
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", argv[2]);
+
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out || fwrite(file, 1, header.file_size, out) != header.file_size || fclose(out) != 0)
+    {
+        perror(tmp_path);
+        return -1;
+    }
+
+    if (rename(tmp_path, argv[2]) != 0)
+    {
+        perror(argv[2]);
+        return -1;
+    }
+
+    printf("Wrote %u cities x %u hours (%u bytes) to %s\n", count, hours, header.file_size, argv[2]);
+
+    free(file);
+    return 0;
+}
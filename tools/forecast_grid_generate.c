@@ -0,0 +1,178 @@
+/**
+ * Tool: forecast_grid_generate.c
+ *
+ * Writes a synthetic global model grid in the tiled layout the server
+ * maps. Fields vary smoothly in space and time so interpolated values
+ * look like weather. Stands in for the job that regrids real model output.
+ *
+ *   forecast_grid_generate <grid.bin> [resolution degrees] [hours]
+ **/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../include/forecast/forecast_store_format.h"
+#include "../include/forecast/forecast_grid_format.h"
+
+#define DEFAULT_RESOLUTION 2.0
+#define DEFAULT_HOURS 240
+#define GRID_TILE 8
+
+static uint64_t align64(uint64_t n)
+{
+    return (n + 63) & ~(uint64_t)63;
+}
+
+/**
+ * Smooth field in [-1, 1]: a few travelling waves whose phase depends on
+ * the model run, a stand-in for pressure systems
+ **/
+static double waves(double lat, double lon, double hour, double seed)
+{
+    double x = lon * M_PI / 180.0;
+    double y = lat * M_PI / 180.0;
+
+    return 0.5 * sin(3.0 * x + 2.0 * y - hour / 30.0 + seed) +
+           0.3 * sin(5.0 * x - 4.0 * y + hour / 19.0 + 2.1 * seed) +
+           0.2 * cos(7.0 * x + 6.0 * y - hour / 11.0 + 0.7 * seed);
+}
+
+static uint8_t pick_condition(double temperature, double humidity, double wind)
+{
+    if (humidity > 92 && wind < 8) return FORECAST_CONDITION_FOG;
+    if (humidity > 80) return temperature < 0.5 ? FORECAST_CONDITION_SNOW :
+                              (wind > 30 ? FORECAST_CONDITION_THUNDER : FORECAST_CONDITION_RAINY);
+    if (humidity > 68) return FORECAST_CONDITION_CLOUDY;
+    if (humidity > 52) return FORECAST_CONDITION_PARTLY_CLOUDY;
+    return FORECAST_CONDITION_SUNNY;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 4)
+    {
+        printf("Usage: %s <grid.bin> [resolution degrees] [hours]\n", argv[0]);
+        return -1;
+    }
+
+    double resolution = (argc >= 3) ? strtod(argv[2], NULL) : DEFAULT_RESOLUTION;
+    uint32_t hours = (argc == 4) ? (uint32_t)strtoul(argv[3], NULL, 10) : DEFAULT_HOURS;
+
+    if (!(resolution >= 0.1 && resolution <= 10.0) || fmod(360.0, resolution) > 1e-9)
+    {
+        fprintf(stderr, "resolution must divide 360 and be 0.1..10 degrees\n");
+        return -1;
+    }
+
+    if (hours == 0 || hours > 24 * 16)
+    {
+        fprintf(stderr, "hours must be 1..%d\n", 24 * 16);
+        return -1;
+    }
+
+    uint32_t rows = (uint32_t)lround(180.0 / resolution) + 1;
+    uint32_t cols = (uint32_t)lround(360.0 / resolution);
+    uint32_t tiles_y = (rows + GRID_TILE - 1) / GRID_TILE;
+    uint32_t tiles_x = (cols + GRID_TILE - 1) / GRID_TILE;
+    uint64_t cells = (uint64_t)tiles_y * tiles_x * GRID_TILE * GRID_TILE * hours;
+
+    int64_t run_time = time(NULL);
+    int64_t base_time = run_time - run_time % 3600;
+
+    forecast_grid_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FORECAST_GRID_MAGIC, sizeof(header.magic));
+    header.version            = FORECAST_GRID_VERSION;
+    header.hours              = hours;
+    header.base_time          = base_time;
+    header.run_time           = run_time;
+    header.lat0               = -90.0f;
+    header.lon0               = -180.0f;
+    header.resolution         = (float)resolution;
+    header.rows               = rows;
+    header.cols               = cols;
+    header.tile               = GRID_TILE;
+    header.tiles_x            = tiles_x;
+    header.tiles_y            = tiles_y;
+    header.temperature_offset = align64(sizeof(header));
+    header.wind_offset        = header.temperature_offset + align64(cells * sizeof(int16_t));
+    header.humidity_offset    = header.wind_offset + align64(cells * sizeof(uint16_t));
+    header.condition_offset   = header.humidity_offset + align64(cells);
+    header.file_size          = header.condition_offset + align64(cells);
+
+    uint8_t *file = calloc(1, header.file_size);
+    if (!file)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    memcpy(file, &header, sizeof(header));
+
+    int16_t *temperature = (int16_t *)(file + header.temperature_offset);
+    uint16_t *wind       = (uint16_t *)(file + header.wind_offset);
+    uint8_t *humidity    = file + header.humidity_offset;
+    uint8_t *condition   = file + header.condition_offset;
+    double seed          = (double)(run_time / 3600 % 1000);
+
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        double lat = header.lat0 + row * resolution;
+        double climate = 28.0 - 0.45 * fabs(lat);
+
+        for (uint32_t col = 0; col < cols; col++)
+        {
+            double lon = header.lon0 + col * resolution;
+            size_t tile = (size_t)(row / GRID_TILE) * tiles_x + col / GRID_TILE;
+            size_t cell = (tile * GRID_TILE * GRID_TILE + (row % GRID_TILE) * GRID_TILE + col % GRID_TILE) * hours;
+
+            for (uint32_t h = 0; h < hours; h++)
+            {
+                int64_t t = base_time + (int64_t)h * 3600;
+                double local_hour = fmod((double)(t % 86400) / 3600.0 + lon / 15.0 + 48.0, 24.0);
+                double daily = 5.0 * sin((local_hour - 9.0) * M_PI / 12.0);
+                double system = waves(lat, lon, (double)h, seed);
+
+                double temp = climate + daily + 4.0 * system;
+                double hum = 60.0 + 30.0 * waves(lat, lon, (double)h, seed + 1.0) - 1.5 * daily;
+                double wnd = 14.0 + 12.0 * waves(lat, lon, (double)h, seed + 2.0) + 6.0 * fabs(system);
+
+                if (hum < 5) hum = 5;
+                if (hum > 100) hum = 100;
+                if (wnd < 0) wnd = 0;
+
+                temperature[cell + h] = (int16_t)lround(temp * 10.0);
+                wind[cell + h]        = (uint16_t)lround(wnd * 10.0);
+                humidity[cell + h]    = (uint8_t)lround(hum);
+                condition[cell + h]   = pick_condition(temp, hum, wnd);
+            }
+        }
+    }
+
+    /* Write next to the target and rename, the server picks up whole files only */
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", argv[1]);
+
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out || fwrite(file, 1, header.file_size, out) != header.file_size || fclose(out) != 0)
+    {
+        perror(tmp_path);
+        return -1;
+    }
+
+    if (rename(tmp_path, argv[1]) != 0)
+    {
+        perror(argv[1]);
+        return -1;
+    }
+
+    printf("Wrote %ux%u grid at %.2f degrees x %u hours (%llu bytes) to %s\n", rows, cols, resolution,
+           hours, (unsigned long long)header.file_size, argv[1]);
+
+    free(file);
+    return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * Tool: upstream_stub.c
+ *
+ * A stand-in for the upstream weather API, for running the server with
+ * UPSTREAM_ENABLED 1 locally. Answers GET /weather and GET /forecast with
+ * a short text body and keeps connections alive; a delay past
+ * UPSTREAM_TIMEOUT_MS exercises the 504 path, stopping it the 502 one.
+ *
+ *   upstream_stub [port] [delay ms]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "../include/config/config.h"
+
+#define STUB_MAX_CLIENTS 16
+#define STUB_BUFFER_SIZE 2048
+
+typedef struct stub_client
+{
+    int fd;
+    char buffer[STUB_BUFFER_SIZE];
+    size_t len;
+} stub_client_t;
+
+static int listen_on(const char *port)
+{
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if (getaddrinfo(UPSTREAM_HOST, port, &hints, &res) != 0 || !res) return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    int yes = 1;
+
+    if (fd < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) != 0 ||
+        bind(fd, res->ai_addr, res->ai_addrlen) != 0 ||
+        listen(fd, 16) != 0)
+    {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+/**
+ * Answers every complete request in the buffer, -1 once the client
+ * should be dropped
+ **/
+static int answer(stub_client_t *client, unsigned delay_ms)
+{
+    char *end;
+
+    while ((end = strstr(client->buffer, "\r\n\r\n")) != NULL)
+    {
+        char method[8] = "";
+        char target[512] = "";
+        sscanf(client->buffer, "%7s %511s", method, target);
+
+        int known = strcmp(method, "GET") == 0 &&
+                    (strncmp(target, "/weather?", 9) == 0 || strncmp(target, "/forecast?", 10) == 0);
+
+        char body[640];
+        int body_len = known ? snprintf(body, sizeof(body), "Stub upstream answer for %s\n", target)
+                             : snprintf(body, sizeof(body), "Not Found\n");
+
+        char response[1024];
+        int len = snprintf(response, sizeof(response),
+                           "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n"
+                           "Connection: keep-alive\r\n\r\n%s",
+                           known ? "200 OK" : "404 Not Found", body_len, body);
+
+        if (delay_ms)
+        {
+            struct timespec ts = { .tv_sec = delay_ms / 1000, .tv_nsec = (long)(delay_ms % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+
+        printf("%s %s -> %s\n", method, target, known ? "200" : "404");
+        if (send(client->fd, response, (size_t)len, MSG_NOSIGNAL) != len) return -1;
+
+        size_t used = (size_t)(end + 4 - client->buffer);
+        memmove(client->buffer, client->buffer + used, client->len - used + 1);
+        client->len -= used;
+    }
+
+    return client->len < sizeof(client->buffer) - 1 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 3)
+    {
+        printf("Usage: %s [port] [delay ms]\n", argv[0]);
+        return -1;
+    }
+
+    const char *port = (argc >= 2) ? argv[1] : UPSTREAM_PORT;
+    unsigned delay_ms = (argc == 3) ? (unsigned)strtoul(argv[2], NULL, 10) : 0;
+
+    int listen_fd = listen_on(port);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "Cannot listen on %s:%s: %s\n", UPSTREAM_HOST, port, strerror(errno));
+        return -1;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("Upstream stub on %s:%s, %u ms per answer\n", UPSTREAM_HOST, port, delay_ms);
+
+    stub_client_t clients[STUB_MAX_CLIENTS];
+    for (int i = 0; i < STUB_MAX_CLIENTS; i++) clients[i].fd = -1;
+
+    for (;;)
+    {
+        struct pollfd pfds[STUB_MAX_CLIENTS + 1];
+        pfds[0].fd = listen_fd;
+        pfds[0].events = POLLIN;
+
+        for (int i = 0; i < STUB_MAX_CLIENTS; i++)
+        {
+            pfds[i + 1].fd = clients[i].fd;
+            pfds[i + 1].events = POLLIN;
+        }
+
+        if (poll(pfds, STUB_MAX_CLIENTS + 1, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN)
+        {
+            int fd = accept(listen_fd, NULL, NULL);
+
+            for (int i = 0; fd >= 0 && i < STUB_MAX_CLIENTS; i++)
+            {
+                if (clients[i].fd < 0)
+                {
+                    clients[i].fd = fd;
+                    clients[i].len = 0;
+                    clients[i].buffer[0] = '\0';
+                    fd = -1;
+                }
+            }
+
+            /* All slots taken */
+            if (fd >= 0) close(fd);
+        }
+
+        for (int i = 0; i < STUB_MAX_CLIENTS; i++)
+        {
+            stub_client_t *client = &clients[i];
+            if (client->fd < 0 || !(pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            ssize_t r = recv(client->fd, client->buffer + client->len,
+                             sizeof(client->buffer) - client->len - 1, 0);
+
+            if (r > 0)
+            {
+                client->len += (size_t)r;
+                client->buffer[client->len] = '\0';
+            }
+
+            if (r <= 0 || answer(client, delay_ms) != 0)
+            {
+                close(client->fd);
+                client->fd = -1;
+            }
+        }
+    }
+
+    close(listen_fd);
+    return 0;
+}